@@ -0,0 +1,582 @@
+/*
+ * snesbench.c - Subsystem throughput benchmarks
+ *
+ * Runs synthetic workloads that each load one subsystem (65c816 loops,
+ * DMA, Mode 7, sprites, BRR mixing, APU sync modes, every upscaler mode) a number of times
+ * and writes the per-run timings as JSON: the median and the 99th
+ * percentile (nearest rank) run time and the throughput at both.
+ * Runs are timed with a PerfStats counter per workload.
+ *
+ * Usage: snesbench [--reps N] [--filter TEXT] [--output FILE] [--list]
+ * The report goes to a file because emulator log lines go to stdout.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/types.h"
+#include "../include/emulator.h"
+#include "../include/upscaler.h"
+#include "../include/performance.h"
+
+#define BENCH_MAX_REPS       1000
+#define BENCH_DEFAULT_REPS   15
+#define BENCH_CPU_FRAMES     30
+#define BENCH_DMA_BYTES      0x8000  /* Per transfer */
+#define BENCH_DMA_COUNT      64      /* Transfers per run */
+#define BENCH_PPU_FRAMES     30
+#define BENCH_APU_SAMPLES    32000   /* One second of audio per run */
+#define BENCH_SYNC_FRAMES    60
+#define BENCH_UPSCALE_FRAMES 10
+#define BENCH_DEFAULT_OUTPUT "snesbench.json"
+
+/* One workload: set up once, then timed run by run */
+typedef struct Workload Workload;
+struct Workload {
+    const char *name;
+    const char *unit;       /* What is counted: instructions, bytes, ... */
+    int (*setup)(Workload *work);
+    u64 (*run)(Workload *work);  /* Returns units processed */
+    void (*cleanup)(Workload *work);
+    int param;              /* Workload variant (upscale mode) */
+    void *data;
+};
+
+/* Large state lives outside the stack */
+static Emulator g_emu;
+static Memory g_mem;
+static PPU g_ppu;
+static APU g_apu;
+static u32 g_frame[SCREEN_WIDTH * SCREEN_HEIGHT];
+static u32 g_upscaled[SCREEN_WIDTH * 4 * SCREEN_HEIGHT * 4];  /* Largest (4x) output */
+static u64 g_times[BENCH_MAX_REPS];
+
+/* Cycles per CPU loop iteration, measured at setup */
+static u64 g_cpu_loop_cycles;
+static u32 g_frames_run;
+static u32 g_seed = 12345;
+
+static u32 bench_random(void) {
+    g_seed = g_seed * 1103515245 + 12345;
+    return g_seed >> 8;
+}
+
+/* Native-mode 16-bit loop of 13 instructions with no data-dependent branch */
+#define BENCH_CPU_LOOP_INSTRUCTIONS 13
+static const u8 cpu_program[] = {
+    0x18,              /* CLC */
+    0xFB,              /* XCE */
+    0xC2, 0x30,        /* REP #$30 */
+    0xA9, 0x34, 0x12,  /* loop: LDA #$1234 */
+    0x69, 0x01, 0x00,  /* ADC #$0001 */
+    0x8D, 0x10, 0x00,  /* STA $0010 */
+    0xAD, 0x10, 0x00,  /* LDA $0010 */
+    0x29, 0xFF, 0x0F,  /* AND #$0FFF */
+    0xAA,              /* TAX */
+    0xE8,              /* INX */
+    0x8E, 0x12, 0x00,  /* STX $0012 */
+    0x20, 0x1D, 0x80,  /* JSR sub */
+    0x80, 0xE7,        /* BRA loop */
+    0x48,              /* sub: PHA */
+    0x68,              /* PLA */
+    0x60               /* RTS */
+};
+#define BENCH_CPU_SETUP_INSTRUCTIONS 3
+
+/* Load a 32KB LoROM running program into g_emu */
+static int bench_load_program(const u8 *program, size_t size) {
+    static u8 rom[0x8000];
+    const char *filename = "snesbench_rom.sfc";
+    RomImage *image;
+    FILE *file;
+    int result;
+    
+    memset(rom, 0, sizeof(rom));
+    memcpy(rom, program, size);
+    memcpy(&rom[0x7FC0], "SNESBENCH            ", 21);
+    rom[0x7FDC] = 0xFF;
+    rom[0x7FDD] = 0xFF;
+    rom[0x7FFC] = 0x00;  /* Reset vector: $8000 */
+    rom[0x7FFD] = 0x80;
+    
+    file = fopen(filename, "wb");
+    if (!file) {
+        return ERROR;
+    }
+    result = fwrite(rom, 1, sizeof(rom), file) == sizeof(rom) ? SUCCESS : ERROR;
+    fclose(file);
+    
+    image = result == SUCCESS ? rom_image_load(filename) : NULL;
+    remove(filename);
+    if (!image) {
+        return ERROR;
+    }
+    result = emulator_init(&g_emu, image);
+    rom_image_release(image);
+    return result;
+}
+
+/* 65c816 loop through the frame loop, nothing drawn */
+static int cpu_loop_setup(Workload *work) {
+    u64 start;
+    int i;
+    
+    (void)work;
+    if (bench_load_program(cpu_program, sizeof(cpu_program)) != SUCCESS) {
+        return ERROR;
+    }
+    ppu_set_render_policy(&g_emu.ppu, PPU_RENDER_NEVER, 1);
+    
+    /* Step one iteration to learn its cycle count */
+    for (i = 0; i < BENCH_CPU_SETUP_INSTRUCTIONS; i++) {
+        cpu_step(&g_emu.cpu);
+    }
+    start = g_emu.cpu.cycles;
+    for (i = 0; i < BENCH_CPU_LOOP_INSTRUCTIONS; i++) {
+        cpu_step(&g_emu.cpu);
+    }
+    g_cpu_loop_cycles = g_emu.cpu.cycles - start;
+    return g_emu.cpu.stopped || g_cpu_loop_cycles == 0 ? ERROR : SUCCESS;
+}
+
+static u64 cpu_loop_run(Workload *work) {
+    u64 start = g_emu.cpu.cycles;
+    u32 frame;
+    
+    (void)work;
+    for (frame = 0; frame < BENCH_CPU_FRAMES; frame++) {
+        emulator_run_frame(&g_emu);
+    }
+    g_frames_run += BENCH_CPU_FRAMES;
+    return (g_emu.cpu.cycles - start) / g_cpu_loop_cycles * BENCH_CPU_LOOP_INSTRUCTIONS;
+}
+
+static void emulator_workload_cleanup(Workload *work) {
+    (void)work;
+    emulator_cleanup(&g_emu);
+}
+
+/* General purpose DMA from WRAM to VRAM through $2118/$2119 */
+static int dma_setup(Workload *work) {
+    static const u8 idle_program[] = {
+        0x80, 0xFE         /* BRA * */
+    };
+    u32 i;
+    
+    (void)work;
+    if (bench_load_program(idle_program, sizeof(idle_program)) != SUCCESS) {
+        return ERROR;
+    }
+    for (i = 0; i < WRAM_SIZE; i++) {
+        g_emu.memory.wram[i] = (u8)bench_random();
+    }
+    memory_write(&g_emu.memory, PPU_VMAIN, 0x80);  /* Increment after the high byte */
+    return SUCCESS;
+}
+
+static u64 dma_run(Workload *work) {
+    Memory *mem = &g_emu.memory;
+    u32 i;
+    
+    (void)work;
+    for (i = 0; i < BENCH_DMA_COUNT; i++) {
+        memory_write(mem, PPU_VMADDL, 0x00);
+        memory_write(mem, PPU_VMADDH, (u8)((i & 1) << 6));
+        memory_write(mem, 0x4300, 0x01);  /* Mode 1: two registers */
+        memory_write(mem, 0x4301, 0x18);  /* B-bus: VMDATAL */
+        memory_write(mem, 0x4302, 0x00);
+        memory_write(mem, 0x4303, (u8)(i << 4));
+        memory_write(mem, 0x4304, 0x7E);  /* WRAM bank */
+        memory_write(mem, 0x4305, (u8)BENCH_DMA_BYTES);
+        memory_write(mem, 0x4306, (u8)(BENCH_DMA_BYTES >> 8));
+        memory_write(mem, 0x420B, 0x01);
+    }
+    return (u64)BENCH_DMA_COUNT * BENCH_DMA_BYTES;
+}
+
+/* Standalone PPU with random VRAM and palette */
+static void ppu_bench_setup(void) {
+    u32 i;
+    
+    memory_init(&g_mem);
+    ppu_init(&g_ppu);
+    ppu_set_memory(&g_ppu, g_mem.vram, g_mem.cgram, g_mem.oam);
+    memory_set_ppu(&g_mem, &g_ppu);
+    
+    for (i = 0; i < VRAM_SIZE; i++) {
+        g_mem.vram[i] = (u8)bench_random();
+    }
+    for (i = 0; i < CGRAM_SIZE; i++) {
+        g_mem.cgram[i] = (u8)bench_random();
+    }
+    memory_vram_written(&g_mem, 0, VRAM_SIZE);
+    memory_cgram_written(&g_mem, 0, CGRAM_SIZE);
+    memory_write(&g_mem, PPU_INIDISP, 0x0F);
+}
+
+/* Draw frames; the caller changes registers between them */
+static u64 ppu_bench_frame(void) {
+    u32 line;
+    
+    for (line = 0; line < SCANLINES_PER_FRAME; line++) {
+        ppu_step_scanline(&g_ppu);
+    }
+    return SCREEN_HEIGHT;
+}
+
+static void ppu_workload_cleanup(Workload *work) {
+    (void)work;
+    ppu_cleanup(&g_ppu);
+}
+
+/* Write a 16-bit Mode 7 register (low byte first) */
+static void mode7_write(u16 address, s16 value) {
+    memory_write(&g_mem, address, (u8)value);
+    memory_write(&g_mem, address, (u8)((u16)value >> 8));
+}
+
+/* Rotating, zooming Mode 7 plane */
+static int mode7_setup(Workload *work) {
+    (void)work;
+    ppu_bench_setup();
+    memory_write(&g_mem, PPU_BGMODE, 0x07);
+    memory_write(&g_mem, PPU_TM, 0x01);
+    memory_write(&g_mem, PPU_M7SEL, 0x00);
+    return SUCCESS;
+}
+
+static u64 mode7_run(Workload *work) {
+    u64 lines = 0;
+    u32 frame;
+    
+    (void)work;
+    for (frame = 0; frame < BENCH_PPU_FRAMES; frame++) {
+        double angle = (g_frames_run + frame) * 0.05;
+        double scale = 1.0 + 0.5 * sin(angle * 0.3);
+        
+        mode7_write(0x211B, (s16)(cos(angle) * scale * 256));   /* M7A */
+        mode7_write(0x211C, (s16)(sin(angle) * scale * 256));   /* M7B */
+        mode7_write(0x211D, (s16)(-sin(angle) * scale * 256));  /* M7C */
+        mode7_write(0x211E, (s16)(cos(angle) * scale * 256));   /* M7D */
+        mode7_write(0x211F, 512);                                /* M7X */
+        mode7_write(0x2120, 512);                                /* M7Y */
+        lines += ppu_bench_frame();
+    }
+    g_frames_run += BENCH_PPU_FRAMES;
+    return lines;
+}
+
+/* 128 moving sprites over BG1 in Mode 1, half of them 16x16 */
+static int sprites_setup(Workload *work) {
+    u32 i;
+    
+    (void)work;
+    ppu_bench_setup();
+    memory_write(&g_mem, PPU_BGMODE, 0x01);
+    memory_write(&g_mem, PPU_TM, 0x11);
+    memory_write(&g_mem, PPU_OBSEL, 0x00);  /* 8x8 and 16x16 */
+    
+    /* High table: every other sprite large */
+    memory_write(&g_mem, PPU_OAMADDL, 0x00);
+    memory_write(&g_mem, PPU_OAMADDH, 0x01);
+    for (i = 0; i < 32; i++) {
+        memory_write(&g_mem, PPU_OAMDATA, 0x88);
+    }
+    return SUCCESS;
+}
+
+static u64 sprites_run(Workload *work) {
+    u64 lines = 0;
+    u32 frame;
+    u32 i;
+    
+    (void)work;
+    for (frame = 0; frame < BENCH_PPU_FRAMES; frame++) {
+        u32 t = g_frames_run + frame;
+        
+        memory_write(&g_mem, PPU_OAMADDL, 0x00);
+        memory_write(&g_mem, PPU_OAMADDH, 0x00);
+        for (i = 0; i < 128; i++) {
+            memory_write(&g_mem, PPU_OAMDATA, (u8)(i * 37 + t));          /* X */
+            memory_write(&g_mem, PPU_OAMDATA, (u8)((i * 13 + t / 2) % 224));  /* Y */
+            memory_write(&g_mem, PPU_OAMDATA, (u8)i);                     /* Tile */
+            memory_write(&g_mem, PPU_OAMDATA, (u8)(0x30 | ((i & 7) << 1)));  /* Priority, palette */
+        }
+        lines += ppu_bench_frame();
+    }
+    g_frames_run += BENCH_PPU_FRAMES;
+    return lines;
+}
+
+/* Eight looping BRR voices mixed by the DSP */
+static int brr_setup(Workload *work) {
+    u32 v;
+    u32 block;
+    u32 i;
+    
+    (void)work;
+    apu_init(&g_apu);
+    
+    /* 16 blocks per voice; the last one ends and loops */
+    for (v = 0; v < DSP_NUM_VOICES; v++) {
+        u16 address = (u16)(0x1000 + v * 0x100);
+        
+        for (block = 0; block < 16; block++) {
+            u16 base = (u16)(address + block * 9);
+            
+            g_apu.ram[base] = (u8)(0xB0 | ((block & 3) << 2) | (block == 15 ? 0x03 : 0x00));
+            for (i = 1; i < 9; i++) {
+                g_apu.ram[base + i] = (u8)bench_random();
+            }
+        }
+        apu_write_dsp(&g_apu, (u8)(v << 4 | 0x00), 0x30);  /* VOL L */
+        apu_write_dsp(&g_apu, (u8)(v << 4 | 0x01), 0x30);  /* VOL R */
+        apu_write_dsp(&g_apu, (u8)(v << 4 | 0x02), 0x00);  /* PITCH */
+        apu_write_dsp(&g_apu, (u8)(v << 4 | 0x03), 0x10);
+        apu_write_dsp(&g_apu, (u8)(v << 4 | 0x04), (u8)(address >> 8));  /* SRCN */
+        g_apu.dsp.voices[v].loop_address = address;
+    }
+    apu_write_dsp(&g_apu, 0x0C, 0x7F);  /* Main volume */
+    apu_write_dsp(&g_apu, 0x1C, 0x7F);
+    apu_write_dsp(&g_apu, 0x4C, 0xFF);  /* Key on all voices */
+    return SUCCESS;
+}
+
+static u64 brr_run(Workload *work) {
+    (void)work;
+    g_apu.buffer_pos = 0;
+    apu_generate_samples(&g_apu, BENCH_APU_SAMPLES);
+    return BENCH_APU_SAMPLES;
+}
+
+static void brr_cleanup(Workload *work) {
+    (void)work;
+    apu_cleanup(&g_apu);
+}
+
+/* Whole frames drawn in Mode 1 with the APU synced lazily or threaded */
+static int apu_sync_setup(Workload *work) {
+    u32 i;
+    
+    (void)work;
+    if (bench_load_program(cpu_program, sizeof(cpu_program)) != SUCCESS) {
+        return ERROR;
+    }
+    for (i = 0; i < VRAM_SIZE; i++) {
+        g_emu.memory.vram[i] = (u8)bench_random();
+    }
+    for (i = 0; i < CGRAM_SIZE; i++) {
+        g_emu.memory.cgram[i] = (u8)bench_random();
+    }
+    memory_vram_written(&g_emu.memory, 0, VRAM_SIZE);
+    memory_cgram_written(&g_emu.memory, 0, CGRAM_SIZE);
+    memory_write(&g_emu.memory, PPU_INIDISP, 0x0F);
+    memory_write(&g_emu.memory, PPU_BGMODE, 0x01);
+    memory_write(&g_emu.memory, PPU_TM, 0x17);
+    return SUCCESS;
+}
+
+/* The worker is joined inside the run, so time it lags behind is counted */
+static u64 apu_sync_run(Workload *work) {
+    u32 frame;
+    
+    if (work->param == APU_SYNC_THREADED &&
+        apu_start_thread(&g_emu.apu, g_emu.cpu.cycles) != SUCCESS) {
+        return 0;
+    }
+    for (frame = 0; frame < BENCH_SYNC_FRAMES; frame++) {
+        emulator_run_frame(&g_emu);
+        apu_drain_audio(&g_emu.apu);
+        g_emu.apu.buffer_pos = 0;
+    }
+    apu_stop_thread(&g_emu.apu);
+    return BENCH_SYNC_FRAMES;
+}
+
+/* Upscale a busy frame in one mode */
+static int upscale_setup(Workload *work) {
+    Upscaler *upscaler = (Upscaler *)malloc(sizeof(Upscaler));
+    u32 i;
+    
+    if (!upscaler) {
+        return ERROR;
+    }
+    upscaler_init(upscaler);
+    upscaler_set_mode(upscaler, (UpscaleMode)work->param);
+    work->data = upscaler;
+    
+    /* Flat areas with edges, like a game frame */
+    for (i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+        g_frame[i] = ((i / 7) % 5 == 0) ? bench_random() | 0xFF000000 : 0xFF204080;
+    }
+    return SUCCESS;
+}
+
+static u64 upscale_run(Workload *work) {
+    Upscaler *upscaler = (Upscaler *)work->data;
+    u16 width;
+    u16 height;
+    u32 frame;
+    
+    upscaler_get_output_size(upscaler, SCREEN_WIDTH, SCREEN_HEIGHT, &width, &height);
+    for (frame = 0; frame < BENCH_UPSCALE_FRAMES; frame++) {
+        upscaler_process(upscaler, g_frame, SCREEN_WIDTH, SCREEN_HEIGHT, g_upscaled);
+    }
+    return (u64)BENCH_UPSCALE_FRAMES * width * height;
+}
+
+static void upscale_cleanup(Workload *work) {
+    Upscaler *upscaler = (Upscaler *)work->data;
+    
+    upscaler_cleanup(upscaler);
+    free(upscaler);
+    work->data = NULL;
+}
+
+static Workload workloads[] = {
+    { "cpu_loop",      "instructions", cpu_loop_setup, cpu_loop_run, emulator_workload_cleanup, 0,                 NULL },
+    { "dma",           "bytes",        dma_setup,      dma_run,      emulator_workload_cleanup, 0,                 NULL },
+    { "mode7",         "scanlines",    mode7_setup,    mode7_run,    ppu_workload_cleanup,      0,                 NULL },
+    { "sprites_128",   "scanlines",    sprites_setup,  sprites_run,  ppu_workload_cleanup,      0,                 NULL },
+    { "brr_8_voices",  "samples",      brr_setup,      brr_run,      brr_cleanup,               0,                 NULL },
+    { "apu_lazy",      "frames",       apu_sync_setup, apu_sync_run, emulator_workload_cleanup, APU_SYNC_LAZY,     NULL },
+    { "apu_threaded",  "frames",       apu_sync_setup, apu_sync_run, emulator_workload_cleanup, APU_SYNC_THREADED, NULL },
+    { "upscale_none",  "pixels",       upscale_setup,  upscale_run,  upscale_cleanup,           UPSCALE_NONE,      NULL },
+    { "upscale_2x",    "pixels",       upscale_setup,  upscale_run,  upscale_cleanup,           UPSCALE_2X,        NULL },
+    { "upscale_3x",    "pixels",       upscale_setup,  upscale_run,  upscale_cleanup,           UPSCALE_3X,        NULL },
+    { "upscale_4x",    "pixels",       upscale_setup,  upscale_run,  upscale_cleanup,           UPSCALE_4X,        NULL },
+    { "upscale_ml_2x", "pixels",       upscale_setup,  upscale_run,  upscale_cleanup,           UPSCALE_ML_2X,     NULL },
+    { "upscale_ml_3x", "pixels",       upscale_setup,  upscale_run,  upscale_cleanup,           UPSCALE_ML_3X,     NULL },
+    { "upscale_ml_4x", "pixels",       upscale_setup,  upscale_run,  upscale_cleanup,           UPSCALE_ML_4X,     NULL }
+};
+
+#define WORKLOAD_COUNT ((int)(sizeof(workloads) / sizeof(workloads[0])))
+
+static int compare_u64(const void *a, const void *b) {
+    u64 x = *(const u64 *)a;
+    u64 y = *(const u64 *)b;
+    
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted values */
+static u64 percentile(const u64 *sorted, u32 count, u32 percent) {
+    u32 rank = (count * percent + 99) / 100;
+    
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/* Time one workload and write its JSON object */
+static int bench_workload(Workload *work, u32 reps, FILE *out, bool first) {
+    int counter = perf_register(work->name);
+    u64 units = 0;
+    u64 median;
+    u64 p99;
+    u32 rep;
+    
+    g_frames_run = 0;
+    if (counter < 0 || work->setup(work) != SUCCESS) {
+        fprintf(stderr, "Error: Cannot set up workload '%s'\n", work->name);
+        return ERROR;
+    }
+    
+    /* One untimed run warms caches and lazily built tables */
+    work->run(work);
+    for (rep = 0; rep < reps; rep++) {
+        u64 before = g_perf_stats.counters[counter].total_ns;
+        
+        perf_start(counter);
+        units = work->run(work);
+        perf_stop(counter);
+        g_times[rep] = g_perf_stats.counters[counter].total_ns - before;
+        if (g_times[rep] == 0) {
+            g_times[rep] = 1;
+        }
+    }
+    work->cleanup(work);
+    
+    qsort(g_times, reps, sizeof(g_times[0]), compare_u64);
+    median = percentile(g_times, reps, 50);
+    p99 = percentile(g_times, reps, 99);
+    
+    fprintf(out, "%s    {\"name\": \"%s\", \"unit\": \"%s\", \"units_per_run\": %llu, "
+            "\"median_ns\": %llu, \"p99_ns\": %llu, \"min_ns\": %llu, "
+            "\"median_per_sec\": %.1f, \"p99_per_sec\": %.1f}",
+            first ? "" : ",\n", work->name, work->unit, (unsigned long long)units,
+            (unsigned long long)median, (unsigned long long)p99,
+            (unsigned long long)g_times[0], units * 1e9 / median, units * 1e9 / p99);
+    
+    fprintf(stderr, "  %-14s %14.0f %s/s (median)  %14.0f %s/s (p99)\n", work->name,
+            units * 1e9 / median, work->unit, units * 1e9 / p99, work->unit);
+    return SUCCESS;
+}
+
+static void print_usage(const char *program_name) {
+    printf("Usage: %s [options]\n", program_name);
+    printf("Options:\n");
+    printf("  --reps N       Timed runs per workload (default %d)\n", BENCH_DEFAULT_REPS);
+    printf("  --filter TEXT  Only run workloads whose name contains TEXT\n");
+    printf("  --output FILE  Write the JSON report to FILE (default %s)\n", BENCH_DEFAULT_OUTPUT);
+    printf("  --list         List the workloads\n");
+    printf("  -h, --help     Show this help message\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *filter = NULL;
+    const char *output = BENCH_DEFAULT_OUTPUT;
+    u32 reps = BENCH_DEFAULT_REPS;
+    FILE *out;
+    bool first = true;
+    int failed = 0;
+    int i;
+    
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = (u32)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--list") == 0) {
+            for (i = 0; i < WORKLOAD_COUNT; i++) {
+                printf("%-14s %s\n", workloads[i].name, workloads[i].unit);
+            }
+            return 0;
+        } else {
+            print_usage(argv[0]);
+            return strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (reps == 0 || reps > BENCH_MAX_REPS) {
+        fprintf(stderr, "Error: --reps must be 1-%d\n", BENCH_MAX_REPS);
+        return 1;
+    }
+    
+    out = fopen(output, "w");
+    if (!out) {
+        fprintf(stderr, "Error: Cannot create report '%s'\n", output);
+        return 1;
+    }
+    
+    perf_init();
+    fprintf(stderr, "snesbench: %u runs per workload\n", reps);
+    fprintf(out, "{\n  \"benchmark\": \"snesbench\",\n  \"version\": 1,\n");
+    fprintf(out, "  \"reps\": %u,\n  \"percentile_method\": \"nearest-rank\",\n", reps);
+    fprintf(out, "  \"workloads\": [\n");
+    for (i = 0; i < WORKLOAD_COUNT; i++) {
+        if (filter && !strstr(workloads[i].name, filter)) {
+            continue;
+        }
+        if (bench_workload(&workloads[i], reps, out, first) == SUCCESS) {
+            first = false;
+        } else {
+            failed++;
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+    
+    fprintf(stderr, "Report written to %s\n", output);
+    return failed ? 1 : 0;
+}
@@ -8,10 +8,69 @@
 #define APU_H
 
 #include "types.h"
+#include "thread.h"
 
 /* SPC-700 RAM size */
 #define SPC_RAM_SIZE 0x10000  /* 64KB */
 
+/* Output sample rate and CPU cycles per second (89342 cycles x 60 frames) */
+#define APU_SAMPLE_RATE 32000
+#define APU_CPU_CLOCK   5360520
+
+/*
+ * SPC-700 clock relative to the CPU cycle counter: 1.024 MHz over
+ * APU_CPU_CLOCK, reduced (1024000 / 5360520 = 25600 / 134013)
+ */
+#define APU_SPC_CLOCK 1024000
+#define APU_CLOCK_NUM 25600
+#define APU_CLOCK_DEN 134013
+
+/* APU synchronization modes */
+typedef enum {
+    APU_SYNC_SCANLINE = 0,  /* Catch up once per scanline */
+    APU_SYNC_LAZY,          /* Catch up on port access and at end of frame */
+    APU_SYNC_THREADED       /* Run on a worker thread (non-deterministic) */
+} ApuSyncMode;
+
+/* Threaded mode queue sizes (powers of two) */
+#define APU_MAILBOX_SIZE    256    /* Pending port writes */
+#define APU_AUDIO_RING_SIZE 16384  /* Interleaved stereo s16 samples */
+
+/* Timestamped port write from the main CPU */
+typedef struct {
+    u64 time;               /* CPU timestamp of the write */
+    u8 port;                /* Port 0-3 */
+    u8 value;               /* Written value */
+} ApuPortWrite;
+
+/*
+ * Threaded mode state
+ * Each index is written by one side only: the main thread produces port
+ * writes and time limits, the APU thread produces port outputs and audio.
+ * With nothing to do the worker sleeps on wake; time limits wake it once
+ * it is APU_THREAD_WAKE_CYCLES behind, port writes and stop at once.
+ */
+typedef struct {
+    Thread thread;          /* Worker thread */
+    bool stop;              /* Set by main thread to end the worker */
+    bool sleeping;          /* Worker is (about to be) waiting on wake */
+    u64 wait_time;          /* APU time when the worker last went to sleep */
+    Mutex lock;             /* Guards the sleep/wake handshake */
+    Cond wake;              /* Signaled when there is new work or stop */
+    u64 time_limit;         /* CPU timestamp the APU may run up to */
+    u64 main_time;          /* Last CPU timestamp seen by the main thread */
+    u32 ports_out;          /* port_out[0-3] packed, published by APU thread */
+    
+    ApuPortWrite mailbox[APU_MAILBOX_SIZE];  /* Main CPU -> APU port writes */
+    u32 mailbox_head;       /* Producer index (main thread) */
+    u32 mailbox_tail;       /* Consumer index (APU thread) */
+    
+    s16 audio_ring[APU_AUDIO_RING_SIZE];     /* APU -> host audio samples */
+    u32 audio_head;         /* Producer index (APU thread) */
+    u32 audio_tail;         /* Consumer index (main thread) */
+    u32 audio_dropped;      /* Samples dropped because the ring was full */
+} ApuThreadState;
+
 /* DSP Registers */
 #define DSP_NUM_VOICES 8
 
@@ -30,6 +89,8 @@ typedef struct {
     u16 sample_address;     /* Current sample address */
     u16 loop_address;       /* Loop point address */
     u8 sample_offset;       /* Offset within current BRR block */
+    s16 brr_old;            /* Last two decoded samples (BRR filter history) */
+    s16 brr_older;
     
     bool key_on;            /* Key on flag */
     bool key_off;           /* Key off flag */
@@ -93,6 +154,13 @@ typedef struct {
     u32 buffer_pos;         /* Current buffer position */
     
     bool enabled;           /* APU enabled */
+    
+    /* Synchronization with the main CPU */
+    ApuSyncMode sync_mode;  /* When the emulator calls apu_sync */
+    u64 sync_time;          /* CPU timestamp the APU has caught up to */
+    s64 cycle_budget;       /* SPC-700 cycles owed, scaled by APU_CLOCK_DEN */
+    u64 sample_budget;      /* Samples owed, scaled by APU_CPU_CLOCK */
+    ApuThreadState *thread; /* Worker state while threaded (NULL otherwise) */
 } APU;
 
 /* Function declarations */
@@ -102,6 +170,11 @@ typedef struct {
  */
 void apu_init(APU *apu);
 
+/*
+ * Stop the worker thread (if any) and free buffers allocated by apu_init
+ */
+void apu_cleanup(APU *apu);
+
 /*
  * Reset APU to power-on state
  */
@@ -112,6 +185,31 @@ void apu_reset(APU *apu);
  */
 void apu_run(APU *apu, u32 cycles);
 
+/*
+ * Catch the APU up to a main CPU timestamp
+ * Runs the SPC-700 for the elapsed time (carrying instruction overshoot
+ * into the next call) and generates the matching audio samples.
+ */
+void apu_sync(APU *apu, u64 cpu_time);
+
+/*
+ * Move the APU onto a worker thread starting at the given CPU timestamp
+ * While running, the main thread may only use apu_sync, the port
+ * functions, apu_drain_audio and apu_stop_thread.
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int apu_start_thread(APU *apu, u64 cpu_time);
+
+/*
+ * Stop the worker thread and finish all queued work on the caller
+ */
+void apu_stop_thread(APU *apu);
+
+/*
+ * Move samples produced by the worker thread into audio_buffer
+ */
+void apu_drain_audio(APU *apu);
+
 /*
  * Write to APU communication port (from main CPU)
  */
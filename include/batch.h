@@ -0,0 +1,80 @@
+/*
+ * batch.h - Parallel batch runner
+ *
+ * Runs a list of ROMs for a fixed number of frames, one emulator instance
+ * per run, on a pool of worker threads. Each worker starts with its own
+ * slice of the run list and steals from the others once it is empty.
+ * Runs of the same ROM share one RomImage. The final framebuffer and WRAM
+ * hashes make the report usable for regression checks; timings show
+ * throughput.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "types.h"
+
+/* One run: a ROM emulated for a number of frames */
+typedef struct {
+    char rom_path[256];     /* ROM file */
+    u32 frames;             /* Frames to emulate */
+    
+    /* Results (filled in by batch_run) */
+    int status;             /* SUCCESS, or ERROR if the ROM could not be run */
+    u64 framebuffer_hash;   /* FNV-1a of the last frame */
+    u64 wram_hash;          /* FNV-1a of WRAM after the last frame */
+    u64 cpu_cycles;         /* CPU cycles emulated */
+    bool cpu_stopped;       /* CPU halted (STP or unimplemented opcode) */
+    u64 elapsed_ns;         /* Wall-clock time of the run */
+    u32 worker;             /* Worker thread that ran it */
+} BatchJob;
+
+/* Batch of runs */
+typedef struct {
+    BatchJob *jobs;
+    u32 job_count;
+    u32 job_capacity;
+    
+    u32 thread_count;       /* Worker threads used by the last batch_run */
+    u64 elapsed_ns;         /* Wall-clock time of the last batch_run */
+} Batch;
+
+/* Function declarations */
+
+/*
+ * Initialize an empty batch
+ */
+void batch_init(Batch *batch);
+
+/*
+ * Free the run list
+ */
+void batch_cleanup(Batch *batch);
+
+/*
+ * Append count runs of a ROM
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int batch_add(Batch *batch, const char *rom_path, u32 frames, u32 count);
+
+/*
+ * Append the runs listed in a text file
+ * One ROM per line, optionally followed by a run count ("game.sfc 8").
+ * Blank lines and lines starting with '#' are ignored.
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int batch_load_list(Batch *batch, const char *filename, u32 frames);
+
+/*
+ * Run every job on the given number of worker threads (0 = one per core)
+ * Returns SUCCESS if all runs succeeded, ERROR otherwise
+ */
+int batch_run(Batch *batch, u32 threads);
+
+/*
+ * Write the results as JSON (filename ending in .json) or CSV
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int batch_write_report(const Batch *batch, const char *filename);
+
+#endif /* BATCH_H */
@@ -8,6 +8,7 @@
 #ifndef CARTRIDGE_H
 #define CARTRIDGE_H
 
+#include <stddef.h>
 #include "types.h"
 
 /* Cartridge mapper types */
@@ -64,12 +65,25 @@ typedef struct {
     /* For ROM editing/backup */
     u8 *rom_backup;           /* Backup of original ROM data */
     bool has_backup;          /* Whether backup exists */
+    u32 rom_generation;       /* Bumped whenever ROM data is modified */
+    
+    /* Memory-mapped ROM file (rom_map == NULL: rom_data is a heap buffer) */
+    u8 *rom_map;              /* Private (copy-on-write) mapping; rom_data points into it */
+    size_t rom_map_size;      /* Length of the mapping */
+    int rom_fd;               /* ROM file backing the mapping (restores re-map it) */
+    bool backup_mapped;       /* rom_backup is a read-only mapping of the file */
 } Cartridge;
 
 /* Function declarations */
 
 /*
  * Load a ROM file from disk
+ * On POSIX hosts the file is mapped MAP_PRIVATE: pages are read on first
+ * use and shared through the page cache between processes running the
+ * same ROM; edits stay private to this cartridge. Unedited pages still
+ * read the file, so it must not be modified in place while loaded
+ * (replace it, as cartridge_save_rom does). Falls back to reading the
+ * file into a heap buffer where mapping is unavailable.
  * Returns SUCCESS on success, ERROR on failure
  */
 int cartridge_load(Cartridge *cart, const char *filename);
@@ -122,11 +136,16 @@ void cartridge_update_checksum(Cartridge *cart);
 
 /*
  * Save modified ROM to file
+ * The data is written to "<filename>.tmp" and renamed over filename, so
+ * saving over the ROM a cartridge is mapped from leaves the mapping intact.
  */
 int cartridge_save_rom(const Cartridge *cart, const char *filename);
 
 /*
  * Create backup of ROM data
+ * An unmodified mapped ROM is backed up by mapping the file a second time
+ * (no copy); restoring then drops the private pages of the edits. The fd
+ * keeps the loaded file alive even if cartridge_save_rom replaces it.
  */
 int cartridge_backup_rom(Cartridge *cart);
 
@@ -35,6 +35,24 @@
 #define VECTOR_EMULATION_RESET 0xFFFC
 #define VECTOR_EMULATION_IRQ   0xFFFE
 
+/*
+ * Opcode dispatch table selectors
+ * Native mode indexes by (P >> 4) & 3, i.e. M<<1 | X; emulation mode
+ * always has 8-bit registers and its own stack behaviour.
+ */
+#define CPU_DISPATCH_M16_X16   0
+#define CPU_DISPATCH_M16_X8    1
+#define CPU_DISPATCH_M8_X16    2
+#define CPU_DISPATCH_M8_X8     3
+#define CPU_DISPATCH_EMULATION 4
+#define CPU_DISPATCH_MODES     5
+
+/* Predecoded basic-block cache (private to cpu.c) */
+typedef struct CpuBlockCache CpuBlockCache;
+
+/* Bus the CPU runs on (memory.h) */
+struct Memory;
+
 /* CPU structure */
 typedef struct {
     /* Registers */
@@ -63,6 +81,13 @@ typedef struct {
     /* Timing */
     u32 instruction_cycles; /* Cycles for current instruction */
     
+    /* Bus */
+    struct Memory *mem;  /* Memory the CPU reads and writes through */
+    
+    /* Dispatch */
+    u8 dispatch_mode;    /* Active opcode table (CPU_DISPATCH_*) */
+    CpuBlockCache *block_cache; /* Decoded blocks used by cpu_run */
+    
     /* Debug/Breakpoint support */
     u32 breakpoints[8];  /* Up to 8 breakpoints (24-bit addresses) */
     u8 breakpoint_count; /* Number of active breakpoints */
@@ -72,9 +97,10 @@ typedef struct {
 /* Function declarations */
 
 /*
- * Initialize CPU to power-on state
+ * Initialize CPU to power-on state on the given bus
+ * (the reset vector is read from mem)
  */
-void cpu_init(CPU *cpu);
+void cpu_init(CPU *cpu, struct Memory *mem);
 
 /*
  * Reset CPU to reset vector
@@ -89,9 +115,27 @@ u32 cpu_step(CPU *cpu);
 
 /*
  * Execute CPU for specified number of cycles
+ * Uses the basic-block cache; falls back to cpu_step for breakpoints,
+ * interrupts and code outside directly mapped pages.
  */
 void cpu_run(CPU *cpu, u32 cycles);
 
+/*
+ * Execute CPU until its cycle counter reaches the given timestamp
+ * (typically the next scheduler event); may overshoot by one instruction
+ */
+void cpu_run_until(CPU *cpu, u64 timestamp);
+
+/*
+ * Discard all cached blocks
+ */
+void cpu_flush_block_cache(CPU *cpu);
+
+/*
+ * Free CPU resources (block cache)
+ */
+void cpu_cleanup(CPU *cpu);
+
 /*
  * Trigger NMI interrupt
  */
@@ -102,6 +146,12 @@ void cpu_nmi(CPU *cpu);
  */
 void cpu_irq(CPU *cpu);
 
+/*
+ * Select the opcode table matching the current M/X/E state
+ * Must be called whenever P or E is changed outside of cpu_step
+ */
+void cpu_update_dispatch(CPU *cpu);
+
 /*
  * Get/Set status flags */
 u8 cpu_get_flag(const CPU *cpu, u8 flag);
@@ -0,0 +1,93 @@
+/*
+ * emulator.h - Emulator instance (one complete SNES)
+ *
+ * Bundles the CPU, PPU, APU, memory, input and event scheduler of one
+ * machine so several can run in the same process. The cartridge ROM is
+ * held in a reference-counted RomImage that instances share read-only;
+ * everything that changes while a game runs (WRAM, SRAM, registers) is
+ * per instance.
+ */
+
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include "types.h"
+#include "cartridge.h"
+#include "memory.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "apu.h"
+#include "input.h"
+#include "scheduler.h"
+
+/*
+ * Shared ROM image
+ * Loaded once and never written while instances use it.
+ */
+typedef struct {
+    Cartridge cart;       /* Loaded cartridge (ROM data, parsed header) */
+    u32 refcount;         /* Instances and other holders of the image */
+} RomImage;
+
+/* Emulator instance */
+typedef struct {
+    Memory memory;        /* Bus, WRAM, VRAM, CGRAM, OAM, DMA */
+    CPU cpu;              /* 65c816 */
+    PPU ppu;              /* Picture processing unit */
+    APU apu;              /* SPC-700 + DSP */
+    InputSystem input;    /* Controllers */
+    Scheduler scheduler;  /* Scanline/VBlank/HDMA/IRQ events */
+    
+    Cartridge cart;       /* This instance's view of the ROM (own SRAM) */
+    RomImage *rom;        /* Shared ROM image */
+    
+    bool running;         /* Event chain started */
+    u64 frame_end;        /* CPU time at which the current frame ends */
+    u32 frames;           /* Frames run so far */
+} Emulator;
+
+/* Function declarations */
+
+/*
+ * Load a ROM file into a new image with one reference
+ * Returns NULL on failure
+ */
+RomImage *rom_image_load(const char *filename);
+
+/*
+ * Add a reference to an image (thread-safe)
+ */
+RomImage *rom_image_retain(RomImage *image);
+
+/*
+ * Drop a reference; the image is unloaded with the last one (thread-safe)
+ */
+void rom_image_release(RomImage *image);
+
+/*
+ * Initialize an instance running the given ROM image
+ * Takes a reference to the image. The machine is reset and ready to run.
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int emulator_init(Emulator *emu, RomImage *rom);
+
+/*
+ * Free instance resources and release its ROM image reference
+ */
+void emulator_cleanup(Emulator *emu);
+
+/*
+ * Run one frame (262 scanlines) of CPU, PPU, APU and DMA/HDMA
+ * On return the APU has caught up with the CPU. With render threads the
+ * frame is still being drawn and is published at the next VBlank, so the
+ * framebuffer lags one frame behind; use emulator_present to read it.
+ */
+void emulator_run_frame(Emulator *emu);
+
+/*
+ * Wait for the render threads and return the last finished frame
+ * (the framebuffer, NULL if there is none)
+ */
+const u32 *emulator_present(Emulator *emu);
+
+#endif /* EMULATOR_H */
@@ -9,6 +9,8 @@
 
 #include "types.h"
 
+struct Movie;
+
 /* Controller button masks */
 #define BUTTON_B      0x8000
 #define BUTTON_Y      0x4000
@@ -40,6 +42,8 @@ typedef struct {
     bool auto_read;       /* Automatic controller reading */
     u16 auto_joy1;        /* Auto-read result for joypad 1 */
     u16 auto_joy2;        /* Auto-read result for joypad 2 */
+    
+    struct Movie *movie;  /* Attached input movie (NULL = live input only) */
 } InputSystem;
 
 /* Function declarations */
@@ -64,6 +68,11 @@ void input_set_button(InputSystem *input, u8 controller, u16 button, bool presse
  */
 void input_set_buttons(InputSystem *input, u8 controller, u16 button_mask);
 
+/*
+ * Attach an input movie, stepped by every auto-read (NULL to detach)
+ */
+void input_set_movie(InputSystem *input, struct Movie *movie);
+
 /*
  * Write to joypad register (strobe)
  */
@@ -81,6 +90,7 @@ u8 input_read_joypad2(InputSystem *input);
 
 /*
  * Perform auto-read (called during VBlank)
+ * Steps the attached movie first, so it sees exactly one call per frame.
  */
 void input_auto_read(InputSystem *input);
 
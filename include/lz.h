@@ -0,0 +1,33 @@
+/*
+ * lz.h - Fast LZ77 block compression
+ *
+ * Byte-oriented LZ in the LZ4 block layout: each sequence is a token
+ * (literal count and match length nibbles), the literals, a 16-bit match
+ * offset and length extension bytes. There is no entropy stage, so both
+ * directions run at memory speed; used for save states.
+ */
+
+#ifndef LZ_H
+#define LZ_H
+
+#include "types.h"
+
+/*
+ * Largest compressed size of size input bytes (incompressible data)
+ */
+u32 lz_compress_bound(u32 size);
+
+/*
+ * Compress size bytes of src into dst
+ * Returns the compressed size, or 0 if it does not fit in capacity
+ */
+u32 lz_compress(const u8 *src, u32 size, u8 *dst, u32 capacity);
+
+/*
+ * Decompress a block produced by lz_compress
+ * Returns the decompressed size, or 0 if the block is malformed or its
+ * output does not fit in capacity
+ */
+u32 lz_decompress(const u8 *src, u32 size, u8 *dst, u32 capacity);
+
+#endif /* LZ_H */
@@ -10,6 +10,8 @@
 
 #include "types.h"
 #include "cartridge.h"
+#include "apu.h"
+#include "ppu.h"
 
 /* Memory regions */
 #define WRAM_START     0x7E0000
@@ -17,33 +19,153 @@
 #define SRAM_START     0x700000
 #define SRAM_END       0x7DFFFF
 
-/* DMA channel structure */
+/*
+ * Page table
+ * The 24-bit bus is split into 8KB pages. Pages backed by plain host
+ * memory (WRAM, ROM) hold a direct pointer; NULL pages (I/O, SRAM, open
+ * bus) go through the slow handler.
+ */
+#define MEMORY_PAGE_SHIFT  13
+#define MEMORY_PAGE_SIZE   (1 << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGE_MASK   (MEMORY_PAGE_SIZE - 1)
+#define MEMORY_PAGE_COUNT  (0x1000000 >> MEMORY_PAGE_SHIFT)
+
+/*
+ * I/O registers
+ * Only two blocks of $2000-$5FFF hold registers: the B-bus ($2100-$21FF)
+ * and the CPU/joypad/DMA block ($4000-$43FF). Accesses are dispatched per
+ * 256-byte page; everything else in the range is open bus.
+ */
+#define MEMORY_IO_BBUS_SIZE 0x100  /* $2100-$21FF */
+#define MEMORY_IO_CPU_SIZE  0x400  /* $4000-$43FF */
+
+/* DMA timing in CPU cycles (8 master clocks per byte and per channel) */
+#define DMA_CYCLES_PER_BYTE     2
+#define DMA_CYCLES_PER_CHANNEL  2
+
+/*
+ * Write watches
+ * WRAM (the only writable host memory) is watched in 64-byte spans. Pages
+ * holding a watched span, and every bus mirror of them, take the slow write
+ * path; writes there only do work when they land in a watched span.
+ */
+#define MEMORY_WATCH_CODE  0x01  /* Span holds code in the CPU block cache */
+#define MEMORY_WATCH_HDMA  0x02  /* Span holds HDMA tables or data */
+
+#define MEMORY_WATCH_SPAN_SHIFT 6
+#define MEMORY_WATCH_SPANS  (WRAM_SIZE >> MEMORY_WATCH_SPAN_SHIFT)
+#define MEMORY_WRAM_PAGES   (WRAM_SIZE >> MEMORY_PAGE_SHIFT)
+#define MEMORY_NO_PAGE      0xFFFF
+#define MEMORY_CODE_WRITES  8     /* Written code spans queued for the CPU */
+#define MEMORY_HDMA_RANGES  32    /* WRAM byte runs read by compiled HDMA */
+
+/* Run of WRAM bytes [start, end) */
+typedef struct {
+    u32 start;
+    u32 end;
+} MemoryRange;
+
+/* DMA channel structure (wide fields first) */
 typedef struct {
+    u16 src_addr;        /* Source address (low 16 bits) */
+    u16 transfer_size;   /* Transfer size in bytes */
+    u16 hdma_table_addr; /* HDMA table address */
     u8 control;          /* DMA control register */
     u8 dest_register;    /* Destination (B-bus register) */
-    u16 src_addr;        /* Source address (low 16 bits) */
     u8 src_bank;         /* Source bank */
-    u16 transfer_size;   /* Transfer size in bytes */
+    u8 hdma_table_bank;  /* HDMA table bank */
+    u8 hdma_indirect_bank; /* HDMA indirect data bank (DASBx) */
     bool enabled;        /* Channel enabled flag */
     bool hdma_enabled;   /* HDMA enabled flag */
-    u8 hdma_table_bank;  /* HDMA table bank */
-    u16 hdma_table_addr; /* HDMA table address */
 } DMAChannel;
 
-/* Memory structure */
+/*
+ * HDMA
+ * Tables are compiled into a flat list of B-bus writes per scanline and
+ * replayed from it. The list is kept across frames until a channel's
+ * setup changes or a table or data byte it was compiled from is written
+ * (other writes near the tables are ignored); a write in the middle of a
+ * frame recompiles from the current line, one line at a time, and the
+ * whole frame again at the next one.
+ */
+#define HDMA_LINES      225  /* HDMA runs on lines 0-224 */
+#define HDMA_MAX_WRITES (HDMA_LINES * 8 * 4)
+
+/* Progress of one HDMA channel through its table */
 typedef struct {
-    u8 wram[WRAM_SIZE];       /* 128KB Work RAM */
-    u8 vram[VRAM_SIZE];       /* 64KB Video RAM */
-    u8 cgram[CGRAM_SIZE];     /* 512 bytes Color RAM (palette) */
-    u8 oam[OAM_SIZE];         /* 544 bytes Object Attribute Memory */
+    u16 table_addr;      /* Next table byte (A2Ax) */
+    u16 indirect_addr;   /* Next indirect data byte (DASx) */
+    u8 line_counter;     /* Line counter and repeat flag (NLTRx) */
+    bool do_transfer;    /* Transfer on the next line */
+    bool active;         /* Table not terminated */
+} HDMAState;
+
+/* One precompiled HDMA register write */
+typedef struct {
+    u8 reg;              /* B-bus register ($2100 + reg) */
+    u8 value;
+} HDMAWrite;
+
+/* HDMA writes of one frame */
+typedef struct {
+    HDMAState state[HDMA_LINES + 1][8];  /* Channel state before each line */
+    u16 line_start[HDMA_LINES + 1];      /* First write of each line */
+    HDMAWrite writes[HDMA_MAX_WRITES];
+    DMAChannel setup[8];  /* Channel registers the program was compiled with */
+    u32 generation;       /* hdma_generation the program was compiled at */
+    u16 compiled;         /* Lines [0, compiled) are valid */
+    u16 line;             /* Next line to replay */
+    bool partial;         /* Tables changed mid-frame: compile line by line */
+} HDMAProgram;
+
+/*
+ * Memory structure
+ * Ordered by access frequency: the page table every bus access goes
+ * through comes first, the bulk memories last.
+ */
+typedef struct Memory {
+    /* Page table (rebuilt by memory_update_map) */
+    u8 *read_map[MEMORY_PAGE_COUNT];   /* Readable host pages or NULL */
+    u8 *write_map[MEMORY_PAGE_COUNT];  /* Writable host pages or NULL */
+    
+    /* Write watches for the CPU block cache and HDMA */
+    u8 watch_pages[MEMORY_PAGE_COUNT]; /* Page holds watched spans (slow writes) */
+    u8 watch_spans[MEMORY_WATCH_SPANS];  /* MEMORY_WATCH_* flags per WRAM span */
+    u16 watch_count[MEMORY_WRAM_PAGES];  /* Watched spans per WRAM page */
+    u16 wram_mirrors[MEMORY_WRAM_PAGES]; /* First bus page mapping each WRAM page */
+    u16 mirror_next[MEMORY_PAGE_COUNT];  /* Next bus page of the same WRAM page */
+    u16 code_written[MEMORY_CODE_WRITES];  /* Code spans written, for the CPU */
+    u8 code_written_count;
+    MemoryRange hdma_reads[MEMORY_HDMA_RANGES];  /* WRAM read by the HDMA program */
+    u8 hdma_read_count;
+    
+    u32 code_generation;               /* Bumped when all cached code is stale */
+    u32 hdma_generation;               /* Bumped when HDMA tables or setup change */
     
     Cartridge *cart;          /* Pointer to loaded cartridge */
     
+    /* PPU registers ($2100-$213F) */
+    PPU *ppu;                 /* Attached PPU (NULL = plain I/O registers) */
+    
+    /* APU ports ($2140-$217F) */
+    APU *apu;                 /* Attached APU (NULL = plain I/O registers) */
+    const u64 *apu_clock;     /* CPU timestamp used to sync the APU */
+    
     /* DMA state */
+    u64 *cpu_clock;           /* CPU timestamp charged for DMA (NULL = DMA is free) */
     DMAChannel dma[8];        /* 8 DMA channels */
     
     /* Memory mapped I/O registers */
-    u8 io_registers[0x8000];  /* $2000-$7FFF I/O space */
+    u8 io_bbus[MEMORY_IO_BBUS_SIZE];  /* Last values written to $2100-$21FF */
+    u8 io_cpu[MEMORY_IO_CPU_SIZE];    /* $4000-$43FF */
+    
+    /* Compiled HDMA tables */
+    HDMAProgram hdma;
+    
+    u8 wram[WRAM_SIZE];       /* 128KB Work RAM */
+    u8 vram[VRAM_SIZE];       /* 64KB Video RAM */
+    u8 cgram[CGRAM_SIZE];     /* 512 bytes Color RAM (palette) */
+    u8 oam[OAM_SIZE];         /* 544 bytes Object Attribute Memory */
 } Memory;
 
 /* Function declarations */
@@ -63,6 +185,74 @@ void memory_reset(Memory *mem);
  */
 void memory_set_cartridge(Memory *mem, Cartridge *cart);
 
+/*
+ * Attach the PPU to $2100-$213F
+ * Writes are still mirrored into io_bbus for inspection.
+ */
+void memory_set_ppu(Memory *mem, PPU *ppu);
+
+/*
+ * Attach the CPU clock that DMA transfers stall
+ * Each transfer adds its duration to *clock, so the CPU resumes after it.
+ */
+void memory_set_cpu_clock(Memory *mem, u64 *clock);
+
+/*
+ * Get the storage of an I/O register ($2100-$21FF or $4000-$43FF)
+ * Returns NULL for addresses outside both register blocks
+ */
+u8 *memory_io_register(Memory *mem, u16 address);
+
+/*
+ * Notify the attached PPU that VRAM bytes were modified directly
+ * (editors, bulk copies) so its decoded tile cache is refreshed.
+ */
+void memory_vram_written(Memory *mem, u32 address, u32 length);
+
+/*
+ * Notify the attached PPU that CGRAM bytes were modified directly
+ * so its palette cache is refreshed.
+ */
+void memory_cgram_written(Memory *mem, u32 address, u32 length);
+
+/*
+ * Notify the attached PPU that OAM bytes were modified directly
+ * so its sprite lists are re-evaluated.
+ */
+void memory_oam_written(Memory *mem, u32 address, u32 length);
+
+/*
+ * Attach the APU to $2140-$217F
+ * Port accesses first catch the APU up to *clock (the CPU cycle counter).
+ */
+void memory_set_apu(Memory *mem, APU *apu, const u64 *clock);
+
+/*
+ * Rebuild the page table from the current WRAM/cartridge layout
+ * Called by memory_reset and memory_set_cartridge; call it again after
+ * copying a Memory structure or replacing the cartridge ROM buffer.
+ */
+void memory_update_map(Memory *mem);
+
+/*
+ * Watch length bytes at address (within one page) for writes
+ * The first write to a watched span queues it in code_written and drops
+ * the watch (MEMORY_WATCH_CODE). In MEMORY_WATCH_HDMA spans only writes
+ * to bytes in hdma_reads bump hdma_generation. Read-only memory is ignored.
+ */
+void memory_watch_range(Memory *mem, u32 address, u32 length, u8 flags);
+
+/*
+ * Mark length bytes at address as holding cached code
+ */
+void memory_mark_code(Memory *mem, u32 address, u32 length);
+
+/*
+ * WRAM span of a directly mapped WRAM address, or MEMORY_WATCH_SPANS
+ * for any other address
+ */
+u32 memory_watch_span(const Memory *mem, u32 address);
+
 /*
  * Read byte from 24-bit address
  */
@@ -90,6 +280,8 @@ u32 memory_read24(Memory *mem, u32 address);
 
 /*
  * DMA transfer
+ * CPU->PPU transfers from mapped memory into VRAM, CGRAM or OAM are done
+ * as block writes; everything else goes through the bus byte by byte.
  */
 void memory_dma_transfer(Memory *mem, u8 channel);
 
@@ -106,11 +298,15 @@ void memory_dma_trigger(Memory *mem, u8 channels_mask);
 
 /*
  * Initialize HDMA channel
+ * Called for every channel at the start of a frame; replay restarts at
+ * line 0 and the program is recompiled if the channel setup changed.
  */
 void memory_hdma_init(Memory *mem, u8 channel);
 
 /*
  * Process HDMA for current scanline
+ * Replays the precompiled writes of the next line (compiling it first if
+ * needed) straight into the B-bus registers.
  */
 void memory_hdma_run(Memory *mem);
 
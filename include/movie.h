@@ -0,0 +1,98 @@
+/*
+ * movie.h - Input movies
+ *
+ * Records the joypad state of every frame from power-on and plays it back,
+ * so a run can be reproduced exactly. The movie is attached to the input
+ * system and steps once per auto-joypad read (one per VBlank, so one per
+ * frame), overriding the live buttons during playback. Playback can run
+ * fast-forward with drawing off to reach a recorded point quickly.
+ *
+ * File format (little-endian):
+ *   Header  "SNESMOVI", u32 version, u32 ROM size,
+ *           u32 ROM checksum (cartridge_calculate_checksum), u32 frame count
+ *   Frames  u16 joypad 1, u16 joypad 2 (BUTTON_* masks) per frame
+ */
+
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "types.h"
+#include "cartridge.h"
+#include "input.h"
+#include "emulator.h"
+
+#define MOVIE_MAGIC   "SNESMOVI"
+#define MOVIE_VERSION 1
+
+/* Movie modes */
+typedef enum {
+    MOVIE_IDLE = 0,       /* Detached or finished: live input */
+    MOVIE_RECORDING,      /* Append the buttons of each frame */
+    MOVIE_PLAYING         /* Replace the buttons of each frame */
+} MovieMode;
+
+/* Input movie */
+typedef struct Movie {
+    MovieMode mode;
+    u32 rom_size;         /* ROM the movie was recorded with */
+    u16 rom_checksum;
+    
+    u16 *frames;          /* Joypad 1 and 2 buttons per frame */
+    u32 frame_count;
+    u32 capacity;         /* Frames allocated */
+    u32 position;         /* Next frame to record or play */
+} Movie;
+
+/* Function declarations */
+
+/*
+ * Initialize an empty movie
+ */
+void movie_init(Movie *movie);
+
+/*
+ * Free movie frames
+ */
+void movie_free(Movie *movie);
+
+/*
+ * Start recording from the first frame of a ROM (discards any frames)
+ */
+void movie_record(Movie *movie, const Cartridge *cart);
+
+/*
+ * Start playback from the first frame
+ * Returns SUCCESS on success, ERROR if the movie was made with another ROM
+ */
+int movie_play(Movie *movie, const Cartridge *cart);
+
+/*
+ * Step one frame: record the buttons, or replace them when playing
+ * Called by input_auto_read. Playback ends (IDLE) after the last frame.
+ */
+void movie_step(Movie *movie, InputSystem *input);
+
+/*
+ * Check if playback has used every frame
+ */
+bool movie_finished(const Movie *movie);
+
+/*
+ * Run up to frames frames of a playing movie as fast as possible
+ * Nothing is drawn meanwhile. Returns the number of frames run.
+ */
+u32 movie_fast_forward(Movie *movie, Emulator *emu, u32 frames);
+
+/*
+ * Write a movie to a file
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int movie_write_file(const Movie *movie, const char *filename);
+
+/*
+ * Read a movie from a file
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int movie_read_file(Movie *movie, const char *filename);
+
+#endif /* MOVIE_H */
@@ -8,14 +8,13 @@
 #define PERFORMANCE_H
 
 #include "types.h"
-#include <time.h>
 
 /* Performance counter */
 typedef struct {
     const char *name;
     u64 call_count;
-    u64 total_cycles;
-    clock_t start_time;
+    u64 total_ns;         /* Time spent between start and stop */
+    u64 start_ns;         /* thread_time_ns() at the last start */
     bool is_running;
 } PerfCounter;
 
@@ -71,6 +70,12 @@ void perf_print_stats(void);
  */
 void perf_reset(void);
 
+/*
+ * Print the size and layout of the hot emulator structures
+ * (struct sizes and the offsets of their hot/cold sections in cache lines)
+ */
+void perf_print_struct_sizes(void);
+
 /* Convenience macros */
 #define PERF_SCOPE_START(name) \
     static int __perf_id_##name = -1; \
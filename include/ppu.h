@@ -21,6 +21,7 @@
 #define PPU_OBSEL    0x2101  /* Object Size and Base */
 #define PPU_OAMADDL  0x2102  /* OAM Address (low) */
 #define PPU_OAMADDH  0x2103  /* OAM Address (high) */
+#define PPU_OAMDATA  0x2104  /* OAM Data Write */
 #define PPU_BGMODE   0x2105  /* BG Mode and Character Size */
 #define PPU_BG1SC    0x2107  /* BG1 Tilemap Address */
 #define PPU_BG2SC    0x2108  /* BG2 Tilemap Address */
@@ -28,8 +29,85 @@
 #define PPU_BG4SC    0x210A  /* BG4 Tilemap Address */
 #define PPU_BG12NBA  0x210B  /* BG1 & BG2 Chr Address */
 #define PPU_BG34NBA  0x210C  /* BG3 & BG4 Chr Address */
+#define PPU_BG1HOFS  0x210D  /* BG1 Horizontal Scroll */
+#define PPU_BG4VOFS  0x2114  /* BG4 Vertical Scroll */
+#define PPU_VMAIN    0x2115  /* VRAM Address Increment Mode */
+#define PPU_VMADDL   0x2116  /* VRAM Address (low) */
+#define PPU_VMADDH   0x2117  /* VRAM Address (high) */
+#define PPU_VMDATAL  0x2118  /* VRAM Data Write (low) */
+#define PPU_VMDATAH  0x2119  /* VRAM Data Write (high) */
+#define PPU_M7SEL    0x211A  /* Mode 7 Settings */
 #define PPU_CGADD    0x2121  /* CGRAM Address */
 #define PPU_CGDATA   0x2122  /* CGRAM Data */
+#define PPU_W12SEL   0x2123  /* Window Mask Settings for BG1/BG2 */
+#define PPU_W34SEL   0x2124  /* Window Mask Settings for BG3/BG4 */
+#define PPU_WOBJSEL  0x2125  /* Window Mask Settings for OBJ/Color */
+#define PPU_WH0      0x2126  /* Window 1 Left Position */
+#define PPU_WH3      0x2129  /* Window 2 Right Position */
+#define PPU_WBGLOG   0x212A  /* Window Logic for BGs */
+#define PPU_WOBJLOG  0x212B  /* Window Logic for OBJ/Color */
+#define PPU_TM       0x212C  /* Main Screen Designation */
+#define PPU_TS       0x212D  /* Sub Screen Designation */
+#define PPU_TMW      0x212E  /* Main Screen Window Mask */
+#define PPU_TSW      0x212F  /* Sub Screen Window Mask */
+#define PPU_CGWSEL   0x2130  /* Color Math Control A */
+#define PPU_CGADSUB  0x2131  /* Color Math Control B */
+#define PPU_COLDATA  0x2132  /* Fixed Color Data */
+
+/*
+ * Layer line buffers
+ * Each BG layer and the OBJ layer renders one scanline of u16 entries:
+ * (z-key << 8) | CGRAM index, where the z-key is (rank << 3) | layer and
+ * rank orders the layer/priority pairs for the current BG mode. Entry 0 is
+ * transparent, so the visible pixel is simply the maximum entry.
+ */
+#define PPU_LAYER_OBJ      4   /* Layer number of sprites (BGs are 0-3) */
+#define PPU_LAYER_BACKDROP 5   /* Layer number of the backdrop */
+#define PPU_LAYER_COUNT    5   /* Line buffers (BG1-BG4, OBJ) */
+
+/* Compositor implementation (selected at ppu_init from CPU features) */
+typedef enum {
+    PPU_COMPOSE_SCALAR = 0,
+    PPU_COMPOSE_SSE2,
+    PPU_COMPOSE_AVX2
+} PPUComposePath;
+
+/*
+ * Decoded tile cache
+ * One cache per color depth (2, 4 and 8 bpp) holding every 8x8 tile of
+ * VRAM as 64 color indices. VRAM writes only set the dirty flag; a tile is
+ * re-decoded from its bitplanes the next time it is drawn.
+ */
+#define TILE_CACHE_DEPTHS 3   /* 2bpp, 4bpp, 8bpp (index = bpp >> 2) */
+
+typedef struct {
+    u8 *pixels;           /* tile_count x 64 decoded color indices */
+    u8 *dirty;            /* Per-tile flag: bitplanes changed since decode */
+    u16 tile_count;       /* Tiles in 64KB VRAM at this depth */
+    u8 bpp;               /* Bits per pixel */
+} TileCache;
+
+/*
+ * Sprite evaluation
+ * OAM is unpacked into oam_sprites and sorted into per-scanline lists once
+ * after it (or OBSEL) changes, applying the hardware limits of 32 sprites
+ * and 34 8-pixel tiles per line.
+ */
+#define PPU_OBJ_PER_LINE   32  /* Range limit: sprites per scanline */
+#define PPU_OBJ_TILES      34  /* Time limit: sprite tiles per scanline */
+#define PPU_OBJ_RANGE_OVER 0x40  /* STAT77 range over flag */
+#define PPU_OBJ_TIME_OVER  0x80  /* STAT77 time over flag */
+
+/* Which frames are drawn (timing, VBlank and NMI are unaffected) */
+typedef enum {
+    PPU_RENDER_ALWAYS = 0,    /* Draw every frame */
+    PPU_RENDER_EVERY_NTH,     /* Draw one frame in render_interval */
+    PPU_RENDER_ON_REQUEST,    /* Draw only frames requested with ppu_request_frame */
+    PPU_RENDER_NEVER          /* Never draw (headless) */
+} PPURenderPolicy;
+
+/* Render worker pool (defined in ppu.c) */
+typedef struct PPURenderPool PPURenderPool;
 
 /* Background layer structure */
 typedef struct {
@@ -44,18 +122,34 @@ typedef struct {
 
 /* Sprite/Object structure */
 typedef struct {
-    s16 x;                /* X position */
+    s16 x;                /* X position (-256 to 255) */
     u8 y;                 /* Y position */
-    u8 tile;              /* Tile number */
+    u16 tile;             /* Tile number (bit 8 selects the second name table) */
     u8 palette;           /* Palette (0-7) */
     u8 priority;          /* Priority (0-3) */
     bool h_flip;          /* Horizontal flip */
     bool v_flip;          /* Vertical flip */
     bool size;            /* Size (small/large) */
+    u8 width;             /* Width in pixels for the current OBSEL */
+    u8 height;            /* Height in pixels for the current OBSEL */
 } Sprite;
 
-/* PPU structure */
+/*
+ * PPU structure
+ * Fields are grouped by how often they are touched. The scanline renderers
+ * read the hot block (pointers, per-line register state, palette, sprite
+ * lists) for every pixel; register port latches and frame bookkeeping are
+ * touched once per write or line; the cold tail only on configuration
+ * changes. See the --sizes report for the resulting offsets.
+ */
 typedef struct {
+    /* Output and PPU memory */
+    u32 *framebuffer;     /* RGBA pixel data (256x224) */
+    u16 *layer_buffer[PPU_LAYER_COUNT];  /* Line buffers for BG1-BG4 and OBJ */
+    u8 *vram;             /* Pointer to VRAM (in Memory structure) */
+    u8 *cgram;            /* Pointer to CGRAM (palette) */
+    u8 *oam;              /* Pointer to OAM */
+    
     /* Timing */
     u16 vcount;           /* Vertical counter (scanline) */
     u16 hcount;           /* Horizontal counter */
@@ -66,18 +160,53 @@ typedef struct {
     u8 brightness;        /* Screen brightness (0-15) */
     bool forced_blank;    /* Forced blank (screen off) */
     u8 bg_mode;           /* Background mode (0-7) */
+    bool bg3_priority;    /* Mode 1 BG3 high priority in front (BGMODE bit 3) */
+    u8 compose_path;      /* PPUComposePath used for the priority merge and Mode 7 */
+    
+    /* Screen designation and windows */
+    u8 main_screen;       /* TM: layers on the main screen */
+    u8 sub_screen;        /* TS: layers on the sub screen */
+    u8 main_window;       /* TMW: windows applied on the main screen */
+    u8 sub_window;        /* TSW: windows applied on the sub screen */
+    u8 window_sel[3];     /* W12SEL, W34SEL, WOBJSEL */
+    u8 window_pos[4];     /* WH0-WH3 (window 1 left/right, window 2 left/right) */
+    u8 window_logic[2];   /* WBGLOG, WOBJLOG */
+    
+    /* Color math */
+    u8 cgwsel;            /* CGWSEL: clip/prevent regions, sub screen source */
+    u8 cgadsub;           /* CGADSUB: add/subtract, half, layer enables */
+    u16 fixed_color;      /* COLDATA as 15-bit BGR */
     
     /* Background layers */
     BGLayer bg[4];        /* BG1, BG2, BG3, BG4 */
     
-    /* Sprites/Objects */
-    Sprite oam_sprites[128];  /* 128 sprites in OAM */
-    u8 oam_priority[128];     /* Priority table */
+    /* Mode 7 state */
+    s16 m7_matrix_a;      /* Mode 7 matrix parameter A */
+    s16 m7_matrix_b;      /* Mode 7 matrix parameter B */
+    s16 m7_matrix_c;      /* Mode 7 matrix parameter C */
+    s16 m7_matrix_d;      /* Mode 7 matrix parameter D */
+    s16 m7_center_x;      /* Mode 7 center X */
+    s16 m7_center_y;      /* Mode 7 center Y */
+    u8 m7_repeat;         /* Mode 7 screen over (M7SEL bits 6-7: 0/1 wrap, 2 clear, 3 tile 0) */
+    bool m7_h_flip;       /* Mode 7 horizontal flip */
+    bool m7_v_flip;       /* Mode 7 vertical flip */
     
-    /* VRAM and palette */
-    u8 *vram;             /* Pointer to VRAM (in Memory structure) */
-    u8 *cgram;            /* Pointer to CGRAM (palette) */
-    u8 *oam;              /* Pointer to OAM */
+    /* Sprite settings */
+    u8 obj_size;              /* OBSEL size selection (0-7) */
+    u16 obj_name_base;        /* First sprite name table (VRAM byte address) */
+    u16 obj_name_gap;         /* Offset of the second name table (bytes) */
+    u8 obj_first;             /* Highest priority sprite (OAM priority rotation) */
+    bool obj_dirty;           /* OAM or OBSEL changed since the last evaluation */
+    u8 obj_status;            /* Range/time over flags of the last evaluation */
+    
+    /* Palette cache (kept in sync with CGRAM and brightness) */
+    u32 palette_lit[256]; /* CGRAM colors with master brightness applied */
+    
+    /* Decoded tiles and sprites */
+    TileCache tile_cache[TILE_CACHE_DEPTHS];  /* Decoded BG/OBJ tiles */
+    Sprite oam_sprites[128];  /* 128 sprites unpacked from OAM */
+    u8 obj_line_count[SCREEN_HEIGHT];                 /* Sprites on each line */
+    u8 obj_lines[SCREEN_HEIGHT][PPU_OBJ_PER_LINE];    /* Sprite numbers, priority order */
     
     /* CGRAM state */
     u16 cgram_addr;       /* CGRAM address pointer */
@@ -85,37 +214,45 @@ typedef struct {
     u8 cgram_buffer;      /* CGRAM buffer for writes */
     
     /* OAM state */
-    u16 oam_addr;         /* OAM address pointer */
-    u8 oam_buffer;        /* OAM buffer */
+    u16 oam_addr;         /* OAM address pointer (byte address) */
+    u16 oam_reload;       /* OAMADD word address */
+    bool oam_rotate;      /* OAMADDH bit 7: OAM priority rotation */
+    u8 oam_buffer;        /* OAM buffer (low table writes go in pairs) */
     
     /* VRAM state */
-    u16 vram_addr;        /* VRAM address pointer */
+    u16 vram_addr;        /* VRAM address pointer (word address) */
     u8 vram_increment;    /* VRAM address increment */
+    bool vram_inc_high;   /* Increment after high byte access (VMAIN bit 7) */
     
-    /* Mode 7 state */
-    s16 m7_matrix_a;      /* Mode 7 matrix parameter A */
-    s16 m7_matrix_b;      /* Mode 7 matrix parameter B */
-    s16 m7_matrix_c;      /* Mode 7 matrix parameter C */
-    s16 m7_matrix_d;      /* Mode 7 matrix parameter D */
-    s16 m7_center_x;      /* Mode 7 center X */
-    s16 m7_center_y;      /* Mode 7 center Y */
-    u8 m7_repeat;         /* Mode 7 repeat mode */
-    bool m7_h_flip;       /* Mode 7 horizontal flip */
-    bool m7_v_flip;       /* Mode 7 vertical flip */
+    /* Write latches */
+    u8 bg_scroll_latch;   /* Previous byte written to BGnHOFS/BGnVOFS */
     u8 m7_latch;          /* Mode 7 write latch */
     
-    /* Frame buffer */
-    u32 *framebuffer;     /* RGBA pixel data (256x224) */
-    u8 *layer_buffer[5];  /* Separate buffers for each layer + sprites */
-    
     /* Render flags */
     bool needs_render;    /* Frame needs rendering */
     u32 frame_count;      /* Frame counter */
+    u8 render_policy;     /* PPURenderPolicy */
+    u32 render_interval;  /* Frames per drawn frame (PPU_RENDER_EVERY_NTH) */
+    bool render_requested;  /* ppu_request_frame called for the next frame */
+    bool render_enabled;  /* Current frame is drawn */
+    
+    /* Unchanged line detection */
+    u32 mem_generation;   /* Bumped whenever VRAM/CGRAM/OAM contents change */
+    bool frame_changed;   /* A visible line was redrawn since the last VBlank */
+    bool frame_unchanged; /* Last completed frame is identical to the one before */
+    u64 line_hash[SCREEN_HEIGHT];  /* Inputs of each framebuffer line (0 = unknown) */
+    
+    /* Cold: rebuilt or used only on configuration changes */
+    u32 palette[256];     /* CGRAM colors converted to RGBA (before brightness) */
+    u8 oam_priority[128]; /* Priority table */
+    void *layer_block;    /* Allocation holding the cache-line aligned layer buffers */
+    PPURenderPool *render_pool;  /* Render worker threads (NULL = render inline) */
     
     /* ML Upscaling */
     Upscaler *upscaler;   /* ML upscaling context */
     bool upscaling_enabled; /* Enable ML upscaling */
     u32 *upscaled_buffer; /* Buffer for upscaled output */
+    bool upscaled_stale;  /* Framebuffer changed since upscaled_buffer was made */
 } PPU;
 
 /* Function declarations */
@@ -125,6 +262,11 @@ typedef struct {
  */
 void ppu_init(PPU *ppu);
 
+/*
+ * Free buffers allocated by ppu_init and ppu_enable_upscaling
+ */
+void ppu_cleanup(PPU *ppu);
+
 /*
  * Reset PPU to power-on state
  */
@@ -135,6 +277,20 @@ void ppu_reset(PPU *ppu);
  */
 void ppu_step_scanline(PPU *ppu);
 
+/*
+ * Select which frames are drawn; interval is used by PPU_RENDER_EVERY_NTH
+ * (frames whose frame_count is a multiple of it are drawn). Skipped frames
+ * keep all timing and leave the framebuffer and frame_unchanged as if
+ * nothing changed.
+ */
+void ppu_set_render_policy(PPU *ppu, PPURenderPolicy policy, u32 interval);
+
+/*
+ * Draw the next frame under PPU_RENDER_ON_REQUEST
+ * (the current one if it has only just started)
+ */
+void ppu_request_frame(PPU *ppu);
+
 /*
  * Check if in VBlank period
  */
@@ -155,38 +311,108 @@ void ppu_write_register(PPU *ppu, u16 address, u8 value);
  */
 u8 ppu_read_register(PPU *ppu, u16 address);
 
+/*
+ * DMA block write through VMDATA ($2118/$2119), CGDATA ($2122) or OAMDATA ($2104)
+ * reg is the B-bus register (BBADx), pattern the four register offsets of
+ * the transfer mode and phase the pattern position of data[0]. fixed repeats
+ * data[0] for every byte. Behaves like length register writes, but changed
+ * memory is invalidated once and linear VRAM uploads become a block copy.
+ * Returns the number of bytes written; 0 if the transfer does not target
+ * one of these ports (the caller writes the bytes one by one instead).
+ */
+u32 ppu_dma_write(PPU *ppu, u8 reg, const u8 *pattern, u32 phase,
+                  const u8 *data, u32 length, bool fixed);
+
 /*
  * Set memory pointers (VRAM, CGRAM, OAM)
  */
 void ppu_set_memory(PPU *ppu, u8 *vram, u8 *cgram, u8 *oam);
 
+/*
+ * Mark VRAM bytes [address, address + length) as modified
+ * Must be called by anything that writes VRAM behind the PPU's back
+ * (DMA, editors); writes through $2118/$2119 are tracked automatically.
+ */
+void ppu_invalidate_vram(PPU *ppu, u32 address, u32 length);
+
+/*
+ * Re-convert palette entries after CGRAM bytes [address, address + length)
+ * were modified directly; writes through $2122 are tracked automatically.
+ */
+void ppu_invalidate_cgram(PPU *ppu, u32 address, u32 length);
+
+/*
+ * Schedule sprite re-evaluation after OAM bytes [address, address + length)
+ * were modified directly; writes through $2104 are tracked automatically.
+ */
+void ppu_invalidate_oam(PPU *ppu, u32 address, u32 length);
+
+/*
+ * Rebuild oam_sprites and the per-scanline sprite lists from OAM
+ * (done automatically before sprites are drawn if OAM changed)
+ */
+void ppu_evaluate_sprites(PPU *ppu);
+
+/*
+ * Get a decoded 8x8 tile (64 color indices, row-major)
+ * bpp is 2, 4 or 8; the tile number wraps within VRAM.
+ */
+const u8 *ppu_get_tile(PPU *ppu, u8 bpp, u16 tile);
+
 /*
  * Render a single scanline
  */
 void ppu_render_scanline(PPU *ppu);
 
+/*
+ * Start render worker threads
+ * Visible scanlines are then recorded (register snapshot per line plus a
+ * log of VRAM/CGRAM/OAM writes) and drawn by the workers in parallel bands
+ * once VBlank starts. The finished frame replaces framebuffer at the next
+ * VBlank or at ppu_render_flush. count = 0 uses one thread per spare core.
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int ppu_start_render_threads(PPU *ppu, u32 count);
+
+/*
+ * Finish and publish any recorded frame, then stop the render threads
+ */
+void ppu_stop_render_threads(PPU *ppu);
+
+/*
+ * Wait for recorded frames to be drawn and publish the latest one
+ * (no-op without render threads)
+ */
+void ppu_render_flush(PPU *ppu);
+
 /*
  * Output frame to PPM file
  */
 void ppu_output_ppm(const PPU *ppu, const char *filename);
 
 /*
- * Get pixel color from palette
+ * Get displayed pixel color (brightness applied) from the palette cache
  */
 u32 ppu_get_color(const PPU *ppu, u8 palette_index);
 
 /*
- * Render background layer
+ * Resolve priority, windows and color math of the layer line buffers
+ * into the current framebuffer line
+ */
+void ppu_compose_scanline(PPU *ppu);
+
+/*
+ * Render background layer into its line buffer
  */
 void ppu_render_background(PPU *ppu, u8 layer);
 
 /*
- * Render sprites/objects
+ * Render sprites/objects into the OBJ line buffer
  */
 void ppu_render_sprites(PPU *ppu);
 
 /*
- * Render Mode 7 background
+ * Render Mode 7 background into the BG1 line buffer
  */
 void ppu_render_mode7(PPU *ppu);
 
@@ -202,8 +428,9 @@ void ppu_disable_upscaling(PPU *ppu);
 
 /*
  * Get upscaled framebuffer (if upscaling is enabled)
+ * The upscaler only runs again after the framebuffer changed.
  * Returns NULL if upscaling is disabled or not ready
  */
-const u32 *ppu_get_upscaled_framebuffer(const PPU *ppu, u16 *width, u16 *height);
+const u32 *ppu_get_upscaled_framebuffer(PPU *ppu, u16 *width, u16 *height);
 
 #endif /* PPU_H */
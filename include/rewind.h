@@ -0,0 +1,80 @@
+/*
+ * rewind.h - Rewind buffer
+ *
+ * Keeps a snapshot of every frame within a memory budget. Snapshots are
+ * raw save states; every keyframe_interval-th one is stored whole (LZ
+ * compressed) and the rest as the XOR against their keyframe, run-length
+ * encoded (and LZ compressed when that is smaller), so only the bytes that
+ * changed since the keyframe take space.
+ * Seeking decodes one keyframe and at most one delta. When the budget is
+ * exceeded the oldest keyframe is dropped together with its deltas.
+ */
+
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "types.h"
+#include "emulator.h"
+#include "savestate.h"
+
+/* One stored snapshot */
+typedef struct {
+    u8 *data;             /* LZ keyframe or RLE XOR delta */
+    u32 size;
+    u32 frame;            /* Emulator frame count when captured */
+    bool keyframe;
+    bool compressed;      /* Delta is LZ compressed on top */
+} RewindEntry;
+
+/* Rewind buffer */
+typedef struct {
+    RewindEntry *entries; /* Ring of snapshots, oldest at head */
+    u32 capacity;
+    u32 head;
+    u32 count;
+    u32 keyframes;        /* Keyframes in the ring */
+    
+    u32 budget;           /* Bytes allowed for snapshot data */
+    u32 used;             /* Bytes of snapshot data stored */
+    u32 keyframe_interval;  /* Snapshots per keyframe */
+    u32 since_keyframe;   /* Snapshots since the newest keyframe */
+    
+    SaveState state;      /* Raw snapshot being stored or restored */
+    u8 *key_raw;          /* Raw newest keyframe (deltas are against it) */
+    u8 *work;             /* Encoding and decoding buffers */
+    u32 raw_size;         /* Size of a raw snapshot */
+} RewindBuffer;
+
+/* Function declarations */
+
+/*
+ * Initialize an empty rewind buffer
+ * budget is the memory allowed for stored snapshots; a keyframe is stored
+ * every keyframe_interval snapshots (larger = smaller, slower to seek).
+ */
+void rewind_init(RewindBuffer *rw, u32 budget, u32 keyframe_interval);
+
+/*
+ * Free all snapshots and buffers
+ */
+void rewind_free(RewindBuffer *rw);
+
+/*
+ * Store a snapshot of the instance (call once per frame)
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int rewind_push(RewindBuffer *rw, Emulator *emu);
+
+/*
+ * Restore the snapshot frames_back before the newest (0 = newest)
+ * Newer snapshots are discarded, so pushing continues from there.
+ * Returns SUCCESS on success, ERROR if there is no such snapshot
+ */
+int rewind_seek(RewindBuffer *rw, Emulator *emu, u32 frames_back);
+
+/*
+ * Number of snapshots available to seek to
+ */
+u32 rewind_count(const RewindBuffer *rw);
+
+#endif /* REWIND_H */
@@ -0,0 +1,47 @@
+/*
+ * runahead.h - Run-ahead input latency reduction
+ *
+ * Each displayed frame is emulated twice over: the committed frame runs
+ * with the current input and without drawing, the machine is snapshotted,
+ * then frames more frames run ahead with the same input and only the last
+ * of them is drawn. The snapshot is restored afterwards, so the game's
+ * reaction to new input shows up frames earlier than it otherwise would.
+ * Audio is kept from the committed frame only. Snapshots leave out the
+ * framebuffer, and restoring keeps the PPU caches for unchanged video
+ * memory, so the rollback costs little next to the extra frames.
+ */
+
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include "types.h"
+#include "emulator.h"
+#include "savestate.h"
+
+/* Run-ahead state of one instance */
+typedef struct {
+    u32 frames;           /* Frames emulated ahead (0 = off) */
+    SaveState state;      /* Snapshot of the committed frame */
+    u64 snapshot_ns;      /* Save + restore time of the last frame */
+} RunAhead;
+
+/* Function declarations */
+
+/*
+ * Initialize run-ahead for a number of frames (0 = run frames normally)
+ */
+void runahead_init(RunAhead *ra, u32 frames);
+
+/*
+ * Free the snapshot buffers
+ */
+void runahead_free(RunAhead *ra);
+
+/*
+ * Run one displayed frame
+ * Not available while the APU runs on its own thread.
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int runahead_run_frame(RunAhead *ra, Emulator *emu);
+
+#endif /* RUNAHEAD_H */
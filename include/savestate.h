@@ -0,0 +1,83 @@
+/*
+ * savestate.h - Save states
+ *
+ * Snapshots the complete machine state of an emulator instance (CPU, bus
+ * and DMA, PPU, APU, input, pending events, SRAM and the last frame) into
+ * a memory buffer that can be restored into any instance running the same
+ * ROM, or written to a file.
+ *
+ * Format (little-endian):
+ *   Header  "SNESSTAT", u32 version, u32 flags, u32 ROM size,
+ *           u32 ROM header checksum, u32 chunk count
+ *   Chunks  char tag[4], u32 flags, u32 raw size, u32 stored size, data
+ * A chunk holds one component as it is laid out in memory, with the host
+ * fields (pointers, output buffers, render and sync settings) zeroed, so
+ * the raw size doubles as a layout check. Chunks may be LZ compressed.
+ * Unknown chunks are skipped.
+ */
+
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "types.h"
+#include "emulator.h"
+
+#define SAVESTATE_MAGIC    "SNESSTAT"
+#define SAVESTATE_VERSION  1
+
+/* Save flags */
+#define SAVESTATE_COMPRESS 0x0001  /* LZ compress the chunks */
+#define SAVESTATE_NO_FRAME 0x0002  /* Leave out the last frame (restoring keeps the current one) */
+
+/* Chunk flags */
+#define SAVESTATE_CHUNK_LZ 0x0001  /* Chunk data is LZ compressed */
+
+/* Save state buffer (reused between saves to avoid reallocation) */
+typedef struct {
+    u8 *data;             /* Encoded state */
+    u32 size;             /* Bytes used */
+    u32 capacity;         /* Bytes allocated */
+    u8 *scratch;          /* Decoded chunks while saving and loading */
+    u32 scratch_capacity;
+} SaveState;
+
+/* Function declarations */
+
+/*
+ * Initialize an empty save state buffer
+ */
+void savestate_init(SaveState *state);
+
+/*
+ * Free save state buffers
+ */
+void savestate_free(SaveState *state);
+
+/*
+ * Snapshot an instance (flags: SAVESTATE_*)
+ * Call between frames. Not available while the APU runs on its own
+ * thread. Returns SUCCESS on success, ERROR on failure
+ */
+int savestate_save(Emulator *emu, SaveState *state, u32 flags);
+
+/*
+ * Restore a snapshot into an instance running the same ROM
+ * The instance is left unchanged if the state is malformed or was made
+ * with a different ROM or structure layout.
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int savestate_load(Emulator *emu, SaveState *state);
+
+/*
+ * Write a snapshot to a file
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int savestate_write_file(const SaveState *state, const char *filename);
+
+/*
+ * Read a snapshot from a file
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int savestate_read_file(SaveState *state, const char *filename);
+
+#endif /* SAVESTATE_H */
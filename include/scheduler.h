@@ -0,0 +1,85 @@
+/*
+ * scheduler.h - Timestamped event scheduler
+ *
+ * Keeps the next due time of each periodic hardware event (scanline
+ * start, HBlank, VBlank/NMI, HDMA, APU sync, IRQ timer) in a min-heap so
+ * the CPU can run uninterrupted until the earliest one.
+ * Timestamps are in CPU cycles (the same units as CPU.cycles).
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "types.h"
+
+/* NTSC timing in CPU cycles */
+#define CYCLES_PER_SCANLINE  341    /* 1364 master clocks / 4 */
+#define CYCLES_PER_FRAME     89342  /* 262 scanlines */
+#define HBLANK_START_CYCLE   274    /* HBlank begins at dot 274 */
+#define VBLANK_START_LINE    225    /* First VBlank scanline */
+
+/* Never-due timestamp */
+#define SCHEDULER_NEVER 0xFFFFFFFFFFFFFFFFULL
+
+/*
+ * Event types
+ * Each type is pending at most once. Events due at the same timestamp are
+ * delivered in this order.
+ */
+typedef enum {
+    EVENT_SCANLINE = 0,   /* Start of a new scanline */
+    EVENT_VBLANK,         /* VBlank start (NMI, auto-joypad read) */
+    EVENT_IRQ_TIMER,      /* H/V timer IRQ */
+    EVENT_HBLANK,         /* HBlank start */
+    EVENT_HDMA,           /* HDMA transfers for the current line */
+    EVENT_APU_SYNC,       /* Let the APU catch up */
+    EVENT_COUNT
+} EventType;
+
+/* Pending event */
+typedef struct {
+    u64 time;             /* Due timestamp */
+    u8 type;              /* EventType */
+} ScheduledEvent;
+
+/* Scheduler state */
+typedef struct {
+    ScheduledEvent heap[EVENT_COUNT];  /* Min-heap ordered by (time, type) */
+    u8 count;                          /* Number of pending events */
+    s8 position[EVENT_COUNT];          /* Heap index per type (-1 = idle) */
+} Scheduler;
+
+/* Function declarations */
+
+/*
+ * Initialize scheduler with no pending events
+ */
+void scheduler_init(Scheduler *sched);
+
+/*
+ * Schedule (or reschedule) an event at the given timestamp
+ */
+void scheduler_schedule(Scheduler *sched, EventType type, u64 time);
+
+/*
+ * Remove a pending event
+ */
+void scheduler_cancel(Scheduler *sched, EventType type);
+
+/*
+ * Check whether an event type is pending
+ */
+bool scheduler_is_pending(const Scheduler *sched, EventType type);
+
+/*
+ * Timestamp of the earliest pending event (SCHEDULER_NEVER if none)
+ */
+u64 scheduler_next_time(const Scheduler *sched);
+
+/*
+ * Pop the earliest event if it is due at or before now
+ * Returns true and fills type/time when an event was popped
+ */
+bool scheduler_pop(Scheduler *sched, u64 now, EventType *type, u64 *time);
+
+#endif /* SCHEDULER_H */
@@ -0,0 +1,139 @@
+/*
+ * thread.h - Minimal threading and atomics portability layer
+ *
+ * Wraps pthreads (Linux) and Win32 threads behind one interface, plus the
+ * acquire/release atomics needed by the single-producer/single-consumer
+ * queues used between emulator threads.
+ */
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#include "types.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/* Thread entry point */
+typedef void (*ThreadFunc)(void *arg);
+
+/* Thread handle */
+typedef struct {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    ThreadFunc func;      /* Entry point */
+    void *arg;            /* Entry point argument */
+    bool running;         /* Thread was started and not yet joined */
+} Thread;
+
+/* Mutex */
+typedef struct {
+#ifdef _WIN32
+    CRITICAL_SECTION handle;
+#else
+    pthread_mutex_t handle;
+#endif
+} Mutex;
+
+/* Condition variable (used with a Mutex) */
+typedef struct {
+#ifdef _WIN32
+    CONDITION_VARIABLE handle;
+#else
+    pthread_cond_t handle;
+#endif
+} Cond;
+
+/*
+ * Start a thread running func(arg)
+ * Returns SUCCESS on success, ERROR on failure
+ */
+int thread_create(Thread *thread, ThreadFunc func, void *arg);
+
+/*
+ * Wait for a thread to finish
+ */
+void thread_join(Thread *thread);
+
+/*
+ * Give up the rest of the current time slice
+ */
+void thread_yield(void);
+
+/*
+ * Number of online CPU cores (at least 1)
+ */
+u32 thread_cpu_count(void);
+
+/*
+ * Monotonic wall-clock time in nanoseconds (for measuring intervals)
+ */
+u64 thread_time_ns(void);
+
+/*
+ * Mutex operations
+ */
+void mutex_init(Mutex *mutex);
+void mutex_destroy(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+
+/*
+ * Condition variable operations
+ * cond_wait releases the mutex while waiting and reacquires it on wakeup;
+ * callers must re-check their predicate in a loop.
+ */
+void cond_init(Cond *cond);
+void cond_destroy(Cond *cond);
+void cond_wait(Cond *cond, Mutex *mutex);
+void cond_signal(Cond *cond);
+void cond_broadcast(Cond *cond);
+
+/* Atomics (GCC/Clang builtins, also available in MinGW) */
+
+static inline u32 atomic_load_u32(const u32 *ptr) {
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void atomic_store_u32(u32 *ptr, u32 value) {
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+static inline u64 atomic_load_u64(const u64 *ptr) {
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void atomic_store_u64(u64 *ptr, u64 value) {
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+static inline bool atomic_load_bool(const bool *ptr) {
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void atomic_store_bool(bool *ptr, bool value) {
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+/* Full barrier: orders a store before a later load (sleep/wake handshakes) */
+static inline void atomic_fence(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/* Add/subtract and return the new value (reference counts) */
+static inline u32 atomic_increment_u32(u32 *ptr) {
+    return __atomic_add_fetch(ptr, 1, __ATOMIC_ACQ_REL);
+}
+
+static inline u32 atomic_decrement_u32(u32 *ptr) {
+    return __atomic_sub_fetch(ptr, 1, __ATOMIC_ACQ_REL);
+}
+
+#endif /* THREAD_H */
@@ -43,6 +43,12 @@ typedef uint8_t bool;
 #define LOROM_HEADER_OFFSET 0x7FC0
 #define HIROM_HEADER_OFFSET 0xFFC0
 
+/* Cache line size assumed when laying out hot structures */
+#define CACHE_LINE_SIZE 64
+
+/* Compile-time assertion (C99 has no static_assert) */
+#define STATIC_ASSERT(cond, name) typedef char static_assert_##name[(cond) ? 1 : -1]
+
 /* Return codes */
 #define SUCCESS  0
 #define ERROR   -1
@@ -27,9 +27,23 @@ void apu_init(APU *apu) {
         apu->dsp.voices[i].key_off = false;
     }
     
+    apu->sync_mode = APU_SYNC_LAZY;
+    
     apu_reset(apu);
 }
 
+void apu_cleanup(APU *apu) {
+    apu_stop_thread(apu);
+    
+    free(apu->audio_buffer);
+    apu->audio_buffer = NULL;
+    apu->buffer_size = 0;
+    apu->buffer_pos = 0;
+    
+    free(apu->dsp.sample_buffer);
+    apu->dsp.sample_buffer = NULL;
+}
+
 void apu_reset(APU *apu) {
     int i;
     
@@ -69,6 +83,10 @@ void apu_reset(APU *apu) {
     /* Reset audio buffer */
     apu->buffer_pos = 0;
     
+    /* Drop any cycles or samples owed from before the reset */
+    apu->cycle_budget = 0;
+    apu->sample_budget = 0;
+    
     apu->enabled = true;
 }
 
@@ -93,17 +111,285 @@ void apu_run(APU *apu, u32 cycles) {
     }
 }
 
+/* Run the SPC-700 and DSP up to a CPU timestamp (owner thread only) */
+static void apu_catch_up(APU *apu, u64 cpu_time) {
+    u64 elapsed;
+    u32 samples;
+    
+    if (cpu_time <= apu->sync_time) {
+        return;
+    }
+    
+    elapsed = cpu_time - apu->sync_time;
+    apu->sync_time = cpu_time;
+    
+    if (!apu->enabled) {
+        return;
+    }
+    
+    /* Run the SPC-700 without interruption for the elapsed time (at 1.024 MHz) */
+    apu->cycle_budget += (s64)(elapsed * APU_CLOCK_NUM);
+    while (apu->cycle_budget > 0 && !apu->cpu.stopped) {
+        apu->cycle_budget -= (s64)spc700_execute_instruction(apu) * APU_CLOCK_DEN;
+    }
+    if (apu->cpu.stopped && apu->cycle_budget > 0) {
+        apu->cycle_budget = 0;
+    }
+    
+    /* Generate samples for the elapsed time at the output rate */
+    apu->sample_budget += elapsed * APU_SAMPLE_RATE;
+    samples = (u32)(apu->sample_budget / APU_CPU_CLOCK);
+    apu->sample_budget -= (u64)samples * APU_CPU_CLOCK;
+    if (samples > 0) {
+        apu_generate_samples(apu, samples);
+    }
+}
+
+/* CPU cycles a sleeping worker may fall behind before a sync wakes it (8 lines) */
+#define APU_THREAD_WAKE_CYCLES 2728
+
+/*
+ * Wake the worker if it sleeps at least behind cycles behind the main
+ * thread (main thread, after publishing work)
+ */
+static void apu_thread_wake(ApuThreadState *ts, u64 behind) {
+    /* Pairs with the fence in apu_thread_wait: one side sees the other */
+    atomic_fence();
+    if (atomic_load_bool(&ts->sleeping) &&
+        ts->main_time - atomic_load_u64(&ts->wait_time) >= behind) {
+        mutex_lock(&ts->lock);
+        cond_signal(&ts->wake);
+        mutex_unlock(&ts->lock);
+    }
+}
+
+void apu_sync(APU *apu, u64 cpu_time) {
+    ApuThreadState *ts = apu->thread;
+    
+    if (ts) {
+        /* Threaded: just let the worker run further */
+        if (cpu_time > ts->main_time) {
+            ts->main_time = cpu_time;
+            atomic_store_u64(&ts->time_limit, cpu_time);
+            apu_thread_wake(ts, APU_THREAD_WAKE_CYCLES);
+        }
+        return;
+    }
+    
+    apu_catch_up(apu, cpu_time);
+}
+
+/*
+ * Threaded mode
+ */
+
+/* CPU cycles the worker runs between publishing port outputs */
+#define APU_THREAD_SLICE 64
+
+/* Apply queued port writes due by limit, then run up to limit */
+static void apu_thread_advance(APU *apu, ApuThreadState *ts, u64 limit) {
+    u32 head = atomic_load_u32(&ts->mailbox_head);
+    u32 tail = ts->mailbox_tail;
+    
+    while (tail != head) {
+        const ApuPortWrite *msg = &ts->mailbox[tail & (APU_MAILBOX_SIZE - 1)];
+        if (msg->time > limit) {
+            break;
+        }
+        apu_catch_up(apu, msg->time);
+        apu->port_in[msg->port] = msg->value;
+        tail++;
+        atomic_store_u32(&ts->mailbox_tail, tail);
+    }
+    
+    apu_catch_up(apu, limit);
+    atomic_store_u32(&ts->ports_out,
+                     apu->port_out[0] | (apu->port_out[1] << 8) |
+                     (apu->port_out[2] << 16) | ((u32)apu->port_out[3] << 24));
+}
+
+/* Worker has time or port writes to process */
+static bool apu_thread_has_work(const APU *apu, ApuThreadState *ts) {
+    return apu->sync_time < atomic_load_u64(&ts->time_limit) ||
+           atomic_load_u32(&ts->mailbox_head) != ts->mailbox_tail;
+}
+
+/* Block until the main thread publishes work or asks to stop */
+static void apu_thread_wait(APU *apu, ApuThreadState *ts) {
+    mutex_lock(&ts->lock);
+    atomic_store_u64(&ts->wait_time, apu->sync_time);
+    atomic_store_bool(&ts->sleeping, true);
+    atomic_fence();
+    while (!atomic_load_bool(&ts->stop) && !apu_thread_has_work(apu, ts)) {
+        cond_wait(&ts->wake, &ts->lock);
+    }
+    atomic_store_bool(&ts->sleeping, false);
+    mutex_unlock(&ts->lock);
+}
+
+static void apu_thread_main(void *arg) {
+    APU *apu = (APU *)arg;
+    ApuThreadState *ts = apu->thread;
+    
+    while (!atomic_load_bool(&ts->stop)) {
+        u64 limit = atomic_load_u64(&ts->time_limit);
+        
+        if (apu_thread_has_work(apu, ts)) {
+            u64 target = apu->sync_time + APU_THREAD_SLICE;
+            apu_thread_advance(apu, ts, target < limit ? target : limit);
+        } else {
+            apu_thread_wait(apu, ts);
+        }
+    }
+}
+
+int apu_start_thread(APU *apu, u64 cpu_time) {
+    ApuThreadState *ts;
+    
+    if (apu->thread) {
+        return SUCCESS;
+    }
+    
+    ts = (ApuThreadState *)calloc(1, sizeof(ApuThreadState));
+    if (!ts) {
+        return ERROR;
+    }
+    
+    /* Catch up on the caller first so both sides agree on the start time */
+    apu_catch_up(apu, cpu_time);
+    ts->main_time = apu->sync_time;
+    ts->time_limit = apu->sync_time;
+    ts->ports_out = apu->port_out[0] | (apu->port_out[1] << 8) |
+                    (apu->port_out[2] << 16) | ((u32)apu->port_out[3] << 24);
+    
+    mutex_init(&ts->lock);
+    cond_init(&ts->wake);
+    
+    apu->thread = ts;
+    if (thread_create(&ts->thread, apu_thread_main, apu) != SUCCESS) {
+        apu->thread = NULL;
+        cond_destroy(&ts->wake);
+        mutex_destroy(&ts->lock);
+        free(ts);
+        return ERROR;
+    }
+    
+    apu->sync_mode = APU_SYNC_THREADED;
+    return SUCCESS;
+}
+
+void apu_stop_thread(APU *apu) {
+    ApuThreadState *ts = apu->thread;
+    
+    if (!ts) {
+        return;
+    }
+    
+    atomic_store_bool(&ts->stop, true);
+    apu_thread_wake(ts, 0);
+    thread_join(&ts->thread);
+    cond_destroy(&ts->wake);
+    mutex_destroy(&ts->lock);
+    
+    /* Finish queued writes and the remaining time on this thread */
+    apu_thread_advance(apu, ts, ts->main_time);
+    apu_drain_audio(apu);
+    
+    if (ts->audio_dropped > 0) {
+        fprintf(stderr, "APU: %u audio samples dropped (ring full)\n",
+                ts->audio_dropped);
+    }
+    
+    apu->thread = NULL;
+    apu->sync_mode = APU_SYNC_LAZY;
+    free(ts);
+}
+
+void apu_drain_audio(APU *apu) {
+    ApuThreadState *ts = apu->thread;
+    u32 head, tail;
+    
+    if (!ts) {
+        return;
+    }
+    
+    head = atomic_load_u32(&ts->audio_head);
+    tail = ts->audio_tail;
+    
+    while (tail != head && apu->buffer_pos < apu->buffer_size) {
+        apu->audio_buffer[apu->buffer_pos++] =
+            ts->audio_ring[tail & (APU_AUDIO_RING_SIZE - 1)];
+        tail++;
+    }
+    
+    /* Discard what no longer fits so the worker never stalls */
+    atomic_store_u32(&ts->audio_tail, head);
+}
+
+/* Store one stereo sample in the ring (threaded) or audio_buffer */
+static void apu_output_sample(APU *apu, s16 left, s16 right) {
+    ApuThreadState *ts = apu->thread;
+    
+    if (ts) {
+        u32 head = ts->audio_head;
+        u32 tail = atomic_load_u32(&ts->audio_tail);
+        
+        if (head - tail > APU_AUDIO_RING_SIZE - 2) {
+            ts->audio_dropped += 2;
+            return;
+        }
+        ts->audio_ring[head & (APU_AUDIO_RING_SIZE - 1)] = left;
+        ts->audio_ring[(head + 1) & (APU_AUDIO_RING_SIZE - 1)] = right;
+        atomic_store_u32(&ts->audio_head, head + 2);
+        return;
+    }
+    
+    if (apu->buffer_pos + 2 <= apu->buffer_size) {
+        apu->audio_buffer[apu->buffer_pos++] = left;
+        apu->audio_buffer[apu->buffer_pos++] = right;
+    }
+}
+
 void apu_write_port(APU *apu, u8 port, u8 value) {
-    if (port < 4) {
-        apu->port_in[port] = value;
+    ApuThreadState *ts = apu->thread;
+    
+    if (port >= 4) {
+        return;
+    }
+    
+    if (ts) {
+        /* Queue the write for the worker, waiting if the mailbox is full */
+        u32 head = ts->mailbox_head;
+        ApuPortWrite *msg;
+        
+        while (head - atomic_load_u32(&ts->mailbox_tail) >= APU_MAILBOX_SIZE) {
+            atomic_store_u64(&ts->time_limit, ts->main_time);
+            apu_thread_wake(ts, 0);
+            thread_yield();
+        }
+        
+        msg = &ts->mailbox[head & (APU_MAILBOX_SIZE - 1)];
+        msg->time = ts->main_time;
+        msg->port = port;
+        msg->value = value;
+        atomic_store_u32(&ts->mailbox_head, head + 1);
+        apu_thread_wake(ts, 0);
+        return;
     }
+    
+    apu->port_in[port] = value;
 }
 
 u8 apu_read_port(APU *apu, u8 port) {
-    if (port < 4) {
-        return apu->port_out[port];
+    if (port >= 4) {
+        return 0;
+    }
+    
+    if (apu->thread) {
+        return (atomic_load_u32(&apu->thread->ports_out) >> (port * 8)) & 0xFF;
     }
-    return 0;
+    
+    return apu->port_out[port];
 }
 
 u8 apu_read_ram(const APU *apu, u16 address) {
@@ -198,7 +484,7 @@ void apu_generate_samples(APU *apu, u32 num_samples) {
     u32 i, v;
     s32 sample_left, sample_right;
     
-    for (i = 0; i < num_samples && apu->buffer_pos < apu->buffer_size; i++) {
+    for (i = 0; i < num_samples; i++) {
         sample_left = 0;
         sample_right = 0;
         
@@ -216,8 +502,6 @@ void apu_generate_samples(APU *apu, u32 num_samples) {
                     if (voice->sample_address < SPC_RAM_SIZE - 9) {
                         /* Decode next BRR block (9 bytes: 1 header + 8 data) */
                         u8 brr_block[9];
-                        static s16 old_samples[DSP_NUM_VOICES] = {0};
-                        static s16 older_samples[DSP_NUM_VOICES] = {0};
                         
                         /* Read BRR block from APU RAM */
                         for (int j = 0; j < 9; j++) {
@@ -226,7 +510,7 @@ void apu_generate_samples(APU *apu, u32 num_samples) {
                         
                         /* Decode BRR block into sample buffer */
                         brr_decode_block(brr_block, voice->sample_buffer, 
-                                       &old_samples[v], &older_samples[v]);
+                                       &voice->brr_old, &voice->brr_older);
                         
                         /* Check for end/loop flags in BRR header */
                         if (brr_block[0] & 0x01) {  /* End flag */
@@ -269,8 +553,7 @@ void apu_generate_samples(APU *apu, u32 num_samples) {
         if (sample_right < -32768) sample_right = -32768;
         
         /* Store stereo sample */
-        apu->audio_buffer[apu->buffer_pos++] = (s16)sample_left;
-        apu->audio_buffer[apu->buffer_pos++] = (s16)sample_right;
+        apu_output_sample(apu, (s16)sample_left, (s16)sample_right);
     }
     
     apu->dsp.sample_count += num_samples;
@@ -435,10 +718,19 @@ void brr_decode_block(const u8 *brr_block, s16 *samples, s16 *old, s16 *older) {
 
 /* SPC-700 helper functions */
 static u8 spc700_read_byte(APU *apu, u16 addr) {
+    /* $F4-$F7: communication ports written by the main CPU */
+    if (addr >= 0x00F4 && addr <= 0x00F7) {
+        return apu->port_in[addr - 0x00F4];
+    }
     return apu->ram[addr];
 }
 
 static void spc700_write_byte(APU *apu, u16 addr, u8 value) {
+    /* $F4-$F7: communication ports read by the main CPU */
+    if (addr >= 0x00F4 && addr <= 0x00F7) {
+        apu->port_out[addr - 0x00F4] = value;
+        return;
+    }
     apu->ram[addr] = value;
 }
 
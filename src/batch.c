@@ -0,0 +1,416 @@
+/*
+ * batch.c - Parallel batch runner implementation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "../include/batch.h"
+#include "../include/emulator.h"
+#include "../include/thread.h"
+
+/* Run queue of one worker (own end: tail, thieves take from head) */
+typedef struct {
+    u32 *items;             /* Job indices */
+    u32 head;
+    u32 tail;
+    Mutex lock;
+} BatchQueue;
+
+typedef struct BatchPool BatchPool;
+
+/* Worker thread with its own reusable emulator instance */
+typedef struct {
+    Thread thread;
+    BatchQueue queue;
+    Emulator *emu;
+    BatchPool *pool;
+    u32 index;
+} BatchWorker;
+
+struct BatchPool {
+    Batch *batch;
+    RomImage **images;      /* Shared ROM image of each job (NULL = failed) */
+    BatchWorker *workers;
+    u32 worker_count;
+};
+
+/* FNV-1a over a block of memory */
+static u64 batch_hash(const void *data, size_t size) {
+    const u8 *bytes = (const u8 *)data;
+    u64 hash = 0xCBF29CE484222325ULL;
+    size_t i;
+    
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+void batch_init(Batch *batch) {
+    memset(batch, 0, sizeof(Batch));
+}
+
+void batch_cleanup(Batch *batch) {
+    free(batch->jobs);
+    memset(batch, 0, sizeof(Batch));
+}
+
+int batch_add(Batch *batch, const char *rom_path, u32 frames, u32 count) {
+    u32 i;
+    
+    if (!rom_path || strlen(rom_path) >= sizeof(batch->jobs[0].rom_path)) {
+        return ERROR;
+    }
+    
+    if (batch->job_count + count > batch->job_capacity) {
+        u32 capacity = batch->job_capacity ? batch->job_capacity : 16;
+        BatchJob *jobs;
+        
+        while (capacity < batch->job_count + count) {
+            capacity *= 2;
+        }
+        jobs = (BatchJob *)realloc(batch->jobs, capacity * sizeof(BatchJob));
+        if (!jobs) {
+            return ERROR;
+        }
+        batch->jobs = jobs;
+        batch->job_capacity = capacity;
+    }
+    
+    for (i = 0; i < count; i++) {
+        BatchJob *job = &batch->jobs[batch->job_count++];
+        
+        memset(job, 0, sizeof(BatchJob));
+        strcpy(job->rom_path, rom_path);
+        job->frames = frames;
+        job->status = ERROR;
+    }
+    return SUCCESS;
+}
+
+int batch_load_list(Batch *batch, const char *filename, u32 frames) {
+    char line[512];
+    FILE *file = fopen(filename, "r");
+    int result = SUCCESS;
+    
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open batch list '%s'\n", filename);
+        return ERROR;
+    }
+    
+    while (result == SUCCESS && fgets(line, sizeof(line), file)) {
+        char *path = line;
+        char *end;
+        long count = 1;
+        
+        while (isspace((unsigned char)*path)) {
+            path++;
+        }
+        if (*path == '\0' || *path == '#') {
+            continue;
+        }
+        
+        /* Split off an optional run count after the path */
+        end = path + strlen(path);
+        while (end > path && isspace((unsigned char)end[-1])) {
+            *--end = '\0';
+        }
+        while (end > path && isdigit((unsigned char)end[-1])) {
+            end--;
+        }
+        if (end > path && *end != '\0' && isspace((unsigned char)end[-1])) {
+            count = strtol(end, NULL, 10);
+            while (end > path && isspace((unsigned char)end[-1])) {
+                *--end = '\0';
+            }
+        }
+        
+        if (count <= 0 || batch_add(batch, path, frames, (u32)count) != SUCCESS) {
+            fprintf(stderr, "Error: Invalid batch entry '%s'\n", path);
+            result = ERROR;
+        }
+    }
+    
+    fclose(file);
+    return result;
+}
+
+/* Take a job from the worker's own queue */
+static bool batch_queue_pop(BatchQueue *queue, u32 *job) {
+    bool found;
+    
+    mutex_lock(&queue->lock);
+    found = queue->tail > queue->head;
+    if (found) {
+        *job = queue->items[--queue->tail];
+    }
+    mutex_unlock(&queue->lock);
+    return found;
+}
+
+/* Take a job from the other end of another worker's queue */
+static bool batch_queue_steal(BatchQueue *queue, u32 *job) {
+    bool found;
+    
+    mutex_lock(&queue->lock);
+    found = queue->tail > queue->head;
+    if (found) {
+        *job = queue->items[queue->head++];
+    }
+    mutex_unlock(&queue->lock);
+    return found;
+}
+
+static void batch_run_job(BatchWorker *worker, u32 index) {
+    BatchJob *job = &worker->pool->batch->jobs[index];
+    RomImage *image = worker->pool->images[index];
+    Emulator *emu = worker->emu;
+    u64 start;
+    u32 frame;
+    
+    job->worker = worker->index;
+    if (!image || emulator_init(emu, image) != SUCCESS) {
+        job->status = ERROR;
+        return;
+    }
+    
+    /* Only the frame that is hashed is drawn */
+    ppu_set_render_policy(&emu->ppu, PPU_RENDER_ON_REQUEST, 1);
+    
+    start = thread_time_ns();
+    for (frame = 0; frame < job->frames; frame++) {
+        if (frame + 1 == job->frames) {
+            ppu_request_frame(&emu->ppu);
+        }
+        emulator_run_frame(emu);
+    }
+    job->elapsed_ns = thread_time_ns() - start;
+    
+    job->cpu_cycles = emu->cpu.cycles;
+    job->cpu_stopped = emu->cpu.stopped;
+    job->framebuffer_hash = batch_hash(emulator_present(emu),
+                                       SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(u32));
+    job->wram_hash = batch_hash(emu->memory.wram, sizeof(emu->memory.wram));
+    job->status = SUCCESS;
+    
+    emulator_cleanup(emu);
+}
+
+static void batch_worker_main(void *arg) {
+    BatchWorker *worker = (BatchWorker *)arg;
+    BatchPool *pool = worker->pool;
+    u32 job;
+    u32 i;
+    
+    for (;;) {
+        bool found = batch_queue_pop(&worker->queue, &job);
+        
+        /* Own queue empty: steal, starting with the next worker */
+        for (i = 1; !found && i < pool->worker_count; i++) {
+            BatchWorker *victim = &pool->workers[(worker->index + i) % pool->worker_count];
+            found = batch_queue_steal(&victim->queue, &job);
+        }
+        
+        /* No job is added after the start, so empty queues mean done */
+        if (!found) {
+            break;
+        }
+        batch_run_job(worker, job);
+    }
+}
+
+/* Load each distinct ROM once; runs of the same ROM share the image */
+static void batch_load_images(Batch *batch, RomImage **images) {
+    u32 i;
+    u32 j;
+    
+    for (i = 0; i < batch->job_count; i++) {
+        for (j = 0; j < i; j++) {
+            if (strcmp(batch->jobs[j].rom_path, batch->jobs[i].rom_path) == 0) {
+                break;
+            }
+        }
+        if (j < i) {
+            images[i] = images[j] ? rom_image_retain(images[j]) : NULL;
+        } else {
+            images[i] = rom_image_load(batch->jobs[i].rom_path);
+            if (!images[i]) {
+                fprintf(stderr, "Error: Cannot load ROM '%s'\n", batch->jobs[i].rom_path);
+            }
+        }
+    }
+}
+
+int batch_run(Batch *batch, u32 threads) {
+    BatchPool pool;
+    u32 started = 0;
+    u32 first = 0;
+    u64 start;
+    u32 i;
+    int result = SUCCESS;
+    
+    if (threads == 0) {
+        threads = thread_cpu_count();
+    }
+    if (threads > batch->job_count) {
+        threads = batch->job_count > 0 ? batch->job_count : 1;
+    }
+    
+    memset(&pool, 0, sizeof(pool));
+    pool.batch = batch;
+    pool.worker_count = threads;
+    pool.images = (RomImage **)calloc(batch->job_count + 1, sizeof(RomImage *));
+    pool.workers = (BatchWorker *)calloc(threads, sizeof(BatchWorker));
+    if (!pool.images || !pool.workers) {
+        free(pool.images);
+        free(pool.workers);
+        return ERROR;
+    }
+    
+    start = thread_time_ns();
+    batch_load_images(batch, pool.images);
+    
+    /* Contiguous slices, so a worker's own runs tend to share a ROM */
+    for (i = 0; i < threads; i++) {
+        BatchWorker *worker = &pool.workers[i];
+        u32 last = (u32)((u64)batch->job_count * (i + 1) / threads);
+        u32 j;
+        
+        worker->pool = &pool;
+        worker->index = i;
+        worker->emu = (Emulator *)malloc(sizeof(Emulator));
+        worker->queue.items = (u32 *)malloc((last - first + 1) * sizeof(u32));
+        mutex_init(&worker->queue.lock);
+        if (!worker->emu || !worker->queue.items) {
+            result = ERROR;
+        }
+        
+        /* Pop takes from the tail: store the slice reversed to run it in order */
+        for (j = first; j < last && worker->queue.items; j++) {
+            worker->queue.items[last - 1 - j] = j;
+        }
+        worker->queue.tail = worker->queue.items ? last - first : 0;
+        first = last;
+    }
+    
+    if (result == SUCCESS) {
+        /* Worker 0 runs on the calling thread */
+        for (i = 1; i < threads; i++) {
+            if (thread_create(&pool.workers[i].thread, batch_worker_main,
+                              &pool.workers[i]) != SUCCESS) {
+                break;
+            }
+            started++;
+        }
+        batch_worker_main(&pool.workers[0]);
+        for (i = 1; i <= started; i++) {
+            thread_join(&pool.workers[i].thread);
+        }
+    }
+    
+    batch->thread_count = started + 1;
+    batch->elapsed_ns = thread_time_ns() - start;
+    
+    for (i = 0; i < threads; i++) {
+        mutex_destroy(&pool.workers[i].queue.lock);
+        free(pool.workers[i].queue.items);
+        free(pool.workers[i].emu);
+    }
+    for (i = 0; i < batch->job_count; i++) {
+        rom_image_release(pool.images[i]);
+        if (batch->jobs[i].status != SUCCESS) {
+            result = ERROR;
+        }
+    }
+    free(pool.images);
+    free(pool.workers);
+    return result;
+}
+
+/* Write a string as a JSON literal */
+static void batch_write_json_string(FILE *file, const char *text) {
+    fputc('"', file);
+    for (; *text; text++) {
+        if (*text == '"' || *text == '\\') {
+            fputc('\\', file);
+            fputc(*text, file);
+        } else if ((unsigned char)*text < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char)*text);
+        } else {
+            fputc(*text, file);
+        }
+    }
+    fputc('"', file);
+}
+
+int batch_write_report(const Batch *batch, const char *filename) {
+    size_t length = strlen(filename);
+    bool json = length >= 5 && strcmp(filename + length - 5, ".json") == 0;
+    FILE *file = fopen(filename, "w");
+    u32 i;
+    
+    if (!file) {
+        fprintf(stderr, "Error: Cannot create report '%s'\n", filename);
+        return ERROR;
+    }
+    
+    if (json) {
+        fprintf(file, "{\n  \"threads\": %u,\n  \"seconds\": %.6f,\n  \"runs\": [\n",
+                batch->thread_count, batch->elapsed_ns / 1e9);
+    } else {
+        fprintf(file, "rom,frames,status,cpu_cycles,cpu_stopped,framebuffer_hash,wram_hash,seconds,fps,worker\n");
+    }
+    
+    for (i = 0; i < batch->job_count; i++) {
+        const BatchJob *job = &batch->jobs[i];
+        double seconds = job->elapsed_ns / 1e9;
+        double fps = seconds > 0.0 ? job->frames / seconds : 0.0;
+        
+        if (json) {
+            fprintf(file, "    {\"rom\": ");
+            batch_write_json_string(file, job->rom_path);
+            fprintf(file, ", \"frames\": %u, \"status\": \"%s\", \"cpu_cycles\": %llu, "
+                    "\"cpu_stopped\": %s, "
+                    "\"framebuffer_hash\": \"%016llx\", \"wram_hash\": \"%016llx\", "
+                    "\"seconds\": %.6f, \"fps\": %.1f, \"worker\": %u}%s\n",
+                    job->frames, job->status == SUCCESS ? "ok" : "error",
+                    (unsigned long long)job->cpu_cycles,
+                    job->cpu_stopped ? "true" : "false",
+                    (unsigned long long)job->framebuffer_hash,
+                    (unsigned long long)job->wram_hash,
+                    seconds, fps, job->worker,
+                    i + 1 < batch->job_count ? "," : "");
+        } else {
+            /* Quote the path only if it needs it */
+            if (strpbrk(job->rom_path, ",\"\n")) {
+                const char *c;
+                fputc('"', file);
+                for (c = job->rom_path; *c; c++) {
+                    if (*c == '"') {
+                        fputc('"', file);
+                    }
+                    fputc(*c, file);
+                }
+                fputc('"', file);
+            } else {
+                fputs(job->rom_path, file);
+            }
+            fprintf(file, ",%u,%s,%llu,%u,%016llx,%016llx,%.6f,%.1f,%u\n",
+                    job->frames, job->status == SUCCESS ? "ok" : "error",
+                    (unsigned long long)job->cpu_cycles,
+                    job->cpu_stopped ? 1 : 0,
+                    (unsigned long long)job->framebuffer_hash,
+                    (unsigned long long)job->wram_hash,
+                    seconds, fps, job->worker);
+        }
+    }
+    
+    if (json) {
+        fprintf(file, "  ]\n}\n");
+    }
+    
+    fclose(file);
+    return SUCCESS;
+}
@@ -2,6 +2,15 @@
  * cartridge.c - ROM cartridge loading and management implementation
  */
 
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CARTRIDGE_MMAP 1
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,6 +19,9 @@
 /* SMC header size (some ROMs have a 512-byte copier header) */
 #define SMC_HEADER_SIZE 512
 
+/* Span probed for the LoROM/HiROM headers ($7FC0 and $FFC0) */
+#define HEADER_PROBE_SIZE 0x10000
+
 /* Region names for display */
 static const char *region_names[] = {
     "Japan", "North America", "Europe", "Scandinavia",
@@ -18,17 +30,67 @@ static const char *region_names[] = {
     "Unknown", "Korean"
 };
 
-int cartridge_load(Cartridge *cart, const char *filename) {
+#ifdef CARTRIDGE_MMAP
+/*
+ * Map the ROM file copy-on-write
+ * Returns SUCCESS with rom_data/rom_size set, or ERROR (nothing to clean
+ * up) if the file cannot be mapped and has to be read instead.
+ * Pages not yet edited still read through to the file, so the file must
+ * not be rewritten in place while it is mapped (truncating it makes
+ * accesses fault); cartridge_save_rom replaces it instead.
+ */
+static int cartridge_map(Cartridge *cart, const char *filename) {
+    struct stat st;
+    size_t offset;
+    void *map;
+    int fd;
+    
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return ERROR;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 0x8000) {
+        close(fd);
+        return ERROR;
+    }
+    
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return ERROR;
+    }
+    
+    /* Skip SMC header if present */
+    offset = ((st.st_size % 1024) == 512) ? SMC_HEADER_SIZE : 0;
+    
+    cart->rom_map = (u8 *)map;
+    cart->rom_map_size = (size_t)st.st_size;
+    cart->rom_fd = fd;
+    cart->rom_data = cart->rom_map + offset;
+    cart->rom_size = (u32)(st.st_size - offset);
+    return SUCCESS;
+}
+
+static void cartridge_unmap(Cartridge *cart) {
+    if (cart->backup_mapped && cart->rom_backup) {
+        munmap(cart->rom_backup - (cart->rom_data - cart->rom_map), cart->rom_map_size);
+    }
+    munmap(cart->rom_map, cart->rom_map_size);
+    close(cart->rom_fd);
+    cart->rom_map = NULL;
+    cart->rom_map_size = 0;
+    cart->rom_fd = -1;
+}
+#endif
+
+/* Read the whole ROM file into a heap buffer */
+static int cartridge_read_file(Cartridge *cart, const char *filename) {
     FILE *file;
     long file_size;
     size_t bytes_read;
     u8 *data;
     bool has_smc_header = false;
     
-    /* Initialize cartridge structure */
-    memset(cart, 0, sizeof(Cartridge));
-    strncpy(cart->filename, filename, sizeof(cart->filename) - 1);
-    
     /* Open ROM file */
     file = fopen(filename, "rb");
     if (!file) {
@@ -78,12 +140,41 @@ int cartridge_load(Cartridge *cart, const char *filename) {
     
     cart->rom_data = data;
     cart->rom_size = file_size;
+    return SUCCESS;
+}
+
+int cartridge_load(Cartridge *cart, const char *filename) {
+    int result = ERROR;
+    
+    /* Initialize cartridge structure */
+    memset(cart, 0, sizeof(Cartridge));
+    strncpy(cart->filename, filename, sizeof(cart->filename) - 1);
+    cart->rom_fd = -1;
+    
+#ifdef CARTRIDGE_MMAP
+    result = cartridge_map(cart, filename);
+    if (result == SUCCESS) {
+        /* Both header candidates are read front to back right away */
+        posix_madvise(cart->rom_map, cart->rom_map_size < HEADER_PROBE_SIZE ?
+                      cart->rom_map_size : HEADER_PROBE_SIZE, POSIX_MADV_SEQUENTIAL);
+    }
+#endif
+    if (result != SUCCESS && cartridge_read_file(cart, filename) != SUCCESS) {
+        return ERROR;
+    }
     
     /* Parse ROM header */
     if (cartridge_parse_header(cart) != SUCCESS) {
         fprintf(stderr, "Warning: ROM header parsing failed, attempting to continue...\n");
     }
     
+#ifdef CARTRIDGE_MMAP
+    /* Emulation jumps around the ROM: back to default readahead */
+    if (cart->rom_map) {
+        posix_madvise(cart->rom_map, cart->rom_map_size, POSIX_MADV_NORMAL);
+    }
+#endif
+    
     /* Allocate SRAM if present */
     if (cart->has_sram && cart->sram_size > 0) {
         cart->sram_data = (u8 *)calloc(cart->sram_size, 1);
@@ -97,6 +188,15 @@ int cartridge_load(Cartridge *cart, const char *filename) {
 }
 
 void cartridge_unload(Cartridge *cart) {
+#ifdef CARTRIDGE_MMAP
+    if (cart->rom_map) {
+        cartridge_unmap(cart);
+        cart->rom_data = NULL;
+        cart->rom_backup = NULL;
+        cart->backup_mapped = false;
+    }
+#endif
+    
     if (cart->rom_data) {
         free(cart->rom_data);
         cart->rom_data = NULL;
@@ -288,6 +388,7 @@ u16 cartridge_calculate_checksum(const Cartridge *cart) {
 void cartridge_write_rom(Cartridge *cart, u32 address, u8 value) {
     if (address < cart->rom_size) {
         cart->rom_data[address] = value;
+        cart->rom_generation++;
     }
 }
 
@@ -316,10 +417,12 @@ void cartridge_update_checksum(Cartridge *cart) {
         /* Update header structure */
         cart->header.checksum = new_checksum;
         cart->header.checksum_complement = new_complement;
+        cart->rom_generation++;
     }
 }
 
 int cartridge_save_rom(const Cartridge *cart, const char *filename) {
+    char temp_name[sizeof(cart->filename) + 8];
     FILE *file;
     size_t bytes_written;
     
@@ -327,15 +430,30 @@ int cartridge_save_rom(const Cartridge *cart, const char *filename) {
         return ERROR;
     }
     
-    file = fopen(filename, "wb");
+    /*
+     * Write a new file and move it into place: filename may be the ROM
+     * this cartridge is mapped from, which must not be truncated
+     */
+    if (snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename) >= (int)sizeof(temp_name)) {
+        return ERROR;
+    }
+    file = fopen(temp_name, "wb");
     if (!file) {
         return ERROR;
     }
     
     bytes_written = fwrite(cart->rom_data, 1, cart->rom_size, file);
-    fclose(file);
+    if (fclose(file) != 0 || bytes_written != cart->rom_size) {
+        remove(temp_name);
+        return ERROR;
+    }
     
-    if (bytes_written != cart->rom_size) {
+#ifdef _WIN32
+    /* rename() does not replace an existing file here */
+    remove(filename);
+#endif
+    if (rename(temp_name, filename) != 0) {
+        remove(temp_name);
         return ERROR;
     }
     
@@ -349,10 +467,30 @@ int cartridge_backup_rom(Cartridge *cart) {
     
     /* Free existing backup if present */
     if (cart->rom_backup) {
+#ifdef CARTRIDGE_MMAP
+        if (cart->backup_mapped) {
+            munmap(cart->rom_backup - (cart->rom_data - cart->rom_map), cart->rom_map_size);
+        } else
+#endif
         free(cart->rom_backup);
         cart->rom_backup = NULL;
+        cart->backup_mapped = false;
     }
     
+#ifdef CARTRIDGE_MMAP
+    /* Unmodified mapped ROM: the file itself is the backup */
+    if (cart->rom_map && cart->rom_generation == 0) {
+        void *map = mmap(NULL, cart->rom_map_size, PROT_READ, MAP_PRIVATE, cart->rom_fd, 0);
+        
+        if (map != MAP_FAILED) {
+            cart->rom_backup = (u8 *)map + (cart->rom_data - cart->rom_map);
+            cart->backup_mapped = true;
+            cart->has_backup = true;
+            return SUCCESS;
+        }
+    }
+#endif
+    
     /* Allocate and copy ROM data */
     cart->rom_backup = (u8 *)malloc(cart->rom_size);
     if (!cart->rom_backup) {
@@ -374,8 +512,20 @@ int cartridge_restore_rom(Cartridge *cart) {
         return ERROR;
     }
     
+#ifdef CARTRIDGE_MMAP
+    /* Map the file over the edited pages (same address, private copies dropped) */
+    if (cart->backup_mapped &&
+        mmap(cart->rom_map, cart->rom_map_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, cart->rom_fd, 0) != MAP_FAILED) {
+        cart->rom_generation++;
+        cartridge_parse_header(cart);
+        return SUCCESS;
+    }
+#endif
+    
     /* Restore ROM data from backup */
     memcpy(cart->rom_data, cart->rom_backup, cart->rom_size);
+    cart->rom_generation++;
     
     /* Re-parse header */
     cartridge_parse_header(cart);
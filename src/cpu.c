@@ -3,15 +3,81 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../include/cpu.h"
 #include "../include/memory.h"
 
-/* External memory system (to be linked) */
-extern Memory g_memory;
+/*
+ * Opcode dispatch
+ *
+ * Every opcode is described by a handler, the number of operand bytes that
+ * follow it and its base cycle count. There is one 256-entry table per
+ * register width combination (M/X) plus one for emulation mode, so the
+ * width of an instruction is decided once when P or E changes instead of
+ * on every instruction. Handlers receive the already-fetched operand and
+ * only add cycles for data-dependent cases such as taken branches.
+ */
+typedef void (*CpuHandler)(CPU *cpu, u32 operand);
+
+typedef struct {
+    CpuHandler handler;  /* Instruction implementation (NULL = unimplemented) */
+    u8 operand_bytes;    /* Operand bytes following the opcode (0-3) */
+    u8 cycles;           /* Base cycle count */
+    u8 flags;            /* CPU_OP_* flags */
+} CpuOpcode;
+
+/* Opcode flags */
+#define CPU_OP_ENDS_BLOCK 0x01  /* Changes PC, M/X/E or repeats itself */
+
+static const CpuOpcode cpu_dispatch_tables[CPU_DISPATCH_MODES][256];
+
+/*
+ * Basic-block cache
+ *
+ * Straight-line runs of instructions are decoded once into blocks keyed by
+ * the 24-bit PC and the dispatch mode. A block ends after any instruction
+ * flagged CPU_OP_ENDS_BLOCK, before an instruction that crosses an 8KB page
+ * and at CPU_BLOCK_MAX_INSNS. Only code in directly mapped pages is cached.
+ * Blocks in WRAM register their bytes with memory_mark_code(); a write to
+ * them queues the 64-byte span in Memory.code_written, and only the blocks
+ * covering a queued span are dropped. A new memory code generation (layout
+ * change) or cartridge ROM generation flushes the whole cache.
+ */
+#define CPU_BLOCK_CACHE_SIZE 1024  /* Number of blocks (power of two) */
+#define CPU_BLOCK_MAX_INSNS  16    /* Instructions per block */
 
-void cpu_init(CPU *cpu) {
+typedef struct {
+    CpuHandler handler;  /* Instruction implementation */
+    u32 operand;         /* Predecoded operand */
+    u8 length;           /* Opcode + operand bytes */
+    u8 cycles;           /* Base cycle count */
+} CpuDecodedOp;
+
+typedef struct {
+    u32 key;             /* 24-bit PC | dispatch mode << 24 */
+    u32 epoch;           /* Cache epoch the block was built in */
+    u16 span_first;      /* WRAM watch spans holding the code */
+    u16 span_last;       /* (first > last for ROM blocks) */
+    u8 count;            /* Number of decoded instructions */
+    CpuDecodedOp ops[CPU_BLOCK_MAX_INSNS];
+} CpuBlock;
+
+struct CpuBlockCache {
+    u32 epoch;           /* Current epoch (blocks from older ones are stale) */
+    u32 code_generation; /* Memory code generation at last check */
+    u32 rom_generation;  /* Cartridge ROM generation at last check */
+    const Cartridge *cart; /* Cartridge at last check */
+    CpuBlock blocks[CPU_BLOCK_CACHE_SIZE];
+};
+
+void cpu_init(CPU *cpu, Memory *mem) {
     memset(cpu, 0, sizeof(CPU));
+    cpu->mem = mem;
+    cpu->block_cache = (CpuBlockCache *)calloc(1, sizeof(CpuBlockCache));
+    if (cpu->block_cache) {
+        cpu->block_cache->epoch = 1;  /* Zeroed blocks are never valid */
+    }
     cpu->breakpoint_count = 0;
     cpu->breakpoint_hit = false;
     cpu_reset(cpu);
@@ -25,31 +91,49 @@ void cpu_reset(CPU *cpu) {
     cpu->d = 0;
     cpu->dbr = 0;
     cpu->pbr = 0;
-    
+
     /* Set emulation mode */
     cpu->e = 1;
-    
+
     /* Set processor status flags */
     cpu->p = FLAG_I | FLAG_M | FLAG_X;  /* IRQ disabled, 8-bit registers */
-    
+    cpu_update_dispatch(cpu);
+
     /* Stack pointer set to $01FF in emulation mode */
     cpu->sp = 0x01FF;
-    
+
     /* Read reset vector from $FFFC */
-    cpu->pc = memory_read16(&g_memory, VECTOR_EMULATION_RESET);
-    
+    cpu->pc = memory_read16(cpu->mem, VECTOR_EMULATION_RESET);
+
     /* Reset cycle counter */
     cpu->cycles = 0;
     cpu->stopped = false;
     cpu->waiting = false;
-    
+
     /* Clear interrupt flags */
     cpu->nmi_pending = false;
     cpu->irq_pending = false;
-    
+
     printf("CPU reset: PC=$%04X\n", cpu->pc);
 }
 
+void cpu_update_dispatch(CPU *cpu) {
+    if (cpu->e) {
+        /* Emulation mode always runs with 8-bit registers */
+        cpu->p |= FLAG_M | FLAG_X;
+        cpu->dispatch_mode = CPU_DISPATCH_EMULATION;
+    } else {
+        /* FLAG_X is bit 4 and FLAG_M bit 5, so (P >> 4) & 3 indexes M/X */
+        cpu->dispatch_mode = (cpu->p >> 4) & 0x03;
+    }
+
+    /* 8-bit index registers drop their high byte */
+    if (cpu->p & FLAG_X) {
+        cpu->x &= 0xFF;
+        cpu->y &= 0xFF;
+    }
+}
+
 u8 cpu_get_flag(const CPU *cpu, u8 flag) {
     return (cpu->p & flag) ? 1 : 0;
 }
@@ -60,6 +144,11 @@ void cpu_set_flag(CPU *cpu, u8 flag, bool value) {
     } else {
         cpu->p &= ~flag;
     }
+
+    /* Register widths changed - select the matching opcode table */
+    if (flag & (FLAG_M | FLAG_X)) {
+        cpu_update_dispatch(cpu);
+    }
 }
 
 void cpu_print_state(const CPU *cpu) {
@@ -68,7 +157,7 @@ void cpu_print_state(const CPU *cpu) {
     printf("  A: $%04X  X: $%04X  Y: $%04X\n", cpu->a, cpu->x, cpu->y);
     printf("  SP: $%04X  D: $%04X\n", cpu->sp, cpu->d);
     printf("  DBR: $%02X  P: $%02X [", cpu->dbr, cpu->p);
-    
+
     /* Print flag states */
     printf("%c", cpu_get_flag(cpu, FLAG_N) ? 'N' : '-');
     printf("%c", cpu_get_flag(cpu, FLAG_V) ? 'V' : '-');
@@ -79,52 +168,69 @@ void cpu_print_state(const CPU *cpu) {
     printf("%c", cpu_get_flag(cpu, FLAG_Z) ? 'Z' : '-');
     printf("%c", cpu_get_flag(cpu, FLAG_C) ? 'C' : '-');
     printf("]\n");
-    
+
     printf("  E: %d (", cpu->e);
     printf(cpu->e ? "Emulation" : "Native");
     printf(" mode)\n");
-    
+
     printf("  Cycles: %lu\n", (unsigned long)cpu->cycles);
 }
 
-/* Push byte to stack */
-static void cpu_push8(CPU *cpu, u8 value) {
-    if (cpu->e) {
-        /* Emulation mode: stack in page 1 ($0100-$01FF) */
-        memory_write(&g_memory, 0x0100 | (cpu->sp & 0xFF), value);
-        cpu->sp = 0x0100 | ((cpu->sp - 1) & 0xFF);
-    } else {
-        /* Native mode: full 16-bit stack pointer */
-        memory_write(&g_memory, cpu->sp, value);
-        cpu->sp--;
-    }
+/* Stack access - emulation mode keeps the stack in page 1 ($0100-$01FF) */
+static inline void cpu_push8_native(CPU *cpu, u8 value) {
+    memory_write(cpu->mem, cpu->sp, value);
+    cpu->sp--;
 }
 
-/* Push 16-bit word to stack */
-static void cpu_push16(CPU *cpu, u16 value) {
-    cpu_push8(cpu, (value >> 8) & 0xFF);  /* High byte first */
-    cpu_push8(cpu, value & 0xFF);         /* Low byte second */
+static inline void cpu_push8_emu(CPU *cpu, u8 value) {
+    memory_write(cpu->mem, 0x0100 | (cpu->sp & 0xFF), value);
+    cpu->sp = 0x0100 | ((cpu->sp - 1) & 0xFF);
+}
+
+static inline u8 cpu_pull8_native(CPU *cpu) {
+    cpu->sp++;
+    return memory_read(cpu->mem, cpu->sp);
 }
 
-/* Pull byte from stack */
-static u8 cpu_pull8(CPU *cpu) {
+static inline u8 cpu_pull8_emu(CPU *cpu) {
+    cpu->sp = 0x0100 | ((cpu->sp + 1) & 0xFF);
+    return memory_read(cpu->mem, cpu->sp);
+}
+
+static inline void cpu_push16_native(CPU *cpu, u16 value) {
+    cpu_push8_native(cpu, (value >> 8) & 0xFF);  /* High byte first */
+    cpu_push8_native(cpu, value & 0xFF);         /* Low byte second */
+}
+
+static inline void cpu_push16_emu(CPU *cpu, u16 value) {
+    cpu_push8_emu(cpu, (value >> 8) & 0xFF);
+    cpu_push8_emu(cpu, value & 0xFF);
+}
+
+static inline u16 cpu_pull16_native(CPU *cpu) {
+    u8 low = cpu_pull8_native(cpu);
+    u8 high = cpu_pull8_native(cpu);
+    return low | (high << 8);
+}
+
+static inline u16 cpu_pull16_emu(CPU *cpu) {
+    u8 low = cpu_pull8_emu(cpu);
+    u8 high = cpu_pull8_emu(cpu);
+    return low | (high << 8);
+}
+
+/* Mode-checking variants for interrupt entry (not on the per-opcode path) */
+static void cpu_push8(CPU *cpu, u8 value) {
     if (cpu->e) {
-        /* Emulation mode */
-        cpu->sp = 0x0100 | ((cpu->sp + 1) & 0xFF);
-        return memory_read(&g_memory, 0x0100 | (cpu->sp & 0xFF));
+        cpu_push8_emu(cpu, value);
     } else {
-        /* Native mode */
-        cpu->sp++;
-        return memory_read(&g_memory, cpu->sp);
+        cpu_push8_native(cpu, value);
     }
 }
 
-/* Pull 16-bit word from stack (used later for RTI/RTS instructions) */
-__attribute__((unused))
-static u16 cpu_pull16(CPU *cpu) {
-    u8 low = cpu_pull8(cpu);
-    u8 high = cpu_pull8(cpu);
-    return low | (high << 8);
+static void cpu_push16(CPU *cpu, u16 value) {
+    cpu_push8(cpu, (value >> 8) & 0xFF);
+    cpu_push8(cpu, value & 0xFF);
 }
 
 void cpu_nmi(CPU *cpu) {
@@ -140,26 +246,26 @@ void cpu_irq(CPU *cpu) {
 /* Handle NMI interrupt */
 static void cpu_handle_nmi(CPU *cpu) {
     u16 vector;
-    
+
     /* Push return address and status */
     cpu_push8(cpu, cpu->pbr);
     cpu_push16(cpu, cpu->pc);
     cpu_push8(cpu, cpu->p);
-    
+
     /* Get interrupt vector */
     if (cpu->e) {
-        vector = memory_read16(&g_memory, VECTOR_EMULATION_NMI);
+        vector = memory_read16(cpu->mem, VECTOR_EMULATION_NMI);
     } else {
-        vector = memory_read16(&g_memory, VECTOR_NATIVE_NMI);
+        vector = memory_read16(cpu->mem, VECTOR_NATIVE_NMI);
     }
-    
+
     /* Set PC to interrupt handler */
     cpu->pc = vector;
     cpu->pbr = 0;
-    
+
     /* Set interrupt disable flag */
-    cpu_set_flag(cpu, FLAG_I, true);
-    
+    cpu->p |= FLAG_I;
+
     cpu->nmi_pending = false;
     cpu->instruction_cycles += 7;  /* NMI takes 7 cycles */
 }
@@ -167,935 +273,1000 @@ static void cpu_handle_nmi(CPU *cpu) {
 /* Handle IRQ interrupt */
 static void cpu_handle_irq(CPU *cpu) {
     u16 vector;
-    
+
     /* Push return address and status */
     cpu_push8(cpu, cpu->pbr);
     cpu_push16(cpu, cpu->pc);
     cpu_push8(cpu, cpu->p);
-    
+
     /* Get interrupt vector */
     if (cpu->e) {
-        vector = memory_read16(&g_memory, VECTOR_EMULATION_IRQ);
+        vector = memory_read16(cpu->mem, VECTOR_EMULATION_IRQ);
     } else {
-        vector = memory_read16(&g_memory, VECTOR_NATIVE_IRQ);
+        vector = memory_read16(cpu->mem, VECTOR_NATIVE_IRQ);
     }
-    
+
     /* Set PC to interrupt handler */
     cpu->pc = vector;
     cpu->pbr = 0;
-    
+
     /* Set interrupt disable flag */
-    cpu_set_flag(cpu, FLAG_I, true);
-    
+    cpu->p |= FLAG_I;
+
     cpu->irq_pending = false;
     cpu->instruction_cycles += 7;  /* IRQ takes 7 cycles */
 }
 
-u32 cpu_step(CPU *cpu) {
-    u8 opcode;
-    
-    if (cpu->stopped) {
-        return 1;
+/* Flag helpers for the opcode handlers (no width tests) */
+static inline void cpu_set_nz8(CPU *cpu, u8 value) {
+    cpu->p = (cpu->p & ~(FLAG_N | FLAG_Z)) | (value & FLAG_N) |
+             (value == 0 ? FLAG_Z : 0);
+}
+
+static inline void cpu_set_nz16(CPU *cpu, u16 value) {
+    cpu->p = (cpu->p & ~(FLAG_N | FLAG_Z)) | ((value >> 8) & FLAG_N) |
+             (value == 0 ? FLAG_Z : 0);
+}
+
+static inline void cpu_put_flag(CPU *cpu, u8 flag, bool value) {
+    cpu->p = value ? (cpu->p | flag) : (cpu->p & ~flag);
+}
+
+static inline u32 cpu_data_addr(const CPU *cpu, u16 addr) {
+    return ((u32)cpu->dbr << 16) | addr;
+}
+
+/* Taken branches cost one extra cycle */
+static inline void cpu_branch(CPU *cpu, u32 operand, bool taken) {
+    if (taken) {
+        cpu->pc += (s8)operand;
+        cpu->instruction_cycles++;
     }
-    
-    /* Check for breakpoint */
-    if (cpu_check_breakpoint(cpu)) {
-        cpu->breakpoint_hit = true;
-        cpu->stopped = true;
-        printf("Breakpoint hit at $%02X:%04X\n", cpu->pbr, cpu->pc);
-        return 1;
+}
+
+/* Opcode handlers - width independent */
+
+static void op_nop(CPU *cpu, u32 operand) {
+    (void)cpu;
+    (void)operand;
+}
+
+static void op_clc(CPU *cpu, u32 operand) { (void)operand; cpu->p &= ~FLAG_C; }
+static void op_sec(CPU *cpu, u32 operand) { (void)operand; cpu->p |= FLAG_C; }
+static void op_sei(CPU *cpu, u32 operand) { (void)operand; cpu->p |= FLAG_I; }
+static void op_cli(CPU *cpu, u32 operand) { (void)operand; cpu->p &= ~FLAG_I; }
+static void op_cld(CPU *cpu, u32 operand) { (void)operand; cpu->p &= ~FLAG_D; }
+static void op_sed(CPU *cpu, u32 operand) { (void)operand; cpu->p |= FLAG_D; }
+static void op_clv(CPU *cpu, u32 operand) { (void)operand; cpu->p &= ~FLAG_V; }
+
+/* REP/SEP may change register widths, so the dispatch table is reselected */
+static void op_rep(CPU *cpu, u32 operand) {
+    cpu->p &= ~operand;
+    cpu_update_dispatch(cpu);
+}
+
+static void op_sep(CPU *cpu, u32 operand) {
+    cpu->p |= operand;
+    cpu_update_dispatch(cpu);
+}
+
+static void op_xce(CPU *cpu, u32 operand) {
+    u8 temp = cpu->e;
+    (void)operand;
+    cpu->e = cpu->p & FLAG_C;
+    cpu_put_flag(cpu, FLAG_C, temp);
+    if (cpu->e) {
+        /* Switching to emulation mode */
+        cpu->sp = 0x0100 | (cpu->sp & 0xFF);
     }
-    
-    /* Handle pending interrupts */
-    if (cpu->nmi_pending) {
-        cpu_handle_nmi(cpu);
-        return cpu->instruction_cycles;
+    cpu_update_dispatch(cpu);
+}
+
+static void op_bcc(CPU *cpu, u32 operand) { cpu_branch(cpu, operand, !(cpu->p & FLAG_C)); }
+static void op_bcs(CPU *cpu, u32 operand) { cpu_branch(cpu, operand, (cpu->p & FLAG_C) != 0); }
+static void op_beq(CPU *cpu, u32 operand) { cpu_branch(cpu, operand, (cpu->p & FLAG_Z) != 0); }
+static void op_bne(CPU *cpu, u32 operand) { cpu_branch(cpu, operand, !(cpu->p & FLAG_Z)); }
+static void op_bmi(CPU *cpu, u32 operand) { cpu_branch(cpu, operand, (cpu->p & FLAG_N) != 0); }
+static void op_bpl(CPU *cpu, u32 operand) { cpu_branch(cpu, operand, !(cpu->p & FLAG_N)); }
+static void op_bvc(CPU *cpu, u32 operand) { cpu_branch(cpu, operand, !(cpu->p & FLAG_V)); }
+static void op_bvs(CPU *cpu, u32 operand) { cpu_branch(cpu, operand, (cpu->p & FLAG_V) != 0); }
+static void op_bra(CPU *cpu, u32 operand) { cpu->pc += (s8)operand; }
+
+static void op_jmp_abs(CPU *cpu, u32 operand) {
+    cpu->pc = operand & 0xFFFF;
+}
+
+static void op_jmp_long(CPU *cpu, u32 operand) {
+    cpu->pbr = (operand >> 16) & 0xFF;
+    cpu->pc = operand & 0xFFFF;
+}
+
+static void op_tcd(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->d = cpu->a;
+    cpu_set_nz16(cpu, cpu->d);
+}
+
+static void op_tdc(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->a = cpu->d;
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+static void op_tcs(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->sp = cpu->a;
+}
+
+static void op_tsc(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->a = cpu->sp;
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+/* MVN/MVP move one byte per execution and repeat until A wraps to $FFFF */
+static void op_mvn(CPU *cpu, u32 operand) {
+    u8 dest_bank = operand & 0xFF;
+    u8 src_bank = (operand >> 8) & 0xFF;
+    u8 value = memory_read(cpu->mem, ((u32)src_bank << 16) | cpu->x);
+
+    memory_write(cpu->mem, ((u32)dest_bank << 16) | cpu->y, value);
+    cpu->x++;
+    cpu->y++;
+    cpu->a--;
+    if (cpu->a != 0xFFFF) {
+        cpu->pc -= 3;  /* Re-execute this instruction */
     }
-    
-    if (cpu->irq_pending && !cpu_get_flag(cpu, FLAG_I)) {
-        cpu_handle_irq(cpu);
-        return cpu->instruction_cycles;
+    cpu->dbr = dest_bank;
+}
+
+static void op_mvp(CPU *cpu, u32 operand) {
+    u8 dest_bank = operand & 0xFF;
+    u8 src_bank = (operand >> 8) & 0xFF;
+    u8 value = memory_read(cpu->mem, ((u32)src_bank << 16) | cpu->x);
+
+    memory_write(cpu->mem, ((u32)dest_bank << 16) | cpu->y, value);
+    cpu->x--;
+    cpu->y--;
+    cpu->a--;
+    if (cpu->a != 0xFFFF) {
+        cpu->pc -= 3;  /* Re-execute this instruction */
     }
-    
-    /* Reset instruction cycle counter */
-    cpu->instruction_cycles = 0;
-    
-    /* Fetch opcode */
-    opcode = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-    cpu->pc++;
-    
-    /* Execute instruction (simplified - only a few opcodes for now) */
-    switch (opcode) {
-        case 0xEA:  /* NOP */
-            cpu->instruction_cycles = 2;
-            break;
-            
-        /* Flag instructions */
-        case 0x18:  /* CLC - Clear Carry */
-            cpu_set_flag(cpu, FLAG_C, false);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0x38:  /* SEC - Set Carry */
-            cpu_set_flag(cpu, FLAG_C, true);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0x78:  /* SEI - Set Interrupt Disable */
-            cpu_set_flag(cpu, FLAG_I, true);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0x58:  /* CLI - Clear Interrupt Disable */
-            cpu_set_flag(cpu, FLAG_I, false);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0xD8:  /* CLD - Clear Decimal */
-            cpu_set_flag(cpu, FLAG_D, false);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0xF8:  /* SED - Set Decimal */
-            cpu_set_flag(cpu, FLAG_D, true);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0xB8:  /* CLV - Clear Overflow */
-            cpu_set_flag(cpu, FLAG_V, false);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0xC2:  /* REP - Reset Processor Status Bits */
-            {
-                u8 operand = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc++;
-                cpu->p &= ~operand;
-                cpu->instruction_cycles = 3;
-            }
-            break;
-            
-        case 0xE2:  /* SEP - Set Processor Status Bits */
-            {
-                u8 operand = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc++;
-                cpu->p |= operand;
-                cpu->instruction_cycles = 3;
-            }
-            break;
-            
-        /* Load/Store instructions - 8-bit immediate */
-        case 0xA9:  /* LDA immediate */
-            {
-                if (cpu_get_flag(cpu, FLAG_M)) {
-                    /* 8-bit mode */
-                    cpu->a = (cpu->a & 0xFF00) | memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc++;
-                    cpu->instruction_cycles = 2;
-                } else {
-                    /* 16-bit mode */
-                    u16 value = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->a = value;
-                    cpu->pc += 2;
-                    cpu->instruction_cycles = 3;
-                }
-                cpu_set_flag(cpu, FLAG_Z, (cpu->a & (cpu_get_flag(cpu, FLAG_M) ? 0xFF : 0xFFFF)) == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->a & (cpu_get_flag(cpu, FLAG_M) ? 0x80 : 0x8000)) != 0);
-            }
-            break;
-            
-        case 0xA2:  /* LDX immediate */
-            {
-                if (cpu_get_flag(cpu, FLAG_X)) {
-                    /* 8-bit mode */
-                    cpu->x = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc++;
-                    cpu->instruction_cycles = 2;
-                } else {
-                    /* 16-bit mode */
-                    cpu->x = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc += 2;
-                    cpu->instruction_cycles = 3;
-                }
-                cpu_set_flag(cpu, FLAG_Z, cpu->x == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->x & (cpu_get_flag(cpu, FLAG_X) ? 0x80 : 0x8000)) != 0);
-            }
-            break;
-            
-        case 0xA0:  /* LDY immediate */
-            {
-                if (cpu_get_flag(cpu, FLAG_X)) {
-                    /* 8-bit mode */
-                    cpu->y = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc++;
-                    cpu->instruction_cycles = 2;
-                } else {
-                    /* 16-bit mode */
-                    cpu->y = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc += 2;
-                    cpu->instruction_cycles = 3;
-                }
-                cpu_set_flag(cpu, FLAG_Z, cpu->y == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->y & (cpu_get_flag(cpu, FLAG_X) ? 0x80 : 0x8000)) != 0);
-            }
-            break;
-            
-        /* Transfer instructions */
-        case 0xAA:  /* TAX - Transfer A to X */
-            if (cpu_get_flag(cpu, FLAG_X)) {
-                cpu->x = cpu->a & 0xFF;
-            } else {
-                cpu->x = cpu->a;
-            }
-            cpu_set_flag(cpu, FLAG_Z, cpu->x == 0);
-            cpu_set_flag(cpu, FLAG_N, (cpu->x & (cpu_get_flag(cpu, FLAG_X) ? 0x80 : 0x8000)) != 0);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0xA8:  /* TAY - Transfer A to Y */
-            if (cpu_get_flag(cpu, FLAG_X)) {
-                cpu->y = cpu->a & 0xFF;
-            } else {
-                cpu->y = cpu->a;
-            }
-            cpu_set_flag(cpu, FLAG_Z, cpu->y == 0);
-            cpu_set_flag(cpu, FLAG_N, (cpu->y & (cpu_get_flag(cpu, FLAG_X) ? 0x80 : 0x8000)) != 0);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0x8A:  /* TXA - Transfer X to A */
-            if (cpu_get_flag(cpu, FLAG_M)) {
-                cpu->a = (cpu->a & 0xFF00) | (cpu->x & 0xFF);
-            } else {
-                cpu->a = cpu->x;
-            }
-            cpu_set_flag(cpu, FLAG_Z, (cpu->a & (cpu_get_flag(cpu, FLAG_M) ? 0xFF : 0xFFFF)) == 0);
-            cpu_set_flag(cpu, FLAG_N, (cpu->a & (cpu_get_flag(cpu, FLAG_M) ? 0x80 : 0x8000)) != 0);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0x98:  /* TYA - Transfer Y to A */
-            if (cpu_get_flag(cpu, FLAG_M)) {
-                cpu->a = (cpu->a & 0xFF00) | (cpu->y & 0xFF);
-            } else {
-                cpu->a = cpu->y;
-            }
-            cpu_set_flag(cpu, FLAG_Z, (cpu->a & (cpu_get_flag(cpu, FLAG_M) ? 0xFF : 0xFFFF)) == 0);
-            cpu_set_flag(cpu, FLAG_N, (cpu->a & (cpu_get_flag(cpu, FLAG_M) ? 0x80 : 0x8000)) != 0);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        /* Stack instructions */
-        case 0x48:  /* PHA - Push Accumulator */
-            if (cpu_get_flag(cpu, FLAG_M)) {
-                cpu_push8(cpu, cpu->a & 0xFF);
-                cpu->instruction_cycles = 3;
-            } else {
-                cpu_push16(cpu, cpu->a);
-                cpu->instruction_cycles = 4;
-            }
-            break;
-            
-        case 0x68:  /* PLA - Pull Accumulator */
-            if (cpu_get_flag(cpu, FLAG_M)) {
-                cpu->a = (cpu->a & 0xFF00) | cpu_pull8(cpu);
-                cpu_set_flag(cpu, FLAG_Z, (cpu->a & 0xFF) == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x80) != 0);
-                cpu->instruction_cycles = 4;
-            } else {
-                cpu->a = cpu_pull16(cpu);
-                cpu_set_flag(cpu, FLAG_Z, cpu->a == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x8000) != 0);
-                cpu->instruction_cycles = 5;
-            }
-            break;
-            
-        case 0x08:  /* PHP - Push Processor Status */
-            cpu_push8(cpu, cpu->p);
-            cpu->instruction_cycles = 3;
-            break;
-            
-        case 0x28:  /* PLP - Pull Processor Status */
-            cpu->p = cpu_pull8(cpu);
-            cpu->instruction_cycles = 4;
-            break;
-            
-        /* Increment/Decrement */
-        case 0xE8:  /* INX - Increment X */
-            if (cpu_get_flag(cpu, FLAG_X)) {
-                cpu->x = (cpu->x + 1) & 0xFF;
-                cpu_set_flag(cpu, FLAG_Z, (cpu->x & 0xFF) == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->x & 0x80) != 0);
-            } else {
-                cpu->x = (cpu->x + 1) & 0xFFFF;
-                cpu_set_flag(cpu, FLAG_Z, cpu->x == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->x & 0x8000) != 0);
-            }
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0xC8:  /* INY - Increment Y */
-            if (cpu_get_flag(cpu, FLAG_X)) {
-                cpu->y = (cpu->y + 1) & 0xFF;
-                cpu_set_flag(cpu, FLAG_Z, (cpu->y & 0xFF) == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->y & 0x80) != 0);
-            } else {
-                cpu->y = (cpu->y + 1) & 0xFFFF;
-                cpu_set_flag(cpu, FLAG_Z, cpu->y == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->y & 0x8000) != 0);
-            }
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0xCA:  /* DEX - Decrement X */
-            if (cpu_get_flag(cpu, FLAG_X)) {
-                cpu->x = (cpu->x - 1) & 0xFF;
-                cpu_set_flag(cpu, FLAG_Z, (cpu->x & 0xFF) == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->x & 0x80) != 0);
-            } else {
-                cpu->x = (cpu->x - 1) & 0xFFFF;
-                cpu_set_flag(cpu, FLAG_Z, cpu->x == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->x & 0x8000) != 0);
-            }
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0x88:  /* DEY - Decrement Y */
-            if (cpu_get_flag(cpu, FLAG_X)) {
-                cpu->y = (cpu->y - 1) & 0xFF;
-                cpu_set_flag(cpu, FLAG_Z, (cpu->y & 0xFF) == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->y & 0x80) != 0);
-            } else {
-                cpu->y = (cpu->y - 1) & 0xFFFF;
-                cpu_set_flag(cpu, FLAG_Z, cpu->y == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->y & 0x8000) != 0);
-            }
-            cpu->instruction_cycles = 2;
-            break;
-            
-        /* Branch instructions */
-        case 0x90:  /* BCC - Branch if Carry Clear */
-            {
-                s8 offset = (s8)memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc++;
-                if (!cpu_get_flag(cpu, FLAG_C)) {
-                    cpu->pc += offset;
-                    cpu->instruction_cycles = 3;
-                } else {
-                    cpu->instruction_cycles = 2;
-                }
-            }
-            break;
-            
-        case 0xB0:  /* BCS - Branch if Carry Set */
-            {
-                s8 offset = (s8)memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc++;
-                if (cpu_get_flag(cpu, FLAG_C)) {
-                    cpu->pc += offset;
-                    cpu->instruction_cycles = 3;
-                } else {
-                    cpu->instruction_cycles = 2;
-                }
-            }
-            break;
-            
-        case 0xF0:  /* BEQ - Branch if Equal (Zero set) */
-            {
-                s8 offset = (s8)memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc++;
-                if (cpu_get_flag(cpu, FLAG_Z)) {
-                    cpu->pc += offset;
-                    cpu->instruction_cycles = 3;
-                } else {
-                    cpu->instruction_cycles = 2;
-                }
-            }
-            break;
-            
-        case 0xD0:  /* BNE - Branch if Not Equal (Zero clear) */
-            {
-                s8 offset = (s8)memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc++;
-                if (!cpu_get_flag(cpu, FLAG_Z)) {
-                    cpu->pc += offset;
-                    cpu->instruction_cycles = 3;
-                } else {
-                    cpu->instruction_cycles = 2;
-                }
-            }
-            break;
-            
-        case 0x30:  /* BMI - Branch if Minus (Negative set) */
-            {
-                s8 offset = (s8)memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc++;
-                if (cpu_get_flag(cpu, FLAG_N)) {
-                    cpu->pc += offset;
-                    cpu->instruction_cycles = 3;
-                } else {
-                    cpu->instruction_cycles = 2;
-                }
-            }
-            break;
-            
-        case 0x10:  /* BPL - Branch if Plus (Negative clear) */
-            {
-                s8 offset = (s8)memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc++;
-                if (!cpu_get_flag(cpu, FLAG_N)) {
-                    cpu->pc += offset;
-                    cpu->instruction_cycles = 3;
-                } else {
-                    cpu->instruction_cycles = 2;
-                }
-            }
-            break;
-            
-        case 0x80:  /* BRA - Branch Always */
-            {
-                s8 offset = (s8)memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc++;
-                cpu->pc += offset;
-                cpu->instruction_cycles = 3;
-            }
-            break;
-            
-        /* Jump instructions */
-        case 0x4C:  /* JMP absolute */
-            {
-                u16 addr = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc = addr;
-                cpu->instruction_cycles = 3;
-            }
-            break;
-            
-        case 0x5C:  /* JMP long */
-            {
-                u32 addr = memory_read24(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pbr = (addr >> 16) & 0xFF;
-                cpu->pc = addr & 0xFFFF;
-                cpu->instruction_cycles = 4;
-            }
-            break;
-            
-        /* Subroutine instructions */
-        case 0x20:  /* JSR - Jump to Subroutine */
-            {
-                u16 addr = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc += 2;
-                cpu_push16(cpu, cpu->pc - 1);
-                cpu->pc = addr;
-                cpu->instruction_cycles = 6;
-            }
-            break;
-            
-        case 0x60:  /* RTS - Return from Subroutine */
-            {
-                u16 addr = cpu_pull16(cpu);
-                cpu->pc = addr + 1;
-                cpu->instruction_cycles = 6;
-            }
-            break;
-            
-        case 0x40:  /* RTI - Return from Interrupt */
-            cpu->p = cpu_pull8(cpu);
-            cpu->pc = cpu_pull16(cpu);
-            cpu->pbr = cpu_pull8(cpu);
-            cpu->instruction_cycles = 6;
-            break;
-            
-        case 0x6B:  /* RTL - Return from Subroutine Long */
-            {
-                u16 addr = cpu_pull16(cpu);
-                cpu->pbr = cpu_pull8(cpu);
-                cpu->pc = addr + 1;
-                cpu->instruction_cycles = 6;
-            }
-            break;
-            
-        /* Store instructions - absolute */
-        case 0x8D:  /* STA absolute */
-            {
-                u16 addr = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc += 2;
-                if (cpu_get_flag(cpu, FLAG_M)) {
-                    memory_write(&g_memory, (cpu->dbr << 16) | addr, cpu->a & 0xFF);
-                    cpu->instruction_cycles = 4;
-                } else {
-                    memory_write16(&g_memory, (cpu->dbr << 16) | addr, cpu->a);
-                    cpu->instruction_cycles = 5;
-                }
-            }
-            break;
-            
-        case 0x8E:  /* STX absolute */
-            {
-                u16 addr = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc += 2;
-                if (cpu_get_flag(cpu, FLAG_X)) {
-                    memory_write(&g_memory, (cpu->dbr << 16) | addr, cpu->x & 0xFF);
-                    cpu->instruction_cycles = 4;
-                } else {
-                    memory_write16(&g_memory, (cpu->dbr << 16) | addr, cpu->x);
-                    cpu->instruction_cycles = 5;
-                }
-            }
-            break;
-            
-        case 0x8C:  /* STY absolute */
-            {
-                u16 addr = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc += 2;
-                if (cpu_get_flag(cpu, FLAG_X)) {
-                    memory_write(&g_memory, (cpu->dbr << 16) | addr, cpu->y & 0xFF);
-                    cpu->instruction_cycles = 4;
-                } else {
-                    memory_write16(&g_memory, (cpu->dbr << 16) | addr, cpu->y);
-                    cpu->instruction_cycles = 5;
-                }
-            }
-            break;
-            
-        case 0x9C:  /* STZ absolute */
-            {
-                u16 addr = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc += 2;
-                if (cpu_get_flag(cpu, FLAG_M)) {
-                    memory_write(&g_memory, (cpu->dbr << 16) | addr, 0);
-                    cpu->instruction_cycles = 4;
-                } else {
-                    memory_write16(&g_memory, (cpu->dbr << 16) | addr, 0);
-                    cpu->instruction_cycles = 5;
-                }
-            }
-            break;
-            
-        /* Load instructions - absolute */
-        case 0xAD:  /* LDA absolute */
-            {
-                u16 addr = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc += 2;
-                if (cpu_get_flag(cpu, FLAG_M)) {
-                    cpu->a = (cpu->a & 0xFF00) | memory_read(&g_memory, (cpu->dbr << 16) | addr);
-                    cpu_set_flag(cpu, FLAG_Z, (cpu->a & 0xFF) == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x80) != 0);
-                    cpu->instruction_cycles = 4;
-                } else {
-                    cpu->a = memory_read16(&g_memory, (cpu->dbr << 16) | addr);
-                    cpu_set_flag(cpu, FLAG_Z, cpu->a == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x8000) != 0);
-                    cpu->instruction_cycles = 5;
-                }
-            }
-            break;
-            
-        case 0xAE:  /* LDX absolute */
-            {
-                u16 addr = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc += 2;
-                if (cpu_get_flag(cpu, FLAG_X)) {
-                    cpu->x = memory_read(&g_memory, (cpu->dbr << 16) | addr);
-                    cpu_set_flag(cpu, FLAG_Z, (cpu->x & 0xFF) == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->x & 0x80) != 0);
-                    cpu->instruction_cycles = 4;
-                } else {
-                    cpu->x = memory_read16(&g_memory, (cpu->dbr << 16) | addr);
-                    cpu_set_flag(cpu, FLAG_Z, cpu->x == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->x & 0x8000) != 0);
-                    cpu->instruction_cycles = 5;
-                }
-            }
-            break;
-            
-        case 0xAC:  /* LDY absolute */
-            {
-                u16 addr = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc += 2;
-                if (cpu_get_flag(cpu, FLAG_X)) {
-                    cpu->y = memory_read(&g_memory, (cpu->dbr << 16) | addr);
-                    cpu_set_flag(cpu, FLAG_Z, (cpu->y & 0xFF) == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->y & 0x80) != 0);
-                    cpu->instruction_cycles = 4;
-                } else {
-                    cpu->y = memory_read16(&g_memory, (cpu->dbr << 16) | addr);
-                    cpu_set_flag(cpu, FLAG_Z, cpu->y == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->y & 0x8000) != 0);
-                    cpu->instruction_cycles = 5;
-                }
-            }
-            break;
-            
-        /* Arithmetic - ADC */
-        case 0x69:  /* ADC immediate */
-            {
-                if (cpu_get_flag(cpu, FLAG_M)) {
-                    u8 operand = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc++;
-                    u8 a = cpu->a & 0xFF;
-                    u16 result = a + operand + (cpu_get_flag(cpu, FLAG_C) ? 1 : 0);
-                    cpu->a = (cpu->a & 0xFF00) | (result & 0xFF);
-                    cpu_set_flag(cpu, FLAG_C, result > 0xFF);
-                    cpu_set_flag(cpu, FLAG_Z, (result & 0xFF) == 0);
-                    cpu_set_flag(cpu, FLAG_N, (result & 0x80) != 0);
-                    cpu_set_flag(cpu, FLAG_V, ((a ^ result) & (operand ^ result) & 0x80) != 0);
-                    cpu->instruction_cycles = 2;
-                } else {
-                    u16 operand = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc += 2;
-                    u32 result = cpu->a + operand + (cpu_get_flag(cpu, FLAG_C) ? 1 : 0);
-                    cpu_set_flag(cpu, FLAG_C, result > 0xFFFF);
-                    cpu->a = result & 0xFFFF;
-                    cpu_set_flag(cpu, FLAG_Z, cpu->a == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x8000) != 0);
-                    cpu_set_flag(cpu, FLAG_V, ((cpu->a ^ result) & (operand ^ result) & 0x8000) != 0);
-                    cpu->instruction_cycles = 3;
-                }
-            }
-            break;
-            
-        /* Arithmetic - SBC */
-        case 0xE9:  /* SBC immediate */
-            {
-                if (cpu_get_flag(cpu, FLAG_M)) {
-                    u8 operand = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc++;
-                    u8 a = cpu->a & 0xFF;
-                    u16 result = a - operand - (cpu_get_flag(cpu, FLAG_C) ? 0 : 1);
-                    cpu->a = (cpu->a & 0xFF00) | (result & 0xFF);
-                    cpu_set_flag(cpu, FLAG_C, result <= 0xFF);
-                    cpu_set_flag(cpu, FLAG_Z, (result & 0xFF) == 0);
-                    cpu_set_flag(cpu, FLAG_N, (result & 0x80) != 0);
-                    cpu_set_flag(cpu, FLAG_V, ((a ^ operand) & (a ^ result) & 0x80) != 0);
-                    cpu->instruction_cycles = 2;
-                } else {
-                    u16 operand = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc += 2;
-                    u32 result = cpu->a - operand - (cpu_get_flag(cpu, FLAG_C) ? 0 : 1);
-                    cpu_set_flag(cpu, FLAG_C, result <= 0xFFFF);
-                    cpu->a = result & 0xFFFF;
-                    cpu_set_flag(cpu, FLAG_Z, cpu->a == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x8000) != 0);
-                    cpu_set_flag(cpu, FLAG_V, ((cpu->a ^ operand) & (cpu->a ^ result) & 0x8000) != 0);
-                    cpu->instruction_cycles = 3;
-                }
-            }
-            break;
-            
-        /* Logic operations */
-        case 0x29:  /* AND immediate */
-            {
-                if (cpu_get_flag(cpu, FLAG_M)) {
-                    u8 operand = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc++;
-                    cpu->a = (cpu->a & 0xFF00) | ((cpu->a & operand) & 0xFF);
-                    cpu_set_flag(cpu, FLAG_Z, (cpu->a & 0xFF) == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x80) != 0);
-                    cpu->instruction_cycles = 2;
-                } else {
-                    u16 operand = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc += 2;
-                    cpu->a &= operand;
-                    cpu_set_flag(cpu, FLAG_Z, cpu->a == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x8000) != 0);
-                    cpu->instruction_cycles = 3;
-                }
-            }
-            break;
-            
-        case 0x09:  /* ORA immediate */
-            {
-                if (cpu_get_flag(cpu, FLAG_M)) {
-                    u8 operand = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc++;
-                    cpu->a = (cpu->a & 0xFF00) | ((cpu->a | operand) & 0xFF);
-                    cpu_set_flag(cpu, FLAG_Z, (cpu->a & 0xFF) == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x80) != 0);
-                    cpu->instruction_cycles = 2;
-                } else {
-                    u16 operand = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc += 2;
-                    cpu->a |= operand;
-                    cpu_set_flag(cpu, FLAG_Z, cpu->a == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x8000) != 0);
-                    cpu->instruction_cycles = 3;
-                }
-            }
-            break;
-            
-        case 0x49:  /* EOR immediate */
-            {
-                if (cpu_get_flag(cpu, FLAG_M)) {
-                    u8 operand = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc++;
-                    cpu->a = (cpu->a & 0xFF00) | ((cpu->a ^ operand) & 0xFF);
-                    cpu_set_flag(cpu, FLAG_Z, (cpu->a & 0xFF) == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x80) != 0);
-                    cpu->instruction_cycles = 2;
-                } else {
-                    u16 operand = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc += 2;
-                    cpu->a ^= operand;
-                    cpu_set_flag(cpu, FLAG_Z, cpu->a == 0);
-                    cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x8000) != 0);
-                    cpu->instruction_cycles = 3;
-                }
-            }
-            break;
-            
-        /* Comparison operations */
-        case 0xC9:  /* CMP immediate */
-            {
-                if (cpu_get_flag(cpu, FLAG_M)) {
-                    u8 operand = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc++;
-                    u8 a = cpu->a & 0xFF;
-                    u8 result = a - operand;
-                    cpu_set_flag(cpu, FLAG_C, a >= operand);
-                    cpu_set_flag(cpu, FLAG_Z, result == 0);
-                    cpu_set_flag(cpu, FLAG_N, (result & 0x80) != 0);
-                    cpu->instruction_cycles = 2;
-                } else {
-                    u16 operand = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc += 2;
-                    u16 result = cpu->a - operand;
-                    cpu_set_flag(cpu, FLAG_C, cpu->a >= operand);
-                    cpu_set_flag(cpu, FLAG_Z, result == 0);
-                    cpu_set_flag(cpu, FLAG_N, (result & 0x8000) != 0);
-                    cpu->instruction_cycles = 3;
-                }
-            }
-            break;
-            
-        case 0xE0:  /* CPX immediate */
-            {
-                if (cpu_get_flag(cpu, FLAG_X)) {
-                    u8 operand = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc++;
-                    u8 x = cpu->x & 0xFF;
-                    u8 result = x - operand;
-                    cpu_set_flag(cpu, FLAG_C, x >= operand);
-                    cpu_set_flag(cpu, FLAG_Z, result == 0);
-                    cpu_set_flag(cpu, FLAG_N, (result & 0x80) != 0);
-                    cpu->instruction_cycles = 2;
-                } else {
-                    u16 operand = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc += 2;
-                    u16 result = cpu->x - operand;
-                    cpu_set_flag(cpu, FLAG_C, cpu->x >= operand);
-                    cpu_set_flag(cpu, FLAG_Z, result == 0);
-                    cpu_set_flag(cpu, FLAG_N, (result & 0x8000) != 0);
-                    cpu->instruction_cycles = 3;
-                }
-            }
-            break;
-            
-        case 0xC0:  /* CPY immediate */
-            {
-                if (cpu_get_flag(cpu, FLAG_X)) {
-                    u8 operand = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc++;
-                    u8 y = cpu->y & 0xFF;
-                    u8 result = y - operand;
-                    cpu_set_flag(cpu, FLAG_C, y >= operand);
-                    cpu_set_flag(cpu, FLAG_Z, result == 0);
-                    cpu_set_flag(cpu, FLAG_N, (result & 0x80) != 0);
-                    cpu->instruction_cycles = 2;
-                } else {
-                    u16 operand = memory_read16(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                    cpu->pc += 2;
-                    u16 result = cpu->y - operand;
-                    cpu_set_flag(cpu, FLAG_C, cpu->y >= operand);
-                    cpu_set_flag(cpu, FLAG_Z, result == 0);
-                    cpu_set_flag(cpu, FLAG_N, (result & 0x8000) != 0);
-                    cpu->instruction_cycles = 3;
-                }
-            }
-            break;
-            
-        /* Additional branch instructions */
-        case 0x50:  /* BVC - Branch if Overflow Clear */
-            {
-                s8 offset = (s8)memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc++;
-                if (!cpu_get_flag(cpu, FLAG_V)) {
-                    cpu->pc += offset;
-                    cpu->instruction_cycles = 3;
-                } else {
-                    cpu->instruction_cycles = 2;
-                }
-            }
-            break;
-            
-        case 0x70:  /* BVS - Branch if Overflow Set */
-            {
-                s8 offset = (s8)memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                cpu->pc++;
-                if (cpu_get_flag(cpu, FLAG_V)) {
-                    cpu->pc += offset;
-                    cpu->instruction_cycles = 3;
-                } else {
-                    cpu->instruction_cycles = 2;
-                }
-            }
-            break;
-            
-        /* Stack pointer operations */
-        case 0xBA:  /* TSX - Transfer SP to X */
-            if (cpu_get_flag(cpu, FLAG_X)) {
-                cpu->x = cpu->sp & 0xFF;
-                cpu_set_flag(cpu, FLAG_Z, (cpu->x & 0xFF) == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->x & 0x80) != 0);
-            } else {
-                cpu->x = cpu->sp;
-                cpu_set_flag(cpu, FLAG_Z, cpu->x == 0);
-                cpu_set_flag(cpu, FLAG_N, (cpu->x & 0x8000) != 0);
-            }
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0x9A:  /* TXS - Transfer X to SP */
-            if (cpu->e) {
-                cpu->sp = 0x0100 | (cpu->x & 0xFF);
-            } else {
-                cpu->sp = cpu->x;
-            }
-            cpu->instruction_cycles = 2;
-            break;
-            
-        /* Additional transfer operations */
-        case 0x5B:  /* TCD - Transfer C (16-bit A) to D */
-            cpu->d = cpu->a;
-            cpu_set_flag(cpu, FLAG_Z, cpu->d == 0);
-            cpu_set_flag(cpu, FLAG_N, (cpu->d & 0x8000) != 0);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0x7B:  /* TDC - Transfer D to C (16-bit A) */
-            cpu->a = cpu->d;
-            cpu_set_flag(cpu, FLAG_Z, cpu->a == 0);
-            cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x8000) != 0);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0x1B:  /* TCS - Transfer C (16-bit A) to SP */
-            cpu->sp = cpu->a;
-            cpu->instruction_cycles = 2;
-            break;
-            
-        case 0x3B:  /* TSC - Transfer SP to C (16-bit A) */
-            cpu->a = cpu->sp;
-            cpu_set_flag(cpu, FLAG_Z, cpu->a == 0);
-            cpu_set_flag(cpu, FLAG_N, (cpu->a & 0x8000) != 0);
-            cpu->instruction_cycles = 2;
-            break;
-            
-        /* XCE - Exchange Carry and Emulation flags */
-        case 0xFB:
-            {
-                u8 temp = cpu->e;
-                cpu->e = cpu_get_flag(cpu, FLAG_C);
-                cpu_set_flag(cpu, FLAG_C, temp);
-                if (cpu->e) {
-                    /* Switching to emulation mode */
-                    cpu_set_flag(cpu, FLAG_M, true);
-                    cpu_set_flag(cpu, FLAG_X, true);
-                    cpu->sp = 0x0100 | (cpu->sp & 0xFF);
-                }
-                cpu->instruction_cycles = 2;
+    cpu->dbr = dest_bank;
+}
+
+/* Opcode handlers - 8-bit accumulator (M=1) */
+
+static void op_lda_imm8(CPU *cpu, u32 operand) {
+    cpu->a = (cpu->a & 0xFF00) | (operand & 0xFF);
+    cpu_set_nz8(cpu, cpu->a & 0xFF);
+}
+
+static void op_lda_abs8(CPU *cpu, u32 operand) {
+    cpu->a = (cpu->a & 0xFF00) | memory_read(cpu->mem, cpu_data_addr(cpu, operand));
+    cpu_set_nz8(cpu, cpu->a & 0xFF);
+}
+
+static void op_sta_abs8(CPU *cpu, u32 operand) {
+    memory_write(cpu->mem, cpu_data_addr(cpu, operand), cpu->a & 0xFF);
+}
+
+static void op_stz_abs8(CPU *cpu, u32 operand) {
+    memory_write(cpu->mem, cpu_data_addr(cpu, operand), 0);
+}
+
+static void op_txa8(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->a = (cpu->a & 0xFF00) | (cpu->x & 0xFF);
+    cpu_set_nz8(cpu, cpu->a & 0xFF);
+}
+
+static void op_tya8(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->a = (cpu->a & 0xFF00) | (cpu->y & 0xFF);
+    cpu_set_nz8(cpu, cpu->a & 0xFF);
+}
+
+static void op_adc_imm8(CPU *cpu, u32 operand) {
+    u8 a = cpu->a & 0xFF;
+    u8 value = operand & 0xFF;
+    u16 result = a + value + (cpu->p & FLAG_C);
+
+    cpu->a = (cpu->a & 0xFF00) | (result & 0xFF);
+    cpu_put_flag(cpu, FLAG_C, result > 0xFF);
+    cpu_put_flag(cpu, FLAG_V, ((a ^ result) & (value ^ result) & 0x80) != 0);
+    cpu_set_nz8(cpu, result & 0xFF);
+}
+
+static void op_sbc_imm8(CPU *cpu, u32 operand) {
+    u8 a = cpu->a & 0xFF;
+    u8 value = operand & 0xFF;
+    u16 result = a - value - ((cpu->p & FLAG_C) ? 0 : 1);
+
+    cpu->a = (cpu->a & 0xFF00) | (result & 0xFF);
+    cpu_put_flag(cpu, FLAG_C, result <= 0xFF);
+    cpu_put_flag(cpu, FLAG_V, ((a ^ value) & (a ^ result) & 0x80) != 0);
+    cpu_set_nz8(cpu, result & 0xFF);
+}
+
+static void op_and_imm8(CPU *cpu, u32 operand) {
+    cpu->a &= 0xFF00 | operand;
+    cpu_set_nz8(cpu, cpu->a & 0xFF);
+}
+
+static void op_ora_imm8(CPU *cpu, u32 operand) {
+    cpu->a |= operand & 0xFF;
+    cpu_set_nz8(cpu, cpu->a & 0xFF);
+}
+
+static void op_eor_imm8(CPU *cpu, u32 operand) {
+    cpu->a ^= operand & 0xFF;
+    cpu_set_nz8(cpu, cpu->a & 0xFF);
+}
+
+static void op_cmp_imm8(CPU *cpu, u32 operand) {
+    u8 a = cpu->a & 0xFF;
+    u8 value = operand & 0xFF;
+
+    cpu_put_flag(cpu, FLAG_C, a >= value);
+    cpu_set_nz8(cpu, (u8)(a - value));
+}
+
+/* Opcode handlers - 16-bit accumulator (M=0) */
+
+static void op_lda_imm16(CPU *cpu, u32 operand) {
+    cpu->a = operand & 0xFFFF;
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+static void op_lda_abs16(CPU *cpu, u32 operand) {
+    cpu->a = memory_read16(cpu->mem, cpu_data_addr(cpu, operand));
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+static void op_sta_abs16(CPU *cpu, u32 operand) {
+    memory_write16(cpu->mem, cpu_data_addr(cpu, operand), cpu->a);
+}
+
+static void op_stz_abs16(CPU *cpu, u32 operand) {
+    memory_write16(cpu->mem, cpu_data_addr(cpu, operand), 0);
+}
+
+static void op_txa16(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->a = cpu->x;
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+static void op_tya16(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->a = cpu->y;
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+static void op_adc_imm16(CPU *cpu, u32 operand) {
+    u16 a = cpu->a;
+    u16 value = operand & 0xFFFF;
+    u32 result = a + value + (cpu->p & FLAG_C);
+
+    cpu->a = result & 0xFFFF;
+    cpu_put_flag(cpu, FLAG_C, result > 0xFFFF);
+    cpu_put_flag(cpu, FLAG_V, ((a ^ result) & (value ^ result) & 0x8000) != 0);
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+static void op_sbc_imm16(CPU *cpu, u32 operand) {
+    u16 a = cpu->a;
+    u16 value = operand & 0xFFFF;
+    u32 result = a - value - ((cpu->p & FLAG_C) ? 0 : 1);
+
+    cpu->a = result & 0xFFFF;
+    cpu_put_flag(cpu, FLAG_C, result <= 0xFFFF);
+    cpu_put_flag(cpu, FLAG_V, ((a ^ value) & (a ^ result) & 0x8000) != 0);
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+static void op_and_imm16(CPU *cpu, u32 operand) {
+    cpu->a &= operand;
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+static void op_ora_imm16(CPU *cpu, u32 operand) {
+    cpu->a |= operand;
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+static void op_eor_imm16(CPU *cpu, u32 operand) {
+    cpu->a ^= operand;
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+static void op_cmp_imm16(CPU *cpu, u32 operand) {
+    u16 value = operand & 0xFFFF;
+
+    cpu_put_flag(cpu, FLAG_C, cpu->a >= value);
+    cpu_set_nz16(cpu, (u16)(cpu->a - value));
+}
+
+/* Opcode handlers - 8-bit index registers (X=1) */
+
+static void op_ldx_imm8(CPU *cpu, u32 operand) {
+    cpu->x = operand & 0xFF;
+    cpu_set_nz8(cpu, cpu->x);
+}
+
+static void op_ldy_imm8(CPU *cpu, u32 operand) {
+    cpu->y = operand & 0xFF;
+    cpu_set_nz8(cpu, cpu->y);
+}
+
+static void op_ldx_abs8(CPU *cpu, u32 operand) {
+    cpu->x = memory_read(cpu->mem, cpu_data_addr(cpu, operand));
+    cpu_set_nz8(cpu, cpu->x);
+}
+
+static void op_ldy_abs8(CPU *cpu, u32 operand) {
+    cpu->y = memory_read(cpu->mem, cpu_data_addr(cpu, operand));
+    cpu_set_nz8(cpu, cpu->y);
+}
+
+static void op_stx_abs8(CPU *cpu, u32 operand) {
+    memory_write(cpu->mem, cpu_data_addr(cpu, operand), cpu->x & 0xFF);
+}
+
+static void op_sty_abs8(CPU *cpu, u32 operand) {
+    memory_write(cpu->mem, cpu_data_addr(cpu, operand), cpu->y & 0xFF);
+}
+
+static void op_tax8(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->x = cpu->a & 0xFF;
+    cpu_set_nz8(cpu, cpu->x);
+}
+
+static void op_tay8(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->y = cpu->a & 0xFF;
+    cpu_set_nz8(cpu, cpu->y);
+}
+
+static void op_tsx8(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->x = cpu->sp & 0xFF;
+    cpu_set_nz8(cpu, cpu->x);
+}
+
+static void op_inx8(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->x = (cpu->x + 1) & 0xFF;
+    cpu_set_nz8(cpu, cpu->x);
+}
+
+static void op_iny8(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->y = (cpu->y + 1) & 0xFF;
+    cpu_set_nz8(cpu, cpu->y);
+}
+
+static void op_dex8(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->x = (cpu->x - 1) & 0xFF;
+    cpu_set_nz8(cpu, cpu->x);
+}
+
+static void op_dey8(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->y = (cpu->y - 1) & 0xFF;
+    cpu_set_nz8(cpu, cpu->y);
+}
+
+static void op_cpx_imm8(CPU *cpu, u32 operand) {
+    u8 x = cpu->x & 0xFF;
+    u8 value = operand & 0xFF;
+
+    cpu_put_flag(cpu, FLAG_C, x >= value);
+    cpu_set_nz8(cpu, (u8)(x - value));
+}
+
+static void op_cpy_imm8(CPU *cpu, u32 operand) {
+    u8 y = cpu->y & 0xFF;
+    u8 value = operand & 0xFF;
+
+    cpu_put_flag(cpu, FLAG_C, y >= value);
+    cpu_set_nz8(cpu, (u8)(y - value));
+}
+
+/* Opcode handlers - 16-bit index registers (X=0) */
+
+static void op_ldx_imm16(CPU *cpu, u32 operand) {
+    cpu->x = operand & 0xFFFF;
+    cpu_set_nz16(cpu, cpu->x);
+}
+
+static void op_ldy_imm16(CPU *cpu, u32 operand) {
+    cpu->y = operand & 0xFFFF;
+    cpu_set_nz16(cpu, cpu->y);
+}
+
+static void op_ldx_abs16(CPU *cpu, u32 operand) {
+    cpu->x = memory_read16(cpu->mem, cpu_data_addr(cpu, operand));
+    cpu_set_nz16(cpu, cpu->x);
+}
+
+static void op_ldy_abs16(CPU *cpu, u32 operand) {
+    cpu->y = memory_read16(cpu->mem, cpu_data_addr(cpu, operand));
+    cpu_set_nz16(cpu, cpu->y);
+}
+
+static void op_stx_abs16(CPU *cpu, u32 operand) {
+    memory_write16(cpu->mem, cpu_data_addr(cpu, operand), cpu->x);
+}
+
+static void op_sty_abs16(CPU *cpu, u32 operand) {
+    memory_write16(cpu->mem, cpu_data_addr(cpu, operand), cpu->y);
+}
+
+static void op_tax16(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->x = cpu->a;
+    cpu_set_nz16(cpu, cpu->x);
+}
+
+static void op_tay16(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->y = cpu->a;
+    cpu_set_nz16(cpu, cpu->y);
+}
+
+static void op_tsx16(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->x = cpu->sp;
+    cpu_set_nz16(cpu, cpu->x);
+}
+
+static void op_inx16(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->x = (cpu->x + 1) & 0xFFFF;
+    cpu_set_nz16(cpu, cpu->x);
+}
+
+static void op_iny16(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->y = (cpu->y + 1) & 0xFFFF;
+    cpu_set_nz16(cpu, cpu->y);
+}
+
+static void op_dex16(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->x = (cpu->x - 1) & 0xFFFF;
+    cpu_set_nz16(cpu, cpu->x);
+}
+
+static void op_dey16(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->y = (cpu->y - 1) & 0xFFFF;
+    cpu_set_nz16(cpu, cpu->y);
+}
+
+static void op_cpx_imm16(CPU *cpu, u32 operand) {
+    u16 value = operand & 0xFFFF;
+
+    cpu_put_flag(cpu, FLAG_C, cpu->x >= value);
+    cpu_set_nz16(cpu, (u16)(cpu->x - value));
+}
+
+static void op_cpy_imm16(CPU *cpu, u32 operand) {
+    u16 value = operand & 0xFFFF;
+
+    cpu_put_flag(cpu, FLAG_C, cpu->y >= value);
+    cpu_set_nz16(cpu, (u16)(cpu->y - value));
+}
+
+/* Opcode handlers - stack operations (native mode) */
+
+static void op_pha8_native(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu_push8_native(cpu, cpu->a & 0xFF);
+}
+
+static void op_pha16_native(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu_push16_native(cpu, cpu->a);
+}
+
+static void op_pla8_native(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->a = (cpu->a & 0xFF00) | cpu_pull8_native(cpu);
+    cpu_set_nz8(cpu, cpu->a & 0xFF);
+}
+
+static void op_pla16_native(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->a = cpu_pull16_native(cpu);
+    cpu_set_nz16(cpu, cpu->a);
+}
+
+static void op_php_native(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu_push8_native(cpu, cpu->p);
+}
+
+static void op_plp_native(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->p = cpu_pull8_native(cpu);
+    cpu_update_dispatch(cpu);
+}
+
+static void op_jsr_native(CPU *cpu, u32 operand) {
+    cpu_push16_native(cpu, cpu->pc - 1);
+    cpu->pc = operand & 0xFFFF;
+}
+
+static void op_rts_native(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->pc = cpu_pull16_native(cpu) + 1;
+}
+
+static void op_rti_native(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->p = cpu_pull8_native(cpu);
+    cpu->pc = cpu_pull16_native(cpu);
+    cpu->pbr = cpu_pull8_native(cpu);
+    cpu_update_dispatch(cpu);
+}
+
+static void op_rtl_native(CPU *cpu, u32 operand) {
+    u16 addr = cpu_pull16_native(cpu);
+    (void)operand;
+    cpu->pbr = cpu_pull8_native(cpu);
+    cpu->pc = addr + 1;
+}
+
+static void op_txs_native(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->sp = cpu->x;
+}
+
+/* Opcode handlers - stack operations (emulation mode, always 8-bit) */
+
+static void op_pha_emu(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu_push8_emu(cpu, cpu->a & 0xFF);
+}
+
+static void op_pla_emu(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->a = (cpu->a & 0xFF00) | cpu_pull8_emu(cpu);
+    cpu_set_nz8(cpu, cpu->a & 0xFF);
+}
+
+static void op_php_emu(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu_push8_emu(cpu, cpu->p);
+}
+
+static void op_plp_emu(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->p = cpu_pull8_emu(cpu);
+    cpu_update_dispatch(cpu);
+}
+
+static void op_jsr_emu(CPU *cpu, u32 operand) {
+    cpu_push16_emu(cpu, cpu->pc - 1);
+    cpu->pc = operand & 0xFFFF;
+}
+
+static void op_rts_emu(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->pc = cpu_pull16_emu(cpu) + 1;
+}
+
+static void op_rti_emu(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->p = cpu_pull8_emu(cpu);
+    cpu->pc = cpu_pull16_emu(cpu);
+    cpu->pbr = cpu_pull8_emu(cpu);
+    cpu_update_dispatch(cpu);
+}
+
+static void op_rtl_emu(CPU *cpu, u32 operand) {
+    u16 addr = cpu_pull16_emu(cpu);
+    (void)operand;
+    cpu->pbr = cpu_pull8_emu(cpu);
+    cpu->pc = addr + 1;
+}
+
+static void op_txs_emu(CPU *cpu, u32 operand) {
+    (void)operand;
+    cpu->sp = 0x0100 | (cpu->x & 0xFF);
+}
+
+/*
+ * Dispatch tables
+ *
+ * Each group lists disjoint opcodes; a table is the union of the groups
+ * matching its M/X/E state.
+ */
+#define OP(handler, operand_bytes, cycles) \
+    { handler, operand_bytes, cycles, 0 }
+#define OP_END(handler, operand_bytes, cycles) \
+    { handler, operand_bytes, cycles, CPU_OP_ENDS_BLOCK }
+
+#define CPU_OPS_COMMON \
+    [0xEA] = OP(op_nop, 0, 2), \
+    [0x18] = OP(op_clc, 0, 2), \
+    [0x38] = OP(op_sec, 0, 2), \
+    [0x78] = OP(op_sei, 0, 2), \
+    [0x58] = OP(op_cli, 0, 2), \
+    [0xD8] = OP(op_cld, 0, 2), \
+    [0xF8] = OP(op_sed, 0, 2), \
+    [0xB8] = OP(op_clv, 0, 2), \
+    [0xC2] = OP_END(op_rep, 1, 3), \
+    [0xE2] = OP_END(op_sep, 1, 3), \
+    [0xFB] = OP_END(op_xce, 0, 2), \
+    [0x90] = OP_END(op_bcc, 1, 2), \
+    [0xB0] = OP_END(op_bcs, 1, 2), \
+    [0xF0] = OP_END(op_beq, 1, 2), \
+    [0xD0] = OP_END(op_bne, 1, 2), \
+    [0x30] = OP_END(op_bmi, 1, 2), \
+    [0x10] = OP_END(op_bpl, 1, 2), \
+    [0x50] = OP_END(op_bvc, 1, 2), \
+    [0x70] = OP_END(op_bvs, 1, 2), \
+    [0x80] = OP_END(op_bra, 1, 3), \
+    [0x4C] = OP_END(op_jmp_abs, 2, 3), \
+    [0x5C] = OP_END(op_jmp_long, 3, 4), \
+    [0x5B] = OP(op_tcd, 0, 2), \
+    [0x7B] = OP(op_tdc, 0, 2), \
+    [0x1B] = OP(op_tcs, 0, 2), \
+    [0x3B] = OP(op_tsc, 0, 2), \
+    [0x54] = OP_END(op_mvn, 2, 7), \
+    [0x44] = OP_END(op_mvp, 2, 7)
+
+#define CPU_OPS_M8 \
+    [0xA9] = OP(op_lda_imm8, 1, 2), \
+    [0xAD] = OP(op_lda_abs8, 2, 4), \
+    [0x8D] = OP(op_sta_abs8, 2, 4), \
+    [0x9C] = OP(op_stz_abs8, 2, 4), \
+    [0x8A] = OP(op_txa8, 0, 2), \
+    [0x98] = OP(op_tya8, 0, 2), \
+    [0x69] = OP(op_adc_imm8, 1, 2), \
+    [0xE9] = OP(op_sbc_imm8, 1, 2), \
+    [0x29] = OP(op_and_imm8, 1, 2), \
+    [0x09] = OP(op_ora_imm8, 1, 2), \
+    [0x49] = OP(op_eor_imm8, 1, 2), \
+    [0xC9] = OP(op_cmp_imm8, 1, 2)
+
+#define CPU_OPS_M16 \
+    [0xA9] = OP(op_lda_imm16, 2, 3), \
+    [0xAD] = OP(op_lda_abs16, 2, 5), \
+    [0x8D] = OP(op_sta_abs16, 2, 5), \
+    [0x9C] = OP(op_stz_abs16, 2, 5), \
+    [0x8A] = OP(op_txa16, 0, 2), \
+    [0x98] = OP(op_tya16, 0, 2), \
+    [0x69] = OP(op_adc_imm16, 2, 3), \
+    [0xE9] = OP(op_sbc_imm16, 2, 3), \
+    [0x29] = OP(op_and_imm16, 2, 3), \
+    [0x09] = OP(op_ora_imm16, 2, 3), \
+    [0x49] = OP(op_eor_imm16, 2, 3), \
+    [0xC9] = OP(op_cmp_imm16, 2, 3)
+
+#define CPU_OPS_X8 \
+    [0xA2] = OP(op_ldx_imm8, 1, 2), \
+    [0xA0] = OP(op_ldy_imm8, 1, 2), \
+    [0xAE] = OP(op_ldx_abs8, 2, 4), \
+    [0xAC] = OP(op_ldy_abs8, 2, 4), \
+    [0x8E] = OP(op_stx_abs8, 2, 4), \
+    [0x8C] = OP(op_sty_abs8, 2, 4), \
+    [0xAA] = OP(op_tax8, 0, 2), \
+    [0xA8] = OP(op_tay8, 0, 2), \
+    [0xBA] = OP(op_tsx8, 0, 2), \
+    [0xE8] = OP(op_inx8, 0, 2), \
+    [0xC8] = OP(op_iny8, 0, 2), \
+    [0xCA] = OP(op_dex8, 0, 2), \
+    [0x88] = OP(op_dey8, 0, 2), \
+    [0xE0] = OP(op_cpx_imm8, 1, 2), \
+    [0xC0] = OP(op_cpy_imm8, 1, 2)
+
+#define CPU_OPS_X16 \
+    [0xA2] = OP(op_ldx_imm16, 2, 3), \
+    [0xA0] = OP(op_ldy_imm16, 2, 3), \
+    [0xAE] = OP(op_ldx_abs16, 2, 5), \
+    [0xAC] = OP(op_ldy_abs16, 2, 5), \
+    [0x8E] = OP(op_stx_abs16, 2, 5), \
+    [0x8C] = OP(op_sty_abs16, 2, 5), \
+    [0xAA] = OP(op_tax16, 0, 2), \
+    [0xA8] = OP(op_tay16, 0, 2), \
+    [0xBA] = OP(op_tsx16, 0, 2), \
+    [0xE8] = OP(op_inx16, 0, 2), \
+    [0xC8] = OP(op_iny16, 0, 2), \
+    [0xCA] = OP(op_dex16, 0, 2), \
+    [0x88] = OP(op_dey16, 0, 2), \
+    [0xE0] = OP(op_cpx_imm16, 2, 3), \
+    [0xC0] = OP(op_cpy_imm16, 2, 3)
+
+#define CPU_OPS_STACK_NATIVE \
+    [0x08] = OP(op_php_native, 0, 3), \
+    [0x28] = OP_END(op_plp_native, 0, 4), \
+    [0x20] = OP_END(op_jsr_native, 2, 6), \
+    [0x60] = OP_END(op_rts_native, 0, 6), \
+    [0x40] = OP_END(op_rti_native, 0, 6), \
+    [0x6B] = OP_END(op_rtl_native, 0, 6), \
+    [0x9A] = OP(op_txs_native, 0, 2)
+
+#define CPU_OPS_STACK_NATIVE_M8 \
+    [0x48] = OP(op_pha8_native, 0, 3), \
+    [0x68] = OP(op_pla8_native, 0, 4)
+
+#define CPU_OPS_STACK_NATIVE_M16 \
+    [0x48] = OP(op_pha16_native, 0, 4), \
+    [0x68] = OP(op_pla16_native, 0, 5)
+
+#define CPU_OPS_STACK_EMU \
+    [0x48] = OP(op_pha_emu, 0, 3), \
+    [0x68] = OP(op_pla_emu, 0, 4), \
+    [0x08] = OP(op_php_emu, 0, 3), \
+    [0x28] = OP_END(op_plp_emu, 0, 4), \
+    [0x20] = OP_END(op_jsr_emu, 2, 6), \
+    [0x60] = OP_END(op_rts_emu, 0, 6), \
+    [0x40] = OP_END(op_rti_emu, 0, 6), \
+    [0x6B] = OP_END(op_rtl_emu, 0, 6), \
+    [0x9A] = OP(op_txs_emu, 0, 2)
+
+static const CpuOpcode cpu_dispatch_tables[CPU_DISPATCH_MODES][256] = {
+    /* CPU_DISPATCH_M16_X16 */
+    { CPU_OPS_COMMON, CPU_OPS_M16, CPU_OPS_X16,
+      CPU_OPS_STACK_NATIVE, CPU_OPS_STACK_NATIVE_M16 },
+    /* CPU_DISPATCH_M16_X8 */
+    { CPU_OPS_COMMON, CPU_OPS_M16, CPU_OPS_X8,
+      CPU_OPS_STACK_NATIVE, CPU_OPS_STACK_NATIVE_M16 },
+    /* CPU_DISPATCH_M8_X16 */
+    { CPU_OPS_COMMON, CPU_OPS_M8, CPU_OPS_X16,
+      CPU_OPS_STACK_NATIVE, CPU_OPS_STACK_NATIVE_M8 },
+    /* CPU_DISPATCH_M8_X8 */
+    { CPU_OPS_COMMON, CPU_OPS_M8, CPU_OPS_X8,
+      CPU_OPS_STACK_NATIVE, CPU_OPS_STACK_NATIVE_M8 },
+    /* CPU_DISPATCH_EMULATION */
+    { CPU_OPS_COMMON, CPU_OPS_M8, CPU_OPS_X8, CPU_OPS_STACK_EMU }
+};
+
+/* Fetch the operand bytes that follow the opcode and advance PC */
+static inline u32 cpu_fetch_operand(CPU *cpu, u8 operand_bytes) {
+    u32 addr = ((u32)cpu->pbr << 16) | cpu->pc;
+    u32 operand;
+
+    switch (operand_bytes) {
+        case 0:  return 0;
+        case 1:  operand = memory_read(cpu->mem, addr); break;
+        case 2:  operand = memory_read16(cpu->mem, addr); break;
+        default: operand = memory_read24(cpu->mem, addr); break;
+    }
+
+    cpu->pc += operand_bytes;
+    return operand;
+}
+
+u32 cpu_step(CPU *cpu) {
+    const CpuOpcode *op;
+    u8 opcode;
+
+    if (cpu->stopped) {
+        return 1;
+    }
+
+    /* Check for breakpoint */
+    if (cpu->breakpoint_count && cpu_check_breakpoint(cpu)) {
+        cpu->breakpoint_hit = true;
+        cpu->stopped = true;
+        printf("Breakpoint hit at $%02X:%04X\n", cpu->pbr, cpu->pc);
+        return 1;
+    }
+
+    /* Handle pending interrupts */
+    cpu->instruction_cycles = 0;
+    if (cpu->nmi_pending) {
+        cpu_handle_nmi(cpu);
+        cpu->cycles += cpu->instruction_cycles;
+        return cpu->instruction_cycles;
+    }
+
+    if (cpu->irq_pending && !cpu_get_flag(cpu, FLAG_I)) {
+        cpu_handle_irq(cpu);
+        cpu->cycles += cpu->instruction_cycles;
+        return cpu->instruction_cycles;
+    }
+
+    /* Fetch opcode and look it up in the table for the current M/X/E state */
+    opcode = memory_read(cpu->mem, ((u32)cpu->pbr << 16) | cpu->pc);
+    cpu->pc++;
+    op = &cpu_dispatch_tables[cpu->dispatch_mode][opcode];
+
+    if (!op->handler) {
+        /* Unimplemented opcode */
+        printf("Unimplemented opcode: $%02X at $%02X:%04X\n",
+               opcode, cpu->pbr, cpu->pc - 1);
+        cpu->stopped = true;
+        cpu->instruction_cycles = 2;
+    } else {
+        u32 operand = cpu_fetch_operand(cpu, op->operand_bytes);
+        cpu->instruction_cycles = op->cycles;
+        op->handler(cpu, operand);
+    }
+
+    /* Update cycle counter */
+    cpu->cycles += cpu->instruction_cycles;
+
+    return cpu->instruction_cycles;
+}
+
+void cpu_flush_block_cache(CPU *cpu) {
+    if (cpu->block_cache) {
+        cpu->block_cache->epoch++;
+    }
+}
+
+void cpu_cleanup(CPU *cpu) {
+    free(cpu->block_cache);
+    cpu->block_cache = NULL;
+}
+
+/* Drop the blocks covering WRAM spans written since the last check */
+static void cpu_drop_written_blocks(Memory *mem, CpuBlockCache *cache) {
+    u32 i;
+    u8 w;
+
+    for (i = 0; i < CPU_BLOCK_CACHE_SIZE; i++) {
+        CpuBlock *block = &cache->blocks[i];
+
+        if (block->epoch != cache->epoch || block->span_first > block->span_last) {
+            continue;
+        }
+        for (w = 0; w < mem->code_written_count; w++) {
+            if (mem->code_written[w] >= block->span_first &&
+                mem->code_written[w] <= block->span_last) {
+                block->epoch = 0;
+                break;
             }
+        }
+    }
+    mem->code_written_count = 0;
+}
+
+/* Drop cached blocks whose code may have changed */
+static inline void cpu_check_block_cache(const CPU *cpu, CpuBlockCache *cache) {
+    Memory *mem = cpu->mem;
+    const Cartridge *cart = mem->cart;
+    u32 rom_generation = cart ? cart->rom_generation : 0;
+
+    if (cache->code_generation != mem->code_generation ||
+        cache->rom_generation != rom_generation || cache->cart != cart) {
+        cache->code_generation = mem->code_generation;
+        cache->rom_generation = rom_generation;
+        cache->cart = cart;
+        cache->epoch++;
+        mem->code_written_count = 0;
+    } else if (mem->code_written_count) {
+        cpu_drop_written_blocks(mem, cache);
+    }
+}
+
+/* Decode a block starting at the current PC; returns NULL if not cacheable */
+static CpuBlock *cpu_build_block(CPU *cpu, CpuBlock *block, u32 key) {
+    u32 address = ((u32)cpu->pbr << 16) | cpu->pc;
+    const u8 *page = cpu->mem->read_map[address >> MEMORY_PAGE_SHIFT];
+    const CpuOpcode *table = cpu_dispatch_tables[cpu->dispatch_mode];
+    u32 start = address & MEMORY_PAGE_MASK;
+    u32 index = start;
+    u32 span;
+    u8 count = 0;
+
+    if (!page) {
+        return NULL;
+    }
+
+    while (count < CPU_BLOCK_MAX_INSNS && index < MEMORY_PAGE_SIZE) {
+        const CpuOpcode *op = &table[page[index]];
+        CpuDecodedOp *decoded = &block->ops[count];
+        u32 operand = 0;
+        u8 i;
+
+        /* Unimplemented opcodes and page-crossing instructions end the block */
+        if (!op->handler || index + op->operand_bytes >= MEMORY_PAGE_SIZE) {
             break;
-            
-        /* Block Move Operations */
-        case 0x54:  /* MVN - Block Move Next (incrementing) */
-            {
-                u8 dest_bank = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                u8 src_bank = memory_read(&g_memory, (cpu->pbr << 16) | (cpu->pc + 1));
-                cpu->pc += 2;
-                
-                /* Move one byte from [src_bank:X] to [dest_bank:Y] */
-                u32 src_addr = (src_bank << 16) | cpu->x;
-                u32 dest_addr = (dest_bank << 16) | cpu->y;
-                u8 value = memory_read(&g_memory, src_addr);
-                memory_write(&g_memory, dest_addr, value);
-                
-                /* Increment source and destination */
-                cpu->x++;
-                cpu->y++;
-                
-                /* Decrement counter (accumulator) */
-                cpu->a--;
-                
-                /* If A != 0xFFFF, repeat this instruction */
-                if (cpu->a != 0xFFFF) {
-                    cpu->pc -= 3;  /* Re-execute this instruction */
-                }
-                
-                /* Set DBR to destination bank */
-                cpu->dbr = dest_bank;
-                
-                /* 7 cycles per byte moved */
-                cpu->instruction_cycles = 7;
-            }
+        }
+
+        for (i = 0; i < op->operand_bytes; i++) {
+            operand |= (u32)page[index + 1 + i] << (8 * i);
+        }
+
+        decoded->handler = op->handler;
+        decoded->operand = operand;
+        decoded->length = 1 + op->operand_bytes;
+        decoded->cycles = op->cycles;
+        count++;
+        index += decoded->length;
+
+        if (op->flags & CPU_OP_ENDS_BLOCK) {
             break;
-            
-        case 0x44:  /* MVP - Block Move Previous (decrementing) */
-            {
-                u8 dest_bank = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
-                u8 src_bank = memory_read(&g_memory, (cpu->pbr << 16) | (cpu->pc + 1));
-                cpu->pc += 2;
-                
-                /* Move one byte from [src_bank:X] to [dest_bank:Y] */
-                u32 src_addr = (src_bank << 16) | cpu->x;
-                u32 dest_addr = (dest_bank << 16) | cpu->y;
-                u8 value = memory_read(&g_memory, src_addr);
-                memory_write(&g_memory, dest_addr, value);
-                
-                /* Decrement source and destination */
-                cpu->x--;
-                cpu->y--;
-                
-                /* Decrement counter (accumulator) */
-                cpu->a--;
-                
-                /* If A != 0xFFFF, repeat this instruction */
-                if (cpu->a != 0xFFFF) {
-                    cpu->pc -= 3;  /* Re-execute this instruction */
-                }
-                
-                /* Set DBR to destination bank */
-                cpu->dbr = dest_bank;
-                
-                /* 7 cycles per byte moved */
-                cpu->instruction_cycles = 7;
+        }
+    }
+
+    if (count == 0) {
+        return NULL;
+    }
+
+    /* Writes to these bytes must now drop the block */
+    span = memory_watch_span(cpu->mem, address);
+    if (span < MEMORY_WATCH_SPANS) {
+        memory_mark_code(cpu->mem, address, index - start);
+        block->span_first = (u16)span;
+        block->span_last = (u16)memory_watch_span(cpu->mem, address + index - start - 1);
+    } else {
+        block->span_first = 1;
+        block->span_last = 0;
+    }
+
+    block->key = key;
+    block->epoch = cpu->block_cache->epoch;
+    block->count = count;
+    return block;
+}
+
+/* Find or build the block at the current PC */
+static CpuBlock *cpu_lookup_block(CPU *cpu) {
+    CpuBlockCache *cache = cpu->block_cache;
+    u32 key = ((u32)cpu->pbr << 16) | cpu->pc | ((u32)cpu->dispatch_mode << 24);
+    u32 hash = (key ^ (key >> 10) ^ (key >> 20)) & (CPU_BLOCK_CACHE_SIZE - 1);
+    CpuBlock *block = &cache->blocks[hash];
+
+    if (block->epoch == cache->epoch && block->key == key) {
+        return block;
+    }
+    return cpu_build_block(cpu, block, key);
+}
+
+void cpu_run_until(CPU *cpu, u64 timestamp) {
+    while (cpu->cycles < timestamp && !cpu->stopped) {
+        CpuBlockCache *cache = cpu->block_cache;
+        CpuBlock *block;
+        u8 i;
+
+        /* Breakpoints, interrupts and uncached code take the step path */
+        if (!cache || cpu->breakpoint_count || cpu->nmi_pending ||
+            (cpu->irq_pending && !(cpu->p & FLAG_I))) {
+            cpu_step(cpu);
+            continue;
+        }
+
+        cpu_check_block_cache(cpu, cache);
+        block = cpu_lookup_block(cpu);
+        if (!block) {
+            cpu_step(cpu);
+            continue;
+        }
+
+        for (i = 0; i < block->count; i++) {
+            const CpuDecodedOp *op = &block->ops[i];
+
+            cpu->pc += op->length;
+            cpu->instruction_cycles = op->cycles;
+            op->handler(cpu, op->operand);
+            cpu->cycles += cpu->instruction_cycles;
+
+            /* Stop early at the deadline or on self-modifying code */
+            if (cpu->cycles >= timestamp || cpu->mem->code_written_count ||
+                cache->code_generation != cpu->mem->code_generation) {
+                break;
             }
-            break;
-            
-        default:
-            /* Unimplemented opcode */
-            printf("Unimplemented opcode: $%02X at $%02X:%04X\n", 
-                   opcode, cpu->pbr, cpu->pc - 1);
-            cpu->stopped = true;
-            cpu->instruction_cycles = 2;
-            break;
+        }
     }
-    
-    /* Update cycle counter */
-    cpu->cycles += cpu->instruction_cycles;
-    
-    return cpu->instruction_cycles;
 }
 
 void cpu_run(CPU *cpu, u32 cycles) {
-    u32 cycles_run = 0;
-    
-    while (cycles_run < cycles && !cpu->stopped) {
-        cycles_run += cpu_step(cpu);
-    }
+    cpu_run_until(cpu, cpu->cycles + cycles);
 }
 
 void cpu_disassemble(const CPU *cpu, char *buffer, size_t size) {
-    u8 opcode = memory_read(&g_memory, (cpu->pbr << 16) | cpu->pc);
+    u8 opcode = memory_read(cpu->mem, (cpu->pbr << 16) | cpu->pc);
     
     /* Simplified disassembly */
     switch (opcode) {
@@ -1110,39 +1281,39 @@ void cpu_disassemble(const CPU *cpu, char *buffer, size_t size) {
         
         case 0xC2:
             snprintf(buffer, size, "REP #$%02X", 
-                    memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0xE2:
             snprintf(buffer, size, "SEP #$%02X",
-                    memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
             
         /* Load instructions */
         case 0xA9:
             if (cpu_get_flag(cpu, FLAG_M)) {
                 snprintf(buffer, size, "LDA #$%02X",
-                        memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             } else {
                 snprintf(buffer, size, "LDA #$%04X",
-                        memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             }
             break;
         case 0xA2:
             if (cpu_get_flag(cpu, FLAG_X)) {
                 snprintf(buffer, size, "LDX #$%02X",
-                        memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             } else {
                 snprintf(buffer, size, "LDX #$%04X",
-                        memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             }
             break;
         case 0xA0:
             if (cpu_get_flag(cpu, FLAG_X)) {
                 snprintf(buffer, size, "LDY #$%02X",
-                        memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             } else {
                 snprintf(buffer, size, "LDY #$%04X",
-                        memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             }
             break;
             
@@ -1167,47 +1338,47 @@ void cpu_disassemble(const CPU *cpu, char *buffer, size_t size) {
         /* Branch instructions */
         case 0x90:
             snprintf(buffer, size, "BCC $%04X",
-                    cpu->pc + 2 + (s8)memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    cpu->pc + 2 + (s8)memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0xB0:
             snprintf(buffer, size, "BCS $%04X",
-                    cpu->pc + 2 + (s8)memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    cpu->pc + 2 + (s8)memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0xF0:
             snprintf(buffer, size, "BEQ $%04X",
-                    cpu->pc + 2 + (s8)memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    cpu->pc + 2 + (s8)memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0xD0:
             snprintf(buffer, size, "BNE $%04X",
-                    cpu->pc + 2 + (s8)memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    cpu->pc + 2 + (s8)memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0x30:
             snprintf(buffer, size, "BMI $%04X",
-                    cpu->pc + 2 + (s8)memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    cpu->pc + 2 + (s8)memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0x10:
             snprintf(buffer, size, "BPL $%04X",
-                    cpu->pc + 2 + (s8)memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    cpu->pc + 2 + (s8)memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0x80:
             snprintf(buffer, size, "BRA $%04X",
-                    cpu->pc + 2 + (s8)memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    cpu->pc + 2 + (s8)memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
             
         /* Jump instructions */
         case 0x4C:
             snprintf(buffer, size, "JMP $%04X",
-                    memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0x5C:
             snprintf(buffer, size, "JML $%06X",
-                    memory_read24(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read24(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
             
         /* Subroutine instructions */
         case 0x20:
             snprintf(buffer, size, "JSR $%04X",
-                    memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0x60: snprintf(buffer, size, "RTS"); break;
         case 0x40: snprintf(buffer, size, "RTI"); break;
@@ -1216,52 +1387,52 @@ void cpu_disassemble(const CPU *cpu, char *buffer, size_t size) {
         /* Store instructions */
         case 0x8D:
             snprintf(buffer, size, "STA $%04X",
-                    memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0x8E:
             snprintf(buffer, size, "STX $%04X",
-                    memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0x8C:
             snprintf(buffer, size, "STY $%04X",
-                    memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0x9C:
             snprintf(buffer, size, "STZ $%04X",
-                    memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
             
         /* Load absolute */
         case 0xAD:
             snprintf(buffer, size, "LDA $%04X",
-                    memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0xAE:
             snprintf(buffer, size, "LDX $%04X",
-                    memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0xAC:
             snprintf(buffer, size, "LDY $%04X",
-                    memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
             
         /* Arithmetic */
         case 0x69:
             if (cpu_get_flag(cpu, FLAG_M)) {
                 snprintf(buffer, size, "ADC #$%02X",
-                        memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             } else {
                 snprintf(buffer, size, "ADC #$%04X",
-                        memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             }
             break;
         case 0xE9:
             if (cpu_get_flag(cpu, FLAG_M)) {
                 snprintf(buffer, size, "SBC #$%02X",
-                        memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             } else {
                 snprintf(buffer, size, "SBC #$%04X",
-                        memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             }
             break;
             
@@ -1269,28 +1440,28 @@ void cpu_disassemble(const CPU *cpu, char *buffer, size_t size) {
         case 0x29:
             if (cpu_get_flag(cpu, FLAG_M)) {
                 snprintf(buffer, size, "AND #$%02X",
-                        memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             } else {
                 snprintf(buffer, size, "AND #$%04X",
-                        memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             }
             break;
         case 0x09:
             if (cpu_get_flag(cpu, FLAG_M)) {
                 snprintf(buffer, size, "ORA #$%02X",
-                        memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             } else {
                 snprintf(buffer, size, "ORA #$%04X",
-                        memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             }
             break;
         case 0x49:
             if (cpu_get_flag(cpu, FLAG_M)) {
                 snprintf(buffer, size, "EOR #$%02X",
-                        memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             } else {
                 snprintf(buffer, size, "EOR #$%04X",
-                        memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             }
             break;
             
@@ -1298,39 +1469,39 @@ void cpu_disassemble(const CPU *cpu, char *buffer, size_t size) {
         case 0xC9:
             if (cpu_get_flag(cpu, FLAG_M)) {
                 snprintf(buffer, size, "CMP #$%02X",
-                        memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             } else {
                 snprintf(buffer, size, "CMP #$%04X",
-                        memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             }
             break;
         case 0xE0:
             if (cpu_get_flag(cpu, FLAG_X)) {
                 snprintf(buffer, size, "CPX #$%02X",
-                        memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             } else {
                 snprintf(buffer, size, "CPX #$%04X",
-                        memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             }
             break;
         case 0xC0:
             if (cpu_get_flag(cpu, FLAG_X)) {
                 snprintf(buffer, size, "CPY #$%02X",
-                        memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             } else {
                 snprintf(buffer, size, "CPY #$%04X",
-                        memory_read16(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                        memory_read16(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             }
             break;
             
         /* Additional branches */
         case 0x50:
             snprintf(buffer, size, "BVC $%04X",
-                    cpu->pc + 2 + (s8)memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    cpu->pc + 2 + (s8)memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
         case 0x70:
             snprintf(buffer, size, "BVS $%04X",
-                    cpu->pc + 2 + (s8)memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1));
+                    cpu->pc + 2 + (s8)memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1));
             break;
             
         /* Additional transfers */
@@ -1345,13 +1516,13 @@ void cpu_disassemble(const CPU *cpu, char *buffer, size_t size) {
         /* Block Move instructions */
         case 0x54:
             snprintf(buffer, size, "MVN $%02X,$%02X",
-                    memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1),
-                    memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 2));
+                    memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1),
+                    memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 2));
             break;
         case 0x44:
             snprintf(buffer, size, "MVP $%02X,$%02X",
-                    memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 1),
-                    memory_read(&g_memory, ((cpu->pbr << 16) | cpu->pc) + 2));
+                    memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 1),
+                    memory_read(cpu->mem, ((cpu->pbr << 16) | cpu->pc) + 2));
             break;
             
         default:
@@ -0,0 +1,246 @@
+/*
+ * emulator.c - Emulator instance implementation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/emulator.h"
+#include "../include/thread.h"
+
+/* CPU I/O registers ($4200-$421F) */
+#define REG_NMITIMEN 0x4200
+#define REG_HTIMEL   0x4207
+#define REG_HTIMEH   0x4208
+#define REG_VTIMEL   0x4209
+#define REG_VTIMEH   0x420A
+#define REG_RDNMI    0x4210
+#define REG_TIMEUP   0x4211
+#define REG_JOY1L    0x4218
+#define REG_JOY1H    0x4219
+#define REG_JOY2L    0x421A
+#define REG_JOY2H    0x421B
+
+RomImage *rom_image_load(const char *filename) {
+    RomImage *image = (RomImage *)calloc(1, sizeof(RomImage));
+    
+    if (!image) {
+        return NULL;
+    }
+    if (cartridge_load(&image->cart, filename) != SUCCESS) {
+        free(image);
+        return NULL;
+    }
+    image->refcount = 1;
+    return image;
+}
+
+RomImage *rom_image_retain(RomImage *image) {
+    atomic_increment_u32(&image->refcount);
+    return image;
+}
+
+void rom_image_release(RomImage *image) {
+    if (image && atomic_decrement_u32(&image->refcount) == 0) {
+        cartridge_unload(&image->cart);
+        free(image);
+    }
+}
+
+static u8 *io_register(Emulator *emu, u16 address) {
+    return memory_io_register(&emu->memory, address);
+}
+
+/* Schedule the H/V timer IRQ for the scanline starting at line_start */
+static void schedule_irq_timer(Emulator *emu, u64 line_start) {
+    u8 nmitimen = *io_register(emu, REG_NMITIMEN);
+    u16 htime = (*io_register(emu, REG_HTIMEL) | (*io_register(emu, REG_HTIMEH) << 8)) & 0x1FF;
+    u16 vtime = (*io_register(emu, REG_VTIMEL) | (*io_register(emu, REG_VTIMEH) << 8)) & 0x1FF;
+    
+    switch ((nmitimen >> 4) & 0x03) {
+        case 1:  /* H-IRQ on every line */
+            scheduler_schedule(&emu->scheduler, EVENT_IRQ_TIMER, line_start + htime);
+            break;
+        case 2:  /* V-IRQ at the start of line VTIME */
+            if (emu->ppu.vcount == vtime) {
+                scheduler_schedule(&emu->scheduler, EVENT_IRQ_TIMER, line_start);
+            }
+            break;
+        case 3:  /* HV-IRQ at dot HTIME of line VTIME */
+            if (emu->ppu.vcount == vtime) {
+                scheduler_schedule(&emu->scheduler, EVENT_IRQ_TIMER, line_start + htime);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* Start the event chain for a frame beginning at the given CPU time */
+static void schedule_frame_start(Emulator *emu, u64 time) {
+    scheduler_schedule(&emu->scheduler, EVENT_SCANLINE, time + CYCLES_PER_SCANLINE);
+    scheduler_schedule(&emu->scheduler, EVENT_HBLANK, time + HBLANK_START_CYCLE);
+    if (emu->apu.sync_mode != APU_SYNC_LAZY) {
+        scheduler_schedule(&emu->scheduler, EVENT_APU_SYNC, time + CYCLES_PER_SCANLINE);
+    }
+    schedule_irq_timer(emu, time);
+}
+
+/* Handle a due scheduler event */
+static void handle_event(Emulator *emu, EventType type, u64 time) {
+    int channel;
+    
+    switch (type) {
+        case EVENT_SCANLINE:
+            ppu_step_scanline(&emu->ppu);
+            emu->ppu.hblank = false;
+            
+            scheduler_schedule(&emu->scheduler, EVENT_SCANLINE, time + CYCLES_PER_SCANLINE);
+            scheduler_schedule(&emu->scheduler, EVENT_HBLANK, time + HBLANK_START_CYCLE);
+            
+            if (emu->ppu.vcount == VBLANK_START_LINE) {
+                scheduler_schedule(&emu->scheduler, EVENT_VBLANK, time);
+            } else if (emu->ppu.vcount == 0) {
+                /* New frame: clear VBlank flag and reload HDMA tables */
+                *io_register(emu, REG_RDNMI) &= 0x7F;
+                for (channel = 0; channel < 8; channel++) {
+                    memory_hdma_init(&emu->memory, channel);
+                }
+            }
+            schedule_irq_timer(emu, time);
+            break;
+            
+        case EVENT_VBLANK:
+            /* Trigger NMI if enabled in NMITIMEN */
+            *io_register(emu, REG_RDNMI) |= 0x80;
+            if (*io_register(emu, REG_NMITIMEN) & 0x80) {
+                cpu_nmi(&emu->cpu);
+            }
+            
+            /* Auto-joypad read (NMITIMEN bit 0) latches into JOY1/JOY2 */
+            emu->input.auto_read = (*io_register(emu, REG_NMITIMEN) & 0x01) != 0;
+            input_auto_read(&emu->input);
+            if (emu->input.auto_read) {
+                *io_register(emu, REG_JOY1L) = (u8)emu->input.auto_joy1;
+                *io_register(emu, REG_JOY1H) = (u8)(emu->input.auto_joy1 >> 8);
+                *io_register(emu, REG_JOY2L) = (u8)emu->input.auto_joy2;
+                *io_register(emu, REG_JOY2H) = (u8)(emu->input.auto_joy2 >> 8);
+            }
+            break;
+            
+        case EVENT_IRQ_TIMER:
+            *io_register(emu, REG_TIMEUP) |= 0x80;
+            cpu_irq(&emu->cpu);
+            break;
+            
+        case EVENT_HBLANK:
+            emu->ppu.hblank = true;
+            if (emu->ppu.vcount < VBLANK_START_LINE) {
+                scheduler_schedule(&emu->scheduler, EVENT_HDMA, time);
+            }
+            break;
+            
+        case EVENT_HDMA:
+            memory_hdma_run(&emu->memory);
+            break;
+            
+        case EVENT_APU_SYNC:
+            apu_sync(&emu->apu, time);
+            scheduler_schedule(&emu->scheduler, EVENT_APU_SYNC, time + CYCLES_PER_SCANLINE);
+            break;
+            
+        default:
+            break;
+    }
+}
+
+/* Run the CPU and all scheduled events up to the given CPU time */
+static void run_until(Emulator *emu, u64 end_time) {
+    EventType type;
+    u64 time;
+    
+    while (emu->cpu.cycles < end_time && !emu->cpu.stopped) {
+        u64 next = scheduler_next_time(&emu->scheduler);
+        
+        /* Run the CPU uninterrupted until the next event is due */
+        cpu_run_until(&emu->cpu, next < end_time ? next : end_time);
+        
+        while (scheduler_pop(&emu->scheduler, emu->cpu.cycles, &type, &time)) {
+            handle_event(emu, type, time);
+        }
+    }
+}
+
+int emulator_init(Emulator *emu, RomImage *rom) {
+    memset(emu, 0, sizeof(Emulator));
+    emu->rom = rom_image_retain(rom);
+    
+    /* Share the ROM data; SRAM belongs to this instance */
+    emu->cart = rom->cart;
+    emu->cart.rom_backup = NULL;
+    emu->cart.has_backup = false;
+    emu->cart.rom_map = NULL;
+    emu->cart.backup_mapped = false;
+    emu->cart.sram_data = NULL;
+    if (emu->cart.has_sram && emu->cart.sram_size > 0) {
+        emu->cart.sram_data = (u8 *)calloc(emu->cart.sram_size, 1);
+        if (!emu->cart.sram_data) {
+            rom_image_release(emu->rom);
+            emu->rom = NULL;
+            return ERROR;
+        }
+    }
+    
+    memory_init(&emu->memory);
+    memory_set_cartridge(&emu->memory, &emu->cart);
+    
+    cpu_init(&emu->cpu, &emu->memory);
+    ppu_init(&emu->ppu);
+    input_init(&emu->input);
+    apu_init(&emu->apu);
+    scheduler_init(&emu->scheduler);
+    
+    /* Connect PPU to memory */
+    ppu_set_memory(&emu->ppu, emu->memory.vram, emu->memory.cgram, emu->memory.oam);
+    memory_set_ppu(&emu->memory, &emu->ppu);
+    
+    /* Route $2140-$217F to the APU, synced to the CPU clock (DMA stalls it) */
+    memory_set_apu(&emu->memory, &emu->apu, &emu->cpu.cycles);
+    memory_set_cpu_clock(&emu->memory, &emu->cpu.cycles);
+    
+    return SUCCESS;
+}
+
+void emulator_cleanup(Emulator *emu) {
+    apu_cleanup(&emu->apu);
+    cpu_cleanup(&emu->cpu);
+    ppu_cleanup(&emu->ppu);
+    
+    free(emu->cart.sram_data);
+    emu->cart.sram_data = NULL;
+    emu->cart.rom_data = NULL;
+    
+    rom_image_release(emu->rom);
+    emu->rom = NULL;
+}
+
+void emulator_run_frame(Emulator *emu) {
+    /* The first frame starts wherever the CPU is now */
+    if (!emu->running) {
+        schedule_frame_start(emu, emu->cpu.cycles);
+        emu->frame_end = emu->cpu.cycles;
+        emu->running = true;
+    }
+    
+    emu->frame_end += CYCLES_PER_FRAME;
+    run_until(emu, emu->frame_end);
+    
+    /* Let the APU catch up with the end of the frame */
+    apu_sync(&emu->apu, emu->cpu.cycles);
+    emu->frames++;
+}
+
+const u32 *emulator_present(Emulator *emu) {
+    ppu_render_flush(&emu->ppu);
+    return emu->ppu.framebuffer;
+}
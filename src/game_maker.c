@@ -372,6 +372,7 @@ void gamemaker_tile_editor(GameMaker *gm) {
                     if (f && gm->mem) {
                         size_t read = fread(&gm->mem->vram[gm->tile_editor.tile_addr], 1, 16, f);
                         fclose(f);
+                        memory_vram_written(gm->mem, gm->tile_editor.tile_addr, 16);
                         if (read == 16) {
                             gm->tile_editor.modified = true;
                             gm->unsaved_changes = true;
@@ -551,6 +552,7 @@ void gamemaker_tile_edit_pixel(GameMaker *gm, u8 x, u8 y, u8 color) {
         gm->mem->vram[addr + 1] &= ~bit_mask;
     }
     
+    memory_vram_written(gm->mem, addr, 2);
     gm->tile_editor.modified = true;
     gm->unsaved_changes = true;
 }
@@ -750,6 +752,7 @@ void gamemaker_sprite_editor(GameMaker *gm) {
                                   (gm->sprite_editor.h_flip ? 0x40 : 0) |
                                   ((gm->sprite_editor.sprite_palette & 7) << 1);
                         gm->mem->oam[oam_offset + 3] = attr;
+                        memory_oam_written(gm->mem, oam_offset, 4);
                         
                         gm->unsaved_changes = true;
                         gamemaker_set_status(gm, "Sprite saved to OAM");
@@ -950,6 +953,7 @@ void gamemaker_sprite_update(GameMaker *gm) {
     if (gm->sprite_editor.h_flip) attrib |= 0x40;
     if (gm->sprite_editor.v_flip) attrib |= 0x80;
     gm->mem->oam[oam_offset + 3] = attrib;
+    memory_oam_written(gm->mem, oam_offset, 4);
     
     gm->unsaved_changes = true;
     gamemaker_set_status(gm, "Sprite updated in OAM");
@@ -1153,6 +1157,7 @@ void gamemaker_tilemap_place_tile(GameMaker *gm) {
     /* Write to VRAM */
     gm->mem->vram[vram_addr] = tile_entry & 0xFF;
     gm->mem->vram[vram_addr + 1] = (tile_entry >> 8) & 0xFF;
+    memory_vram_written(gm->mem, vram_addr, 2);
     
     gm->unsaved_changes = true;
     gamemaker_set_status(gm, "Tile placed");
@@ -1307,6 +1312,7 @@ void gamemaker_palette_editor(GameMaker *gm) {
                     if (cgram_offset + 1 < CGRAM_SIZE) {
                         gm->mem->cgram[cgram_offset] = gm->palette_editor.color_value & 0xFF;
                         gm->mem->cgram[cgram_offset + 1] = (gm->palette_editor.color_value >> 8) & 0xFF;
+                        memory_cgram_written(gm->mem, cgram_offset, 2);
                         gm->palette_editor.modified = true;
                         gm->unsaved_changes = true;
                         printf("Color written to CGRAM\n");
@@ -1405,6 +1411,7 @@ int gamemaker_palette_import(GameMaker *gm, const char *filename) {
     if (base_addr + 32 <= CGRAM_SIZE) {
         bytes_read = fread(&gm->mem->cgram[base_addr], 1, 32, file);
         fclose(file);
+        memory_cgram_written(gm->mem, base_addr, 32);
         
         if (bytes_read == 32) {
             gm->unsaved_changes = true;
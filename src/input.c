@@ -4,6 +4,7 @@
 
 #include <string.h>
 #include "../include/input.h"
+#include "../include/movie.h"
 
 void input_init(InputSystem *input) {
     memset(input, 0, sizeof(InputSystem));
@@ -56,6 +57,10 @@ void input_set_buttons(InputSystem *input, u8 controller, u16 button_mask) {
     }
 }
 
+void input_set_movie(InputSystem *input, struct Movie *movie) {
+    input->movie = movie;
+}
+
 void input_write_strobe(InputSystem *input, u8 value) {
     bool new_strobe = (value & 0x01) != 0;
     
@@ -100,6 +105,11 @@ u8 input_read_joypad2(InputSystem *input) {
 }
 
 void input_auto_read(InputSystem *input) {
+    /* Movies record or replace the buttons once per frame */
+    if (input->movie) {
+        movie_step(input->movie, input);
+    }
+    
     /* Auto-read captures the current controller state during VBlank */
     if (input->auto_read) {
         input->auto_joy1 = input->joypad1.buttons;
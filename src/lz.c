@@ -0,0 +1,202 @@
+/*
+ * lz.c - Fast LZ77 block compression implementation
+ */
+
+#include <string.h>
+#include "../include/lz.h"
+
+#define LZ_MIN_MATCH   4
+#define LZ_MAX_OFFSET  0xFFFF
+#define LZ_HASH_BITS   13
+#define LZ_LAST_LITERALS 5   /* Block always ends with this many literals */
+#define LZ_MATCH_LIMIT 12    /* No match starts in the last 12 bytes */
+
+static inline u32 lz_read32(const u8 *p) {
+    u32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline u32 lz_hash(u32 sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Write a length extension (the part above 15) as 255-runs */
+static u8 *lz_put_length(u8 *out, u32 length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (u8)length;
+    return out;
+}
+
+/* Emit one sequence; match_length 0 = final literals only */
+static u8 *lz_put_sequence(u8 *out, const u8 *out_end, const u8 *literals,
+                           u32 literal_count, u32 offset, u32 match_length) {
+    u32 match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+    u8 *token = out;
+    
+    /* Worst case: token, literal length, literals, offset, match length */
+    if ((u32)(out_end - out) < 1 + literal_count / 255 + 1 + literal_count + 2 +
+                               match_code / 255 + 1) {
+        return NULL;
+    }
+    
+    out++;
+    *token = (u8)((literal_count < 15 ? literal_count : 15) << 4);
+    if (literal_count >= 15) {
+        out = lz_put_length(out, literal_count - 15);
+    }
+    memcpy(out, literals, literal_count);
+    out += literal_count;
+    
+    if (match_length) {
+        *out++ = (u8)(offset & 0xFF);
+        *out++ = (u8)(offset >> 8);
+        *token |= (u8)(match_code < 15 ? match_code : 15);
+        if (match_code >= 15) {
+            out = lz_put_length(out, match_code - 15);
+        }
+    }
+    return out;
+}
+
+u32 lz_compress_bound(u32 size) {
+    return size + size / 255 + 16;
+}
+
+u32 lz_compress(const u8 *src, u32 size, u8 *dst, u32 capacity) {
+    u32 table[1 << LZ_HASH_BITS];  /* Position + 1 of the last sequence per hash */
+    const u8 *out_end = dst + capacity;
+    u8 *out = dst;
+    u32 anchor = 0;
+    u32 pos = 0;
+    
+    memset(table, 0, sizeof(table));
+    
+    while (size > LZ_MATCH_LIMIT && pos < size - LZ_MATCH_LIMIT) {
+        u32 sequence = lz_read32(src + pos);
+        u32 hash = lz_hash(sequence);
+        u32 candidate = table[hash];
+        u32 length;
+        
+        table[hash] = pos + 1;
+        
+        if (candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET ||
+            lz_read32(src + candidate - 1) != sequence) {
+            /* Skip faster through data that does not compress */
+            pos += 1 + ((pos - anchor) >> 6);
+            continue;
+        }
+        candidate--;
+        
+        /* Extend forwards, then backwards over pending literals */
+        length = LZ_MIN_MATCH;
+        while (pos + length + 8 <= size - LZ_LAST_LITERALS &&
+               memcmp(src + candidate + length, src + pos + length, 8) == 0) {
+            length += 8;
+        }
+        while (pos + length < size - LZ_LAST_LITERALS &&
+               src[candidate + length] == src[pos + length]) {
+            length++;
+        }
+        while (pos > anchor && candidate > 0 && src[pos - 1] == src[candidate - 1]) {
+            pos--;
+            candidate--;
+            length++;
+        }
+        
+        out = lz_put_sequence(out, out_end, src + anchor, pos - anchor,
+                              pos - candidate, length);
+        if (!out) {
+            return 0;
+        }
+        
+        /* Index the start of the match so repeats are found sooner */
+        table[lz_hash(lz_read32(src + pos + 1))] = pos + 2;
+        pos += length;
+        anchor = pos;
+    }
+    
+    out = lz_put_sequence(out, out_end, src + anchor, size - anchor, 0, 0);
+    return out ? (u32)(out - dst) : 0;
+}
+
+/* Read a length extension; returns false if it runs past the input */
+static bool lz_get_length(const u8 **in, const u8 *in_end, u32 *length) {
+    u8 byte;
+    
+    do {
+        if (*in >= in_end) {
+            return false;
+        }
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+u32 lz_decompress(const u8 *src, u32 size, u8 *dst, u32 capacity) {
+    const u8 *in = src;
+    const u8 *in_end = src + size;
+    u8 *out = dst;
+    u8 *out_end = dst + capacity;
+    
+    while (in < in_end) {
+        u8 token = *in++;
+        u32 literal_count = token >> 4;
+        u32 match_length = token & 0x0F;
+        u32 offset;
+        
+        if (literal_count == 15 && !lz_get_length(&in, in_end, &literal_count)) {
+            return 0;
+        }
+        if ((u32)(in_end - in) < literal_count || (u32)(out_end - out) < literal_count) {
+            return 0;
+        }
+        memcpy(out, in, literal_count);
+        in += literal_count;
+        out += literal_count;
+        
+        /* The last sequence has literals only */
+        if (in == in_end) {
+            break;
+        }
+        
+        if (in_end - in < 2) {
+            return 0;
+        }
+        offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (offset == 0 || offset > (u32)(out - dst)) {
+            return 0;
+        }
+        
+        if (match_length == 15 && !lz_get_length(&in, in_end, &match_length)) {
+            return 0;
+        }
+        match_length += LZ_MIN_MATCH;
+        if ((u32)(out_end - out) < match_length) {
+            return 0;
+        }
+        
+        /* Overlapping matches repeat the pattern; the copyable span doubles */
+        {
+            const u8 *from = out - offset;
+            
+            while (match_length > 0) {
+                u32 count = (u32)(out - from);
+                
+                if (count > match_length) {
+                    count = match_length;
+                }
+                memcpy(out, from, count);
+                out += count;
+                match_length -= count;
+            }
+        }
+    }
+    
+    return (u32)(out - dst);
+}
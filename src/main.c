@@ -8,24 +8,142 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../include/types.h"
-#include "../include/cartridge.h"
-#include "../include/memory.h"
-#include "../include/cpu.h"
-#include "../include/ppu.h"
-#include "../include/input.h"
-#include "../include/apu.h"
+#include "../include/emulator.h"
+#include "../include/batch.h"
+#include "../include/savestate.h"
+#include "../include/movie.h"
+#include "../include/runahead.h"
+#include "../include/thread.h"
 #include "../include/game_maker.h"
 #include "../include/gui.h"
+#include "../include/performance.h"
 
 /* Global system components */
-Memory g_memory;
-CPU g_cpu;
-PPU g_ppu;
-InputSystem g_input;
-APU g_apu;
-Cartridge g_cartridge;
+static Emulator g_emulator;
+static Movie g_movie;
+static RunAhead g_runahead;
 GuiState g_gui;
 
+/* Parse --render MODE: always, never, request or N (every Nth frame) */
+static int parse_render_policy(const char *arg, PPURenderPolicy *policy, u32 *interval) {
+    int frames;
+    
+    if (strcmp(arg, "always") == 0) {
+        *policy = PPU_RENDER_ALWAYS;
+    } else if (strcmp(arg, "never") == 0) {
+        *policy = PPU_RENDER_NEVER;
+    } else if (strcmp(arg, "request") == 0) {
+        *policy = PPU_RENDER_ON_REQUEST;
+    } else if ((frames = atoi(arg)) > 0) {
+        *policy = PPU_RENDER_EVERY_NTH;
+        *interval = (u32)frames;
+    } else {
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/* Run the ROMs of a batch list and write the report */
+static int run_batch(const char *list, u32 frames, u32 threads, const char *report) {
+    Batch batch;
+    u32 total_frames = 0;
+    u32 failed = 0;
+    double seconds;
+    int result;
+    u32 i;
+    
+    batch_init(&batch);
+    if (batch_load_list(&batch, list, frames) != SUCCESS || batch.job_count == 0) {
+        fprintf(stderr, "Error: No runs in batch list '%s'\n", list);
+        batch_cleanup(&batch);
+        return 1;
+    }
+    
+    printf("Batch: %u runs of %u frames\n", batch.job_count, frames);
+    batch_run(&batch, threads);
+    result = batch_write_report(&batch, report);
+    
+    for (i = 0; i < batch.job_count; i++) {
+        if (batch.jobs[i].status == SUCCESS) {
+            total_frames += batch.jobs[i].frames;
+        } else {
+            failed++;
+        }
+    }
+    seconds = batch.elapsed_ns / 1e9;
+    printf("\nBatch complete: %u runs (%u failed) on %u threads in %.3f s (%.1f frames/s)\n",
+           batch.job_count, failed, batch.thread_count, seconds,
+           seconds > 0.0 ? total_frames / seconds : 0.0);
+    printf("Report written to %s\n", report);
+    
+    batch_cleanup(&batch);
+    return (result == SUCCESS && failed == 0) ? 0 : 1;
+}
+
+/* Restore the instance from a save state file */
+static int load_state(const char *filename) {
+    SaveState state;
+    u64 start;
+    int result;
+    
+    savestate_init(&state);
+    result = savestate_read_file(&state, filename);
+    if (result == SUCCESS) {
+        start = thread_time_ns();
+        result = savestate_load(&g_emulator, &state);
+        if (result == SUCCESS) {
+            printf("State loaded from %s in %.1f us\n", filename,
+                   (thread_time_ns() - start) / 1000.0);
+        } else {
+            fprintf(stderr, "Error: '%s' is not a save state of this ROM\n", filename);
+        }
+    }
+    savestate_free(&state);
+    return result;
+}
+
+/* Write a compressed save state of the instance */
+static int save_state(const char *filename) {
+    SaveState state;
+    u64 start;
+    int result;
+    
+    savestate_init(&state);
+    start = thread_time_ns();
+    result = savestate_save(&g_emulator, &state, SAVESTATE_COMPRESS);
+    if (result == SUCCESS) {
+        printf("State saved to %s (%u bytes) in %.1f us\n", filename, state.size,
+               (thread_time_ns() - start) / 1000.0);
+        result = savestate_write_file(&state, filename);
+    }
+    savestate_free(&state);
+    return result;
+}
+
+/* Replay a movie fast-forward up to its last frame (the test frame) */
+static int play_movie(const char *filename) {
+    u64 start;
+    u32 frames;
+    double seconds;
+    
+    if (movie_read_file(&g_movie, filename) != SUCCESS) {
+        return ERROR;
+    }
+    if (movie_play(&g_movie, &g_emulator.cart) != SUCCESS) {
+        fprintf(stderr, "Error: Movie '%s' was recorded with another ROM\n", filename);
+        return ERROR;
+    }
+    input_set_movie(&g_emulator.input, &g_movie);
+    
+    start = thread_time_ns();
+    frames = movie_fast_forward(&g_movie, &g_emulator,
+                                g_movie.frame_count > 0 ? g_movie.frame_count - 1 : 0);
+    seconds = (thread_time_ns() - start) / 1e9;
+    printf("Movie: %u of %u frames replayed in %.3f s (%.1f frames/s)\n", frames,
+           g_movie.frame_count, seconds, seconds > 0.0 ? frames / seconds : 0.0);
+    return SUCCESS;
+}
+
 static void print_usage(const char *program_name) {
     printf("SNESE - SNES Emulator with Built-in Game Maker\n");
     printf("Usage: %s [options] [rom_file.sfc]\n\n", program_name);
@@ -35,6 +153,19 @@ static void print_usage(const char *program_name) {
     printf("  -d, --debug      Enable debug mode\n");
     printf("  -g, --gui        Show ROM selection GUI (default if no ROM specified)\n");
     printf("  --maker          Launch game maker mode\n");
+    printf("  --apu-thread     Run the APU on its own thread (non-deterministic)\n");
+    printf("  --render-threads N  Draw scanlines on N worker threads (0 = one per spare core)\n");
+    printf("  --render MODE    Frames to draw: always, N (every Nth), request (output frame only), never\n");
+    printf("  --sizes          Print the layout of the core emulator structures\n");
+    printf("  --load-state FILE  Restore a save state before running\n");
+    printf("  --save-state FILE  Write a save state after running\n");
+    printf("  --run-ahead N    Emulate N frames ahead and roll back to cut input latency\n");
+    printf("  --record-movie FILE  Record the joypad input of the run\n");
+    printf("  --play-movie FILE  Replay a movie from reset, fast-forward to its last frame\n");
+    printf("  --batch LIST     Run the ROMs listed in LIST on a thread pool and write a report\n");
+    printf("  --frames N       Frames per batch run (default 60)\n");
+    printf("  --batch-threads N  Batch worker threads (0 = one per core, default)\n");
+    printf("  --report FILE    Batch report, CSV or JSON by extension (default batch_report.csv)\n");
     printf("\n");
     printf("If no ROM file is specified, the ROM selection GUI will be shown.\n");
     printf("\n");
@@ -56,6 +187,23 @@ int main(int argc, char *argv[]) {
     bool debug_mode = false;
     bool maker_mode = false;
     bool show_gui = false;
+    bool apu_thread = false;
+    int render_threads = -1;
+    PPURenderPolicy render_policy = PPU_RENDER_ALWAYS;
+    u32 render_interval = 1;
+    const char *batch_list = NULL;
+    const char *batch_report = "batch_report.csv";
+    u32 batch_frames = 60;
+    u32 batch_threads = 0;
+    const char *load_state_file = NULL;
+    const char *save_state_file = NULL;
+    const char *record_movie_file = NULL;
+    const char *play_movie_file = NULL;
+    u32 run_ahead = 0;
+    RomImage *rom;
+    CPU *cpu = &g_emulator.cpu;
+    PPU *ppu = &g_emulator.ppu;
+    APU *apu = &g_emulator.apu;
     
     print_banner();
     
@@ -72,11 +220,53 @@ int main(int argc, char *argv[]) {
             show_gui = true;
         } else if (strcmp(argv[i], "--maker") == 0) {
             maker_mode = true;
+        } else if (strcmp(argv[i], "--sizes") == 0) {
+            perf_print_struct_sizes();
+            return 0;
+        } else if (strcmp(argv[i], "--apu-thread") == 0) {
+            apu_thread = true;
+        } else if (strcmp(argv[i], "--render-threads") == 0 && i + 1 < argc) {
+            render_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--render") == 0 && i + 1 < argc) {
+            if (parse_render_policy(argv[++i], &render_policy, &render_interval) != SUCCESS) {
+                fprintf(stderr, "Error: Invalid render mode '%s'\n\n", argv[i]);
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--load-state") == 0 && i + 1 < argc) {
+            load_state_file = argv[++i];
+        } else if (strcmp(argv[i], "--save-state") == 0 && i + 1 < argc) {
+            save_state_file = argv[++i];
+        } else if (strcmp(argv[i], "--run-ahead") == 0 && i + 1 < argc) {
+            run_ahead = (u32)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--record-movie") == 0 && i + 1 < argc) {
+            record_movie_file = argv[++i];
+        } else if (strcmp(argv[i], "--play-movie") == 0 && i + 1 < argc) {
+            play_movie_file = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_list = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            batch_frames = (u32)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batch-threads") == 0 && i + 1 < argc) {
+            batch_threads = (u32)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            batch_report = argv[++i];
         } else if (argv[i][0] != '-') {
             rom_filename = argv[i];
         }
     }
     
+    if (record_movie_file && play_movie_file) {
+        fprintf(stderr, "Error: --record-movie and --play-movie are exclusive\n\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+    
+    /* Batch mode runs headless without the GUI */
+    if (batch_list) {
+        return run_batch(batch_list, batch_frames, batch_threads, batch_report);
+    }
+    
     /* Initialize GUI */
     if (gui_init(&g_gui) != SUCCESS) {
         fprintf(stderr, "Failed to initialize GUI\n");
@@ -104,19 +294,20 @@ int main(int argc, char *argv[]) {
     
     /* Load ROM cartridge */
     printf("Loading ROM: %s\n", rom_filename);
-    if (cartridge_load(&g_cartridge, rom_filename) != SUCCESS) {
+    rom = rom_image_load(rom_filename);
+    if (!rom) {
         fprintf(stderr, "Failed to load ROM file\n");
         gui_cleanup(&g_gui);
         return 1;
     }
     
     /* Display ROM information */
-    cartridge_print_info(&g_cartridge);
+    cartridge_print_info(&rom->cart);
     
     /* If info-only mode, exit here */
     if (info_only) {
         printf("Info-only mode: exiting\n");
-        cartridge_unload(&g_cartridge);
+        rom_image_release(rom);
         gui_cleanup(&g_gui);
         return 0;
     }
@@ -125,32 +316,30 @@ int main(int argc, char *argv[]) {
     if (maker_mode) {
         GameMaker game_maker;
         
-        /* Initialize memory for Game Maker */
-        memory_init(&g_memory);
-        memory_set_cartridge(&g_memory, &g_cartridge);
+        /* Initialize memory for Game Maker (it edits the ROM in place) */
+        memory_init(&g_emulator.memory);
+        memory_set_cartridge(&g_emulator.memory, &rom->cart);
         
         /* Enter Game Maker */
-        gamemaker_init(&game_maker, &g_cartridge, &g_memory);
+        gamemaker_init(&game_maker, &rom->cart, &g_emulator.memory);
         gamemaker_run(&game_maker);
         gamemaker_cleanup(&game_maker);
         
-        cartridge_unload(&g_cartridge);
+        rom_image_release(rom);
         gui_cleanup(&g_gui);
         return 0;
     }
     
     /* Initialize emulator components */
     printf("Initializing emulator...\n");
-    memory_init(&g_memory);
-    memory_set_cartridge(&g_memory, &g_cartridge);
-    
-    cpu_init(&g_cpu);
-    ppu_init(&g_ppu);
-    input_init(&g_input);
-    apu_init(&g_apu);
-    
-    /* Connect PPU to memory */
-    ppu_set_memory(&g_ppu, g_memory.vram, g_memory.cgram, g_memory.oam);
+    if (emulator_init(&g_emulator, rom) != SUCCESS) {
+        fprintf(stderr, "Failed to initialize emulator\n");
+        rom_image_release(rom);
+        gui_cleanup(&g_gui);
+        return 1;
+    }
+    rom_image_release(rom);  /* The instance holds its own reference */
+    ppu_set_render_policy(ppu, render_policy, render_interval);
     
     printf("Emulator initialized\n");
     printf("  CPU: 65c816 @ ~3.58 MHz\n");
@@ -167,12 +356,12 @@ int main(int argc, char *argv[]) {
     
     /* Print initial CPU state */
     if (debug_mode) {
-        cpu_print_state(&g_cpu);
+        cpu_print_state(cpu);
         printf("\n");
     }
     
     /* Display reset vector information */
-    printf("Reset vector: $%04X\n", g_cpu.pc);
+    printf("Reset vector: $%04X\n", cpu->pc);
     
     /* Read and display first few instructions */
     if (debug_mode) {
@@ -180,66 +369,105 @@ int main(int argc, char *argv[]) {
         printf("\nFirst instructions at reset vector:\n");
         
         for (i = 0; i < 5; i++) {
-            cpu_disassemble(&g_cpu, disasm_buffer, sizeof(disasm_buffer));
-            printf("  $%02X:%04X: %s\n", g_cpu.pbr, g_cpu.pc, disasm_buffer);
+            cpu_disassemble(cpu, disasm_buffer, sizeof(disasm_buffer));
+            printf("  $%02X:%04X: %s\n", cpu->pbr, cpu->pc, disasm_buffer);
             
             /* Step one instruction */
-            cpu_step(&g_cpu);
+            cpu_step(cpu);
             
-            if (g_cpu.stopped) {
+            if (cpu->stopped) {
                 printf("  CPU stopped (unimplemented opcode)\n");
                 break;
             }
         }
         
         printf("\nCPU state after %d instructions:\n", i);
-        cpu_print_state(&g_cpu);
+        cpu_print_state(cpu);
     } else {
         /* Run emulation loop for a short test */
         printf("\n=== Running Emulation Test ===\n");
         printf("Executing 1 frame of emulation...\n\n");
         
+        /* Continue from a saved state instead of reset */
+        if (load_state_file && load_state(load_state_file) != SUCCESS) {
+            emulator_cleanup(&g_emulator);
+            gui_cleanup(&g_gui);
+            return 1;
+        }
+        
+        /* Movies start from reset; the test frame is the last movie frame */
+        if (play_movie_file && play_movie(play_movie_file) != SUCCESS) {
+            movie_free(&g_movie);
+            emulator_cleanup(&g_emulator);
+            gui_cleanup(&g_gui);
+            return 1;
+        }
+        if (record_movie_file) {
+            movie_record(&g_movie, &g_emulator.cart);
+            input_set_movie(&g_emulator.input, &g_movie);
+        }
+        
         /* Run one frame worth of cycles */
         /* NTSC: ~89342 cycles per frame at 3.58 MHz / 60 Hz */
-        u32 frame_cycles = 89342;
-        u32 cycles_executed = 0;
+        u64 frame_start = cpu->cycles;
         
-        while (cycles_executed < frame_cycles && !g_cpu.stopped) {
-            /* Execute CPU */
-            u32 cpu_cycles = cpu_step(&g_cpu);
-            cycles_executed += cpu_cycles;
-            
-            /* Execute PPU (proportional to CPU cycles) */
-            /* PPU runs at same speed, roughly 1 scanline per 1364 cycles */
-            if (cycles_executed % 1364 == 0) {
-                ppu_step_scanline(&g_ppu);
-                
-                /* Trigger NMI on VBlank */
-                if (g_ppu.vcount == 225) {
-                    cpu_nmi(&g_cpu);
-                    input_auto_read(&g_input);
-                }
-            }
-            
-            /* Execute APU (runs slower, ~1.024 MHz) */
-            /* Approximately 1 APU cycle per 3.5 CPU cycles */
-            apu_run(&g_apu, cpu_cycles / 3);
+        /* Run-ahead rolls the APU back, so it needs the lazily synced one */
+        runahead_init(&g_runahead, run_ahead);
+        if (apu_thread && run_ahead > 0) {
+            fprintf(stderr, "Run-ahead needs the synchronous APU, ignoring --apu-thread\n");
+        } else if (apu_thread && apu_start_thread(apu, frame_start) != SUCCESS) {
+            fprintf(stderr, "Failed to start APU thread, using lazy sync\n");
+        }
+        
+        /* Scanlines are recorded and drawn by worker threads */
+        if (render_threads >= 0 &&
+            ppu_start_render_threads(ppu, (u32)render_threads) != SUCCESS) {
+            fprintf(stderr, "Failed to start render threads, rendering inline\n");
+        }
+        
+        /* The test frame is the one written out */
+        if (render_policy == PPU_RENDER_ON_REQUEST) {
+            ppu_request_frame(ppu);
+        }
+        
+        if (runahead_run_frame(&g_runahead, &g_emulator) != SUCCESS) {
+            fprintf(stderr, "Run-ahead failed\n");
         }
+        apu_stop_thread(apu);
+        
+        u32 cycles_executed = (u32)(cpu->cycles - frame_start);
         
         printf("Frame emulation complete:\n");
         printf("  CPU cycles: %u\n", cycles_executed);
-        printf("  PPU scanline: %u\n", g_ppu.vcount);
-        printf("  APU cycles: %lu\n", (unsigned long)g_apu.cpu.cycles);
+        printf("  PPU scanline: %u\n", ppu->vcount);
+        printf("  APU cycles: %lu\n", (unsigned long)apu->cpu.cycles);
+        if (run_ahead > 0) {
+            printf("  Run-ahead: %u frames, snapshot and rollback in %.1f us\n", run_ahead,
+                   g_runahead.snapshot_ns / 1000.0);
+        }
         
         /* Render and output frame */
-        if (g_ppu.framebuffer) {
-            ppu_render_frame(&g_ppu);
-            ppu_output_ppm(&g_ppu, "output_frame.ppm");
+        if (emulator_present(&g_emulator) && render_policy != PPU_RENDER_NEVER) {
+            ppu_render_frame(ppu);
+            ppu_output_ppm(ppu, "output_frame.ppm");
         }
         
         /* Output audio if any was generated */
-        if (g_apu.buffer_pos > 0) {
-            apu_output_wav(&g_apu, "output_audio.wav");
+        if (apu->buffer_pos > 0) {
+            apu_output_wav(apu, "output_audio.wav");
+        }
+        
+        if (save_state_file && save_state(save_state_file) != SUCCESS) {
+            fprintf(stderr, "Failed to save state\n");
+        }
+        
+        if (record_movie_file) {
+            if (movie_write_file(&g_movie, record_movie_file) == SUCCESS) {
+                printf("Movie of %u frames written to %s\n", g_movie.frame_count,
+                       record_movie_file);
+            } else {
+                fprintf(stderr, "Failed to write movie\n");
+            }
         }
     }
     
@@ -248,7 +476,9 @@ int main(int argc, char *argv[]) {
     printf("Full emulation loop will be implemented in Phase 2 and beyond\n\n");
     
     /* Cleanup */
-    cartridge_unload(&g_cartridge);
+    runahead_free(&g_runahead);
+    movie_free(&g_movie);
+    emulator_cleanup(&g_emulator);
     gui_cleanup(&g_gui);
     
     return 0;
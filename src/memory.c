@@ -3,6 +3,7 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include "../include/memory.h"
 
@@ -27,7 +28,8 @@ void memory_reset(Memory *mem) {
     memset(mem->oam, 0, OAM_SIZE);
     
     /* Clear I/O registers */
-    memset(mem->io_registers, 0, sizeof(mem->io_registers));
+    memset(mem->io_bbus, 0, sizeof(mem->io_bbus));
+    memset(mem->io_cpu, 0, sizeof(mem->io_cpu));
     
     /* Reset DMA channels */
     for (i = 0; i < 8; i++) {
@@ -40,17 +42,436 @@ void memory_reset(Memory *mem) {
         mem->dma[i].hdma_enabled = false;
         mem->dma[i].hdma_table_bank = 0;
         mem->dma[i].hdma_table_addr = 0;
+        mem->dma[i].hdma_indirect_bank = 0;
     }
+    memset(&mem->hdma, 0, sizeof(mem->hdma));
+    
+    memory_update_map(mem);
 }
 
 void memory_set_cartridge(Memory *mem, Cartridge *cart) {
     mem->cart = cart;
+    memory_update_map(mem);
 }
 
-u8 memory_read(Memory *mem, u32 address) {
+void memory_set_ppu(Memory *mem, PPU *ppu) {
+    mem->ppu = ppu;
+}
+
+void memory_set_cpu_clock(Memory *mem, u64 *clock) {
+    mem->cpu_clock = clock;
+}
+
+void memory_vram_written(Memory *mem, u32 address, u32 length) {
+    if (mem->ppu) {
+        ppu_invalidate_vram(mem->ppu, address, length);
+    }
+}
+
+void memory_cgram_written(Memory *mem, u32 address, u32 length) {
+    if (mem->ppu) {
+        ppu_invalidate_cgram(mem->ppu, address, length);
+    }
+}
+
+void memory_oam_written(Memory *mem, u32 address, u32 length) {
+    if (mem->ppu) {
+        ppu_invalidate_oam(mem->ppu, address, length);
+    }
+}
+
+void memory_set_apu(Memory *mem, APU *apu, const u64 *clock) {
+    mem->apu = apu;
+    mem->apu_clock = clock;
+}
+
+u8 *memory_io_register(Memory *mem, u16 address) {
+    if (address >= 0x2100 && address <= 0x21FF) {
+        return &mem->io_bbus[address - 0x2100];
+    }
+    if (address >= 0x4000 && address <= 0x43FF) {
+        return &mem->io_cpu[address - 0x4000];
+    }
+    return NULL;
+}
+
+/* Banks with WRAM mirror and I/O in the low 32KB ($00-$3F and $80-$BF) */
+static inline bool memory_is_io_bank(u8 bank) {
+    return (bank <= 0x3F) || (bank >= 0x80 && bank <= 0xBF);
+}
+
+/* I/O page handlers ($2000-$5FFF, one pair per 256-byte page) */
+typedef u8 (*MemoryIORead)(Memory *mem, u16 offset);
+typedef void (*MemoryIOWrite)(Memory *mem, u16 offset, u8 value);
+
+typedef struct {
+    MemoryIORead read;
+    MemoryIOWrite write;
+} MemoryIOPage;
+
+/* Unmapped I/O pages: open bus */
+static u8 memory_io_open_read(Memory *mem, u16 offset) {
+    (void)mem;
+    (void)offset;
+    return 0xFF;
+}
+
+static void memory_io_open_write(Memory *mem, u16 offset, u8 value) {
+    (void)mem;
+    (void)offset;
+    (void)value;
+}
+
+/* B-bus: PPU ($2100-$213F), APU ports ($2140-$217F), WRAM port and unused */
+static u8 memory_io_bbus_read(Memory *mem, u16 offset) {
+    switch (offset & 0xC0) {
+        case 0x00:
+            /* PPU read registers ($2134-$213F) */
+            if (mem->ppu && offset >= 0x2134) {
+                return ppu_read_register(mem->ppu, offset);
+            }
+            break;
+        case 0x40:
+            /* APU ports - catch the APU up before reading */
+            if (mem->apu) {
+                if (mem->apu_clock) {
+                    apu_sync(mem->apu, *mem->apu_clock);
+                }
+                return apu_read_port(mem->apu, offset & 0x03);
+            }
+            break;
+        default:
+            break;
+    }
+    return mem->io_bbus[offset & 0xFF];
+}
+
+static void memory_io_bbus_write(Memory *mem, u16 offset, u8 value) {
+    switch (offset & 0xC0) {
+        case 0x00:
+            /* PPU registers (mirrored for inspection) */
+            mem->io_bbus[offset & 0xFF] = value;
+            if (mem->ppu) {
+                ppu_write_register(mem->ppu, offset, value);
+            }
+            return;
+        case 0x40:
+            /* APU ports - catch the APU up before the write becomes visible */
+            if (mem->apu) {
+                if (mem->apu_clock) {
+                    apu_sync(mem->apu, *mem->apu_clock);
+                }
+                apu_write_port(mem->apu, offset & 0x03, value);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    mem->io_bbus[offset & 0xFF] = value;
+}
+
+/* CPU, joypad and DMA registers ($4000-$43FF) */
+static u8 memory_io_cpu_read(Memory *mem, u16 offset) {
+    return mem->io_cpu[offset - 0x4000];
+}
+
+/* DMA channel registers ($43x0-$43x7); A1Tx doubles as the HDMA table start */
+static void memory_dma_register_write(Memory *mem, u16 offset, u8 value) {
+    DMAChannel *dma = &mem->dma[(offset >> 4) & 0x07];
+    
+    switch (offset & 0x0F) {
+        case 0x0: dma->control = value; break;
+        case 0x1: dma->dest_register = value; break;
+        case 0x2: dma->src_addr = (dma->src_addr & 0xFF00) | value; break;
+        case 0x3: dma->src_addr = (dma->src_addr & 0x00FF) | (value << 8); break;
+        case 0x4: dma->src_bank = value; break;
+        case 0x5: dma->transfer_size = (dma->transfer_size & 0xFF00) | value; break;
+        case 0x6: dma->transfer_size = (dma->transfer_size & 0x00FF) | (value << 8); break;
+        case 0x7: dma->hdma_indirect_bank = value; break;
+        default: return;
+    }
+    dma->hdma_table_addr = dma->src_addr;
+    dma->hdma_table_bank = dma->src_bank;
+    
+    /* Takes effect from the next HDMA line */
+    if (dma->hdma_enabled) {
+        mem->hdma_generation++;
+    }
+}
+
+static void memory_io_cpu_write(Memory *mem, u16 offset, u8 value) {
+    int i;
+    
+    mem->io_cpu[offset - 0x4000] = value;
+    
+    if (offset == 0x420B) {
+        /* MDMAEN: run the selected channels now */
+        for (i = 0; i < 8; i++) {
+            if (value & (1 << i)) {
+                mem->dma[i].enabled = true;
+            }
+        }
+        memory_dma_trigger(mem, value);
+    } else if (offset == 0x420C) {
+        /* HDMAEN: channels start with the next frame */
+        for (i = 0; i < 8; i++) {
+            mem->dma[i].hdma_enabled = (value & (1 << i)) != 0;
+        }
+        mem->hdma_generation++;
+    } else if (offset >= 0x4300 && offset < 0x4380) {
+        memory_dma_register_write(mem, offset, value);
+    }
+}
+
+#define IO_OPEN { memory_io_open_read, memory_io_open_write }
+#define IO_BBUS { memory_io_bbus_read, memory_io_bbus_write }
+#define IO_CPU  { memory_io_cpu_read, memory_io_cpu_write }
+
+static const MemoryIOPage memory_io_pages[0x40] = {
+    /* $2000-$2FFF */
+    IO_OPEN, IO_BBUS, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN,
+    IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN,
+    /* $3000-$3FFF */
+    IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN,
+    IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN,
+    /* $4000-$4FFF */
+    IO_CPU,  IO_CPU,  IO_CPU,  IO_CPU,  IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN,
+    IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN,
+    /* $5000-$5FFF */
+    IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN,
+    IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN, IO_OPEN
+};
+
+/* Working set checks (see also the --sizes report) */
+STATIC_ASSERT(sizeof(DMAChannel) * 8 <= 2 * CACHE_LINE_SIZE, dma_channels_two_lines);
+STATIC_ASSERT(offsetof(Memory, read_map) == 0, memory_page_table_first);
+STATIC_ASSERT(sizeof(Memory) - offsetof(Memory, wram) ==
+              WRAM_SIZE + VRAM_SIZE + CGRAM_SIZE + OAM_SIZE, memory_bulk_last);
+
+void memory_update_map(Memory *mem) {
+    u32 page;
+    
+    for (page = 0; page < MEMORY_WRAM_PAGES; page++) {
+        mem->wram_mirrors[page] = MEMORY_NO_PAGE;
+    }
+    
+    for (page = 0; page < MEMORY_PAGE_COUNT; page++) {
+        u32 address = page << MEMORY_PAGE_SHIFT;
+        u8 bank = (address >> 16) & 0xFF;
+        u16 offset = address & 0xFFFF;
+        u8 *host = NULL;
+        bool writable = false;
+        
+        if (bank >= 0x7E && bank <= 0x7F) {
+            /* Work RAM banks ($7E-$7F) */
+            host = &mem->wram[((bank - 0x7E) << 16) | offset];
+            writable = true;
+        } else if (memory_is_io_bank(bank) && offset <= 0x1FFF) {
+            /* Mirror of low WRAM */
+            host = &mem->wram[offset];
+            writable = true;
+        } else if (memory_is_io_bank(bank) && offset >= 0x2000 && offset <= 0x5FFF) {
+            /* I/O registers - slow path */
+            host = NULL;
+        } else if (mem->cart && mem->cart->rom_data &&
+                   bank <= 0x7D && offset >= 0x8000) {
+            /* LoROM - only pages fully backed by ROM data */
+            u32 rom_addr = (bank << 15) | (offset & 0x7FFF);
+            if (rom_addr + MEMORY_PAGE_SIZE <= mem->cart->rom_size) {
+                host = &mem->cart->rom_data[rom_addr];
+            }
+        }
+        
+        mem->read_map[page] = host;
+        mem->write_map[page] = writable ? host : NULL;
+        mem->mirror_next[page] = MEMORY_NO_PAGE;
+        
+        /* Chain the bus pages of each WRAM page */
+        if (writable) {
+            u32 wram_page = (u32)(host - mem->wram) >> MEMORY_PAGE_SHIFT;
+            
+            mem->mirror_next[page] = mem->wram_mirrors[wram_page];
+            mem->wram_mirrors[wram_page] = (u16)page;
+        }
+    }
+    
+    /* Any cached code or HDMA program refers to the old layout */
+    memset(mem->watch_pages, 0, sizeof(mem->watch_pages));
+    memset(mem->watch_spans, 0, sizeof(mem->watch_spans));
+    memset(mem->watch_count, 0, sizeof(mem->watch_count));
+    mem->code_written_count = 0;
+    mem->hdma_read_count = 0;
+    mem->code_generation++;
+    mem->hdma_generation++;
+}
+
+/* Move every bus page of a WRAM page to or from the slow write path */
+static void memory_route_wram_page(Memory *mem, u32 wram_page, bool watched) {
+    u32 page;
+    
+    for (page = mem->wram_mirrors[wram_page]; page != MEMORY_NO_PAGE;
+         page = mem->mirror_next[page]) {
+        mem->write_map[page] = watched ? NULL : mem->read_map[page];
+        mem->watch_pages[page] = watched;
+    }
+}
+
+static void memory_watch_span_set(Memory *mem, u32 span, u8 flags) {
+    u8 old = mem->watch_spans[span];
+    u32 wram_page = span >> (MEMORY_PAGE_SHIFT - MEMORY_WATCH_SPAN_SHIFT);
+    
+    mem->watch_spans[span] = old | flags;
+    if (!old && mem->watch_count[wram_page]++ == 0) {
+        memory_route_wram_page(mem, wram_page, true);
+    }
+}
+
+static void memory_watch_span_clear(Memory *mem, u32 span, u8 flags) {
+    u8 old = mem->watch_spans[span];
+    u32 wram_page = span >> (MEMORY_PAGE_SHIFT - MEMORY_WATCH_SPAN_SHIFT);
+    
+    mem->watch_spans[span] = old & ~flags;
+    if (old && !mem->watch_spans[span] && --mem->watch_count[wram_page] == 0) {
+        memory_route_wram_page(mem, wram_page, false);
+    }
+}
+
+/* WRAM offset of a directly mapped WRAM address, or WRAM_SIZE */
+static u32 memory_wram_offset(const Memory *mem, u32 address) {
+    u32 page = (address & 0xFFFFFF) >> MEMORY_PAGE_SHIFT;
+    const u8 *host = mem->read_map[page];
+    
+    /* Only WRAM pages are writable or watched */
+    if (!host || (!mem->write_map[page] && !mem->watch_pages[page])) {
+        return WRAM_SIZE;
+    }
+    return (u32)(host - mem->wram) + (address & MEMORY_PAGE_MASK);
+}
+
+u32 memory_watch_span(const Memory *mem, u32 address) {
+    return memory_wram_offset(mem, address) >> MEMORY_WATCH_SPAN_SHIFT;
+}
+
+void memory_watch_range(Memory *mem, u32 address, u32 length, u8 flags) {
+    u32 first = memory_watch_span(mem, address);
+    u32 last;
+    u32 span;
+    
+    if (first == MEMORY_WATCH_SPANS || length == 0) {
+        return;
+    }
+    last = first + (((address & ((1 << MEMORY_WATCH_SPAN_SHIFT) - 1)) + length - 1) >>
+                    MEMORY_WATCH_SPAN_SHIFT);
+    for (span = first; span <= last && span < MEMORY_WATCH_SPANS; span++) {
+        if ((mem->watch_spans[span] & flags) != flags) {
+            memory_watch_span_set(mem, span, flags);
+        }
+    }
+}
+
+void memory_mark_code(Memory *mem, u32 address, u32 length) {
+    memory_watch_range(mem, address, length, MEMORY_WATCH_CODE);
+}
+
+/* Forget the bytes read by the HDMA program and their watches */
+static void memory_hdma_unwatch(Memory *mem) {
+    u32 span;
+    u8 i;
+    
+    for (i = 0; i < mem->hdma_read_count; i++) {
+        const MemoryRange *range = &mem->hdma_reads[i];
+        
+        for (span = range->start >> MEMORY_WATCH_SPAN_SHIFT;
+             span <= (range->end - 1) >> MEMORY_WATCH_SPAN_SHIFT; span++) {
+            memory_watch_span_clear(mem, span, MEMORY_WATCH_HDMA);
+        }
+    }
+    mem->hdma_read_count = 0;
+}
+
+/* Record a WRAM byte read by the HDMA program and watch its span */
+static void memory_hdma_watch(Memory *mem, u32 address) {
+    u32 offset = memory_wram_offset(mem, address);
+    MemoryRange *range;
+    u8 i;
+    
+    if (offset >= WRAM_SIZE) {
+        return;
+    }
+    
+    /* Tables and data are read in runs: extend the run this byte follows */
+    for (i = 0; i < mem->hdma_read_count; i++) {
+        range = &mem->hdma_reads[i];
+        if (offset >= range->start && offset <= range->end) {
+            if (offset == range->end) {
+                range->end++;
+            }
+            break;
+        }
+    }
+    if (i == mem->hdma_read_count) {
+        if (mem->hdma_read_count < MEMORY_HDMA_RANGES) {
+            range = &mem->hdma_reads[mem->hdma_read_count++];
+            range->start = offset;
+            range->end = offset + 1;
+        } else {
+            /* Out of runs: widen the last one (may invalidate more often) */
+            range = &mem->hdma_reads[MEMORY_HDMA_RANGES - 1];
+            range->start = offset < range->start ? offset : range->start;
+            range->end = offset >= range->end ? offset + 1 : range->end;
+        }
+    }
+    
+    if (!(mem->watch_spans[offset >> MEMORY_WATCH_SPAN_SHIFT] & MEMORY_WATCH_HDMA)) {
+        memory_watch_span_set(mem, offset >> MEMORY_WATCH_SPAN_SHIFT, MEMORY_WATCH_HDMA);
+    }
+}
+
+/* Check if the HDMA program was compiled from a WRAM byte */
+static bool memory_hdma_read_from(const Memory *mem, u32 offset) {
+    u8 i;
+    
+    for (i = 0; i < mem->hdma_read_count; i++) {
+        if (offset >= mem->hdma_reads[i].start && offset < mem->hdma_reads[i].end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Write to a watched span: notify the watchers */
+static void memory_watch_written(Memory *mem, u32 offset) {
+    u32 span = offset >> MEMORY_WATCH_SPAN_SHIFT;
+    u8 flags = mem->watch_spans[span];
+    
+    if (flags & MEMORY_WATCH_CODE) {
+        /* Too many to track: all cached code goes */
+        if (mem->code_written_count < MEMORY_CODE_WRITES) {
+            mem->code_written[mem->code_written_count++] = (u16)span;
+        } else {
+            mem->code_generation++;
+        }
+        memory_watch_span_clear(mem, span, MEMORY_WATCH_CODE);
+    }
+    
+    /* Bytes next to the tables (game variables) do not matter */
+    if ((flags & MEMORY_WATCH_HDMA) && memory_hdma_read_from(mem, offset)) {
+        memory_hdma_unwatch(mem);
+        mem->hdma_generation++;
+    }
+}
+
+/* Slow path for pages without a direct host mapping */
+static u8 memory_read_slow(Memory *mem, u32 address) {
     u8 bank = (address >> 16) & 0xFF;
     u16 offset = address & 0xFFFF;
     
+    /* I/O registers ($2000-$5FFF in banks $00-$3F and $80-$BF) */
+    if (memory_is_io_bank(bank) && offset >= 0x2000 && offset <= 0x5FFF) {
+        return memory_io_pages[(offset >> 8) - 0x20].read(mem, offset);
+    }
+    
     /* Work RAM banks ($7E-$7F) */
     if (bank >= 0x7E && bank <= 0x7F) {
         u32 wram_addr = ((bank - 0x7E) << 16) | offset;
@@ -58,17 +479,10 @@ u8 memory_read(Memory *mem, u32 address) {
     }
     
     /* Mirror of low WRAM in banks $00-$3F and $80-$BF */
-    if (((bank <= 0x3F) || (bank >= 0x80 && bank <= 0xBF)) &&
-        (offset <= 0x1FFF)) {
+    if (memory_is_io_bank(bank) && offset <= 0x1FFF) {
         return mem->wram[offset];
     }
     
-    /* I/O registers ($2000-$5FFF in banks $00-$3F and $80-$BF) */
-    if (((bank <= 0x3F) || (bank >= 0x80 && bank <= 0xBF)) &&
-        (offset >= 0x2000 && offset <= 0x5FFF)) {
-        return mem->io_registers[offset - 0x2000];
-    }
-    
     /* ROM access - delegate to cartridge */
     if (mem->cart) {
         /* Simplified ROM mapping - to be expanded based on mapper type */
@@ -87,10 +501,26 @@ u8 memory_read(Memory *mem, u32 address) {
     return 0xFF;
 }
 
-void memory_write(Memory *mem, u32 address, u8 value) {
+u8 memory_read(Memory *mem, u32 address) {
+    const u8 *page = mem->read_map[(address & 0xFFFFFF) >> MEMORY_PAGE_SHIFT];
+    
+    if (page) {
+        return page[address & MEMORY_PAGE_MASK];
+    }
+    return memory_read_slow(mem, address);
+}
+
+/* Slow path for pages without a direct host mapping */
+static void memory_write_slow(Memory *mem, u32 address, u8 value) {
     u8 bank = (address >> 16) & 0xFF;
     u16 offset = address & 0xFFFF;
     
+    /* I/O registers ($2000-$5FFF in banks $00-$3F and $80-$BF) */
+    if (memory_is_io_bank(bank) && offset >= 0x2000 && offset <= 0x5FFF) {
+        memory_io_pages[(offset >> 8) - 0x20].write(mem, offset, value);
+        return;
+    }
+    
     /* Work RAM banks ($7E-$7F) */
     if (bank >= 0x7E && bank <= 0x7F) {
         u32 wram_addr = ((bank - 0x7E) << 16) | offset;
@@ -99,19 +529,11 @@ void memory_write(Memory *mem, u32 address, u8 value) {
     }
     
     /* Mirror of low WRAM in banks $00-$3F and $80-$BF */
-    if (((bank <= 0x3F) || (bank >= 0x80 && bank <= 0xBF)) &&
-        (offset <= 0x1FFF)) {
+    if (memory_is_io_bank(bank) && offset <= 0x1FFF) {
         mem->wram[offset] = value;
         return;
     }
     
-    /* I/O registers ($2000-$5FFF in banks $00-$3F and $80-$BF) */
-    if (((bank <= 0x3F) || (bank >= 0x80 && bank <= 0xBF)) &&
-        (offset >= 0x2000 && offset <= 0x5FFF)) {
-        mem->io_registers[offset - 0x2000] = value;
-        return;
-    }
-    
     /* SRAM write - delegate to cartridge if applicable */
     if (mem->cart && mem->cart->has_sram) {
         /* Simplified SRAM mapping - to be expanded */
@@ -119,7 +541,38 @@ void memory_write(Memory *mem, u32 address, u8 value) {
     }
 }
 
+void memory_write(Memory *mem, u32 address, u8 value) {
+    u32 index = (address & 0xFFFFFF) >> MEMORY_PAGE_SHIFT;
+    u8 *page = mem->write_map[index];
+    
+    if (page) {
+        page[address & MEMORY_PAGE_MASK] = value;
+        return;
+    }
+    
+    /* WRAM page with watched spans */
+    if (mem->watch_pages[index]) {
+        u8 *host = mem->read_map[index];
+        u32 offset = (u32)(host - mem->wram) + (address & MEMORY_PAGE_MASK);
+        
+        host[address & MEMORY_PAGE_MASK] = value;
+        if (mem->watch_spans[offset >> MEMORY_WATCH_SPAN_SHIFT]) {
+            memory_watch_written(mem, offset);
+        }
+        return;
+    }
+    memory_write_slow(mem, address, value);
+}
+
 u16 memory_read16(Memory *mem, u32 address) {
+    const u8 *page = mem->read_map[(address & 0xFFFFFF) >> MEMORY_PAGE_SHIFT];
+    u32 index = address & MEMORY_PAGE_MASK;
+    
+    /* Both bytes inside one directly mapped page */
+    if (page && index < MEMORY_PAGE_MASK) {
+        return page[index] | (page[index + 1] << 8);
+    }
+    
     u8 low = memory_read(mem, address);
     u8 high = memory_read(mem, address + 1);
     return low | (high << 8);
@@ -137,11 +590,17 @@ u32 memory_read24(Memory *mem, u32 address) {
     return low | (mid << 8) | (high << 16);
 }
 
+/* B-bus register offsets cycled through by each transfer mode */
+static const u8 memory_dma_pattern[8][4] = {
+    {0, 0, 0, 0}, {0, 1, 0, 1}, {0, 0, 0, 0}, {0, 0, 1, 1},
+    {0, 1, 2, 3}, {0, 1, 0, 1}, {0, 0, 0, 0}, {0, 0, 1, 1}
+};
+
 void memory_dma_transfer(Memory *mem, u8 channel) {
     DMAChannel *dma;
-    u32 src_addr, dest_addr;
-    u16 count;
-    u8 direction, increment;
+    u32 src_addr;
+    u32 count, size, done;
+    u8 direction, increment, mode;
     u8 value;
     
     if (channel >= 8) {
@@ -157,51 +616,67 @@ void memory_dma_transfer(Memory *mem, u8 channel) {
     /* Get transfer direction and addressing mode from control register */
     direction = (dma->control >> 7) & 1;  /* 0=CPU->PPU, 1=PPU->CPU */
     increment = (dma->control >> 3) & 3;  /* 0=increment, 1=fixed, 2=decrement */
-    
-    (void)direction;  /* Typically CPU->PPU for DMA */
+    mode = dma->control & 0x07;           /* B-bus write pattern */
     
     /* Build source address */
     src_addr = (dma->src_bank << 16) | dma->src_addr;
-    
-    /* Destination is a PPU register (B-bus) in $2100-$21FF range */
-    dest_addr = 0x2100 + dma->dest_register;
+    size = dma->transfer_size;
     
     /* Perform transfer */
-    for (count = 0; count < dma->transfer_size; count++) {
-        /* Read from source */
-        value = memory_read(mem, src_addr);
+    for (count = 0; count < size; count += done) {
+        const u8 *page = mem->read_map[src_addr >> MEMORY_PAGE_SHIFT];
         
-        /* Write to destination */
-        if (dest_addr >= 0x2100 && dest_addr < 0x2200) {
-            /* PPU register write */
-            mem->io_registers[dest_addr - 0x2000] = value;
+        done = 0;
+        
+        /* Fast path: mapped source into a PPU data port */
+        if (direction == 0 && page && mem->ppu && increment != 2) {
+            u32 run = size - count;
             
-            /* Handle specific PPU register writes */
-            if (dest_addr == 0x2118 || dest_addr == 0x2119) {
-                /* VRAM write */
-                /* Would need to properly handle VRAM address and increment */
+            /* Incrementing sources stop at the end of the host page */
+            if (increment == 0 && run > MEMORY_PAGE_SIZE - (src_addr & MEMORY_PAGE_MASK)) {
+                run = MEMORY_PAGE_SIZE - (src_addr & MEMORY_PAGE_MASK);
             }
+            done = ppu_dma_write(mem->ppu, dma->dest_register, memory_dma_pattern[mode],
+                                 count, &page[src_addr & MEMORY_PAGE_MASK], run,
+                                 increment != 0);
+        }
+        
+        if (done == 0) {
+            /* Read from source */
+            value = memory_read(mem, src_addr);
+            
+            /* Write to destination (PPU/APU registers see the write) */
+            memory_write(mem, 0x2100 | ((dma->dest_register +
+                                         memory_dma_pattern[mode][count & 3]) & 0xFF), value);
+            done = 1;
         }
         
-        /* Update source address based on increment mode */
+        /* Update source address based on increment mode (within the bank) */
         switch (increment) {
             case 0:  /* Increment */
-                src_addr++;
-                break;
-            case 1:  /* Fixed */
-                /* Don't change address */
+                src_addr = (src_addr & 0xFF0000) | ((src_addr + done) & 0xFFFF);
                 break;
             case 2:  /* Decrement */
-                src_addr--;
+                src_addr = (src_addr & 0xFF0000) | ((src_addr - done) & 0xFFFF);
+                break;
+            default:  /* Fixed */
                 break;
         }
     }
     
-    /* Clear transfer size to indicate completion */
+    /* Registers end up as on hardware: address advanced, size 0 */
+    dma->src_addr = src_addr & 0xFFFF;
     dma->transfer_size = 0;
     dma->enabled = false;
-    
-    /* Note: Real SNES takes 8 cycles per byte + overhead */
+    mem->io_cpu[0x302 + channel * 16] = dma->src_addr & 0xFF;
+    mem->io_cpu[0x303 + channel * 16] = dma->src_addr >> 8;
+    mem->io_cpu[0x305 + channel * 16] = 0;
+    mem->io_cpu[0x306 + channel * 16] = 0;
+    
+    /* The CPU is halted for the transfer: 8 master clocks per byte + overhead */
+    if (mem->cpu_clock) {
+        *mem->cpu_clock += DMA_CYCLES_PER_CHANNEL + (u64)size * DMA_CYCLES_PER_BYTE;
+    }
 }
 
 u32 memory_map_address(const Memory *mem, u8 bank, u16 offset) {
@@ -257,104 +732,151 @@ void memory_dma_trigger(Memory *mem, u8 channels_mask) {
     }
 }
 
-void memory_hdma_init(Memory *mem, u8 channel) {
-    DMAChannel *dma;
+/* Bytes per HDMA transfer unit of each mode */
+static const u8 memory_hdma_length[8] = {1, 2, 2, 4, 4, 4, 2, 4};
+
+/* Read a table or data byte for HDMA, watching it for changes */
+static u8 memory_hdma_fetch(Memory *mem, u8 bank, u16 offset) {
+    u32 address = ((u32)bank << 16) | offset;
     
-    if (channel >= 8) {
+    memory_hdma_watch(mem, address);
+    return memory_read(mem, address);
+}
+
+/* Load the next table entry (line counter and indirect address) */
+static void memory_hdma_load_entry(Memory *mem, const DMAChannel *dma, HDMAState *state) {
+    state->line_counter = memory_hdma_fetch(mem, dma->hdma_table_bank, state->table_addr++);
+    if (state->line_counter == 0) {
+        state->active = false;
         return;
     }
     
-    dma = &mem->dma[channel];
+    /* Indirect mode: the entry points at the data */
+    if (dma->control & 0x40) {
+        u8 low = memory_hdma_fetch(mem, dma->hdma_table_bank, state->table_addr++);
+        u8 high = memory_hdma_fetch(mem, dma->hdma_table_bank, state->table_addr++);
+        state->indirect_addr = low | (high << 8);
+    }
+    state->do_transfer = true;
+}
+
+/* Same HDMA-relevant registers */
+static bool memory_hdma_same_setup(const DMAChannel *a, const DMAChannel *b) {
+    return a->hdma_enabled == b->hdma_enabled && a->control == b->control &&
+           a->dest_register == b->dest_register &&
+           a->hdma_table_addr == b->hdma_table_addr &&
+           a->hdma_table_bank == b->hdma_table_bank &&
+           a->hdma_indirect_bank == b->hdma_indirect_bank;
+}
+
+/* Compile lines [first, last) from the channel states before line first */
+static void memory_hdma_compile(Memory *mem, u16 first, u16 last) {
+    HDMAProgram *prog = &mem->hdma;
+    u16 count = prog->line_start[first];
+    u16 line;
+    int i, j;
+    
+    if (first == 0) {
+        /* Frame start: every enabled channel loads its first entry */
+        memory_hdma_unwatch(mem);
+        count = 0;
+        for (i = 0; i < 8; i++) {
+            DMAChannel *dma = &mem->dma[i];
+            HDMAState *state = &prog->state[0][i];
+            
+            prog->setup[i] = *dma;
+            memset(state, 0, sizeof(*state));
+            if (dma->hdma_enabled) {
+                state->table_addr = dma->hdma_table_addr;
+                state->active = true;
+                memory_hdma_load_entry(mem, dma, state);
+            }
+        }
+    }
+    
+    for (line = first; line < last; line++) {
+        prog->line_start[line] = count;
+        
+        for (i = 0; i < 8; i++) {
+            const DMAChannel *dma = &mem->dma[i];
+            HDMAState *state = &prog->state[line + 1][i];
+            
+            *state = prog->state[line][i];
+            if (!state->active || !dma->hdma_enabled) {
+                continue;
+            }
+            
+            if (state->do_transfer) {
+                u8 mode = dma->control & 0x07;
+                
+                for (j = 0; j < memory_hdma_length[mode]; j++) {
+                    HDMAWrite *write = &prog->writes[count++];
+                    
+                    write->reg = (u8)(dma->dest_register + memory_dma_pattern[mode][j]);
+                    if (dma->control & 0x40) {
+                        write->value = memory_hdma_fetch(mem, dma->hdma_indirect_bank,
+                                                         state->indirect_addr++);
+                    } else {
+                        write->value = memory_hdma_fetch(mem, dma->hdma_table_bank,
+                                                         state->table_addr++);
+                    }
+                }
+            }
+            
+            /* Count down; bit 7 (repeat) transfers on every line of the entry */
+            state->line_counter--;
+            state->do_transfer = (state->line_counter & 0x80) != 0;
+            if ((state->line_counter & 0x7F) == 0) {
+                memory_hdma_load_entry(mem, dma, state);
+            }
+        }
+    }
+    prog->line_start[last] = count;
+    prog->compiled = last;
+}
+
+void memory_hdma_init(Memory *mem, u8 channel) {
+    HDMAProgram *prog = &mem->hdma;
     
-    if (!dma->hdma_enabled) {
+    if (channel >= 8) {
         return;
     }
     
-    /* Initialize HDMA table address and indirect address */
-    /* This prepares the channel for scanline-by-scanline transfers */
-    dma->transfer_size = 0;  /* Will be set per scanline */
+    /* Lines before a mid-frame change were compiled from the old tables */
+    prog->line = 0;
+    if (prog->partial) {
+        prog->compiled = 0;
+    }
+    prog->partial = false;
+    if (!memory_hdma_same_setup(&prog->setup[channel], &mem->dma[channel])) {
+        prog->compiled = 0;
+    }
 }
 
 void memory_hdma_run(Memory *mem) {
-    int i;
-    DMAChannel *dma;
-    u8 line_count;
-    u32 table_addr;
-    u8 dest_reg;
-    u8 data;
+    HDMAProgram *prog = &mem->hdma;
+    u16 line = prog->line;
+    u16 i;
     
-    /* Process each HDMA channel */
-    for (i = 0; i < 8; i++) {
-        dma = &mem->dma[i];
-        
-        if (!dma->hdma_enabled) {
-            continue;
-        }
-        
-        /* Get table address */
-        table_addr = ((u32)dma->hdma_table_bank << 16) | dma->hdma_table_addr;
-        
-        /* Read line count from table */
-        line_count = memory_read(mem, table_addr);
-        
-        if (line_count == 0) {
-            /* End of table or repeat mode */
-            continue;
-        }
-        
-        dest_reg = dma->dest_register;
-        
-        /* HDMA transfer modes */
-        switch (dma->control & 0x07) {
-            case 0:  /* 1 register write */
-                table_addr++;
-                data = memory_read(mem, table_addr);
-                memory_write(mem, 0x2100 + dest_reg, data);
-                dma->hdma_table_addr++;
-                break;
-                
-            case 1:  /* 2 registers write */
-                table_addr++;
-                data = memory_read(mem, table_addr);
-                memory_write(mem, 0x2100 + dest_reg, data);
-                table_addr++;
-                data = memory_read(mem, table_addr);
-                memory_write(mem, 0x2101 + dest_reg, data);
-                dma->hdma_table_addr += 2;
-                break;
-                
-            case 2:  /* 1 register write twice */
-                table_addr++;
-                data = memory_read(mem, table_addr);
-                memory_write(mem, 0x2100 + dest_reg, data);
-                table_addr++;
-                data = memory_read(mem, table_addr);
-                memory_write(mem, 0x2100 + dest_reg, data);
-                dma->hdma_table_addr += 2;
-                break;
-                
-            case 3:  /* 2 registers write twice */
-            case 4:  /* 4 registers write */
-                /* More complex modes - simplified implementation */
-                table_addr++;
-                data = memory_read(mem, table_addr);
-                memory_write(mem, 0x2100 + dest_reg, data);
-                dma->hdma_table_addr++;
-                break;
-                
-            default:
-                /* Other modes */
-                dma->hdma_table_addr++;
-                break;
-        }
-        
-        /* Decrement line counter if not infinite repeat */
-        if (line_count < 0x80) {
-            line_count--;
-            if (line_count == 0) {
-                /* Move to next entry in table */
-                dma->hdma_table_addr++;
-            }
+    if (line >= HDMA_LINES) {
+        return;
+    }
+    prog->line++;
+    
+    /* Tables or registers changed: drop the lines not replayed yet */
+    if (prog->generation != mem->hdma_generation) {
+        prog->generation = mem->hdma_generation;
+        if (prog->compiled > line) {
+            prog->compiled = line;
         }
+        prog->partial = line > 0;
+    }
+    
+    if (line >= prog->compiled) {
+        memory_hdma_compile(mem, line, prog->partial ? line + 1 : HDMA_LINES);
+    }
+    
+    for (i = prog->line_start[line]; i < prog->line_start[line + 1]; i++) {
+        memory_io_bbus_write(mem, 0x2100 | prog->writes[i].reg, prog->writes[i].value);
     }
 }
@@ -0,0 +1,216 @@
+/*
+ * movie.c - Input movie implementation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/movie.h"
+
+#define MOVIE_HEADER_SIZE 24
+
+static void movie_put_u32(u8 *out, u32 value) {
+    out[0] = (u8)value;
+    out[1] = (u8)(value >> 8);
+    out[2] = (u8)(value >> 16);
+    out[3] = (u8)(value >> 24);
+}
+
+static u32 movie_get_u32(const u8 *in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((u32)in[3] << 24);
+}
+
+/* Room for at least count frames */
+static int movie_reserve(Movie *movie, u32 count) {
+    u32 capacity = movie->capacity ? movie->capacity : 1024;
+    u16 *frames;
+    
+    if (movie->capacity >= count) {
+        return SUCCESS;
+    }
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    frames = (u16 *)realloc(movie->frames, capacity * 2 * sizeof(u16));
+    if (!frames) {
+        return ERROR;
+    }
+    movie->frames = frames;
+    movie->capacity = capacity;
+    return SUCCESS;
+}
+
+void movie_init(Movie *movie) {
+    memset(movie, 0, sizeof(Movie));
+}
+
+void movie_free(Movie *movie) {
+    free(movie->frames);
+    memset(movie, 0, sizeof(Movie));
+}
+
+void movie_record(Movie *movie, const Cartridge *cart) {
+    movie->mode = MOVIE_RECORDING;
+    movie->rom_size = cart->rom_size;
+    movie->rom_checksum = cartridge_calculate_checksum(cart);
+    movie->frame_count = 0;
+    movie->position = 0;
+}
+
+int movie_play(Movie *movie, const Cartridge *cart) {
+    if (movie->rom_size != cart->rom_size ||
+        movie->rom_checksum != cartridge_calculate_checksum(cart)) {
+        return ERROR;
+    }
+    movie->mode = MOVIE_PLAYING;
+    movie->position = 0;
+    return SUCCESS;
+}
+
+void movie_step(Movie *movie, InputSystem *input) {
+    u16 *frame;
+    
+    switch (movie->mode) {
+        case MOVIE_RECORDING:
+            /* Out of memory ends the recording rather than losing sync */
+            if (movie_reserve(movie, movie->position + 1) != SUCCESS) {
+                movie->mode = MOVIE_IDLE;
+                break;
+            }
+            frame = &movie->frames[movie->position * 2];
+            frame[0] = input->joypad1.buttons;
+            frame[1] = input->joypad2.buttons;
+            movie->position++;
+            movie->frame_count = movie->position;
+            break;
+        
+        case MOVIE_PLAYING:
+            if (movie->position >= movie->frame_count) {
+                movie->mode = MOVIE_IDLE;
+                break;
+            }
+            frame = &movie->frames[movie->position * 2];
+            input_set_buttons(input, 0, frame[0]);
+            input_set_buttons(input, 1, frame[1]);
+            movie->position++;
+            break;
+        
+        default:
+            break;
+    }
+}
+
+bool movie_finished(const Movie *movie) {
+    return movie->position >= movie->frame_count;
+}
+
+u32 movie_fast_forward(Movie *movie, Emulator *emu, u32 frames) {
+    PPURenderPolicy policy = (PPURenderPolicy)emu->ppu.render_policy;
+    u32 interval = emu->ppu.render_interval;
+    u32 remaining = movie->frame_count - movie->position;
+    u32 frame;
+    
+    if (movie->mode != MOVIE_PLAYING) {
+        return 0;
+    }
+    if (frames > remaining) {
+        frames = remaining;
+    }
+    
+    ppu_set_render_policy(&emu->ppu, PPU_RENDER_NEVER, 1);
+    for (frame = 0; frame < frames; frame++) {
+        emulator_run_frame(emu);
+    }
+    ppu_set_render_policy(&emu->ppu, policy, interval);
+    return frames;
+}
+
+int movie_write_file(const Movie *movie, const char *filename) {
+    u8 header[MOVIE_HEADER_SIZE];
+    u8 bytes[4];
+    FILE *file = fopen(filename, "wb");
+    u32 i;
+    
+    if (!file) {
+        fprintf(stderr, "Error: Cannot create movie '%s'\n", filename);
+        return ERROR;
+    }
+    
+    memcpy(header, MOVIE_MAGIC, 8);
+    movie_put_u32(header + 8, MOVIE_VERSION);
+    movie_put_u32(header + 12, movie->rom_size);
+    movie_put_u32(header + 16, movie->rom_checksum);
+    movie_put_u32(header + 20, movie->frame_count);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        fclose(file);
+        return ERROR;
+    }
+    
+    for (i = 0; i < movie->frame_count; i++) {
+        const u16 *frame = &movie->frames[i * 2];
+        
+        bytes[0] = (u8)frame[0];
+        bytes[1] = (u8)(frame[0] >> 8);
+        bytes[2] = (u8)frame[1];
+        bytes[3] = (u8)(frame[1] >> 8);
+        if (fwrite(bytes, 1, sizeof(bytes), file) != sizeof(bytes)) {
+            fclose(file);
+            return ERROR;
+        }
+    }
+    
+    fclose(file);
+    return SUCCESS;
+}
+
+int movie_read_file(Movie *movie, const char *filename) {
+    u8 header[MOVIE_HEADER_SIZE];
+    u8 bytes[4];
+    FILE *file = fopen(filename, "rb");
+    u32 frame_count;
+    long size;
+    u32 i;
+    
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open movie '%s'\n", filename);
+        return ERROR;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    if (size < MOVIE_HEADER_SIZE ||
+        fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, MOVIE_MAGIC, 8) != 0 ||
+        movie_get_u32(header + 8) != MOVIE_VERSION) {
+        fprintf(stderr, "Error: '%s' is not a movie file\n", filename);
+        fclose(file);
+        return ERROR;
+    }
+    
+    frame_count = movie_get_u32(header + 20);
+    if (frame_count > (u32)(size - MOVIE_HEADER_SIZE) / 4 ||
+        movie_reserve(movie, frame_count) != SUCCESS) {
+        fclose(file);
+        return ERROR;
+    }
+    
+    for (i = 0; i < frame_count; i++) {
+        if (fread(bytes, 1, sizeof(bytes), file) != sizeof(bytes)) {
+            fclose(file);
+            return ERROR;
+        }
+        movie->frames[i * 2] = (u16)(bytes[0] | (bytes[1] << 8));
+        movie->frames[i * 2 + 1] = (u16)(bytes[2] | (bytes[3] << 8));
+    }
+    
+    movie->mode = MOVIE_IDLE;
+    movie->rom_size = movie_get_u32(header + 12);
+    movie->rom_checksum = (u16)movie_get_u32(header + 16);
+    movie->frame_count = frame_count;
+    movie->position = 0;
+    
+    fclose(file);
+    return SUCCESS;
+}
@@ -2,9 +2,15 @@
  * performance.c - Performance monitoring implementation
  */
 
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include "../include/performance.h"
+#include "../include/memory.h"
+#include "../include/cpu.h"
+#include "../include/ppu.h"
+#include "../include/apu.h"
+#include "../include/thread.h"
 
 /* Global performance stats */
 PerfStats g_perf_stats = {0};
@@ -37,7 +43,7 @@ int perf_register(const char *name) {
     
     counter->name = name;
     counter->call_count = 0;
-    counter->total_cycles = 0;
+    counter->total_ns = 0;
     counter->is_running = false;
     
     return id;
@@ -50,24 +56,24 @@ void perf_start(int counter_id) {
     
     PerfCounter *counter = &g_perf_stats.counters[counter_id];
     if (!counter->is_running) {
-        counter->start_time = clock();
+        counter->start_ns = thread_time_ns();
         counter->is_running = true;
         counter->call_count++;
     }
 }
 
 void perf_stop(int counter_id) {
-    clock_t end_time;
+    u64 end_ns;
     
     if (!g_perf_stats.enabled || counter_id < 0 || counter_id >= g_perf_stats.counter_count) {
         return;
     }
     
-    end_time = clock();
+    end_ns = thread_time_ns();
     
     PerfCounter *counter = &g_perf_stats.counters[counter_id];
     if (counter->is_running) {
-        counter->total_cycles += (u64)(end_time - counter->start_time);
+        counter->total_ns += end_ns - counter->start_ns;
         counter->is_running = false;
     }
 }
@@ -104,8 +110,7 @@ void perf_print_stats(void) {
     for (u8 i = 0; i < g_perf_stats.counter_count; i++) {
         PerfCounter *counter = &g_perf_stats.counters[i];
         
-        /* Convert clock ticks to microseconds */
-        u64 total_us = (counter->total_cycles * 1000000) / CLOCKS_PER_SEC;
+        u64 total_us = counter->total_ns / 1000;
         u64 avg_us = counter->call_count > 0 ? total_us / counter->call_count : 0;
         
         printf("%-30s %10llu %15llu %15llu\n",
@@ -122,7 +127,55 @@ void perf_reset(void) {
     for (u8 i = 0; i < g_perf_stats.counter_count; i++) {
         PerfCounter *counter = &g_perf_stats.counters[i];
         counter->call_count = 0;
-        counter->total_cycles = 0;
+        counter->total_ns = 0;
         counter->is_running = false;
     }
 }
+
+/* One row of the layout report: byte offset/size and cache line span */
+static void perf_print_layout(const char *name, size_t offset, size_t size) {
+    printf("  %-28s %8lu %8lu   lines %lu-%lu\n", name,
+           (unsigned long)offset, (unsigned long)size,
+           (unsigned long)(offset / CACHE_LINE_SIZE),
+           (unsigned long)((offset + (size ? size - 1 : 0)) / CACHE_LINE_SIZE));
+}
+
+#define PERF_FIELD(type, field) \
+    perf_print_layout(#field, offsetof(type, field), sizeof(((type *)0)->field))
+
+void perf_print_struct_sizes(void) {
+    printf("Structure layout (%d byte cache lines)\n\n", CACHE_LINE_SIZE);
+    printf("  %-28s %8s %8s\n", "Structure / field", "Offset", "Size");
+    
+    perf_print_layout("CPU", 0, sizeof(CPU));
+    perf_print_layout("APU", 0, sizeof(APU));
+    perf_print_layout("Sprite", 0, sizeof(Sprite));
+    perf_print_layout("DMAChannel", 0, sizeof(DMAChannel));
+    
+    printf("\n");
+    perf_print_layout("Memory", 0, sizeof(Memory));
+    PERF_FIELD(Memory, read_map);
+    PERF_FIELD(Memory, write_map);
+    PERF_FIELD(Memory, watch_pages);
+    PERF_FIELD(Memory, watch_spans);
+    PERF_FIELD(Memory, dma);
+    PERF_FIELD(Memory, io_bbus);
+    PERF_FIELD(Memory, io_cpu);
+    PERF_FIELD(Memory, hdma);
+    PERF_FIELD(Memory, wram);
+    PERF_FIELD(Memory, vram);
+    
+    printf("\n");
+    perf_print_layout("PPU", 0, sizeof(PPU));
+    PERF_FIELD(PPU, framebuffer);
+    PERF_FIELD(PPU, bg);
+    PERF_FIELD(PPU, palette_lit);
+    PERF_FIELD(PPU, tile_cache);
+    PERF_FIELD(PPU, oam_sprites);
+    PERF_FIELD(PPU, obj_lines);
+    PERF_FIELD(PPU, cgram_addr);
+    PERF_FIELD(PPU, line_hash);
+    PERF_FIELD(PPU, palette);
+    PERF_FIELD(PPU, upscaler);
+    printf("\n");
+}
@@ -2,11 +2,98 @@
  * ppu.c - Picture Processing Unit implementation
  */
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "../include/ppu.h"
 #include "../include/upscaler.h"
+#include "../include/thread.h"
+
+/* x86 SIMD compositor paths (selected at runtime by CPU features) */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PPU_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* Targets of the render thread write log */
+#define PPU_LOG_VRAM  0
+#define PPU_LOG_CGRAM 1
+#define PPU_LOG_OAM   2
+
+static void ppu_render_log(PPU *ppu, u8 target, u32 address, u32 length);
+static void ppu_render_record_line(PPU *ppu);
+
+/* Working set checks: the per-line state the renderers read for every
+ * pixel stays within the first few cache lines (see the --sizes report) */
+STATIC_ASSERT(offsetof(PPU, palette_lit) <= 4 * CACHE_LINE_SIZE, ppu_line_state_hot);
+STATIC_ASSERT(offsetof(PPU, palette) > offsetof(PPU, line_hash), ppu_cold_tail_last);
+
+/* Background color depth per BG mode (0 = layer not present) */
+static const u8 ppu_bg_bpp[8][4] = {
+    {2, 2, 2, 2},  /* Mode 0 */
+    {4, 4, 2, 0},  /* Mode 1 */
+    {4, 4, 0, 0},  /* Mode 2 */
+    {8, 4, 0, 0},  /* Mode 3 */
+    {8, 2, 0, 0},  /* Mode 4 */
+    {4, 2, 0, 0},  /* Mode 5 */
+    {4, 0, 0, 0},  /* Mode 6 */
+    {0, 0, 0, 0}   /* Mode 7 (rendered by ppu_render_mode7) */
+};
+
+/*
+ * Layer priority ranks per BG mode (higher = in front)
+ * Index 8 is mode 1 with the BG3 priority bit set.
+ */
+#define PPU_RANK_MODE1_BG3 8
+
+static const u8 ppu_bg_rank[9][4][2] = {
+    {{8, 11}, {7, 10}, {2, 5}, {1, 4}},  /* Mode 0 */
+    {{6, 9},  {5, 8},  {1, 3}, {0, 0}},  /* Mode 1 */
+    {{3, 7},  {1, 5},  {0, 0}, {0, 0}},  /* Mode 2 */
+    {{3, 7},  {1, 5},  {0, 0}, {0, 0}},  /* Mode 3 */
+    {{3, 7},  {1, 5},  {0, 0}, {0, 0}},  /* Mode 4 */
+    {{3, 7},  {1, 5},  {0, 0}, {0, 0}},  /* Mode 5 */
+    {{3, 7},  {1, 5},  {0, 0}, {0, 0}},  /* Mode 6 */
+    {{2, 2},  {0, 0},  {0, 0}, {0, 0}},  /* Mode 7 */
+    {{5, 8},  {4, 7},  {1, 10}, {0, 0}}  /* Mode 1, BG3 priority */
+};
+
+static const u8 ppu_obj_rank[9][4] = {
+    {3, 6, 9, 12},  /* Mode 0 */
+    {2, 4, 7, 10},  /* Mode 1 */
+    {2, 4, 6, 8},   /* Mode 2 */
+    {2, 4, 6, 8},   /* Mode 3 */
+    {2, 4, 6, 8},   /* Mode 4 */
+    {2, 4, 6, 8},   /* Mode 5 */
+    {2, 4, 6, 8},   /* Mode 6 */
+    {1, 3, 4, 5},   /* Mode 7 */
+    {2, 3, 6, 9}    /* Mode 1, BG3 priority */
+};
+
+/* Row of the rank tables for the current mode */
+static inline u8 ppu_rank_mode(const PPU *ppu) {
+    return (ppu->bg_mode == 1 && ppu->bg3_priority) ? PPU_RANK_MODE1_BG3 : ppu->bg_mode;
+}
+
+/* High byte of a line buffer entry for a layer at the given rank */
+static inline u16 ppu_layer_key(u8 rank, u8 layer) {
+    return (u16)(((rank << 3) | layer) << 8);
+}
+
+/* Pick the fastest compositor this CPU supports */
+static u8 ppu_select_compose_path(void) {
+#ifdef PPU_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return PPU_COMPOSE_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return PPU_COMPOSE_SSE2;
+    }
+#endif
+    return PPU_COMPOSE_SCALAR;
+}
 
 void ppu_init(PPU *ppu) {
     int i;
@@ -15,14 +102,102 @@ void ppu_init(PPU *ppu) {
     /* Allocate framebuffer */
     ppu->framebuffer = (u32 *)calloc(SCREEN_WIDTH * SCREEN_HEIGHT, sizeof(u32));
     
-    /* Allocate layer buffers */
-    for (i = 0; i < 5; i++) {
-        ppu->layer_buffer[i] = (u8 *)calloc(SCREEN_WIDTH * SCREEN_HEIGHT, 1);
+    /* Allocate layer line buffers as one block starting on a cache line
+     * (each buffer is 512 bytes, so all of them stay line aligned) */
+    ppu->layer_block = calloc(1, PPU_LAYER_COUNT * SCREEN_WIDTH * sizeof(u16) +
+                                 CACHE_LINE_SIZE);
+    if (ppu->layer_block) {
+        uintptr_t base = ((uintptr_t)ppu->layer_block + CACHE_LINE_SIZE - 1) &
+                         ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+        for (i = 0; i < PPU_LAYER_COUNT; i++) {
+            ppu->layer_buffer[i] = (u16 *)base + i * SCREEN_WIDTH;
+        }
+    }
+    ppu->compose_path = ppu_select_compose_path();
+    
+    /* Allocate decoded tile caches (all tiles start dirty) */
+    for (i = 0; i < TILE_CACHE_DEPTHS; i++) {
+        TileCache *cache = &ppu->tile_cache[i];
+        cache->bpp = 2 << i;
+        cache->tile_count = VRAM_SIZE / (cache->bpp * 8);
+        cache->pixels = (u8 *)calloc(cache->tile_count, 64);
+        cache->dirty = (u8 *)malloc(cache->tile_count);
+        if (cache->dirty) {
+            memset(cache->dirty, 1, cache->tile_count);
+        }
     }
     
     ppu_reset(ppu);
 }
 
+void ppu_cleanup(PPU *ppu) {
+    int i;
+    
+    ppu_stop_render_threads(ppu);
+    ppu_disable_upscaling(ppu);
+    
+    free(ppu->framebuffer);
+    ppu->framebuffer = NULL;
+    
+    free(ppu->layer_block);
+    ppu->layer_block = NULL;
+    for (i = 0; i < PPU_LAYER_COUNT; i++) {
+        ppu->layer_buffer[i] = NULL;
+    }
+    
+    for (i = 0; i < TILE_CACHE_DEPTHS; i++) {
+        free(ppu->tile_cache[i].pixels);
+        free(ppu->tile_cache[i].dirty);
+        ppu->tile_cache[i].pixels = NULL;
+        ppu->tile_cache[i].dirty = NULL;
+    }
+}
+
+/* Convert a 15-bit BGR color to RGBA (0xAABBGGRR format for little-endian) */
+static u32 ppu_convert_color(u16 color15) {
+    u8 r = (color15 & 0x1F) << 3;
+    u8 g = ((color15 >> 5) & 0x1F) << 3;
+    u8 b = ((color15 >> 10) & 0x1F) << 3;
+    
+    return 0xFF000000 | (b << 16) | (g << 8) | r;
+}
+
+/* Scale an RGBA color by the master brightness (0-15) */
+static u32 ppu_apply_brightness(u32 pixel, u8 brightness) {
+    u8 r, g, b;
+    
+    if (brightness >= 15) {
+        return pixel;
+    }
+    
+    r = ((pixel & 0xFF) * brightness) / 15;
+    g = (((pixel >> 8) & 0xFF) * brightness) / 15;
+    b = (((pixel >> 16) & 0xFF) * brightness) / 15;
+    return 0xFF000000 | (b << 16) | (g << 8) | r;
+}
+
+/* Refresh one palette cache entry from CGRAM */
+static void ppu_update_color(PPU *ppu, u8 index) {
+    u32 color = 0xFF000000;  /* Black without CGRAM */
+    
+    if (ppu->cgram) {
+        color = ppu_convert_color(ppu->cgram[index * 2] |
+                                  ((ppu->cgram[index * 2 + 1] & 0x7F) << 8));
+    }
+    
+    ppu->palette[index] = color;
+    ppu->palette_lit[index] = ppu_apply_brightness(color, ppu->brightness);
+}
+
+/* Re-apply the master brightness to the whole palette */
+static void ppu_update_brightness(PPU *ppu) {
+    int i;
+    
+    for (i = 0; i < 256; i++) {
+        ppu->palette_lit[i] = ppu_apply_brightness(ppu->palette[i], ppu->brightness);
+    }
+}
+
 void ppu_reset(PPU *ppu) {
     int i;
     
@@ -33,8 +208,21 @@ void ppu_reset(PPU *ppu) {
     ppu->brightness = 15;
     ppu->forced_blank = true;
     ppu->bg_mode = 0;
+    ppu->bg3_priority = false;
     ppu->frame_count = 0;
     
+    /* Reset screen designation, windows and color math */
+    ppu->main_screen = 0;
+    ppu->sub_screen = 0;
+    ppu->main_window = 0;
+    ppu->sub_window = 0;
+    memset(ppu->window_sel, 0, sizeof(ppu->window_sel));
+    memset(ppu->window_pos, 0, sizeof(ppu->window_pos));
+    memset(ppu->window_logic, 0, sizeof(ppu->window_logic));
+    ppu->cgwsel = 0;
+    ppu->cgadsub = 0;
+    ppu->fixed_color = 0;
+    
     /* Reset background layers */
     for (i = 0; i < 4; i++) {
         ppu->bg[i].tilemap_addr = 0;
@@ -52,11 +240,21 @@ void ppu_reset(PPU *ppu) {
     
     /* Reset OAM state */
     ppu->oam_addr = 0;
+    ppu->oam_reload = 0;
+    ppu->oam_rotate = false;
     ppu->oam_buffer = 0;
+    ppu->obj_size = 0;
+    ppu->obj_name_base = 0;
+    ppu->obj_name_gap = 0x2000;
+    ppu->obj_first = 0;
+    ppu->obj_status = 0;
+    ppu->obj_dirty = true;
     
     /* Reset VRAM state */
     ppu->vram_addr = 0;
     ppu->vram_increment = 1;
+    ppu->vram_inc_high = false;
+    ppu->bg_scroll_latch = 0;
     
     /* Reset Mode 7 state */
     ppu->m7_matrix_a = 0x0100;  /* Identity matrix (1.0 in fixed point) */
@@ -71,20 +269,435 @@ void ppu_reset(PPU *ppu) {
     ppu->m7_latch = 0;
     
     ppu->needs_render = false;
+    ppu_set_render_policy(ppu, (PPURenderPolicy)ppu->render_policy, ppu->render_interval);
+    
+    /* Rebuild palette cache for the reset brightness */
+    ppu_invalidate_cgram(ppu, 0, CGRAM_SIZE);
     
     /* Clear framebuffer */
     if (ppu->framebuffer) {
         memset(ppu->framebuffer, 0, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(u32));
     }
+    memset(ppu->line_hash, 0, sizeof(ppu->line_hash));
+    ppu->frame_changed = false;
+    ppu->frame_unchanged = false;
+    ppu->upscaled_stale = true;
 }
 
 void ppu_set_memory(PPU *ppu, u8 *vram, u8 *cgram, u8 *oam) {
     ppu->vram = vram;
     ppu->cgram = cgram;
     ppu->oam = oam;
+    
+    /* Cached tiles and colors came from whatever was attached before */
+    ppu_invalidate_vram(ppu, 0, VRAM_SIZE);
+    ppu_invalidate_cgram(ppu, 0, CGRAM_SIZE);
+    ppu_invalidate_oam(ppu, 0, OAM_SIZE);
+}
+
+void ppu_invalidate_cgram(PPU *ppu, u32 address, u32 length) {
+    u32 index, last;
+    
+    if (address >= CGRAM_SIZE || length == 0) {
+        return;
+    }
+    
+    last = (address + length - 1) / 2;
+    if (last > 255) {
+        last = 255;
+    }
+    
+    if (ppu->render_pool) {
+        ppu_render_log(ppu, PPU_LOG_CGRAM, address & ~1u, (last + 1) * 2 - (address & ~1u));
+    }
+    
+    for (index = address / 2; index <= last; index++) {
+        ppu_update_color(ppu, index);
+    }
+    ppu->mem_generation++;
+}
+
+void ppu_invalidate_vram(PPU *ppu, u32 address, u32 length) {
+    u32 end = address + length;
+    int i;
+    
+    if (address >= VRAM_SIZE || length == 0) {
+        return;
+    }
+    if (end > VRAM_SIZE) {
+        end = VRAM_SIZE;
+    }
+    
+    if (ppu->render_pool) {
+        ppu_render_log(ppu, PPU_LOG_VRAM, address, end - address);
+    }
+    ppu->mem_generation++;
+    
+    for (i = 0; i < TILE_CACHE_DEPTHS; i++) {
+        TileCache *cache = &ppu->tile_cache[i];
+        u32 tile_bytes = cache->bpp * 8;
+        
+        if (cache->dirty) {
+            u32 first = address / tile_bytes;
+            u32 last = (end - 1) / tile_bytes;
+            memset(&cache->dirty[first], 1, last - first + 1);
+        }
+    }
+}
+
+void ppu_invalidate_oam(PPU *ppu, u32 address, u32 length) {
+    if (address >= OAM_SIZE || length == 0) {
+        return;
+    }
+    if (address + length > OAM_SIZE) {
+        length = OAM_SIZE - address;
+    }
+    
+    if (ppu->render_pool) {
+        ppu_render_log(ppu, PPU_LOG_OAM, address, length);
+    }
+    ppu->obj_dirty = true;
+    ppu->mem_generation++;
+}
+
+/* Decode one tile from planar VRAM data into 64 color indices */
+static void ppu_decode_tile(const PPU *ppu, TileCache *cache, u16 tile) {
+    const u8 *src = &ppu->vram[tile * cache->bpp * 8];
+    u8 *dst = &cache->pixels[tile * 64];
+    int row, x, plane;
+    
+    /* Bitplanes are stored in interleaved pairs, 16 bytes per pair */
+    for (row = 0; row < 8; row++) {
+        for (x = 0; x < 8; x++) {
+            int shift = 7 - x;
+            u8 color = 0;
+            
+            for (plane = 0; plane < cache->bpp; plane += 2) {
+                const u8 *pair = &src[plane * 8 + row * 2];
+                color |= ((pair[0] >> shift) & 1) << plane;
+                color |= ((pair[1] >> shift) & 1) << (plane + 1);
+            }
+            dst[row * 8 + x] = color;
+        }
+    }
+}
+
+const u8 *ppu_get_tile(PPU *ppu, u8 bpp, u16 tile) {
+    TileCache *cache = &ppu->tile_cache[bpp >> 2];
+    
+    tile &= cache->tile_count - 1;
+    if (cache->dirty[tile]) {
+        ppu_decode_tile(ppu, cache, tile);
+        cache->dirty[tile] = 0;
+    }
+    return &cache->pixels[tile * 64];
+}
+
+/* Range of PPU memory changed by a run of port writes (empty when end == 0) */
+typedef struct {
+    u32 first;
+    u32 end;
+} PPUSpan;
+
+static inline void ppu_span_add(PPUSpan *span, u32 address, u32 length) {
+    if (span->end == 0) {
+        span->first = address;
+        span->end = address + length;
+        return;
+    }
+    if (address < span->first) {
+        span->first = address;
+    }
+    if (address + length > span->end) {
+        span->end = address + length;
+    }
+}
+
+/* Write one byte through OAMDATA */
+static void ppu_oam_write(PPU *ppu, u8 value, PPUSpan *changed) {
+    u16 address = ppu->oam_addr;
+    
+    ppu->oam_addr = (address + 1) & 0x3FF;
+    if (!ppu->oam) {
+        return;
+    }
+    
+    if (address >= 512) {
+        /* High table (mirrored every 32 bytes) is written directly */
+        address = 512 + (address & 0x1F);
+        if (ppu->oam[address] != value) {
+            ppu->oam[address] = value;
+            ppu_span_add(changed, address, 1);
+        }
+    } else if (!(address & 1)) {
+        /* Low table words are committed when the odd byte arrives */
+        ppu->oam_buffer = value;
+    } else if (ppu->oam[address - 1] != ppu->oam_buffer || ppu->oam[address] != value) {
+        ppu->oam[address - 1] = ppu->oam_buffer;
+        ppu->oam[address] = value;
+        ppu_span_add(changed, address - 1, 2);
+    }
+}
+
+/* Write one byte through CGDATA (colors are committed in pairs) */
+static void ppu_cgram_write(PPU *ppu, u8 value, PPUSpan *changed) {
+    u8 *entry;
+    
+    if (!ppu->cgram_latch) {
+        ppu->cgram_buffer = value;
+        ppu->cgram_latch = true;
+        return;
+    }
+    
+    entry = ppu->cgram ? &ppu->cgram[ppu->cgram_addr * 2] : NULL;
+    if (entry && (entry[0] != ppu->cgram_buffer || entry[1] != (value & 0x7F))) {
+        entry[0] = ppu->cgram_buffer;
+        entry[1] = value & 0x7F;
+        ppu_span_add(changed, ppu->cgram_addr * 2, 2);
+    }
+    ppu->cgram_addr = (ppu->cgram_addr + 1) & 0xFF;
+    ppu->cgram_latch = false;
+}
+
+/* Update OAMADD (and the priority rotation it selects) */
+static void ppu_set_oam_address(PPU *ppu, u16 reload, bool rotate) {
+    u8 first = rotate ? (u8)((reload >> 1) & 0x7F) : 0;
+    
+    ppu->oam_reload = reload & 0x1FF;
+    ppu->oam_addr = ppu->oam_reload << 1;
+    if (ppu->obj_first != first) {
+        ppu->obj_first = first;
+        ppu->obj_dirty = true;
+    }
+}
+
+/* Write one byte of the VRAM word at the current address */
+static void ppu_vram_write(PPU *ppu, u8 high, u8 value, PPUSpan *changed) {
+    u32 address = ((ppu->vram_addr & 0x7FFF) << 1) | high;
+    
+    if (ppu->vram && ppu->vram[address] != value) {
+        ppu->vram[address] = value;
+        ppu_span_add(changed, address, 1);
+    }
+    
+    /* Advance after the byte selected by VMAIN bit 7 */
+    if (ppu->vram_inc_high == (high != 0)) {
+        ppu->vram_addr += ppu->vram_increment;
+    }
+}
+
+/* Copy whole VRAM words (VMAIN: increment 1 after the high byte) */
+static void ppu_vram_copy(PPU *ppu, const u8 *data, u32 length, bool fixed, PPUSpan *changed) {
+    while (length > 0) {
+        u32 address = (ppu->vram_addr & 0x7FFF) << 1;
+        u32 run = VRAM_SIZE - address;
+        
+        if (run > length) {
+            run = length;
+        }
+        if (fixed) {
+            memset(&ppu->vram[address], data[0], run);
+            ppu_span_add(changed, address, run);
+        } else {
+            if (memcmp(&ppu->vram[address], data, run) != 0) {
+                memcpy(&ppu->vram[address], data, run);
+                ppu_span_add(changed, address, run);
+            }
+            data += run;
+        }
+        ppu->vram_addr += (u16)(run >> 1);
+        length -= run;
+    }
+}
+
+u32 ppu_dma_write(PPU *ppu, u8 reg, const u8 *pattern, u32 phase,
+                  const u8 *data, u32 length, bool fixed) {
+    PPUSpan changed = {0, 0};
+    u8 port = reg + pattern[0];
+    u32 i;
+    
+    for (i = 1; i < 4; i++) {
+        u8 target = reg + pattern[i];
+        
+        /* VMDATAL/VMDATAH mix freely; other ports must not change */
+        if (target != port && !((target | 1) == 0x19 && (port | 1) == 0x19)) {
+            return 0;
+        }
+    }
+    
+    switch (port) {
+        case 0x18:
+        case 0x19:
+            if (!ppu->vram) {
+                return 0;
+            }
+            if (ppu->vram_inc_high && ppu->vram_increment == 1 && !(phase & 1) &&
+                reg + pattern[0] == 0x18 && reg + pattern[1] == 0x19 &&
+                reg + pattern[2] == 0x18 && reg + pattern[3] == 0x19) {
+                /* Linear word upload: straight block copy (or fill) */
+                length &= ~1u;
+                if (length == 0) {
+                    return 0;
+                }
+                ppu_vram_copy(ppu, data, length, fixed, &changed);
+            } else {
+                for (i = 0; i < length; i++) {
+                    u8 high = (reg + pattern[(phase + i) & 3]) & 1;
+                    ppu_vram_write(ppu, high, data[fixed ? 0 : i], &changed);
+                }
+            }
+            if (changed.end) {
+                ppu_invalidate_vram(ppu, changed.first, changed.end - changed.first);
+            }
+            return length;
+            
+        case 0x22:
+            for (i = 0; i < length; i++) {
+                ppu_cgram_write(ppu, data[fixed ? 0 : i], &changed);
+            }
+            if (changed.end) {
+                ppu_invalidate_cgram(ppu, changed.first, changed.end - changed.first);
+            }
+            return length;
+            
+        case 0x04:
+            for (i = 0; i < length; i++) {
+                ppu_oam_write(ppu, data[fixed ? 0 : i], &changed);
+            }
+            if (changed.end) {
+                ppu_invalidate_oam(ppu, changed.first, changed.end - changed.first);
+            }
+            return length;
+            
+        default:
+            return 0;
+    }
+}
+
+/* Scanline state */
+
+/* Render-relevant register state of one scanline */
+typedef struct {
+    u8 brightness;
+    bool forced_blank;
+    u8 bg_mode;
+    bool bg3_priority;
+    BGLayer bg[4];
+    u8 main_screen;
+    u8 sub_screen;
+    u8 main_window;
+    u8 sub_window;
+    u8 window_sel[3];
+    u8 window_pos[4];
+    u8 window_logic[2];
+    u8 cgwsel;
+    u8 cgadsub;
+    u16 fixed_color;
+    s16 m7_matrix_a;
+    s16 m7_matrix_b;
+    s16 m7_matrix_c;
+    s16 m7_matrix_d;
+    s16 m7_center_x;
+    s16 m7_center_y;
+    u8 m7_repeat;
+    bool m7_h_flip;
+    bool m7_v_flip;
+    u8 obj_size;
+    u16 obj_name_base;
+    u16 obj_name_gap;
+    u8 obj_first;
+} PPULineState;
+
+static void ppu_save_line_state(const PPU *ppu, PPULineState *state) {
+    state->brightness = ppu->brightness;
+    state->forced_blank = ppu->forced_blank;
+    state->bg_mode = ppu->bg_mode;
+    state->bg3_priority = ppu->bg3_priority;
+    memcpy(state->bg, ppu->bg, sizeof(state->bg));
+    state->main_screen = ppu->main_screen;
+    state->sub_screen = ppu->sub_screen;
+    state->main_window = ppu->main_window;
+    state->sub_window = ppu->sub_window;
+    memcpy(state->window_sel, ppu->window_sel, sizeof(state->window_sel));
+    memcpy(state->window_pos, ppu->window_pos, sizeof(state->window_pos));
+    memcpy(state->window_logic, ppu->window_logic, sizeof(state->window_logic));
+    state->cgwsel = ppu->cgwsel;
+    state->cgadsub = ppu->cgadsub;
+    state->fixed_color = ppu->fixed_color;
+    state->m7_matrix_a = ppu->m7_matrix_a;
+    state->m7_matrix_b = ppu->m7_matrix_b;
+    state->m7_matrix_c = ppu->m7_matrix_c;
+    state->m7_matrix_d = ppu->m7_matrix_d;
+    state->m7_center_x = ppu->m7_center_x;
+    state->m7_center_y = ppu->m7_center_y;
+    state->m7_repeat = ppu->m7_repeat;
+    state->m7_h_flip = ppu->m7_h_flip;
+    state->m7_v_flip = ppu->m7_v_flip;
+    state->obj_size = ppu->obj_size;
+    state->obj_name_base = ppu->obj_name_base;
+    state->obj_name_gap = ppu->obj_name_gap;
+    state->obj_first = ppu->obj_first;
+}
+
+/*
+ * Hash of everything a visible line's output depends on: the register
+ * state plus the generation of VRAM/CGRAM/OAM contents. Never 0, which
+ * marks a line with no known contents.
+ */
+static u64 ppu_line_hash(const PPU *ppu) {
+    PPULineState state;
+    const u8 *bytes = (const u8 *)&state;
+    u64 hash = 0xCBF29CE484222325ULL;  /* FNV-1a */
+    size_t i;
+    
+    memset(&state, 0, sizeof(state));
+    ppu_save_line_state(ppu, &state);
+    for (i = 0; i < sizeof(state); i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    }
+    hash = (hash ^ ppu->mem_generation) * 0x100000001B3ULL;
+    return hash | 1;
+}
+
+/* Render policy decision for the frame that is starting */
+static bool ppu_frame_drawn(PPU *ppu) {
+    bool drawn;
+    
+    switch (ppu->render_policy) {
+        case PPU_RENDER_EVERY_NTH:
+            return ppu->frame_count % ppu->render_interval == 0;
+        case PPU_RENDER_ON_REQUEST:
+            drawn = ppu->render_requested;
+            ppu->render_requested = false;
+            return drawn;
+        case PPU_RENDER_NEVER:
+            return false;
+        default:
+            return true;
+    }
+}
+
+void ppu_set_render_policy(PPU *ppu, PPURenderPolicy policy, u32 interval) {
+    ppu->render_policy = (u8)policy;
+    ppu->render_interval = interval > 0 ? interval : 1;
+    ppu->render_requested = false;
+    ppu->render_enabled = policy == PPU_RENDER_ALWAYS ||
+                          (policy == PPU_RENDER_EVERY_NTH &&
+                           ppu->frame_count % ppu->render_interval == 0);
+}
+
+void ppu_request_frame(PPU *ppu) {
+    /* Right after the frame started nothing visible was skipped yet */
+    if (ppu->vcount == 0) {
+        ppu->render_enabled = true;
+    } else {
+        ppu->render_requested = true;
+    }
 }
 
 void ppu_step_scanline(PPU *ppu) {
+    bool redraw = false;
+    
     ppu->vcount++;
     
     /* NTSC: 262 scanlines per frame */
@@ -93,6 +706,7 @@ void ppu_step_scanline(PPU *ppu) {
         ppu->vblank = false;
         ppu->frame_count++;
         ppu->needs_render = true;
+        ppu->render_enabled = ppu_frame_drawn(ppu);
     }
     
     /* VBlank starts at scanline 225 */
@@ -100,9 +714,30 @@ void ppu_step_scanline(PPU *ppu) {
         ppu->vblank = true;
     }
     
-    /* Render scanline if in visible area */
-    if (ppu->vcount < SCREEN_HEIGHT && !ppu->forced_blank) {
-        ppu_render_scanline(ppu);
+    /* A visible line whose inputs match what produced the line already in
+     * the framebuffer does not need to be drawn again; frames skipped by
+     * the render policy only keep timing */
+    if (ppu->vcount < SCREEN_HEIGHT && !ppu->forced_blank && ppu->render_enabled) {
+        u64 hash = ppu_line_hash(ppu);
+        redraw = hash != ppu->line_hash[ppu->vcount];
+        if (redraw) {
+            ppu->line_hash[ppu->vcount] = hash;
+            ppu->frame_changed = true;
+        }
+    }
+    
+    /* Render scanline if in visible area (or record it for the workers) */
+    if (ppu->render_pool) {
+        ppu_render_record_line(ppu);
+    } else {
+        if (redraw) {
+            ppu_render_scanline(ppu);
+            ppu->upscaled_stale = true;
+        }
+        if (ppu->vcount == 225) {
+            ppu->frame_unchanged = !ppu->frame_changed;
+            ppu->frame_changed = false;
+        }
     }
 }
 
@@ -111,48 +746,118 @@ bool ppu_in_vblank(const PPU *ppu) {
 }
 
 void ppu_write_register(PPU *ppu, u16 address, u8 value) {
+    PPUSpan changed = {0, 0};
+    int i;
+    
     switch (address) {
         case PPU_INIDISP:  /* Display Control */
-            ppu->brightness = value & 0x0F;
+            if (ppu->brightness != (value & 0x0F)) {
+                ppu->brightness = value & 0x0F;
+                ppu_update_brightness(ppu);
+            }
             ppu->forced_blank = (value & 0x80) != 0;
             break;
             
         case PPU_BGMODE:  /* BG Mode */
             ppu->bg_mode = value & 0x07;
-            ppu->bg[0].enabled = true;  /* BG1 typically enabled */
-            ppu->bg[1].enabled = (ppu->bg_mode <= 1);  /* BG2 in modes 0-1 */
-            ppu->bg[2].enabled = (ppu->bg_mode == 0);  /* BG3 in mode 0 */
-            ppu->bg[3].enabled = (ppu->bg_mode == 0);  /* BG4 in mode 0 */
+            ppu->bg3_priority = (value & 0x08) != 0;
+            for (i = 0; i < 4; i++) {
+                ppu->bg[i].enabled = ppu_bg_bpp[ppu->bg_mode][i] != 0;
+            }
+            ppu->bg[0].enabled |= (ppu->bg_mode == 7);
+            break;
+            
+        case PPU_OBSEL:  /* Object Size and Base */
+            ppu->obj_size = value >> 5;
+            ppu->obj_name_base = (value & 0x07) << 14;
+            ppu->obj_name_gap = (((value >> 3) & 0x03) + 1) << 13;
+            ppu->obj_dirty = true;
+            break;
+            
+        case PPU_OAMADDL:  /* OAM Address (low) */
+            ppu_set_oam_address(ppu, (ppu->oam_reload & 0x100) | value, ppu->oam_rotate);
+            break;
+            
+        case PPU_OAMADDH:  /* OAM Address (high) and priority rotation */
+            ppu->oam_rotate = (value & 0x80) != 0;
+            ppu_set_oam_address(ppu, ((value & 0x01) << 8) | (ppu->oam_reload & 0xFF),
+                                ppu->oam_rotate);
+            break;
+            
+        case PPU_OAMDATA:  /* OAM Data Write */
+            ppu_oam_write(ppu, value, &changed);
+            if (changed.end) {
+                ppu_invalidate_oam(ppu, changed.first, changed.end - changed.first);
+            }
             break;
             
+        /* Tilemap base in 1K-word steps, stored as a VRAM byte address */
         case PPU_BG1SC:  /* BG1 Tilemap Address */
-            ppu->bg[0].tilemap_addr = (value & 0xFC) << 8;
+            ppu->bg[0].tilemap_addr = (value & 0x7C) << 9;
             ppu->bg[0].size = value & 0x03;
             break;
             
         case PPU_BG2SC:  /* BG2 Tilemap Address */
-            ppu->bg[1].tilemap_addr = (value & 0xFC) << 8;
+            ppu->bg[1].tilemap_addr = (value & 0x7C) << 9;
             ppu->bg[1].size = value & 0x03;
             break;
             
         case PPU_BG3SC:  /* BG3 Tilemap Address */
-            ppu->bg[2].tilemap_addr = (value & 0xFC) << 8;
+            ppu->bg[2].tilemap_addr = (value & 0x7C) << 9;
             ppu->bg[2].size = value & 0x03;
             break;
             
         case PPU_BG4SC:  /* BG4 Tilemap Address */
-            ppu->bg[3].tilemap_addr = (value & 0xFC) << 8;
+            ppu->bg[3].tilemap_addr = (value & 0x7C) << 9;
             ppu->bg[3].size = value & 0x03;
             break;
             
+        /* Character base in 4K-word steps, stored as a VRAM byte address */
         case PPU_BG12NBA:  /* BG1 & BG2 Chr Address */
-            ppu->bg[0].chr_addr = (value & 0x0F) << 12;
-            ppu->bg[1].chr_addr = (value & 0xF0) << 8;
+            ppu->bg[0].chr_addr = (value & 0x07) << 13;
+            ppu->bg[1].chr_addr = ((value >> 4) & 0x07) << 13;
             break;
             
         case PPU_BG34NBA:  /* BG3 & BG4 Chr Address */
-            ppu->bg[2].chr_addr = (value & 0x0F) << 12;
-            ppu->bg[3].chr_addr = (value & 0xF0) << 8;
+            ppu->bg[2].chr_addr = (value & 0x07) << 13;
+            ppu->bg[3].chr_addr = ((value >> 4) & 0x07) << 13;
+            break;
+            
+        case 0x210D: case 0x210F: case 0x2111: case 0x2113:  /* BGnHOFS */
+            i = (address - PPU_BG1HOFS) >> 1;
+            ppu->bg[i].h_scroll = ((value << 8) | ppu->bg_scroll_latch) & 0x3FF;
+            ppu->bg_scroll_latch = value;
+            break;
+            
+        case 0x210E: case 0x2110: case 0x2112: case 0x2114:  /* BGnVOFS */
+            i = (address - PPU_BG1HOFS) >> 1;
+            ppu->bg[i].v_scroll = ((value << 8) | ppu->bg_scroll_latch) & 0x3FF;
+            ppu->bg_scroll_latch = value;
+            break;
+            
+        case PPU_VMAIN:  /* VRAM Address Increment Mode */
+            ppu->vram_inc_high = (value & 0x80) != 0;
+            switch (value & 0x03) {
+                case 0: ppu->vram_increment = 1; break;
+                case 1: ppu->vram_increment = 32; break;
+                default: ppu->vram_increment = 128; break;
+            }
+            break;
+            
+        case PPU_VMADDL:  /* VRAM Address (low) */
+            ppu->vram_addr = (ppu->vram_addr & 0xFF00) | value;
+            break;
+            
+        case PPU_VMADDH:  /* VRAM Address (high) */
+            ppu->vram_addr = (ppu->vram_addr & 0x00FF) | (value << 8);
+            break;
+            
+        case PPU_VMDATAL:  /* VRAM Data Write (low) */
+        case PPU_VMDATAH:  /* VRAM Data Write (high) */
+            ppu_vram_write(ppu, address & 1, value, &changed);
+            if (changed.end) {
+                ppu_invalidate_vram(ppu, changed.first, changed.end - changed.first);
+            }
             break;
             
         case PPU_CGADD:  /* CGRAM Address */
@@ -161,22 +866,69 @@ void ppu_write_register(PPU *ppu, u16 address, u8 value) {
             break;
             
         case PPU_CGDATA:  /* CGRAM Data */
-            if (!ppu->cgram_latch) {
-                ppu->cgram_buffer = value;
-                ppu->cgram_latch = true;
-            } else {
-                if (ppu->cgram && ppu->cgram_addr < CGRAM_SIZE / 2) {
-                    ppu->cgram[ppu->cgram_addr * 2] = ppu->cgram_buffer;
-                    ppu->cgram[ppu->cgram_addr * 2 + 1] = value & 0x7F;
-                }
-                ppu->cgram_addr = (ppu->cgram_addr + 1) & 0xFF;
-                ppu->cgram_latch = false;
+            ppu_cgram_write(ppu, value, &changed);
+            if (changed.end) {
+                ppu_invalidate_cgram(ppu, changed.first, changed.end - changed.first);
+            }
+            break;
+            
+        /* Windows */
+        case PPU_W12SEL:
+        case PPU_W34SEL:
+        case PPU_WOBJSEL:
+            ppu->window_sel[address - PPU_W12SEL] = value;
+            break;
+            
+        case 0x2126: case 0x2127: case 0x2128: case 0x2129:  /* WH0-WH3 */
+            ppu->window_pos[address - PPU_WH0] = value;
+            break;
+            
+        case PPU_WBGLOG:
+        case PPU_WOBJLOG:
+            ppu->window_logic[address - PPU_WBGLOG] = value;
+            break;
+            
+        /* Screen designation */
+        case PPU_TM:
+            ppu->main_screen = value & 0x1F;
+            break;
+            
+        case PPU_TS:
+            ppu->sub_screen = value & 0x1F;
+            break;
+            
+        case PPU_TMW:
+            ppu->main_window = value & 0x1F;
+            break;
+            
+        case PPU_TSW:
+            ppu->sub_window = value & 0x1F;
+            break;
+            
+        /* Color math */
+        case PPU_CGWSEL:
+            ppu->cgwsel = value;
+            break;
+            
+        case PPU_CGADSUB:
+            ppu->cgadsub = value;
+            break;
+            
+        case PPU_COLDATA:  /* Bits 5-7 select which channels take the intensity */
+            if (value & 0x20) {
+                ppu->fixed_color = (ppu->fixed_color & ~0x001F) | (value & 0x1F);
+            }
+            if (value & 0x40) {
+                ppu->fixed_color = (ppu->fixed_color & ~0x03E0) | ((value & 0x1F) << 5);
+            }
+            if (value & 0x80) {
+                ppu->fixed_color = (ppu->fixed_color & ~0x7C00) | ((value & 0x1F) << 10);
             }
             break;
             
         /* Mode 7 registers */
-        case 0x211A:  /* M7SEL - Mode 7 Settings */
-            ppu->m7_repeat = value & 0x03;
+        case PPU_M7SEL:  /* M7SEL - Mode 7 Settings */
+            ppu->m7_repeat = value >> 6;
             ppu->m7_h_flip = (value & 0x01) != 0;
             ppu->m7_v_flip = (value & 0x02) != 0;
             break;
@@ -253,27 +1005,32 @@ u8 ppu_read_register(PPU *ppu, u16 address) {
             return 0;
             
         case 0x2138:  /* OAMDATAREAD - OAM Data Read */
-            /* Read from OAM at current address */
-            if (ppu->oam && ppu->oam_addr < 544) {  /* 512 bytes main OAM + 32 bytes high table */
-                u8 value = ppu->oam[ppu->oam_addr];
-                ppu->oam_addr = (ppu->oam_addr + 1) & 0x1FF;
-                return value;
+            /* Read from OAM at current address (high table mirrors above 512) */
+            if (ppu->oam) {
+                u16 address = ppu->oam_addr;
+                ppu->oam_addr = (address + 1) & 0x3FF;
+                return ppu->oam[address < 512 ? address : 512 + (address & 0x1F)];
             }
             return 0;
             
         case 0x2139:  /* VMDATALREAD - VRAM Data Read (low byte) */
             /* Read low byte of VRAM data */
-            if (ppu->vram && ppu->vram_addr * 2 + 1 < VRAM_SIZE) {
-                return ppu->vram[ppu->vram_addr * 2];
+            if (ppu->vram) {
+                u8 value = ppu->vram[(ppu->vram_addr & 0x7FFF) * 2];
+                if (!ppu->vram_inc_high) {
+                    ppu->vram_addr += ppu->vram_increment;
+                }
+                return value;
             }
             return 0;
             
         case 0x213A:  /* VMDATAHREAD - VRAM Data Read (high byte) */
             /* Read high byte of VRAM data */
-            if (ppu->vram && ppu->vram_addr * 2 + 1 < VRAM_SIZE) {
-                u8 value = ppu->vram[ppu->vram_addr * 2 + 1];
-                /* Increment VRAM address after high byte read */
-                ppu->vram_addr += ppu->vram_increment;
+            if (ppu->vram) {
+                u8 value = ppu->vram[(ppu->vram_addr & 0x7FFF) * 2 + 1];
+                if (ppu->vram_inc_high) {
+                    ppu->vram_addr += ppu->vram_increment;
+                }
                 return value;
             }
             return 0;
@@ -307,7 +1064,10 @@ u8 ppu_read_register(PPU *ppu, u16 address) {
         case 0x213E:  /* STAT77 - PPU Status Flag and Version */
             /* Bit 7: Time over flag, Bit 6: Range over flag */
             /* Bits 4-0: PPU version (typically 1) */
-            return 0x01;  /* PPU version 1, no time/range over */
+            if (ppu->obj_dirty && ppu->oam) {
+                ppu_evaluate_sprites(ppu);
+            }
+            return ppu->obj_status | 0x01;
             
         case 0x213F:  /* STAT78 - PPU Status Flag and Version */
             /* Bit 7: V-blank flag, Bit 6: H-blank flag */
@@ -331,257 +1091,525 @@ u8 ppu_read_register(PPU *ppu, u16 address) {
 }
 
 u32 ppu_get_color(const PPU *ppu, u8 palette_index) {
-    u16 color15;
-    u8 r, g, b;
-    
-    if (!ppu->cgram) {
-        return 0xFF000000;  /* Black */
-    }
-    
-    /* Read 15-bit color from CGRAM (2 bytes per color) */
-    color15 = ppu->cgram[palette_index * 2] | 
-              ((ppu->cgram[palette_index * 2 + 1] & 0x7F) << 8);
-    
-    /* Convert 5-bit RGB to 8-bit RGB */
-    r = (color15 & 0x1F) << 3;
-    g = ((color15 >> 5) & 0x1F) << 3;
-    b = ((color15 >> 10) & 0x1F) << 3;
-    
-    /* Return RGBA (0xAABBGGRR format for little-endian) */
-    return 0xFF000000 | (b << 16) | (g << 8) | r;
+    return ppu->palette_lit[palette_index];
 }
 
 void ppu_render_scanline(PPU *ppu) {
-    int x, i;
-    u32 *line;
+    int i;
     
     if (!ppu->framebuffer || ppu->vcount >= SCREEN_HEIGHT) {
         return;
     }
     
-    line = &ppu->framebuffer[ppu->vcount * SCREEN_WIDTH];
-    
-    /* Fill with background color (palette entry 0) */
-    for (x = 0; x < SCREEN_WIDTH; x++) {
-        line[x] = ppu_get_color(ppu, 0);
+    /* Start every layer transparent */
+    for (i = 0; i < PPU_LAYER_COUNT; i++) {
+        memset(ppu->layer_buffer[i], 0, SCREEN_WIDTH * sizeof(u16));
     }
     
     /* Check for Mode 7 rendering */
     if (ppu->bg_mode == 7) {
         ppu_render_mode7(ppu);
     } else {
-        /* Render enabled background layers (back to front) */
-        /* In mode 0: all 4 layers, mode 1: 2-3 layers */
-        for (i = 3; i >= 0; i--) {
+        for (i = 0; i < 4; i++) {
             if (ppu->bg[i].enabled) {
                 ppu_render_background(ppu, i);
             }
         }
     }
     
-    /* Render sprites on top of backgrounds */
     ppu_render_sprites(ppu);
     
-    /* Apply brightness adjustment */
-    if (ppu->brightness < 15) {
+    /* Resolve priorities into the framebuffer line */
+    ppu_compose_scanline(ppu);
+}
+
+/* Merge function: out[x] = max over layers of (layers[i][x] & masks[i][x]) */
+typedef void (*PPUMergeFunc)(u16 *out, const u16 *const *layers,
+                             const u16 *const *masks, int count);
+
+static void ppu_merge_scalar(u16 *out, const u16 *const *layers,
+                             const u16 *const *masks, int count) {
+    int x, i;
+    
+    memset(out, 0, SCREEN_WIDTH * sizeof(u16));
+    for (i = 0; i < count; i++) {
+        const u16 *layer = layers[i];
+        const u16 *mask = masks[i];
+        
         for (x = 0; x < SCREEN_WIDTH; x++) {
-            u32 pixel = line[x];
-            u8 r = ((pixel & 0xFF) * ppu->brightness) / 15;
-            u8 g = (((pixel >> 8) & 0xFF) * ppu->brightness) / 15;
-            u8 b = (((pixel >> 16) & 0xFF) * ppu->brightness) / 15;
-            line[x] = 0xFF000000 | (b << 16) | (g << 8) | r;
+            u16 entry = mask ? (layer[x] & mask[x]) : layer[x];
+            if (entry > out[x]) {
+                out[x] = entry;
+            }
         }
     }
 }
 
-void ppu_render_background(PPU *ppu, u8 layer) {
-    int x, y;
-    u16 tile_x, tile_y;
-    u16 tilemap_addr, tile_num, tile_addr;
-    u16 tile_attr;
-    u8 pixel_data[8];
-    u8 palette;
-    bool h_flip, v_flip;
-    u16 priority;
+/* Convert line buffer entries to colors */
+static void ppu_lookup_scalar(u32 *line, const u16 *entries, const u32 *palette) {
+    int x;
     
-    if (layer >= 4 || !ppu->bg[layer].enabled || !ppu->vram) {
-        return;
+    for (x = 0; x < SCREEN_WIDTH; x++) {
+        line[x] = palette[entries[x] & 0xFF];
     }
+}
+
+#ifdef PPU_X86_SIMD
+/* Entries stay below 0x8000, so the signed 16-bit max is exact */
+__attribute__((target("sse2")))
+static void ppu_merge_sse2(u16 *out, const u16 *const *layers,
+                           const u16 *const *masks, int count) {
+    int x, i;
     
-    /* Get current scanline */
-    y = ppu->vcount;
-    if (y >= SCREEN_HEIGHT) {
-        return;
+    for (x = 0; x < SCREEN_WIDTH; x += 8) {
+        __m128i acc = _mm_setzero_si128();
+        
+        for (i = 0; i < count; i++) {
+            __m128i entry = _mm_loadu_si128((const __m128i *)&layers[i][x]);
+            if (masks[i]) {
+                entry = _mm_and_si128(entry, _mm_loadu_si128((const __m128i *)&masks[i][x]));
+            }
+            acc = _mm_max_epi16(acc, entry);
+        }
+        _mm_storeu_si128((__m128i *)&out[x], acc);
     }
+}
+
+__attribute__((target("avx2")))
+static void ppu_merge_avx2(u16 *out, const u16 *const *layers,
+                           const u16 *const *masks, int count) {
+    int x, i;
     
-    /* Calculate tile row based on scroll offset */
-    tile_y = (y + ppu->bg[layer].v_scroll) / 8;
+    for (x = 0; x < SCREEN_WIDTH; x += 16) {
+        __m256i acc = _mm256_setzero_si256();
+        
+        for (i = 0; i < count; i++) {
+            __m256i entry = _mm256_loadu_si256((const __m256i *)&layers[i][x]);
+            if (masks[i]) {
+                entry = _mm256_and_si256(entry,
+                                         _mm256_loadu_si256((const __m256i *)&masks[i][x]));
+            }
+            acc = _mm256_max_epu16(acc, entry);
+        }
+        _mm256_storeu_si256((__m256i *)&out[x], acc);
+    }
+}
+
+/* Gather 8 palette colors per step */
+__attribute__((target("avx2")))
+static void ppu_lookup_avx2(u32 *line, const u16 *entries, const u32 *palette) {
+    const __m256i index_mask = _mm256_set1_epi32(0xFF);
+    int x;
     
-    /* Render each tile in the scanline */
     for (x = 0; x < SCREEN_WIDTH; x += 8) {
-        int pixel_x, pixel_y;
-        u8 bit0, bit1, color_index;
-        
-        /* Calculate tile column based on scroll offset */
-        tile_x = (x + ppu->bg[layer].h_scroll) / 8;
-        
-        /* Get tilemap entry address */
-        /* Tilemap format: 2 bytes per tile (tile number + attributes) */
-        tilemap_addr = ppu->bg[layer].tilemap_addr + ((tile_y * 32 + tile_x) * 2);
+        __m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)&entries[x]));
+        index = _mm256_and_si256(index, index_mask);
+        _mm256_storeu_si256((__m256i *)&line[x],
+                            _mm256_i32gather_epi32((const int *)palette, index, 4));
+    }
+}
+#endif
+
+/*
+ * Build the mask line of one window-able layer (0-3 BG, 4 OBJ, 5 color)
+ * mask[x] is 0 inside the window and 0xFFFF outside.
+ * Returns false when no window is enabled for the layer.
+ */
+static bool ppu_window_line(const PPU *ppu, u8 layer, u16 *mask) {
+    u8 sel = (ppu->window_sel[layer >> 1] >> ((layer & 1) * 4)) & 0x0F;
+    u8 logic = (ppu->window_logic[layer >> 2] >> ((layer & 3) * 2)) & 0x03;
+    bool w1_enabled = (sel & 0x02) != 0;
+    bool w2_enabled = (sel & 0x08) != 0;
+    int x;
+    
+    if (!w1_enabled && !w2_enabled) {
+        return false;
+    }
+    
+    for (x = 0; x < SCREEN_WIDTH; x++) {
+        bool in1 = (x >= ppu->window_pos[0] && x <= ppu->window_pos[1]) != ((sel & 0x01) != 0);
+        bool in2 = (x >= ppu->window_pos[2] && x <= ppu->window_pos[3]) != ((sel & 0x04) != 0);
+        bool inside;
         
-        /* Clamp to VRAM size */
-        if (tilemap_addr >= VRAM_SIZE - 1) {
-            continue;
+        if (w1_enabled && w2_enabled) {
+            switch (logic) {
+                case 0: inside = in1 || in2; break;   /* OR */
+                case 1: inside = in1 && in2; break;   /* AND */
+                case 2: inside = in1 != in2; break;   /* XOR */
+                default: inside = in1 == in2; break;  /* XNOR */
+            }
+        } else {
+            inside = w1_enabled ? in1 : in2;
         }
+        mask[x] = inside ? 0 : 0xFFFF;
+    }
+    return true;
+}
+
+/* CGWSEL region test: 0 = never, 1 = outside color window, 2 = inside, 3 = always */
+static inline bool ppu_math_region(u8 region, bool in_color_window) {
+    switch (region) {
+        case 0: return false;
+        case 1: return !in_color_window;
+        case 2: return in_color_window;
+        default: return true;
+    }
+}
+
+/* Add or subtract two RGBA colors per channel, optionally halving the result */
+static u32 ppu_color_math(u32 a, u32 b, bool subtract, bool half) {
+    u32 result = 0xFF000000;
+    int shift;
+    
+    for (shift = 0; shift < 24; shift += 8) {
+        int ca = (a >> shift) & 0xFF;
+        int cb = (b >> shift) & 0xFF;
+        int c = subtract ? ca - cb : ca + cb;
         
-        /* Read tile number and attributes */
-        tile_num = ppu->vram[tilemap_addr] | ((ppu->vram[tilemap_addr + 1] & 0x03) << 8);
-        tile_attr = ppu->vram[tilemap_addr + 1];
-        
-        /* Extract attributes */
-        palette = (tile_attr >> 2) & 0x07;  /* Palette number (0-7) */
-        priority = (tile_attr >> 5) & 0x01; /* Priority */
-        h_flip = (tile_attr & 0x40) != 0;   /* Horizontal flip */
-        v_flip = (tile_attr & 0x80) != 0;   /* Vertical flip */
-        
-        (void)priority;  /* Unused for now */
-        
-        /* Calculate tile graphics address */
-        /* Each tile is 8x8 pixels, 2 bits per pixel (4 colors per tile) */
-        /* In 2bpp mode: 16 bytes per tile (2 bitplanes) */
-        tile_addr = ppu->bg[layer].chr_addr + (tile_num * 16);
-        
-        if (tile_addr >= VRAM_SIZE - 15) {
+        if (c < 0) {
+            c = 0;
+        }
+        if (half) {
+            c >>= 1;
+        }
+        if (c > 0xF8) {
+            c = 0xF8;
+        }
+        result |= (u32)c << shift;
+    }
+    return result;
+}
+
+/* Merge the layers enabled in a TM/TS screen into out */
+static void ppu_merge_screen(const PPU *ppu, u16 *out, u8 screen, u8 screen_window,
+                             u16 windows[][SCREEN_WIDTH], const bool *windowed) {
+    const u16 *layers[PPU_LAYER_COUNT];
+    const u16 *masks[PPU_LAYER_COUNT];
+    PPUMergeFunc merge = ppu_merge_scalar;
+    int i, count = 0;
+    
+    for (i = 0; i < PPU_LAYER_COUNT; i++) {
+        if (!(screen & (1 << i)) || (i < 4 && !ppu->bg[i].enabled)) {
             continue;
         }
-        
-        /* Get the pixel row within this tile */
-        pixel_y = (y + ppu->bg[layer].v_scroll) % 8;
-        if (v_flip) {
-            pixel_y = 7 - pixel_y;
+        layers[count] = ppu->layer_buffer[i];
+        masks[count] = ((screen_window & (1 << i)) && windowed[i]) ? windows[i] : NULL;
+        count++;
+    }
+    
+#ifdef PPU_X86_SIMD
+    if (ppu->compose_path == PPU_COMPOSE_AVX2) {
+        merge = ppu_merge_avx2;
+    } else if (ppu->compose_path == PPU_COMPOSE_SSE2) {
+        merge = ppu_merge_sse2;
+    }
+#endif
+    merge(out, layers, masks, count);
+}
+
+void ppu_compose_scanline(PPU *ppu) {
+    u16 windows[PPU_LAYER_COUNT + 1][SCREEN_WIDTH];
+    bool windowed[PPU_LAYER_COUNT + 1];
+    u16 main_line[SCREEN_WIDTH];
+    u16 sub_line[SCREEN_WIDTH];
+    u8 math_layers = ppu->cgadsub & 0x3F;
+    u8 clip_region = (ppu->cgwsel >> 6) & 0x03;
+    u8 prevent_region = (ppu->cgwsel >> 4) & 0x03;
+    bool use_sub = (ppu->cgwsel & 0x02) != 0;
+    u32 fixed, *line;
+    int i, x;
+    
+    if (!ppu->framebuffer || ppu->vcount >= SCREEN_HEIGHT) {
+        return;
+    }
+    line = &ppu->framebuffer[ppu->vcount * SCREEN_WIDTH];
+    
+    /* Window masks for layers that use them, plus the color window */
+    for (i = 0; i <= PPU_LAYER_COUNT; i++) {
+        bool needed = (i == PPU_LAYER_COUNT) ? (ppu->cgwsel & 0xF0) != 0
+                                             : ((ppu->main_window | ppu->sub_window) >> i) & 1;
+        windowed[i] = needed && ppu_window_line(ppu, i, windows[i]);
+    }
+    
+    ppu_merge_screen(ppu, main_line, ppu->main_screen, ppu->main_window, windows, windowed);
+    
+    /* No color math or clipping: straight palette lookup */
+    if ((math_layers == 0 || prevent_region == 3) && clip_region == 0) {
+#ifdef PPU_X86_SIMD
+        if (ppu->compose_path == PPU_COMPOSE_AVX2) {
+            ppu_lookup_avx2(line, main_line, ppu->palette_lit);
+            return;
         }
+#endif
+        ppu_lookup_scalar(line, main_line, ppu->palette_lit);
+        return;
+    }
+    
+    if (use_sub) {
+        ppu_merge_screen(ppu, sub_line, ppu->sub_screen, ppu->sub_window, windows, windowed);
+    }
+    fixed = ppu_convert_color(ppu->fixed_color);
+    
+    for (x = 0; x < SCREEN_WIDTH; x++) {
+        u16 entry = main_line[x];
+        u8 layer = entry ? (entry >> 8) & 0x07 : PPU_LAYER_BACKDROP;
+        bool in_color_window = windowed[PPU_LAYER_COUNT] && windows[PPU_LAYER_COUNT][x] == 0;
+        bool clipped = ppu_math_region(clip_region, in_color_window);
+        u32 color = clipped ? 0xFF000000 : ppu->palette[entry & 0xFF];
+        bool math = ((math_layers >> layer) & 1) &&
+                    !ppu_math_region(prevent_region, in_color_window);
         
-        /* Read the two bitplanes for this row */
-        /* Bitplane 0 at offset 0, bitplane 1 at offset 1 (interleaved) */
-        bit0 = ppu->vram[tile_addr + (pixel_y * 2)];
-        bit1 = ppu->vram[tile_addr + (pixel_y * 2) + 1];
-        
-        /* Decode 8 pixels */
-        for (pixel_x = 0; pixel_x < 8; pixel_x++) {
-            int shift = h_flip ? pixel_x : (7 - pixel_x);
-            
-            /* Combine bits from both planes */
-            color_index = ((bit0 >> shift) & 1) | (((bit1 >> shift) & 1) << 1);
-            
-            pixel_data[pixel_x] = color_index;
+        /* Only sprite palettes 4-7 take part in color math */
+        if (layer == PPU_LAYER_OBJ && (entry & 0xFF) < 192) {
+            math = false;
         }
         
-        /* Draw pixels to framebuffer */
-        for (pixel_x = 0; pixel_x < 8 && (x + pixel_x) < SCREEN_WIDTH; pixel_x++) {
-            u8 color_idx = pixel_data[pixel_x];
+        if (math) {
+            u32 other = fixed;
+            bool half = (ppu->cgadsub & 0x40) && !clipped;
             
-            /* Skip transparent pixels (color 0) */
-            if (color_idx == 0) {
-                continue;
+            /* A transparent sub screen pixel falls back to the fixed color, unhalved */
+            if (use_sub) {
+                if (sub_line[x]) {
+                    other = ppu->palette[sub_line[x] & 0xFF];
+                } else {
+                    half = false;
+                }
             }
-            
-            /* Calculate final palette index */
-            u8 final_palette = (palette * 4) + color_idx;
-            
-            /* Draw pixel */
-            ppu->framebuffer[y * SCREEN_WIDTH + x + pixel_x] = ppu_get_color(ppu, final_palette);
+            color = ppu_color_math(color, other, (ppu->cgadsub & 0x80) != 0, half);
         }
+        
+        line[x] = ppu_apply_brightness(color, ppu->brightness);
     }
 }
 
-void ppu_render_sprites(PPU *ppu) {
-    int sprite_idx, y;
-    u8 sprite_y, sprite_tile, sprite_attr;
-    u16 sprite_x;
-    u8 palette, priority;
-    bool h_flip, v_flip;
-    int sprite_size_x = 8, sprite_size_y = 8;
-    
-    if (!ppu->oam || !ppu->vram) {
+void ppu_render_background(PPU *ppu, u8 layer) {
+    const BGLayer *bg;
+    u16 *buffer;
+    u16 map_y, fine_y, tile_attr, tile_num;
+    u16 map_base, entry_addr;
+    u8 bpp, palette_base, rank_mode;
+    int y, column, fine_x;
+    
+    if (layer >= 4 || !ppu->bg[layer].enabled || !ppu->vram) {
         return;
     }
     
-    /* Current scanline */
+    /* Get current scanline */
     y = ppu->vcount;
     if (y >= SCREEN_HEIGHT) {
         return;
     }
     
-    /* Render sprites (128 sprites in OAM) */
-    /* OAM format: 4 bytes per sprite + 2 bits in high table */
-    for (sprite_idx = 0; sprite_idx < 128; sprite_idx++) {
-        int oam_offset = sprite_idx * 4;
-        int pixel_y, pixel_x;
-        u16 tile_addr;
-        u8 bit0, bit1, color_index;
-        
-        /* Read sprite attributes from OAM */
-        sprite_x = ppu->oam[oam_offset] | ((ppu->oam[512 + (sprite_idx >> 2)] >> ((sprite_idx & 3) * 2)) & 1) << 8;
-        sprite_y = ppu->oam[oam_offset + 1];
-        sprite_tile = ppu->oam[oam_offset + 2];
-        sprite_attr = ppu->oam[oam_offset + 3];
+    bg = &ppu->bg[layer];
+    bpp = ppu_bg_bpp[ppu->bg_mode][layer];
+    if (bpp == 0) {
+        return;
+    }
+    
+    buffer = ppu->layer_buffer[layer];
+    rank_mode = ppu_rank_mode(ppu);
+    
+    /* Tilemap row for this scanline; 64-tall maps put rows 32-63 in the next screen */
+    map_y = (y + bg->v_scroll) & 0x3FF;
+    fine_y = map_y & 7;
+    map_base = bg->tilemap_addr;
+    if ((bg->size & 0x02) && (map_y & 0x100)) {
+        map_base += (bg->size & 0x01) ? 0x1000 : 0x800;
+    }
+    map_base += ((map_y >> 3) & 31) * 64;
+    
+    /* 33 tile columns cover the line at any fine scroll */
+    fine_x = bg->h_scroll & 7;
+    for (column = 0; column < 33; column++) {
+        u16 map_x = (bg->h_scroll >> 3) + column;
+        const u8 *row;
+        bool h_flip;
+        u16 key;
+        int screen_x = column * 8 - fine_x;
+        int pixel_x;
         
-        /* Extract attributes */
-        palette = ((sprite_attr >> 1) & 0x07) + 8;  /* Sprite palettes 8-15 */
-        priority = (sprite_attr >> 4) & 0x03;
-        h_flip = (sprite_attr & 0x40) != 0;
-        v_flip = (sprite_attr & 0x80) != 0;
+        /* Tilemap format: 2 bytes per tile (tile number + attributes) */
+        entry_addr = map_base + (map_x & 31) * 2;
+        if ((bg->size & 0x01) && (map_x & 0x20)) {
+            entry_addr += 0x800;
+        }
         
-        (void)priority;  /* Unused for now */
+        tile_num = ppu->vram[entry_addr] | ((ppu->vram[entry_addr + 1] & 0x03) << 8);
+        tile_attr = ppu->vram[entry_addr + 1];
+        h_flip = (tile_attr & 0x40) != 0;
+        key = ppu_layer_key(ppu_bg_rank[rank_mode][layer][(tile_attr >> 5) & 1], layer);
         
-        /* Check if sprite is on this scanline */
-        if (y < sprite_y || y >= (sprite_y + sprite_size_y)) {
-            continue;
+        /* Palette base: 2bpp palettes are 4 colors (per-layer in mode 0), 4bpp are 16 */
+        palette_base = 0;
+        if (bpp == 2) {
+            palette_base = ((tile_attr >> 2) & 0x07) * 4;
+            if (ppu->bg_mode == 0) {
+                palette_base += layer * 32;
+            }
+        } else if (bpp == 4) {
+            palette_base = ((tile_attr >> 2) & 0x07) * 16;
         }
         
-        /* Calculate row within sprite */
-        pixel_y = y - sprite_y;
-        if (v_flip) {
-            pixel_y = sprite_size_y - 1 - pixel_y;
+        /* Decoded row of the tile (character base is tile-aligned) */
+        row = ppu_get_tile(ppu, bpp, bg->chr_addr / (bpp * 8) + tile_num);
+        row += ((tile_attr & 0x80) ? 7 - fine_y : fine_y) * 8;
+        
+        for (pixel_x = 0; pixel_x < 8; pixel_x++) {
+            int x = screen_x + pixel_x;
+            u8 color_idx = row[h_flip ? 7 - pixel_x : pixel_x];
+            
+            /* Skip transparent pixels (color 0) and off-screen columns */
+            if (color_idx == 0 || x < 0 || x >= SCREEN_WIDTH) {
+                continue;
+            }
+            
+            buffer[x] = key | (u8)(palette_base + color_idx);
         }
+    }
+}
+
+/* Sprite sizes (width, height) for each OBSEL size selection: small, large */
+static const u8 ppu_obj_sizes[8][2][2] = {
+    {{8, 8}, {16, 16}}, {{8, 8}, {32, 32}}, {{8, 8}, {64, 64}},
+    {{16, 16}, {32, 32}}, {{16, 16}, {64, 64}}, {{32, 32}, {64, 64}},
+    {{16, 32}, {32, 64}}, {{16, 32}, {32, 32}}
+};
+
+/* Number of 8-pixel sprite columns on screen */
+static int ppu_obj_visible_tiles(const Sprite *sprite) {
+    int left = sprite->x < 0 ? -sprite->x : 0;
+    int right = sprite->x + sprite->width > SCREEN_WIDTH ? SCREEN_WIDTH - sprite->x : sprite->width;
+    
+    return (right + 7) / 8 - left / 8;
+}
+
+void ppu_evaluate_sprites(PPU *ppu) {
+    int i, n, line;
+    
+    ppu->obj_dirty = false;
+    ppu->obj_status = 0;
+    memset(ppu->obj_line_count, 0, sizeof(ppu->obj_line_count));
+    
+    /* Unpack the low table entry and the two high table bits of each sprite */
+    for (i = 0; i < 128; i++) {
+        const u8 *entry = &ppu->oam[i * 4];
+        u8 high = ppu->oam[512 + (i >> 2)] >> ((i & 3) * 2);
+        Sprite *sprite = &ppu->oam_sprites[i];
         
-        /* Calculate tile graphics address */
-        /* Sprites use 4bpp (16 colors), 32 bytes per 8x8 tile */
-        tile_addr = (sprite_tile * 32);
+        sprite->x = (s16)(entry[0] | ((high & 0x01) << 8));
+        if (sprite->x >= 256) {
+            sprite->x -= 512;
+        }
+        sprite->y = entry[1];
+        sprite->tile = entry[2] | ((entry[3] & 0x01) << 8);
+        sprite->palette = (entry[3] >> 1) & 0x07;
+        sprite->priority = (entry[3] >> 4) & 0x03;
+        sprite->h_flip = (entry[3] & 0x40) != 0;
+        sprite->v_flip = (entry[3] & 0x80) != 0;
+        sprite->size = (high & 0x02) != 0;
+        sprite->width = ppu_obj_sizes[ppu->obj_size][sprite->size][0];
+        sprite->height = ppu_obj_sizes[ppu->obj_size][sprite->size][1];
+    }
+    
+    /* Range pass: the first 32 sprites (in priority order) on each line */
+    for (n = 0; n < 128; n++) {
+        u8 index = (u8)((ppu->obj_first + n) & 0x7F);
+        const Sprite *sprite = &ppu->oam_sprites[index];
+        int row;
         
-        if (tile_addr >= VRAM_SIZE - 31) {
+        if (sprite->x <= -sprite->width) {
             continue;
         }
         
-        /* Read 4 bitplanes for this row */
-        bit0 = ppu->vram[tile_addr + (pixel_y * 2)];
-        bit1 = ppu->vram[tile_addr + (pixel_y * 2) + 1];
-        /* For 4bpp, would need planes 2 and 3 as well */
-        
-        /* Draw sprite pixels */
-        for (pixel_x = 0; pixel_x < sprite_size_x; pixel_x++) {
-            int screen_x = sprite_x + pixel_x;
-            int shift;
-            
-            if (screen_x < 0 || screen_x >= SCREEN_WIDTH) {
+        /* Sprites wrap from the bottom of the 256-line space to the top */
+        for (row = 0; row < sprite->height; row++) {
+            line = (sprite->y + row) & 0xFF;
+            if (line >= SCREEN_HEIGHT) {
                 continue;
             }
+            if (ppu->obj_line_count[line] == PPU_OBJ_PER_LINE) {
+                ppu->obj_status |= PPU_OBJ_RANGE_OVER;
+                continue;
+            }
+            ppu->obj_lines[line][ppu->obj_line_count[line]++] = index;
+        }
+    }
+    
+    /* Time pass: tiles are fetched from the last sprite in range backwards,
+     * so once 34 are loaded the higher priority sprites are dropped */
+    for (line = 0; line < SCREEN_HEIGHT; line++) {
+        int count = ppu->obj_line_count[line];
+        int tiles = 0;
+        
+        for (n = count - 1; n >= 0; n--) {
+            tiles += ppu_obj_visible_tiles(&ppu->oam_sprites[ppu->obj_lines[line][n]]);
+            if (tiles > PPU_OBJ_TILES) {
+                break;
+            }
+        }
+        if (n >= 0) {
+            /* Keep sprites n+1 .. count-1 */
+            ppu->obj_status |= PPU_OBJ_TIME_OVER;
+            memmove(ppu->obj_lines[line], &ppu->obj_lines[line][n + 1], count - n - 1);
+            ppu->obj_line_count[line] = (u8)(count - n - 1);
+        }
+    }
+}
+
+void ppu_render_sprites(PPU *ppu) {
+    u16 *buffer = ppu->layer_buffer[PPU_LAYER_OBJ];
+    const u8 *ranks = ppu_obj_rank[ppu_rank_mode(ppu)];
+    int y = ppu->vcount;
+    int n;
+    
+    if (!ppu->oam || !ppu->vram || y >= SCREEN_HEIGHT) {
+        return;
+    }
+    if (ppu->obj_dirty) {
+        ppu_evaluate_sprites(ppu);
+    }
+    
+    /* Only the sprites pre-evaluated for this line, highest priority first */
+    for (n = 0; n < ppu->obj_line_count[y]; n++) {
+        const Sprite *sprite = &ppu->oam_sprites[ppu->obj_lines[y][n]];
+        u16 key = ppu_layer_key(ranks[sprite->priority], PPU_LAYER_OBJ);
+        u8 palette_base = (u8)(128 + sprite->palette * 16);
+        u16 table = ppu->obj_name_base + ((sprite->tile & 0x100) ? ppu->obj_name_gap : 0);
+        int columns = sprite->width / 8;
+        int row = (u8)(y - sprite->y);
+        int column;
+        
+        if (sprite->v_flip) {
+            row = sprite->height - 1 - row;
+        }
+        
+        for (column = 0; column < columns; column++) {
+            int screen_x = sprite->x + column * 8;
+            int tile_column = sprite->h_flip ? columns - 1 - column : column;
+            u8 name;
+            const u8 *pixels;
+            int pixel_x;
             
-            shift = h_flip ? pixel_x : (7 - pixel_x);
-            
-            /* Get color index (2bpp for now, simplified) */
-            color_index = ((bit0 >> shift) & 1) | (((bit1 >> shift) & 1) << 1);
-            
-            /* Skip transparent pixels */
-            if (color_index == 0) {
+            if (screen_x <= -8 || screen_x >= SCREEN_WIDTH) {
                 continue;
             }
             
-            /* Calculate final palette index */
-            u8 final_palette = (palette * 4) + color_index;
+            /* Large sprites step through the 16x16 tile grid of the name table */
+            name = (u8)((((sprite->tile & 0xF0) + (row >> 3) * 16) & 0xF0) |
+                        ((sprite->tile + tile_column) & 0x0F));
+            pixels = ppu_get_tile(ppu, 4, (u16)((u16)(table + name * 32) / 32)) + (row & 7) * 8;
             
-            /* Draw pixel (sprites have priority over backgrounds) */
-            ppu->framebuffer[y * SCREEN_WIDTH + screen_x] = ppu_get_color(ppu, final_palette);
+            for (pixel_x = 0; pixel_x < 8; pixel_x++) {
+                int x = screen_x + pixel_x;
+                u8 color = pixels[sprite->h_flip ? 7 - pixel_x : pixel_x];
+                
+                /* Skip transparent pixels; higher priority sprites win overlaps */
+                if (x < 0 || x >= SCREEN_WIDTH || color == 0 || buffer[x]) {
+                    continue;
+                }
+                buffer[x] = key | (u8)(palette_base + color);
+            }
         }
     }
 }
@@ -635,15 +1663,133 @@ void ppu_output_ppm(const PPU *ppu, const char *filename) {
     printf("Frame output to %s\n", filename);
 }
 
+/*
+ * Mode 7 line rasterizers
+ * wx/wy are the world coordinates of the first pixel in 16.8 fixed point
+ * and dx/dy the per-pixel step (matrix column A/C, negated when flipped).
+ * The plane is 1024x1024: a 128x128 byte map of 8x8 8bpp tiles.
+ */
+
+/* Color of the plane pixel at integer world coordinates (0-1023) */
+static inline u8 ppu_mode7_pixel(const u8 *vram, u32 px, u32 py) {
+    u8 tile = vram[((py >> 3) * 128 + (px >> 3)) & 0x3FFF];
+    return vram[tile * 64 + (py & 7) * 8 + (px & 7)];
+}
+
+/* Screen over mode 0/1: the plane repeats */
+static void ppu_mode7_line_wrap(u16 *buffer, const u8 *vram, u16 key,
+                                s32 wx, s32 wy, s32 dx, s32 dy) {
+    int x;
+    
+    for (x = 0; x < SCREEN_WIDTH; x++, wx += dx, wy += dy) {
+        u8 color = ppu_mode7_pixel(vram, (wx >> 8) & 0x3FF, (wy >> 8) & 0x3FF);
+        if (color) {
+            buffer[x] = key | color;
+        }
+    }
+}
+
+/* Screen over mode 2: transparent outside the plane */
+static void ppu_mode7_line_clip(u16 *buffer, const u8 *vram, u16 key,
+                                s32 wx, s32 wy, s32 dx, s32 dy) {
+    int x;
+    
+    for (x = 0; x < SCREEN_WIDTH; x++, wx += dx, wy += dy) {
+        u32 px = (u32)(wx >> 8);
+        u32 py = (u32)(wy >> 8);
+        u8 color;
+        
+        if ((px | py) >= 1024) {
+            continue;
+        }
+        color = ppu_mode7_pixel(vram, px, py);
+        if (color) {
+            buffer[x] = key | color;
+        }
+    }
+}
+
+/* Screen over mode 3: tile 0 repeats outside the plane */
+static void ppu_mode7_line_fill(u16 *buffer, const u8 *vram, u16 key,
+                                s32 wx, s32 wy, s32 dx, s32 dy) {
+    int x;
+    
+    for (x = 0; x < SCREEN_WIDTH; x++, wx += dx, wy += dy) {
+        u32 px = (u32)(wx >> 8);
+        u32 py = (u32)(wy >> 8);
+        u8 color;
+        
+        if ((px | py) < 1024) {
+            color = ppu_mode7_pixel(vram, px, py);
+        } else {
+            color = vram[(py & 7) * 8 + (px & 7)];
+        }
+        if (color) {
+            buffer[x] = key | color;
+        }
+    }
+}
+
+#ifdef PPU_X86_SIMD
+/* All screen over modes, 8 pixels per step with gathered map and tile bytes */
+__attribute__((target("avx2")))
+static void ppu_mode7_line_avx2(u16 *buffer, const u8 *vram, u16 key, u8 repeat,
+                                s32 wx, s32 wy, s32 dx, s32 dy) {
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i plane_mask = _mm256_set1_epi32(0x3FF);
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    const __m256i seven = _mm256_set1_epi32(7);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i key_vec = _mm256_set1_epi32(key);
+    const __m256i step_x = _mm256_set1_epi32(dx * 8);
+    const __m256i step_y = _mm256_set1_epi32(dy * 8);
+    const int *base = (const int *)vram;
+    __m256i vx = _mm256_add_epi32(_mm256_set1_epi32(wx), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dx)));
+    __m256i vy = _mm256_add_epi32(_mm256_set1_epi32(wy), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dy)));
+    int x;
+    
+    for (x = 0; x < SCREEN_WIDTH; x += 8) {
+        __m256i px = _mm256_srai_epi32(vx, 8);
+        __m256i py = _mm256_srai_epi32(vy, 8);
+        /* Lanes inside the plane have no bits above the low 10 */
+        __m256i inside = _mm256_cmpeq_epi32(_mm256_andnot_si256(plane_mask, _mm256_or_si256(px, py)), zero);
+        __m256i map, tile, pixel, color, entry;
+        
+        px = _mm256_and_si256(px, plane_mask);
+        py = _mm256_and_si256(py, plane_mask);
+        
+        /* Map byte, then the tile's pixel byte (gathers read 4 bytes, keep 1) */
+        map = _mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi32(py, 3), 7), _mm256_srli_epi32(px, 3));
+        tile = _mm256_and_si256(_mm256_i32gather_epi32(base, map, 1), byte_mask);
+        if (repeat == 3) {
+            tile = _mm256_and_si256(tile, inside);
+        }
+        pixel = _mm256_or_si256(_mm256_slli_epi32(tile, 6),
+                                _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(py, seven), 3),
+                                                _mm256_and_si256(px, seven)));
+        color = _mm256_and_si256(_mm256_i32gather_epi32(base, pixel, 1), byte_mask);
+        if (repeat == 2) {
+            color = _mm256_and_si256(color, inside);
+        }
+        
+        /* Color 0 stays transparent */
+        entry = _mm256_andnot_si256(_mm256_cmpeq_epi32(color, zero), _mm256_or_si256(color, key_vec));
+        _mm_storeu_si128((__m128i *)&buffer[x],
+                         _mm_packus_epi32(_mm256_castsi256_si128(entry), _mm256_extracti128_si256(entry, 1)));
+        
+        vx = _mm256_add_epi32(vx, step_x);
+        vy = _mm256_add_epi32(vy, step_y);
+    }
+}
+#endif
+
 void ppu_render_mode7(PPU *ppu) {
-    int x, y;
-    s32 screen_x, screen_y;
-    s32 world_x, world_y;
     s32 a, b, c, d;
-    s32 center_x, center_y;
-    u8 tile_data, color_index;
-    u16 tile_addr;
-    int tile_x, tile_y, pixel_x, pixel_y;
+    s32 screen_x, screen_y;
+    s32 wx, wy, dx, dy;
+    u16 *buffer = ppu->layer_buffer[0];
+    u16 key = ppu_layer_key(ppu_bg_rank[7][0][0], 0);
+    int y;
     
     if (!ppu->vram || ppu->bg_mode != 7) {
         return;
@@ -660,69 +1806,509 @@ void ppu_render_mode7(PPU *ppu) {
     b = ppu->m7_matrix_b;
     c = ppu->m7_matrix_c;
     d = ppu->m7_matrix_d;
-    center_x = ppu->m7_center_x;
-    center_y = ppu->m7_center_y;
     
-    /* Render each pixel on this scanline */
-    for (x = 0; x < SCREEN_WIDTH; x++) {
-        /* Convert screen coordinates to centered coordinates */
-        screen_x = x - 128;
-        screen_y = y - 112;
-        
-        /* Apply affine transformation: 
-         * world_x = a * screen_x + b * screen_y + center_x
-         * world_y = c * screen_x + d * screen_y + center_y
-         */
-        world_x = ((a * screen_x) >> 8) + ((b * screen_y) >> 8) + center_x;
-        world_y = ((c * screen_x) >> 8) + ((d * screen_y) >> 8) + center_y;
-        
-        /* Handle repeat modes */
-        switch (ppu->m7_repeat & 0x03) {
-            case 0:  /* Repeat */
-                world_x &= 0x3FF;  /* Wrap to 1024x1024 */
-                world_y &= 0x3FF;
-                break;
-            case 1:  /* No repeat - transparent outside */
-                if (world_x < 0 || world_x >= 1024 || world_y < 0 || world_y >= 1024) {
-                    continue;  /* Skip this pixel */
-                }
-                break;
-            case 2:  /* Repeat with tile 0 outside */
-            case 3:
-                if (world_x < 0 || world_x >= 1024 || world_y < 0 || world_y >= 1024) {
-                    world_x = 0;
-                    world_y = 0;
-                }
-                break;
+    /* Centered coordinates of the first pixel; flips mirror the screen */
+    screen_x = ppu->m7_h_flip ? 127 : -128;
+    screen_y = (ppu->m7_v_flip ? 255 - y : y) - 112;
+    
+    /* Start vector once per line:
+     * world_x = a * screen_x + b * screen_y + center_x
+     * world_y = c * screen_x + d * screen_y + center_y
+     * then step by (a, c) per pixel */
+    wx = a * screen_x + b * screen_y + ppu->m7_center_x * 256;
+    wy = c * screen_x + d * screen_y + ppu->m7_center_y * 256;
+    dx = ppu->m7_h_flip ? -a : a;
+    dy = ppu->m7_h_flip ? -c : c;
+    
+#ifdef PPU_X86_SIMD
+    if (ppu->compose_path == PPU_COMPOSE_AVX2) {
+        ppu_mode7_line_avx2(buffer, ppu->vram, key, ppu->m7_repeat, wx, wy, dx, dy);
+        return;
+    }
+#endif
+    
+    switch (ppu->m7_repeat) {
+        case 2:
+            ppu_mode7_line_clip(buffer, ppu->vram, key, wx, wy, dx, dy);
+            break;
+        case 3:
+            ppu_mode7_line_fill(buffer, ppu->vram, key, wx, wy, dx, dy);
+            break;
+        default:
+            ppu_mode7_line_wrap(buffer, ppu->vram, key, wx, wy, dx, dy);
+            break;
+    }
+}
+
+/* Threaded rendering */
+
+/* Logged VRAM/CGRAM/OAM write (data lives in the job's byte pool) */
+typedef struct {
+    u16 line;             /* First scanline that sees the write */
+    u8 target;            /* PPU_LOG_VRAM/CGRAM/OAM */
+    u32 address;          /* Byte address in the target */
+    u32 length;           /* Number of bytes */
+    u32 offset;           /* Offset of the data in write_data */
+} PPULogWrite;
+
+/* One recorded frame */
+typedef struct {
+    bool started;                     /* Frame-start memory snapshot taken */
+    u8 vram[VRAM_SIZE];               /* Memory at the first recorded line */
+    u8 cgram[CGRAM_SIZE];
+    u8 oam[OAM_SIZE];
+    PPULineState lines[SCREEN_HEIGHT];
+    u8 line_valid[SCREEN_HEIGHT];     /* Line was recorded */
+    PPULogWrite *writes;              /* Writes in emulation order */
+    u32 write_count;
+    u32 write_capacity;
+    u8 *write_data;                   /* Bytes of all logged writes */
+    u32 data_size;
+    u32 data_capacity;
+    u32 *framebuffer;                 /* Output drawn by the workers */
+    bool unchanged;                   /* Every line matches the previous frame */
+} PPUFrameJob;
+
+/* Render worker with a private PPU drawing one band of scanlines */
+typedef struct {
+    PPU ppu;
+    u8 vram[VRAM_SIZE];
+    u8 cgram[CGRAM_SIZE];
+    u8 oam[OAM_SIZE];
+    u16 first_line;
+    u16 last_line;                    /* One past the last line */
+    Thread thread;
+    PPURenderPool *pool;
+} PPURenderWorker;
+
+struct PPURenderPool {
+    PPUFrameJob jobs[2];              /* Recording and rendering (double buffered) */
+    u8 recording;                     /* Index of the job being recorded */
+    PPUFrameJob *active;              /* Job handed to the workers (NULL = none) */
+    Mutex lock;
+    Cond work_ready;                  /* Signalled when a job is submitted */
+    Cond work_done;                   /* Signalled when the last band finishes */
+    u32 generation;                   /* Bumped per submitted job */
+    u32 pending;                      /* Workers still drawing the active job */
+    bool stop;
+    u32 worker_count;
+    PPURenderWorker *workers;
+};
+
+static void ppu_load_line_state(PPU *ppu, const PPULineState *state) {
+    if (ppu->brightness != state->brightness) {
+        ppu->brightness = state->brightness;
+        ppu_update_brightness(ppu);
+    }
+    ppu->forced_blank = state->forced_blank;
+    ppu->bg_mode = state->bg_mode;
+    ppu->bg3_priority = state->bg3_priority;
+    memcpy(ppu->bg, state->bg, sizeof(ppu->bg));
+    ppu->main_screen = state->main_screen;
+    ppu->sub_screen = state->sub_screen;
+    ppu->main_window = state->main_window;
+    ppu->sub_window = state->sub_window;
+    memcpy(ppu->window_sel, state->window_sel, sizeof(ppu->window_sel));
+    memcpy(ppu->window_pos, state->window_pos, sizeof(ppu->window_pos));
+    memcpy(ppu->window_logic, state->window_logic, sizeof(ppu->window_logic));
+    ppu->cgwsel = state->cgwsel;
+    ppu->cgadsub = state->cgadsub;
+    ppu->fixed_color = state->fixed_color;
+    ppu->m7_matrix_a = state->m7_matrix_a;
+    ppu->m7_matrix_b = state->m7_matrix_b;
+    ppu->m7_matrix_c = state->m7_matrix_c;
+    ppu->m7_matrix_d = state->m7_matrix_d;
+    ppu->m7_center_x = state->m7_center_x;
+    ppu->m7_center_y = state->m7_center_y;
+    ppu->m7_repeat = state->m7_repeat;
+    ppu->m7_h_flip = state->m7_h_flip;
+    ppu->m7_v_flip = state->m7_v_flip;
+    if (ppu->obj_size != state->obj_size || ppu->obj_first != state->obj_first) {
+        ppu->obj_size = state->obj_size;
+        ppu->obj_first = state->obj_first;
+        ppu->obj_dirty = true;
+    }
+    ppu->obj_name_base = state->obj_name_base;
+    ppu->obj_name_gap = state->obj_name_gap;
+}
+
+/* Append bytes just written to PPU memory to the recording job's log */
+static void ppu_render_log(PPU *ppu, u8 target, u32 address, u32 length) {
+    PPURenderPool *pool = ppu->render_pool;
+    PPUFrameJob *job = &pool->jobs[pool->recording];
+    const u8 *source;
+    PPULogWrite *write;
+    
+    /* Writes before the first recorded line are part of the snapshot; writes
+     * after the last visible line belong to the next frame's snapshot */
+    if (!job->started || ppu->vcount + 1 >= SCREEN_HEIGHT || length == 0) {
+        return;
+    }
+    
+    switch (target) {
+        case PPU_LOG_VRAM: source = ppu->vram; break;
+        case PPU_LOG_CGRAM: source = ppu->cgram; break;
+        default: source = ppu->oam; break;
+    }
+    if (!source) {
+        return;
+    }
+    
+    if (job->write_count == job->write_capacity) {
+        u32 capacity = job->write_capacity ? job->write_capacity * 2 : 256;
+        PPULogWrite *writes = (PPULogWrite *)realloc(job->writes, capacity * sizeof(PPULogWrite));
+        if (!writes) {
+            return;
+        }
+        job->writes = writes;
+        job->write_capacity = capacity;
+    }
+    if (job->data_size + length > job->data_capacity) {
+        u32 capacity = job->data_capacity ? job->data_capacity : 1024;
+        u8 *data;
+        while (capacity < job->data_size + length) {
+            capacity *= 2;
+        }
+        data = (u8 *)realloc(job->write_data, capacity);
+        if (!data) {
+            return;
+        }
+        job->write_data = data;
+        job->data_capacity = capacity;
+    }
+    
+    write = &job->writes[job->write_count++];
+    write->line = ppu->vcount + 1;
+    write->target = target;
+    write->address = address;
+    write->length = length;
+    write->offset = job->data_size;
+    memcpy(&job->write_data[job->data_size], &source[address], length);
+    job->data_size += length;
+}
+
+/* Wait for the active job and publish its frame */
+static void ppu_render_wait(PPU *ppu) {
+    PPURenderPool *pool = ppu->render_pool;
+    PPUFrameJob *job;
+    
+    mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        cond_wait(&pool->work_done, &pool->lock);
+    }
+    job = pool->active;
+    pool->active = NULL;
+    mutex_unlock(&pool->lock);
+    
+    /* An unchanged frame was never drawn; the published one stays */
+    if (job) {
+        ppu->frame_unchanged = job->unchanged;
+        if (!job->unchanged) {
+            u32 *frame = ppu->framebuffer;
+            ppu->framebuffer = job->framebuffer;
+            job->framebuffer = frame;
+            ppu->upscaled_stale = true;
+        }
+    }
+}
+
+/* Start recording into the other job */
+static void ppu_render_reset_job(PPURenderPool *pool) {
+    PPUFrameJob *job;
+    
+    pool->recording ^= 1;
+    job = &pool->jobs[pool->recording];
+    job->started = false;
+    job->write_count = 0;
+    job->data_size = 0;
+    memset(job->line_valid, 0, sizeof(job->line_valid));
+}
+
+/* Hand the recording job to the workers and start recording the other one */
+static void ppu_render_submit(PPU *ppu) {
+    PPURenderPool *pool = ppu->render_pool;
+    PPUFrameJob *job = &pool->jobs[pool->recording];
+    int line;
+    
+    ppu_render_wait(ppu);
+    
+    job->unchanged = !ppu->frame_changed;
+    ppu->frame_changed = false;
+    if (job->unchanged) {
+        mutex_lock(&pool->lock);
+        pool->active = job;
+        mutex_unlock(&pool->lock);
+        ppu_render_reset_job(pool);
+        return;
+    }
+    
+    /* Lines the workers will not draw keep the previous frame, as inline */
+    for (line = 0; line < SCREEN_HEIGHT; line++) {
+        if (!job->line_valid[line] || job->lines[line].forced_blank) {
+            memcpy(&job->framebuffer[line * SCREEN_WIDTH],
+                   &ppu->framebuffer[line * SCREEN_WIDTH], SCREEN_WIDTH * sizeof(u32));
+        }
+    }
+    
+    mutex_lock(&pool->lock);
+    pool->active = job;
+    pool->pending = pool->worker_count;
+    pool->generation++;
+    cond_broadcast(&pool->work_ready);
+    mutex_unlock(&pool->lock);
+    
+    ppu_render_reset_job(pool);
+}
+
+/* Record the current scanline; submit the frame when VBlank starts */
+static void ppu_render_record_line(PPU *ppu) {
+    PPURenderPool *pool = ppu->render_pool;
+    PPUFrameJob *job = &pool->jobs[pool->recording];
+    
+    if (ppu->vcount < SCREEN_HEIGHT && ppu->render_enabled) {
+        if (!job->started) {
+            if (ppu->vram) {
+                memcpy(job->vram, ppu->vram, VRAM_SIZE);
+            }
+            if (ppu->cgram) {
+                memcpy(job->cgram, ppu->cgram, CGRAM_SIZE);
+            }
+            if (ppu->oam) {
+                memcpy(job->oam, ppu->oam, OAM_SIZE);
+            }
+            job->started = true;
+        }
+        ppu_save_line_state(ppu, &job->lines[ppu->vcount]);
+        job->line_valid[ppu->vcount] = 1;
+    } else if (ppu->vcount == 225) {
+        if (job->started) {
+            ppu_render_submit(ppu);
+        } else {
+            /* Frame skipped by the render policy */
+            ppu->frame_unchanged = true;
+        }
+    }
+}
+
+/* Apply one logged write to a worker's private memory */
+static void ppu_worker_apply(PPURenderWorker *worker, const PPUFrameJob *job,
+                             const PPULogWrite *write) {
+    const u8 *data = &job->write_data[write->offset];
+    
+    switch (write->target) {
+        case PPU_LOG_VRAM:
+            memcpy(&worker->vram[write->address], data, write->length);
+            ppu_invalidate_vram(&worker->ppu, write->address, write->length);
+            break;
+        case PPU_LOG_CGRAM:
+            memcpy(&worker->cgram[write->address], data, write->length);
+            ppu_invalidate_cgram(&worker->ppu, write->address, write->length);
+            break;
+        default:
+            memcpy(&worker->oam[write->address], data, write->length);
+            ppu_invalidate_oam(&worker->ppu, write->address, write->length);
+            break;
+    }
+}
+
+/* Draw the worker's band of the job */
+static void ppu_worker_render(PPURenderWorker *worker, PPUFrameJob *job) {
+    PPU *ppu = &worker->ppu;
+    u32 next = 0;
+    u32 offset;
+    u16 line;
+    
+    /* Bring private memory to the frame-start snapshot (only changed tiles
+     * lose their decoded form) */
+    for (offset = 0; offset < VRAM_SIZE; offset += 64) {
+        if (memcmp(&worker->vram[offset], &job->vram[offset], 64) != 0) {
+            memcpy(&worker->vram[offset], &job->vram[offset], 64);
+            ppu_invalidate_vram(ppu, offset, 64);
+        }
+    }
+    if (memcmp(worker->cgram, job->cgram, CGRAM_SIZE) != 0) {
+        memcpy(worker->cgram, job->cgram, CGRAM_SIZE);
+        ppu_invalidate_cgram(ppu, 0, CGRAM_SIZE);
+    }
+    if (memcmp(worker->oam, job->oam, OAM_SIZE) != 0) {
+        memcpy(worker->oam, job->oam, OAM_SIZE);
+        ppu_invalidate_oam(ppu, 0, OAM_SIZE);
+    }
+    
+    ppu->framebuffer = job->framebuffer;
+    for (line = 0; line < worker->last_line; line++) {
+        /* Writes made before this line was drawn */
+        while (next < job->write_count && job->writes[next].line <= line) {
+            ppu_worker_apply(worker, job, &job->writes[next++]);
         }
         
-        /* Convert world coordinates to tile coordinates */
-        tile_x = world_x >> 3;  /* Divide by 8 */
-        tile_y = world_y >> 3;
-        pixel_x = world_x & 7;  /* Modulo 8 */
-        pixel_y = world_y & 7;
-        
-        /* Mode 7 uses a 128x128 tile map at the start of VRAM */
-        /* Each tilemap entry is 1 byte (tile number) */
-        tile_addr = (tile_y * 128 + tile_x) & 0x3FFF;
+        if (line < worker->first_line || !job->line_valid[line]) {
+            continue;
+        }
         
-        u8 tile_num = ppu->vram[tile_addr];
+        ppu_load_line_state(ppu, &job->lines[line]);
+        if (!ppu->forced_blank) {
+            ppu->vcount = line;
+            ppu_render_scanline(ppu);
+        }
+    }
+    ppu->framebuffer = NULL;
+}
+
+static void ppu_worker_main(void *arg) {
+    PPURenderWorker *worker = (PPURenderWorker *)arg;
+    PPURenderPool *pool = worker->pool;
+    u32 seen = 0;
+    
+    mutex_lock(&pool->lock);
+    for (;;) {
+        PPUFrameJob *job;
         
-        /* Mode 7 tiles are 8x8 pixels, 8bpp (1 byte per pixel) */
-        /* Tile data starts at $0000 in VRAM, 64 bytes per tile */
-        tile_addr = (tile_num * 64) + (pixel_y * 8) + pixel_x;
+        while (pool->generation == seen && !pool->stop) {
+            cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->generation;
+        job = pool->active;
+        mutex_unlock(&pool->lock);
         
-        tile_data = ppu->vram[tile_addr];
-        color_index = tile_data;
+        ppu_worker_render(worker, job);
         
-        /* Skip transparent pixels (color 0) */
-        if (color_index == 0) {
-            continue;
+        mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            cond_broadcast(&pool->work_done);
+        }
+    }
+    mutex_unlock(&pool->lock);
+}
+
+/* Release the pool's buffers (threads must already be joined) */
+static void ppu_render_pool_free(PPURenderPool *pool) {
+    u32 i;
+    
+    for (i = 0; i < 2; i++) {
+        free(pool->jobs[i].writes);
+        free(pool->jobs[i].write_data);
+        free(pool->jobs[i].framebuffer);
+    }
+    if (pool->workers) {
+        for (i = 0; i < pool->worker_count; i++) {
+            ppu_cleanup(&pool->workers[i].ppu);
         }
+        free(pool->workers);
+    }
+    cond_destroy(&pool->work_ready);
+    cond_destroy(&pool->work_done);
+    mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+int ppu_start_render_threads(PPU *ppu, u32 count) {
+    PPURenderPool *pool;
+    u32 i, started;
+    
+    if (ppu->render_pool || !ppu->framebuffer) {
+        return ERROR;
+    }
+    
+    if (count == 0) {
+        count = thread_cpu_count() > 1 ? thread_cpu_count() - 1 : 1;
+    }
+    if (count > SCREEN_HEIGHT / 8) {
+        count = SCREEN_HEIGHT / 8;
+    }
+    
+    pool = (PPURenderPool *)calloc(1, sizeof(PPURenderPool));
+    if (!pool) {
+        return ERROR;
+    }
+    mutex_init(&pool->lock);
+    cond_init(&pool->work_ready);
+    cond_init(&pool->work_done);
+    pool->worker_count = count;
+    pool->workers = (PPURenderWorker *)calloc(count, sizeof(PPURenderWorker));
+    pool->jobs[0].framebuffer = (u32 *)calloc(SCREEN_WIDTH * SCREEN_HEIGHT, sizeof(u32));
+    pool->jobs[1].framebuffer = (u32 *)calloc(SCREEN_WIDTH * SCREEN_HEIGHT, sizeof(u32));
+    if (!pool->workers || !pool->jobs[0].framebuffer || !pool->jobs[1].framebuffer) {
+        pool->worker_count = 0;
+        ppu_render_pool_free(pool);
+        return ERROR;
+    }
+    
+    /* Private render contexts, each drawing an equal band of lines */
+    for (i = 0; i < count; i++) {
+        PPURenderWorker *worker = &pool->workers[i];
         
-        /* Draw pixel to framebuffer */
-        ppu->framebuffer[y * SCREEN_WIDTH + x] = ppu_get_color(ppu, color_index);
+        ppu_init(&worker->ppu);
+        free(worker->ppu.framebuffer);
+        worker->ppu.framebuffer = NULL;
+        worker->ppu.compose_path = ppu->compose_path;
+        ppu_set_memory(&worker->ppu, worker->vram, worker->cgram, worker->oam);
+        worker->first_line = i * SCREEN_HEIGHT / count;
+        worker->last_line = (i + 1) * SCREEN_HEIGHT / count;
+        worker->pool = pool;
     }
+    
+    for (started = 0; started < count; started++) {
+        if (thread_create(&pool->workers[started].thread, ppu_worker_main,
+                          &pool->workers[started]) != SUCCESS) {
+            break;
+        }
+    }
+    
+    if (started < count) {
+        mutex_lock(&pool->lock);
+        pool->stop = true;
+        cond_broadcast(&pool->work_ready);
+        mutex_unlock(&pool->lock);
+        for (i = 0; i < started; i++) {
+            thread_join(&pool->workers[i].thread);
+        }
+        ppu_render_pool_free(pool);
+        return ERROR;
+    }
+    
+    ppu->render_pool = pool;
+    return SUCCESS;
+}
+
+void ppu_render_flush(PPU *ppu) {
+    PPURenderPool *pool = ppu->render_pool;
+    
+    if (!pool) {
+        return;
+    }
+    
+    /* A partly recorded frame is drawn as far as it got */
+    if (pool->jobs[pool->recording].started) {
+        ppu_render_submit(ppu);
+    }
+    ppu_render_wait(ppu);
+}
+
+void ppu_stop_render_threads(PPU *ppu) {
+    PPURenderPool *pool = ppu->render_pool;
+    u32 i;
+    
+    if (!pool) {
+        return;
+    }
+    
+    ppu_render_flush(ppu);
+    
+    mutex_lock(&pool->lock);
+    pool->stop = true;
+    cond_broadcast(&pool->work_ready);
+    mutex_unlock(&pool->lock);
+    
+    for (i = 0; i < pool->worker_count; i++) {
+        thread_join(&pool->workers[i].thread);
+    }
+    
+    ppu->render_pool = NULL;
+    ppu_render_pool_free(pool);
 }
 
 /* ML Upscaling implementation */
@@ -763,6 +2349,7 @@ void ppu_enable_upscaling(PPU *ppu, UpscaleMode mode) {
     }
     
     ppu->upscaling_enabled = true;
+    ppu->upscaled_stale = true;
     
     printf("ML Upscaling enabled: %dx%d -> %dx%d\n", 
            SCREEN_WIDTH, SCREEN_HEIGHT, output_width, output_height);
@@ -787,16 +2374,19 @@ void ppu_disable_upscaling(PPU *ppu) {
     }
 }
 
-const u32 *ppu_get_upscaled_framebuffer(const PPU *ppu, u16 *width, u16 *height) {
+const u32 *ppu_get_upscaled_framebuffer(PPU *ppu, u16 *width, u16 *height) {
     if (!ppu || !ppu->upscaling_enabled || !ppu->upscaled_buffer || !ppu->upscaler) {
         return NULL;
     }
     
-    /* Apply upscaling to current framebuffer */
+    /* Apply upscaling to current framebuffer (skipped while it is unchanged) */
     if (ppu->framebuffer) {
-        upscaler_process(ppu->upscaler, ppu->framebuffer,
-                        SCREEN_WIDTH, SCREEN_HEIGHT,
-                        ppu->upscaled_buffer);
+        if (ppu->upscaled_stale) {
+            upscaler_process(ppu->upscaler, ppu->framebuffer,
+                            SCREEN_WIDTH, SCREEN_HEIGHT,
+                            ppu->upscaled_buffer);
+            ppu->upscaled_stale = false;
+        }
         
         /* Get output dimensions */
         if (width && height) {
@@ -0,0 +1,339 @@
+/*
+ * rewind.c - Rewind buffer implementation
+ *
+ * Delta format: pairs of (zero run, literal count) as LEB128 varints,
+ * each followed by that many literal bytes of current XOR keyframe.
+ * Literal runs end at the first 8 unchanged bytes, so an isolated
+ * unchanged byte costs less than starting a new pair. Deltas with long
+ * literal runs (a redrawn screen) are LZ compressed on top when smaller.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "../include/rewind.h"
+#include "../include/lz.h"
+
+#define REWIND_MIN_ZERO_RUN 8
+#define REWIND_INITIAL_ENTRIES 64
+
+static u8 *rewind_put_varint(u8 *out, u32 value) {
+    while (value >= 0x80) {
+        *out++ = (u8)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (u8)value;
+    return out;
+}
+
+static bool rewind_get_varint(const u8 **in, const u8 *in_end, u32 *value) {
+    u32 shift = 0;
+    u8 byte;
+    
+    *value = 0;
+    do {
+        if (*in >= in_end || shift > 28) {
+            return false;
+        }
+        byte = *(*in)++;
+        *value |= (u32)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return true;
+}
+
+/* Largest delta of size bytes: every pair saves at least 8 bytes */
+static u32 rewind_delta_bound(u32 size) {
+    return size + size / 4 + 16;
+}
+
+/* Length of the run of equal bytes at pos, compared 8 at a time */
+static u32 rewind_equal_run(const u8 *a, const u8 *b, u32 pos, u32 size) {
+    u32 start = pos;
+    
+    while (pos + 8 <= size && memcmp(a + pos, b + pos, 8) == 0) {
+        pos += 8;
+    }
+    while (pos < size && a[pos] == b[pos]) {
+        pos++;
+    }
+    return pos - start;
+}
+
+/* Encode cur XOR key; returns the delta size */
+static u32 rewind_encode_delta(const u8 *cur, const u8 *key, u32 size, u8 *dst) {
+    u8 *out = dst;
+    u32 pos = 0;
+    
+    while (pos < size) {
+        u32 zeros = rewind_equal_run(cur, key, pos, size);
+        u32 start = pos + zeros;
+        u32 end = start;
+        u32 i;
+        
+        /* Extend the literals over short unchanged gaps */
+        while (end < size) {
+            u32 run;
+            
+            if (cur[end] != key[end]) {
+                end++;
+                continue;
+            }
+            run = rewind_equal_run(cur, key, end, size);
+            if (run >= REWIND_MIN_ZERO_RUN || end + run == size) {
+                break;
+            }
+            end += run;
+        }
+        
+        out = rewind_put_varint(out, zeros);
+        out = rewind_put_varint(out, end - start);
+        for (i = start; i < end; i++) {
+            *out++ = cur[i] ^ key[i];
+        }
+        pos = end;
+    }
+    return (u32)(out - dst);
+}
+
+/* XOR a delta into dst (which holds the keyframe) */
+static int rewind_apply_delta(const u8 *src, u32 src_size, u8 *dst, u32 size) {
+    const u8 *in = src;
+    const u8 *in_end = src + src_size;
+    u32 pos = 0;
+    
+    while (in < in_end) {
+        u32 zeros;
+        u32 count;
+        u32 i;
+        
+        if (!rewind_get_varint(&in, in_end, &zeros) ||
+            !rewind_get_varint(&in, in_end, &count) ||
+            zeros > size - pos || count > size - pos - zeros ||
+            count > (u32)(in_end - in)) {
+            return ERROR;
+        }
+        pos += zeros;
+        for (i = 0; i < count; i++) {
+            dst[pos + i] ^= in[i];
+        }
+        pos += count;
+        in += count;
+    }
+    return pos == size ? SUCCESS : ERROR;
+}
+
+static RewindEntry *rewind_entry(const RewindBuffer *rw, u32 index) {
+    return &rw->entries[(rw->head + index) % rw->capacity];
+}
+
+/* Drop the oldest snapshot */
+static void rewind_drop_oldest(RewindBuffer *rw) {
+    RewindEntry *entry = rewind_entry(rw, 0);
+    
+    rw->used -= entry->size;
+    if (entry->keyframe) {
+        rw->keyframes--;
+    }
+    free(entry->data);
+    memset(entry, 0, sizeof(RewindEntry));
+    rw->head = (rw->head + 1) % rw->capacity;
+    rw->count--;
+}
+
+/* Drop the newest snapshot */
+static void rewind_drop_newest(RewindBuffer *rw) {
+    RewindEntry *entry = rewind_entry(rw, rw->count - 1);
+    
+    rw->used -= entry->size;
+    if (entry->keyframe) {
+        rw->keyframes--;
+    }
+    free(entry->data);
+    memset(entry, 0, sizeof(RewindEntry));
+    rw->count--;
+}
+
+static void rewind_clear(RewindBuffer *rw) {
+    while (rw->count > 0) {
+        rewind_drop_oldest(rw);
+    }
+    rw->head = 0;
+    rw->since_keyframe = 0;
+}
+
+/* Double the ring, unwrapping it so the oldest entry is first */
+static int rewind_grow(RewindBuffer *rw) {
+    u32 capacity = rw->capacity ? rw->capacity * 2 : REWIND_INITIAL_ENTRIES;
+    RewindEntry *entries = (RewindEntry *)calloc(capacity, sizeof(RewindEntry));
+    u32 i;
+    
+    if (!entries) {
+        return ERROR;
+    }
+    for (i = 0; i < rw->count; i++) {
+        entries[i] = *rewind_entry(rw, i);
+    }
+    free(rw->entries);
+    rw->entries = entries;
+    rw->capacity = capacity;
+    rw->head = 0;
+    return SUCCESS;
+}
+
+void rewind_init(RewindBuffer *rw, u32 budget, u32 keyframe_interval) {
+    memset(rw, 0, sizeof(RewindBuffer));
+    rw->budget = budget;
+    rw->keyframe_interval = keyframe_interval ? keyframe_interval : 1;
+    savestate_init(&rw->state);
+}
+
+void rewind_free(RewindBuffer *rw) {
+    rewind_clear(rw);
+    free(rw->entries);
+    free(rw->key_raw);
+    free(rw->work);
+    savestate_free(&rw->state);
+    memset(rw, 0, sizeof(RewindBuffer));
+}
+
+int rewind_push(RewindBuffer *rw, Emulator *emu) {
+    RewindEntry *entry;
+    bool keyframe;
+    bool compressed = false;
+    const u8 *encoded;
+    u32 size;
+    u8 *data;
+    
+    if (savestate_save(emu, &rw->state, 0) != SUCCESS) {
+        return ERROR;
+    }
+    
+    /* A different layout (e.g. a framebuffer was allocated) starts over */
+    if (rw->state.size != rw->raw_size) {
+        u32 bound = rewind_delta_bound(rw->state.size);
+        
+        rewind_clear(rw);
+        free(rw->key_raw);
+        free(rw->work);
+        rw->key_raw = (u8 *)malloc(rw->state.size);
+        rw->work = (u8 *)malloc(bound + lz_compress_bound(bound));
+        rw->raw_size = rw->key_raw && rw->work ? rw->state.size : 0;
+        if (!rw->raw_size) {
+            return ERROR;
+        }
+    }
+    
+    /* A lone group over budget can only shrink once a new one starts */
+    keyframe = rw->count == 0 || rw->since_keyframe >= rw->keyframe_interval ||
+               (rw->keyframes == 1 && rw->used > rw->budget);
+    
+    if (keyframe) {
+        size = lz_compress(rw->state.data, rw->raw_size, rw->work,
+                           lz_compress_bound(rw->raw_size));
+        if (size == 0) {
+            return ERROR;
+        }
+        encoded = rw->work;
+    } else {
+        u8 *packed = rw->work + rewind_delta_bound(rw->raw_size);
+        u32 packed_size;
+        
+        size = rewind_encode_delta(rw->state.data, rw->key_raw, rw->raw_size, rw->work);
+        encoded = rw->work;
+        packed_size = lz_compress(rw->work, size, packed, lz_compress_bound(size));
+        if (packed_size > 0 && packed_size < size) {
+            encoded = packed;
+            size = packed_size;
+            compressed = true;
+        }
+    }
+    
+    data = (u8 *)malloc(size);
+    if (!data || (rw->count == rw->capacity && rewind_grow(rw) != SUCCESS)) {
+        free(data);
+        return ERROR;
+    }
+    memcpy(data, encoded, size);
+    
+    entry = rewind_entry(rw, rw->count);
+    entry->data = data;
+    entry->size = size;
+    entry->frame = emu->frames;
+    entry->keyframe = keyframe;
+    entry->compressed = compressed;
+    rw->count++;
+    rw->used += size;
+    if (keyframe) {
+        memcpy(rw->key_raw, rw->state.data, rw->raw_size);
+        rw->keyframes++;
+        rw->since_keyframe = 0;
+    }
+    rw->since_keyframe++;
+    
+    /* Evict whole groups, oldest first; the newest group always stays */
+    while (rw->used > rw->budget && rw->keyframes > 1) {
+        do {
+            rewind_drop_oldest(rw);
+        } while (!rewind_entry(rw, 0)->keyframe);
+    }
+    return SUCCESS;
+}
+
+int rewind_seek(RewindBuffer *rw, Emulator *emu, u32 frames_back) {
+    const RewindEntry *entry;
+    const RewindEntry *key;
+    const u8 *delta;
+    u32 delta_size;
+    u32 target;
+    u32 key_index;
+    
+    if (frames_back >= rw->count) {
+        return ERROR;
+    }
+    target = rw->count - 1 - frames_back;
+    key_index = target;
+    while (!rewind_entry(rw, key_index)->keyframe) {
+        key_index--;
+    }
+    entry = rewind_entry(rw, target);
+    key = rewind_entry(rw, key_index);
+    
+    /* Keyframe into work, then the delta on a copy of it */
+    if (lz_decompress(key->data, key->size, rw->work, rw->raw_size) != rw->raw_size) {
+        return ERROR;
+    }
+    memcpy(rw->state.data, rw->work, rw->raw_size);
+    rw->state.size = rw->raw_size;
+    if (!entry->keyframe) {
+        delta = entry->data;
+        delta_size = entry->size;
+        if (entry->compressed) {
+            u8 *unpacked = rw->work + rewind_delta_bound(rw->raw_size);
+            
+            delta_size = lz_decompress(entry->data, entry->size, unpacked,
+                                       rewind_delta_bound(rw->raw_size));
+            delta = unpacked;
+            if (delta_size == 0) {
+                return ERROR;
+            }
+        }
+        if (rewind_apply_delta(delta, delta_size, rw->state.data, rw->raw_size) != SUCCESS) {
+            return ERROR;
+        }
+    }
+    if (savestate_load(emu, &rw->state) != SUCCESS) {
+        return ERROR;
+    }
+    
+    /* Continue the timeline from here, with deltas against this keyframe */
+    memcpy(rw->key_raw, rw->work, rw->raw_size);
+    while (rw->count > target + 1) {
+        rewind_drop_newest(rw);
+    }
+    rw->since_keyframe = target - key_index + 1;
+    return SUCCESS;
+}
+
+u32 rewind_count(const RewindBuffer *rw) {
+    return rw->count;
+}
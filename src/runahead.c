@@ -0,0 +1,70 @@
+/*
+ * runahead.c - Run-ahead implementation
+ */
+
+#include <string.h>
+#include "../include/runahead.h"
+#include "../include/thread.h"
+
+void runahead_init(RunAhead *ra, u32 frames) {
+    memset(ra, 0, sizeof(RunAhead));
+    ra->frames = frames;
+    savestate_init(&ra->state);
+}
+
+void runahead_free(RunAhead *ra) {
+    savestate_free(&ra->state);
+    memset(ra, 0, sizeof(RunAhead));
+}
+
+int runahead_run_frame(RunAhead *ra, Emulator *emu) {
+    PPU *ppu = &emu->ppu;
+    PPURenderPolicy policy = (PPURenderPolicy)ppu->render_policy;
+    u32 interval = ppu->render_interval;
+    bool requested = ppu->render_requested || ppu->render_enabled;
+    struct Movie *movie = emu->input.movie;
+    u32 audio_pos;
+    u64 start;
+    u32 frame;
+    int result;
+    
+    if (ra->frames == 0) {
+        emulator_run_frame(emu);
+        return SUCCESS;
+    }
+    if (emu->apu.thread) {
+        return ERROR;
+    }
+    
+    /* Committed frame: real input and audio, nothing drawn */
+    ppu_set_render_policy(ppu, PPU_RENDER_NEVER, 1);
+    emulator_run_frame(emu);
+    audio_pos = emu->apu.buffer_pos;
+    
+    start = thread_time_ns();
+    if (savestate_save(emu, &ra->state, SAVESTATE_NO_FRAME) != SUCCESS) {
+        ppu_set_render_policy(ppu, policy, interval);
+        return ERROR;
+    }
+    ra->snapshot_ns = thread_time_ns() - start;
+    
+    /* Speculative frames repeat the current input; a movie must not step */
+    emu->input.movie = NULL;
+    for (frame = 0; frame < ra->frames; frame++) {
+        if (frame + 1 == ra->frames) {
+            ppu_set_render_policy(ppu, policy, interval);
+            if (policy == PPU_RENDER_ON_REQUEST && requested) {
+                ppu_request_frame(ppu);
+            }
+        }
+        emulator_run_frame(emu);
+    }
+    emu->input.movie = movie;
+    
+    /* Roll back, keeping the speculative picture and the committed audio */
+    start = thread_time_ns();
+    result = savestate_load(emu, &ra->state);
+    ra->snapshot_ns += thread_time_ns() - start;
+    emu->apu.buffer_pos = audio_pos;
+    return result;
+}
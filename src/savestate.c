@@ -0,0 +1,476 @@
+/*
+ * savestate.c - Save state implementation
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/savestate.h"
+#include "../include/lz.h"
+
+#define SAVESTATE_HEADER_SIZE 28
+#define SAVESTATE_CHUNK_HEADER_SIZE 16
+#define SAVESTATE_VIDEO_SPAN 64   /* Granularity of VRAM/CGRAM/OAM change checks */
+
+/* Host field of a component: zeroed when saving, kept when loading */
+typedef struct {
+    size_t offset;
+    size_t size;
+} StateHole;
+
+#define STATE_HOLE(type, field) { offsetof(type, field), sizeof(((type *)0)->field) }
+#define STATE_COUNT(array) ((u32)(sizeof(array) / sizeof((array)[0])))
+
+static const StateHole cpu_holes[] = {
+    STATE_HOLE(CPU, mem),
+    STATE_HOLE(CPU, block_cache),
+    STATE_HOLE(CPU, breakpoints),
+    STATE_HOLE(CPU, breakpoint_count),
+    STATE_HOLE(CPU, breakpoint_hit)
+};
+
+/* The page table and write watches are rebuilt, so the chunk starts after them */
+#define MEMORY_STATE_START offsetof(Memory, code_generation)
+
+static const StateHole memory_holes[] = {
+    STATE_HOLE(Memory, cart),
+    STATE_HOLE(Memory, ppu),
+    STATE_HOLE(Memory, apu),
+    STATE_HOLE(Memory, apu_clock),
+    STATE_HOLE(Memory, cpu_clock)
+};
+
+static const StateHole ppu_holes[] = {
+    STATE_HOLE(PPU, framebuffer),
+    STATE_HOLE(PPU, layer_buffer),
+    STATE_HOLE(PPU, vram),
+    STATE_HOLE(PPU, cgram),
+    STATE_HOLE(PPU, oam),
+    STATE_HOLE(PPU, compose_path),
+    STATE_HOLE(PPU, tile_cache),
+    STATE_HOLE(PPU, render_policy),
+    STATE_HOLE(PPU, render_interval),
+    STATE_HOLE(PPU, render_requested),
+    STATE_HOLE(PPU, render_enabled),
+    STATE_HOLE(PPU, layer_block),
+    STATE_HOLE(PPU, render_pool),
+    STATE_HOLE(PPU, upscaler),
+    STATE_HOLE(PPU, upscaling_enabled),
+    STATE_HOLE(PPU, upscaled_buffer),
+    STATE_HOLE(PPU, upscaled_stale)
+};
+
+static const StateHole apu_holes[] = {
+    STATE_HOLE(APU, dsp.sample_buffer),
+    STATE_HOLE(APU, audio_buffer),
+    STATE_HOLE(APU, buffer_size),
+    STATE_HOLE(APU, buffer_pos),
+    STATE_HOLE(APU, sync_mode),
+    STATE_HOLE(APU, thread)
+};
+
+static const StateHole input_holes[] = {
+    STATE_HOLE(InputSystem, movie)
+};
+
+/* Chunks in file order */
+typedef enum {
+    CHUNK_CPU = 0,
+    CHUNK_MEMORY,
+    CHUNK_PPU,
+    CHUNK_APU,
+    CHUNK_INPUT,
+    CHUNK_SCHEDULER,
+    CHUNK_EMULATOR,
+    CHUNK_SRAM,
+    CHUNK_FRAMEBUFFER,
+    CHUNK_COUNT
+} StateChunk;
+
+static const char chunk_tags[CHUNK_COUNT][4] = {
+    {'C', 'P', 'U', ' '}, {'M', 'E', 'M', ' '}, {'P', 'P', 'U', ' '},
+    {'A', 'P', 'U', ' '}, {'I', 'N', 'P', 'T'}, {'S', 'C', 'H', 'D'},
+    {'E', 'M', 'U', ' '}, {'S', 'R', 'A', 'M'}, {'F', 'B', 'U', 'F'}
+};
+
+/* Where a chunk lives in an instance */
+typedef struct {
+    u8 *data;             /* Component bytes (NULL = not present) */
+    u32 size;
+    size_t base;          /* Offset of data in its structure (hole origin) */
+    const StateHole *holes;
+    u32 hole_count;
+} StateRegion;
+
+static void savestate_region(Emulator *emu, StateChunk chunk, StateRegion *region) {
+    memset(region, 0, sizeof(StateRegion));
+    
+    switch (chunk) {
+        case CHUNK_CPU:
+            region->data = (u8 *)&emu->cpu;
+            region->size = sizeof(CPU);
+            region->holes = cpu_holes;
+            region->hole_count = STATE_COUNT(cpu_holes);
+            break;
+        case CHUNK_MEMORY:
+            region->data = (u8 *)&emu->memory + MEMORY_STATE_START;
+            region->size = (u32)(sizeof(Memory) - MEMORY_STATE_START);
+            region->base = MEMORY_STATE_START;
+            region->holes = memory_holes;
+            region->hole_count = STATE_COUNT(memory_holes);
+            break;
+        case CHUNK_PPU:
+            region->data = (u8 *)&emu->ppu;
+            region->size = sizeof(PPU);
+            region->holes = ppu_holes;
+            region->hole_count = STATE_COUNT(ppu_holes);
+            break;
+        case CHUNK_APU:
+            region->data = (u8 *)&emu->apu;
+            region->size = sizeof(APU);
+            region->holes = apu_holes;
+            region->hole_count = STATE_COUNT(apu_holes);
+            break;
+        case CHUNK_INPUT:
+            region->data = (u8 *)&emu->input;
+            region->size = sizeof(InputSystem);
+            region->holes = input_holes;
+            region->hole_count = STATE_COUNT(input_holes);
+            break;
+        case CHUNK_SCHEDULER:
+            region->data = (u8 *)&emu->scheduler;
+            region->size = sizeof(Scheduler);
+            break;
+        case CHUNK_EMULATOR:
+            /* Frame loop state: running through the end of the structure */
+            region->data = (u8 *)emu + offsetof(Emulator, running);
+            region->size = (u32)(sizeof(Emulator) - offsetof(Emulator, running));
+            break;
+        case CHUNK_SRAM:
+            if (emu->cart.sram_data) {
+                region->data = emu->cart.sram_data;
+                region->size = emu->cart.sram_size;
+            }
+            break;
+        case CHUNK_FRAMEBUFFER:
+            if (emu->ppu.framebuffer) {
+                region->data = (u8 *)emu->ppu.framebuffer;
+                region->size = SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(u32);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void savestate_put_u32(u8 *out, u32 value) {
+    out[0] = (u8)value;
+    out[1] = (u8)(value >> 8);
+    out[2] = (u8)(value >> 16);
+    out[3] = (u8)(value >> 24);
+}
+
+static u32 savestate_get_u32(const u8 *in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((u32)in[3] << 24);
+}
+
+/* Invalidate the PPU caches for the parts of a video memory a state changes */
+static void savestate_video_changed(Memory *mem, const u8 *live, const u8 *restored, u32 size,
+                                    void (*written)(Memory *, u32, u32)) {
+    u32 run_start = size;
+    u32 pos;
+    
+    for (pos = 0; pos < size; pos += SAVESTATE_VIDEO_SPAN) {
+        u32 length = size - pos < SAVESTATE_VIDEO_SPAN ? size - pos : SAVESTATE_VIDEO_SPAN;
+        bool changed = memcmp(live + pos, restored + pos, length) != 0;
+        
+        if (changed && run_start == size) {
+            run_start = pos;
+        } else if (!changed && run_start != size) {
+            written(mem, run_start, pos - run_start);
+            run_start = size;
+        }
+    }
+    if (run_start != size) {
+        written(mem, run_start, size - run_start);
+    }
+}
+
+/* Grow a buffer to at least size bytes */
+static int savestate_reserve(u8 **buffer, u32 *capacity, u32 size) {
+    u8 *grown;
+    
+    if (*capacity >= size) {
+        return SUCCESS;
+    }
+    grown = (u8 *)realloc(*buffer, size);
+    if (!grown) {
+        return ERROR;
+    }
+    *buffer = grown;
+    *capacity = size;
+    return SUCCESS;
+}
+
+/* Copy a component and clear its host fields */
+static void savestate_copy_out(u8 *dst, const StateRegion *region) {
+    u32 i;
+    
+    memcpy(dst, region->data, region->size);
+    for (i = 0; i < region->hole_count; i++) {
+        memset(dst + region->holes[i].offset - region->base, 0, region->holes[i].size);
+    }
+}
+
+void savestate_init(SaveState *state) {
+    memset(state, 0, sizeof(SaveState));
+}
+
+void savestate_free(SaveState *state) {
+    free(state->data);
+    free(state->scratch);
+    memset(state, 0, sizeof(SaveState));
+}
+
+int savestate_save(Emulator *emu, SaveState *state, u32 flags) {
+    StateRegion regions[CHUNK_COUNT];
+    u32 bound = SAVESTATE_HEADER_SIZE;
+    u32 largest = 0;
+    u32 chunk_count = 0;
+    u8 *out;
+    int i;
+    
+    /* The threaded APU's state is changing under us */
+    if (emu->apu.thread) {
+        return ERROR;
+    }
+    
+    /* Only the picture depends on the render threads */
+    if (!(flags & SAVESTATE_NO_FRAME)) {
+        ppu_render_flush(&emu->ppu);
+    }
+    
+    for (i = 0; i < CHUNK_COUNT; i++) {
+        savestate_region(emu, (StateChunk)i, &regions[i]);
+        if (i == CHUNK_FRAMEBUFFER && (flags & SAVESTATE_NO_FRAME)) {
+            regions[i].data = NULL;
+        }
+        if (regions[i].data) {
+            bound += SAVESTATE_CHUNK_HEADER_SIZE + lz_compress_bound(regions[i].size);
+            if (regions[i].size > largest) {
+                largest = regions[i].size;
+            }
+            chunk_count++;
+        }
+    }
+    
+    if (savestate_reserve(&state->data, &state->capacity, bound) != SUCCESS ||
+        ((flags & SAVESTATE_COMPRESS) &&
+         savestate_reserve(&state->scratch, &state->scratch_capacity, largest) != SUCCESS)) {
+        return ERROR;
+    }
+    
+    out = state->data;
+    memcpy(out, SAVESTATE_MAGIC, 8);
+    savestate_put_u32(out + 8, SAVESTATE_VERSION);
+    savestate_put_u32(out + 12, flags);
+    savestate_put_u32(out + 16, emu->cart.rom_size);
+    savestate_put_u32(out + 20, emu->cart.header.checksum);
+    savestate_put_u32(out + 24, chunk_count);
+    out += SAVESTATE_HEADER_SIZE;
+    
+    for (i = 0; i < CHUNK_COUNT; i++) {
+        const StateRegion *region = &regions[i];
+        u8 *header = out;
+        u32 stored = 0;
+        u32 chunk_flags = 0;
+        
+        if (!region->data) {
+            continue;
+        }
+        out += SAVESTATE_CHUNK_HEADER_SIZE;
+        
+        if (flags & SAVESTATE_COMPRESS) {
+            savestate_copy_out(state->scratch, region);
+            stored = lz_compress(state->scratch, region->size, out,
+                                 lz_compress_bound(region->size));
+            if (stored > 0 && stored < region->size) {
+                chunk_flags = SAVESTATE_CHUNK_LZ;
+            } else {
+                memcpy(out, state->scratch, region->size);
+                stored = region->size;
+            }
+        } else {
+            savestate_copy_out(out, region);
+            stored = region->size;
+        }
+        
+        memcpy(header, chunk_tags[i], 4);
+        savestate_put_u32(header + 4, chunk_flags);
+        savestate_put_u32(header + 8, region->size);
+        savestate_put_u32(header + 12, stored);
+        out += stored;
+    }
+    
+    state->size = (u32)(out - state->data);
+    return SUCCESS;
+}
+
+int savestate_load(Emulator *emu, SaveState *state) {
+    StateRegion regions[CHUNK_COUNT];
+    u32 offsets[CHUNK_COUNT];
+    bool present[CHUNK_COUNT];
+    const u8 *in = state->data;
+    const u8 *end = state->data + state->size;
+    u32 scratch_size = 0;
+    u32 chunk_count;
+    u32 n;
+    int i;
+    
+    if (emu->apu.thread || state->size < SAVESTATE_HEADER_SIZE ||
+        memcmp(in, SAVESTATE_MAGIC, 8) != 0 ||
+        savestate_get_u32(in + 8) != SAVESTATE_VERSION ||
+        savestate_get_u32(in + 16) != emu->cart.rom_size ||
+        savestate_get_u32(in + 20) != emu->cart.header.checksum) {
+        return ERROR;
+    }
+    chunk_count = savestate_get_u32(in + 24);
+    in += SAVESTATE_HEADER_SIZE;
+    
+    for (i = 0; i < CHUNK_COUNT; i++) {
+        savestate_region(emu, (StateChunk)i, &regions[i]);
+        offsets[i] = scratch_size;
+        scratch_size += regions[i].size;
+        present[i] = false;
+    }
+    if (savestate_reserve(&state->scratch, &state->scratch_capacity, scratch_size) != SUCCESS) {
+        return ERROR;
+    }
+    
+    /* Decode every chunk before touching the instance */
+    for (n = 0; n < chunk_count; n++) {
+        u32 chunk_flags;
+        u32 raw_size;
+        u32 stored;
+        
+        if (end - in < SAVESTATE_CHUNK_HEADER_SIZE) {
+            return ERROR;
+        }
+        chunk_flags = savestate_get_u32(in + 4);
+        raw_size = savestate_get_u32(in + 8);
+        stored = savestate_get_u32(in + 12);
+        if ((u32)(end - in) - SAVESTATE_CHUNK_HEADER_SIZE < stored) {
+            return ERROR;
+        }
+        
+        for (i = 0; i < CHUNK_COUNT; i++) {
+            if (memcmp(in, chunk_tags[i], 4) == 0) {
+                break;
+            }
+        }
+        in += SAVESTATE_CHUNK_HEADER_SIZE;
+        
+        if (i < CHUNK_COUNT) {
+            u8 *dst = state->scratch + offsets[i];
+            
+            /* A size mismatch means a different build's structure layout */
+            if (!regions[i].data || raw_size != regions[i].size) {
+                return ERROR;
+            }
+            if (chunk_flags & SAVESTATE_CHUNK_LZ) {
+                if (lz_decompress(in, stored, dst, raw_size) != raw_size) {
+                    return ERROR;
+                }
+            } else if (stored == raw_size) {
+                memcpy(dst, in, raw_size);
+            } else {
+                return ERROR;
+            }
+            present[i] = true;
+        }
+        in += stored;
+    }
+    
+    /* Everything but the last frame is required */
+    for (i = 0; i < CHUNK_FRAMEBUFFER; i++) {
+        if (regions[i].data && !present[i]) {
+            return ERROR;
+        }
+    }
+    
+    /* Keep this instance's host fields and copy the state over */
+    ppu_render_flush(&emu->ppu);
+    for (i = 0; i < CHUNK_COUNT; i++) {
+        const StateRegion *region = &regions[i];
+        u8 *src = state->scratch + offsets[i];
+        u32 h;
+        
+        if (!present[i]) {
+            continue;
+        }
+        for (h = 0; h < region->hole_count; h++) {
+            size_t offset = region->holes[h].offset - region->base;
+            memcpy(src + offset, region->data + offset, region->holes[h].size);
+        }
+        
+        /* Decoded tiles stay valid where video memory is unchanged */
+        if (i == CHUNK_MEMORY) {
+            Memory *mem = &emu->memory;
+            
+            savestate_video_changed(mem, mem->vram, src + offsetof(Memory, vram) - region->base,
+                                    VRAM_SIZE, memory_vram_written);
+            savestate_video_changed(mem, mem->cgram, src + offsetof(Memory, cgram) - region->base,
+                                    CGRAM_SIZE, memory_cgram_written);
+            savestate_video_changed(mem, mem->oam, src + offsetof(Memory, oam) - region->base,
+                                    OAM_SIZE, memory_oam_written);
+        }
+        memcpy(region->data, src, region->size);
+    }
+    
+    /* Rebuild what is derived from the restored memory */
+    memory_update_map(&emu->memory);
+    cpu_flush_block_cache(&emu->cpu);
+    memset(emu->ppu.line_hash, 0, sizeof(emu->ppu.line_hash));
+    emu->ppu.upscaled_stale = true;
+    
+    return SUCCESS;
+}
+
+int savestate_write_file(const SaveState *state, const char *filename) {
+    FILE *file = fopen(filename, "wb");
+    size_t written;
+    
+    if (!file) {
+        fprintf(stderr, "Error: Cannot create save state '%s'\n", filename);
+        return ERROR;
+    }
+    written = fwrite(state->data, 1, state->size, file);
+    fclose(file);
+    return written == state->size ? SUCCESS : ERROR;
+}
+
+int savestate_read_file(SaveState *state, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    long size;
+    
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open save state '%s'\n", filename);
+        return ERROR;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    if (size < SAVESTATE_HEADER_SIZE ||
+        savestate_reserve(&state->data, &state->capacity, (u32)size) != SUCCESS ||
+        fread(state->data, 1, (size_t)size, file) != (size_t)size) {
+        fclose(file);
+        return ERROR;
+    }
+    state->size = (u32)size;
+    
+    fclose(file);
+    return SUCCESS;
+}
@@ -0,0 +1,125 @@
+/*
+ * scheduler.c - Timestamped event scheduler implementation
+ */
+
+#include <string.h>
+#include "../include/scheduler.h"
+
+/* Heap ordering: earlier time first, then lower event type */
+static bool scheduler_before(const ScheduledEvent *a, const ScheduledEvent *b) {
+    if (a->time != b->time) {
+        return a->time < b->time;
+    }
+    return a->type < b->type;
+}
+
+static void scheduler_swap(Scheduler *sched, u8 i, u8 j) {
+    ScheduledEvent temp = sched->heap[i];
+
+    sched->heap[i] = sched->heap[j];
+    sched->heap[j] = temp;
+    sched->position[sched->heap[i].type] = i;
+    sched->position[sched->heap[j].type] = j;
+}
+
+static void scheduler_sift_up(Scheduler *sched, u8 i) {
+    while (i > 0) {
+        u8 parent = (i - 1) / 2;
+        if (!scheduler_before(&sched->heap[i], &sched->heap[parent])) {
+            break;
+        }
+        scheduler_swap(sched, i, parent);
+        i = parent;
+    }
+}
+
+static void scheduler_sift_down(Scheduler *sched, u8 i) {
+    for (;;) {
+        u8 left = 2 * i + 1;
+        u8 right = left + 1;
+        u8 smallest = i;
+
+        if (left < sched->count &&
+            scheduler_before(&sched->heap[left], &sched->heap[smallest])) {
+            smallest = left;
+        }
+        if (right < sched->count &&
+            scheduler_before(&sched->heap[right], &sched->heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        scheduler_swap(sched, i, smallest);
+        i = smallest;
+    }
+}
+
+/* Remove the heap entry at index i */
+static void scheduler_remove_at(Scheduler *sched, u8 i) {
+    u8 last = sched->count - 1;
+
+    sched->position[sched->heap[i].type] = -1;
+    sched->count--;
+
+    if (i != last) {
+        sched->heap[i] = sched->heap[last];
+        sched->position[sched->heap[i].type] = i;
+        scheduler_sift_down(sched, i);
+        scheduler_sift_up(sched, i);
+    }
+}
+
+void scheduler_init(Scheduler *sched) {
+    int i;
+
+    memset(sched, 0, sizeof(Scheduler));
+    for (i = 0; i < EVENT_COUNT; i++) {
+        sched->position[i] = -1;
+    }
+}
+
+void scheduler_schedule(Scheduler *sched, EventType type, u64 time) {
+    s8 i;
+
+    if (type >= EVENT_COUNT) {
+        return;
+    }
+
+    i = sched->position[type];
+    if (i < 0) {
+        /* New event - append and restore heap order */
+        i = sched->count++;
+        sched->heap[i].type = type;
+        sched->position[type] = i;
+    }
+
+    sched->heap[i].time = time;
+    scheduler_sift_up(sched, i);
+    scheduler_sift_down(sched, sched->position[type]);
+}
+
+void scheduler_cancel(Scheduler *sched, EventType type) {
+    if (type < EVENT_COUNT && sched->position[type] >= 0) {
+        scheduler_remove_at(sched, sched->position[type]);
+    }
+}
+
+bool scheduler_is_pending(const Scheduler *sched, EventType type) {
+    return type < EVENT_COUNT && sched->position[type] >= 0;
+}
+
+u64 scheduler_next_time(const Scheduler *sched) {
+    return sched->count ? sched->heap[0].time : SCHEDULER_NEVER;
+}
+
+bool scheduler_pop(Scheduler *sched, u64 now, EventType *type, u64 *time) {
+    if (sched->count == 0 || sched->heap[0].time > now) {
+        return false;
+    }
+
+    *type = (EventType)sched->heap[0].type;
+    *time = sched->heap[0].time;
+    scheduler_remove_at(sched, 0);
+    return true;
+}
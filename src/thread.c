@@ -0,0 +1,166 @@
+/*
+ * thread.c - Threading portability layer implementation
+ */
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "../include/thread.h"
+
+#ifdef _WIN32
+
+static DWORD WINAPI thread_entry(LPVOID param) {
+    Thread *thread = (Thread *)param;
+    thread->func(thread->arg);
+    return 0;
+}
+
+int thread_create(Thread *thread, ThreadFunc func, void *arg) {
+    thread->func = func;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+    thread->running = (thread->handle != NULL);
+    return thread->running ? SUCCESS : ERROR;
+}
+
+void thread_join(Thread *thread) {
+    if (thread->running) {
+        WaitForSingleObject(thread->handle, INFINITE);
+        CloseHandle(thread->handle);
+        thread->running = false;
+    }
+}
+
+void thread_yield(void) {
+    SwitchToThread();
+}
+
+u32 thread_cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (u32)info.dwNumberOfProcessors : 1;
+}
+
+u64 thread_time_ns(void) {
+    LARGE_INTEGER count;
+    LARGE_INTEGER frequency;
+    
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (u64)((double)count.QuadPart * 1e9 / (double)frequency.QuadPart);
+}
+
+void mutex_init(Mutex *mutex) {
+    InitializeCriticalSection(&mutex->handle);
+}
+
+void mutex_destroy(Mutex *mutex) {
+    DeleteCriticalSection(&mutex->handle);
+}
+
+void mutex_lock(Mutex *mutex) {
+    EnterCriticalSection(&mutex->handle);
+}
+
+void mutex_unlock(Mutex *mutex) {
+    LeaveCriticalSection(&mutex->handle);
+}
+
+void cond_init(Cond *cond) {
+    InitializeConditionVariable(&cond->handle);
+}
+
+void cond_destroy(Cond *cond) {
+    (void)cond;  /* Win32 condition variables need no cleanup */
+}
+
+void cond_wait(Cond *cond, Mutex *mutex) {
+    SleepConditionVariableCS(&cond->handle, &mutex->handle, INFINITE);
+}
+
+void cond_signal(Cond *cond) {
+    WakeConditionVariable(&cond->handle);
+}
+
+void cond_broadcast(Cond *cond) {
+    WakeAllConditionVariable(&cond->handle);
+}
+
+#else
+
+static void *thread_entry(void *param) {
+    Thread *thread = (Thread *)param;
+    thread->func(thread->arg);
+    return NULL;
+}
+
+int thread_create(Thread *thread, ThreadFunc func, void *arg) {
+    thread->func = func;
+    thread->arg = arg;
+    thread->running = (pthread_create(&thread->handle, NULL, thread_entry, thread) == 0);
+    return thread->running ? SUCCESS : ERROR;
+}
+
+void thread_join(Thread *thread) {
+    if (thread->running) {
+        pthread_join(thread->handle, NULL);
+        thread->running = false;
+    }
+}
+
+void thread_yield(void) {
+    sched_yield();
+}
+
+u32 thread_cpu_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
+u64 thread_time_ns(void) {
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000ULL + (u64)now.tv_nsec;
+}
+
+void mutex_init(Mutex *mutex) {
+    pthread_mutex_init(&mutex->handle, NULL);
+}
+
+void mutex_destroy(Mutex *mutex) {
+    pthread_mutex_destroy(&mutex->handle);
+}
+
+void mutex_lock(Mutex *mutex) {
+    pthread_mutex_lock(&mutex->handle);
+}
+
+void mutex_unlock(Mutex *mutex) {
+    pthread_mutex_unlock(&mutex->handle);
+}
+
+void cond_init(Cond *cond) {
+    pthread_cond_init(&cond->handle, NULL);
+}
+
+void cond_destroy(Cond *cond) {
+    pthread_cond_destroy(&cond->handle);
+}
+
+void cond_wait(Cond *cond, Mutex *mutex) {
+    pthread_cond_wait(&cond->handle, &mutex->handle);
+}
+
+void cond_signal(Cond *cond) {
+    pthread_cond_signal(&cond->handle);
+}
+
+void cond_broadcast(Cond *cond) {
+    pthread_cond_broadcast(&cond->handle);
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * test_apu.c - APU tests
+ * 
+ * Tests for APU synchronization and CPU communication ports
+ */
+
+#include "test_framework.h"
+#include "../include/apu.h"
+#include "../include/memory.h"
+#include <stdlib.h>
+
+/* Test catch-up runs the SPC-700 for the elapsed CPU time */
+void test_apu_sync_cycles(void) {
+    TEST("APU sync cycle ratio");
+    
+    static APU apu;
+    apu_init(&apu);
+    
+    /* One NTSC frame of CPU time */
+    apu_sync(&apu, 89342);
+    ASSERT(apu.cpu.cycles >= 89342ULL * APU_CLOCK_NUM / APU_CLOCK_DEN);
+    ASSERT(apu.cpu.cycles <= 89342ULL * APU_CLOCK_NUM / APU_CLOCK_DEN + 8);
+    
+    /* Syncing to the same or an earlier time does nothing */
+    u64 cycles = apu.cpu.cycles;
+    apu_sync(&apu, 89342);
+    apu_sync(&apu, 1000);
+    ASSERT(apu.cpu.cycles == cycles);
+    
+    free(apu.audio_buffer);
+    free(apu.dsp.sample_buffer);
+    TEST_PASS();
+}
+
+/* Test one emulated second runs the SPC-700 at 1.024 MHz */
+void test_apu_sync_one_second(void) {
+    TEST("APU clock over one second");
+    
+    static APU apu;
+    int frame;
+    apu_init(&apu);
+    
+    ASSERT(APU_CLOCK_NUM * (u64)APU_CPU_CLOCK == APU_CLOCK_DEN * (u64)APU_SPC_CLOCK);
+    for (frame = 1; frame <= 60; frame++) {
+        apu_sync(&apu, (u64)frame * 89342);
+    }
+    ASSERT(apu.cpu.cycles >= APU_SPC_CLOCK);
+    ASSERT(apu.cpu.cycles <= APU_SPC_CLOCK + 8);
+    ASSERT_EQ((int)apu.buffer_pos / 2, APU_SAMPLE_RATE);
+    
+    free(apu.audio_buffer);
+    free(apu.dsp.sample_buffer);
+    TEST_PASS();
+}
+
+/* Test samples are produced at the output rate without drift */
+void test_apu_sync_samples(void) {
+    TEST("APU sync sample count");
+    
+    static APU apu;
+    int i;
+    apu_init(&apu);
+    
+    /* Many small syncs produce the same count as one large one */
+    for (i = 1; i <= 1000; i++) {
+        apu_sync(&apu, (u64)i * 89);
+    }
+    ASSERT_EQ((int)apu.buffer_pos / 2,
+              (int)(89000ULL * APU_SAMPLE_RATE / APU_CPU_CLOCK));
+    
+    free(apu.audio_buffer);
+    free(apu.dsp.sample_buffer);
+    TEST_PASS();
+}
+
+/* Test $2140-$2143 reach the APU through the memory bus */
+void test_apu_memory_ports(void) {
+    TEST("APU ports via memory bus");
+    
+    static APU apu;
+    static Memory mem;
+    u64 clock = 0;
+    
+    apu_init(&apu);
+    memory_init(&mem);
+    memory_set_apu(&mem, &apu, &clock);
+    
+    /* CPU writes land in the SPC-700 input ports */
+    memory_write(&mem, 0x002141, 0xAA);
+    ASSERT_EQ(apu.port_in[1], 0xAA);
+    
+    /* Mirrors repeat every 4 bytes */
+    memory_write(&mem, 0x80217E, 0x55);
+    ASSERT_EQ(apu.port_in[2], 0x55);
+    
+    apu.port_out[3] = 0xCC;
+    ASSERT_EQ(memory_read(&mem, 0x002143), 0xCC);
+    
+    /* Port accesses catch the APU up to the CPU clock */
+    clock = 700;
+    memory_read(&mem, 0x002140);
+    ASSERT(apu.sync_time == 700);
+    ASSERT(apu.cpu.cycles >= 700ULL * APU_CLOCK_NUM / APU_CLOCK_DEN);
+    
+    free(apu.audio_buffer);
+    free(apu.dsp.sample_buffer);
+    TEST_PASS();
+}
+
+/* Test threaded mode delivers port writes and finishes on stop */
+void test_apu_thread_mailbox(void) {
+    TEST("APU threaded port mailbox");
+    
+    static APU apu;
+    int i;
+    apu_init(&apu);
+    
+    ASSERT(apu_start_thread(&apu, 0) == SUCCESS);
+    ASSERT(apu.sync_mode == APU_SYNC_THREADED);
+    
+    /* Writes are queued with the current CPU timestamp */
+    for (i = 1; i <= 100; i++) {
+        apu_sync(&apu, (u64)i * 100);
+        apu_write_port(&apu, i & 3, (u8)i);
+    }
+    apu_sync(&apu, 89342);
+    apu_stop_thread(&apu);
+    
+    /* After stopping, all work up to the last sync is done */
+    ASSERT(apu.thread == NULL);
+    ASSERT(apu.sync_time == 89342);
+    ASSERT_EQ(apu.port_in[0], 100);
+    ASSERT_EQ(apu.port_in[3], 99);
+    ASSERT_EQ((int)apu.buffer_pos / 2,
+              (int)(89342ULL * APU_SAMPLE_RATE / APU_CPU_CLOCK));
+    
+    free(apu.audio_buffer);
+    free(apu.dsp.sample_buffer);
+    TEST_PASS();
+}
+
+/* Test suite runner */
+void test_apu_suite(void) {
+    TEST_SUITE("APU Module");
+    
+    test_apu_sync_cycles();
+    test_apu_sync_one_second();
+    test_apu_sync_samples();
+    test_apu_memory_ports();
+    test_apu_thread_mailbox();
+}
@@ -112,6 +112,116 @@ void test_cartridge_checksum(void) {
     TEST_PASS();
 }
 
+/* Write a 64KB LoROM image (optionally behind an SMC header) */
+static int write_test_rom(const char *filename, bool smc_header) {
+    static u8 rom[0x10000];
+    FILE *file;
+    size_t written = 0;
+    
+    memset(rom, 0, sizeof(rom));
+    for (int i = 0; i < 0x100; i++) {
+        rom[i] = (u8)i;
+    }
+    memcpy(&rom[0x7FC0], "MAPPED TEST ROM      ", 21);
+    rom[0x7FDC] = 0xFF;  /* Checksum complement + checksum = $FFFF */
+    rom[0x7FDD] = 0xFF;
+    
+    file = fopen(filename, "wb");
+    if (!file) {
+        return ERROR;
+    }
+    if (smc_header) {
+        static const u8 header[512];
+        written += fwrite(header, 1, sizeof(header), file);
+    }
+    written += fwrite(rom, 1, sizeof(rom), file);
+    fclose(file);
+    return written == sizeof(rom) + (smc_header ? 512 : 0) ? SUCCESS : ERROR;
+}
+
+void test_cartridge_load_mapped(void) {
+    TEST("Cartridge load (mapped ROM)");
+    
+    const char *filename = "test_mapped_rom.sfc";
+    Cartridge cart;
+    Cartridge reload;
+    
+    ASSERT_EQ(write_test_rom(filename, true), SUCCESS);
+    ASSERT_EQ(cartridge_load(&cart, filename), SUCCESS);
+    ASSERT_EQ(cart.rom_size, 0x10000);
+    ASSERT_EQ(cart.rom_data[0x10], 0x10);
+    ASSERT(strncmp(cart.header.title, "MAPPED TEST ROM", 15) == 0);
+#ifndef _WIN32
+    ASSERT(cart.rom_map != NULL);
+    ASSERT(cart.rom_data == cart.rom_map + 512);
+#endif
+    
+    /* Backup, edit and restore */
+    ASSERT_EQ(cartridge_backup_rom(&cart), SUCCESS);
+#ifndef _WIN32
+    ASSERT(cart.backup_mapped);
+#endif
+    cartridge_write_rom(&cart, 0x10, 0xAB);
+    ASSERT_EQ(cart.rom_data[0x10], 0xAB);
+    ASSERT_EQ(cart.rom_backup[0x10], 0x10);
+    
+    /* Edits are private: the file is unchanged */
+    ASSERT_EQ(cartridge_load(&reload, filename), SUCCESS);
+    ASSERT_EQ(reload.rom_data[0x10], 0x10);
+    cartridge_unload(&reload);
+    
+    ASSERT_EQ(cartridge_restore_rom(&cart), SUCCESS);
+    ASSERT_EQ(cart.rom_data[0x10], 0x10);
+    ASSERT(strncmp(cart.header.title, "MAPPED TEST ROM", 15) == 0);
+    
+    cartridge_unload(&cart);
+    ASSERT(cart.rom_data == NULL);
+    remove(filename);
+    TEST_PASS();
+}
+
+/* Test saving an edited mapped ROM over its own file */
+void test_cartridge_save_over_source(void) {
+    TEST("Cartridge save over mapped source");
+    
+    const char *filename = "test_saved_rom.sfc";
+    Cartridge cart;
+    Cartridge reload;
+    u32 sum = 0;
+    u32 i;
+    
+    ASSERT_EQ(write_test_rom(filename, false), SUCCESS);
+    ASSERT_EQ(cartridge_load(&cart, filename), SUCCESS);
+    ASSERT_EQ(cartridge_backup_rom(&cart), SUCCESS);
+    cartridge_write_rom(&cart, 0x10, 0xAB);
+    ASSERT_EQ(cartridge_save_rom(&cart, filename), SUCCESS);
+    
+    /* The old mapping is intact: every page still reads */
+    for (i = 0; i < cart.rom_size; i++) {
+        sum += cart.rom_data[i];
+    }
+    ASSERT(sum > 0);
+    ASSERT_EQ(cart.rom_data[0x20], 0x20);
+    
+    /* The file holds the edit; the backup still maps the replaced file */
+    ASSERT_EQ(cartridge_load(&reload, filename), SUCCESS);
+    ASSERT_EQ(reload.rom_size, 0x10000);
+    ASSERT_EQ(reload.rom_data[0x10], 0xAB);
+    cartridge_unload(&reload);
+#ifndef _WIN32
+    ASSERT(cart.backup_mapped);
+#endif
+    ASSERT_EQ(cart.rom_backup[0x10], 0x10);
+    
+    ASSERT_EQ(cartridge_restore_rom(&cart), SUCCESS);
+    ASSERT_EQ(cart.rom_data[0x10], 0x10);
+    ASSERT(strncmp(cart.header.title, "MAPPED TEST ROM", 15) == 0);
+    
+    cartridge_unload(&cart);
+    remove(filename);
+    TEST_PASS();
+}
+
 void test_cartridge_suite(void) {
     TEST_SUITE("Cartridge Module");
     
@@ -119,4 +229,6 @@ void test_cartridge_suite(void) {
     test_cartridge_write_rom();
     test_cartridge_backup_restore();
     test_cartridge_checksum();
+    test_cartridge_load_mapped();
+    test_cartridge_save_over_source();
 }
@@ -0,0 +1,262 @@
+/*
+ * test_cpu.c - CPU tests
+ *
+ * Tests for 65c816 instruction execution and opcode dispatch
+ */
+
+#include "test_framework.h"
+#include "../include/cpu.h"
+#include "../include/memory.h"
+#include <string.h>
+
+/* Memory system used by the CPU core */
+static Memory g_memory;
+
+/* Load a program into low WRAM and point the CPU at it */
+static void load_program(CPU *cpu, const u8 *program, size_t size) {
+    memory_init(&g_memory);
+    memcpy(&g_memory.wram[0x0200], program, size);
+    cpu_init(cpu, &g_memory);
+    cpu->pc = 0x0200;
+}
+
+/* Test power-on state */
+void test_cpu_reset_state(void) {
+    TEST("CPU reset state");
+
+    CPU cpu;
+    memory_init(&g_memory);
+    cpu_init(&cpu, &g_memory);
+
+    ASSERT_EQ(cpu.e, 1);
+    ASSERT_EQ(cpu.sp, 0x01FF);
+    ASSERT(cpu_get_flag(&cpu, FLAG_M));
+    ASSERT(cpu_get_flag(&cpu, FLAG_X));
+    ASSERT_EQ(cpu.dispatch_mode, CPU_DISPATCH_EMULATION);
+
+    TEST_PASS();
+}
+
+/* Test switching to native mode and widening registers */
+void test_cpu_native_16bit(void) {
+    TEST("CPU native mode 16-bit registers");
+
+    /* CLC; XCE; REP #$30; LDA #$1234; LDX #$5678 */
+    const u8 program[] = {
+        0x18, 0xFB, 0xC2, 0x30, 0xA9, 0x34, 0x12, 0xA2, 0x78, 0x56
+    };
+    CPU cpu;
+    load_program(&cpu, program, sizeof(program));
+
+    cpu_step(&cpu);
+    cpu_step(&cpu);
+    ASSERT_EQ(cpu.e, 0);
+    ASSERT_EQ(cpu.dispatch_mode, CPU_DISPATCH_M8_X8);
+
+    cpu_step(&cpu);
+    ASSERT_EQ(cpu.dispatch_mode, CPU_DISPATCH_M16_X16);
+
+    ASSERT_EQ(cpu_step(&cpu), 3);
+    ASSERT_EQ(cpu.a, 0x1234);
+    cpu_step(&cpu);
+    ASSERT_EQ(cpu.x, 0x5678);
+    ASSERT_EQ(cpu.pc, 0x020A);
+
+    TEST_PASS();
+}
+
+/* Test that setting X truncates the index registers */
+void test_cpu_index_truncation(void) {
+    TEST("CPU index register truncation");
+
+    /* CLC; XCE; REP #$10; LDX #$1234; SEP #$10 */
+    const u8 program[] = {
+        0x18, 0xFB, 0xC2, 0x10, 0xA2, 0x34, 0x12, 0xE2, 0x10
+    };
+    CPU cpu;
+    load_program(&cpu, program, sizeof(program));
+
+    for (int i = 0; i < 5; i++) {
+        cpu_step(&cpu);
+    }
+    ASSERT_EQ(cpu.x, 0x34);
+    ASSERT_EQ(cpu.dispatch_mode, CPU_DISPATCH_M8_X8);
+
+    TEST_PASS();
+}
+
+/* Test 16-bit ADC flags */
+void test_cpu_adc_16bit_overflow(void) {
+    TEST("CPU 16-bit ADC overflow flag");
+
+    /* CLC; XCE; REP #$20; LDA #$7FFF; CLC; ADC #$0001 */
+    const u8 program[] = {
+        0x18, 0xFB, 0xC2, 0x20, 0xA9, 0xFF, 0x7F, 0x18, 0x69, 0x01, 0x00
+    };
+    CPU cpu;
+    load_program(&cpu, program, sizeof(program));
+
+    for (int i = 0; i < 6; i++) {
+        cpu_step(&cpu);
+    }
+    ASSERT_EQ(cpu.a, 0x8000);
+    ASSERT(cpu_get_flag(&cpu, FLAG_V));
+    ASSERT(cpu_get_flag(&cpu, FLAG_N));
+    ASSERT(!cpu_get_flag(&cpu, FLAG_C));
+
+    TEST_PASS();
+}
+
+/* Test branch timing */
+void test_cpu_branch_cycles(void) {
+    TEST("CPU branch cycles");
+
+    /* SEC; BCC +2 (not taken); BCS +2 (taken) */
+    const u8 program[] = { 0x38, 0x90, 0x02, 0xB0, 0x02 };
+    CPU cpu;
+    load_program(&cpu, program, sizeof(program));
+
+    cpu_step(&cpu);
+    ASSERT_EQ(cpu_step(&cpu), 2);
+    ASSERT_EQ(cpu.pc, 0x0203);
+    ASSERT_EQ(cpu_step(&cpu), 3);
+    ASSERT_EQ(cpu.pc, 0x0207);
+
+    TEST_PASS();
+}
+
+/* Test emulation mode stack stays in page 1 */
+void test_cpu_emulation_stack(void) {
+    TEST("CPU emulation mode stack wrap");
+
+    /* LDA #$42; PHA; PLA */
+    const u8 program[] = { 0xA9, 0x42, 0x48, 0x68 };
+    CPU cpu;
+    load_program(&cpu, program, sizeof(program));
+    cpu.sp = 0x0100;
+
+    cpu_step(&cpu);
+    cpu_step(&cpu);
+    ASSERT_EQ(cpu.sp, 0x01FF);
+    ASSERT_EQ(g_memory.wram[0x0100], 0x42);
+    cpu_step(&cpu);
+    ASSERT_EQ(cpu.sp, 0x0100);
+    ASSERT_EQ(cpu.a & 0xFF, 0x42);
+
+    TEST_PASS();
+}
+
+/* Test unimplemented opcodes stop the CPU */
+void test_cpu_unimplemented_opcode(void) {
+    TEST("CPU unimplemented opcode");
+
+    const u8 program[] = { 0x02 };  /* COP (not implemented) */
+    CPU cpu;
+    load_program(&cpu, program, sizeof(program));
+
+    ASSERT_EQ(cpu_step(&cpu), 2);
+    ASSERT(cpu.stopped);
+
+    TEST_PASS();
+}
+
+/* Test block-cached execution matches stepping */
+void test_cpu_run_block_cache(void) {
+    TEST("CPU block cache execution");
+
+    /* CLC; XCE; REP #$30; LDX #$0003; loop: DEX; BNE loop; STX $1000 */
+    const u8 program[] = {
+        0x18, 0xFB, 0xC2, 0x30, 0xA2, 0x03, 0x00,
+        0xCA, 0xD0, 0xFD, 0x8E, 0x00, 0x10
+    };
+    CPU cpu;
+    load_program(&cpu, program, sizeof(program));
+    g_memory.wram[0x1000] = 0xAA;
+
+    cpu_run(&cpu, 29);
+    ASSERT_EQ(cpu.x, 0);
+    ASSERT_EQ(cpu.pc, 0x020D);
+    ASSERT_EQ(g_memory.wram[0x1000], 0);
+    ASSERT_EQ((int)cpu.cycles, 29);
+    ASSERT(!cpu.stopped);
+
+    TEST_PASS();
+}
+
+/* Test that writing to cached code invalidates it */
+void test_cpu_run_self_modifying(void) {
+    TEST("CPU block cache invalidation");
+
+    /* LDA #$01 */
+    const u8 program[] = { 0xA9, 0x01 };
+    CPU cpu;
+    load_program(&cpu, program, sizeof(program));
+
+    /* Warm the cache with the original code */
+    cpu_run(&cpu, 2);
+    ASSERT_EQ(cpu.a & 0xFF, 0x01);
+
+    /* Patch the operand through the bank $7E alias and rerun */
+    memory_write(&g_memory, 0x7E0201, 0x05);
+    cpu.pc = 0x0200;
+    cpu_run(&cpu, 2);
+    ASSERT_EQ(cpu.a & 0xFF, 0x05);
+
+    TEST_PASS();
+}
+
+/* Test that data writes next to cached WRAM code keep the cache */
+void test_cpu_run_wram_code_data_writes(void) {
+    TEST("CPU block cache with WRAM code writing data");
+
+    /* CLC; XCE; REP #$30; loop: LDA #$1234; STA $0010; PHA; PLA;
+     * JSR sub; BRA loop; sub: INX; RTS */
+    const u8 program[] = {
+        0x18, 0xFB, 0xC2, 0x30, 0xA9, 0x34, 0x12, 0x8D, 0x10, 0x00,
+        0x48, 0x68, 0x20, 0x11, 0x02, 0x80, 0xF3, 0xE8, 0x60
+    };
+    CPU cpu;
+    u32 code_span = 0x0200 >> MEMORY_WATCH_SPAN_SHIFT;
+    u32 generation;
+    load_program(&cpu, program, sizeof(program));
+
+    cpu_run(&cpu, 200);
+    generation = g_memory.code_generation;
+    ASSERT(g_memory.watch_spans[code_span] & MEMORY_WATCH_CODE);
+
+    /* Direct page and stack writes share the code's page, not its span */
+    cpu_run(&cpu, 2000);
+    ASSERT_EQ(g_memory.code_generation, generation);
+    ASSERT_EQ(g_memory.code_written_count, 0);
+    ASSERT(g_memory.watch_spans[code_span] & MEMORY_WATCH_CODE);
+    ASSERT_EQ(g_memory.wram[0x0010], 0x34);
+    ASSERT_EQ(g_memory.wram[0x0011], 0x12);
+    ASSERT(cpu.x > 20);
+    ASSERT(!cpu.stopped);
+
+    /* A write to the code itself still takes effect */
+    memory_write(&g_memory, 0x000205, 0x78);
+    ASSERT_EQ(g_memory.code_written_count, 1);
+    cpu_run(&cpu, 200);
+    ASSERT_EQ(g_memory.wram[0x0010], 0x78);
+    ASSERT_EQ(g_memory.code_generation, generation);
+
+    cpu_cleanup(&cpu);
+    TEST_PASS();
+}
+
+/* Test suite runner */
+void test_cpu_suite(void) {
+    TEST_SUITE("CPU Module");
+
+    test_cpu_reset_state();
+    test_cpu_native_16bit();
+    test_cpu_index_truncation();
+    test_cpu_adc_16bit_overflow();
+    test_cpu_branch_cycles();
+    test_cpu_emulation_stack();
+    test_cpu_unimplemented_opcode();
+    test_cpu_run_block_cache();
+    test_cpu_run_self_modifying();
+    test_cpu_run_wram_code_data_writes();
+}
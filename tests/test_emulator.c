@@ -0,0 +1,286 @@
+/*
+ * test_emulator.c - Unit tests for emulator instances
+ */
+
+#include "test_framework.h"
+#include "../include/emulator.h"
+#include "../include/batch.h"
+#include "../include/movie.h"
+#include "../include/runahead.h"
+#include "../include/types.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Two instances are too large for the stack */
+static Emulator g_emu_a;
+static Emulator g_emu_b;
+
+/* Enables auto-joypad read and loops copying JOY1L to $0010 */
+static const u8 joypad_program[] = {
+    0xA9, 0x01,        /* LDA #$01 */
+    0x8D, 0x00, 0x42,  /* STA $4200 */
+    0xAD, 0x18, 0x42,  /* loop: LDA $4218 */
+    0x8D, 0x10, 0x00,  /* STA $0010 */
+    0x80, 0xF8         /* BRA loop */
+};
+
+/* Turns the screen on with a red backdrop and idles */
+static const u8 backdrop_program[] = {
+    0xA9, 0x1F,        /* LDA #$1F */
+    0x8D, 0x22, 0x21,  /* STA $2122 */
+    0x9C, 0x22, 0x21,  /* STZ $2122 */
+    0xA9, 0x0F,        /* LDA #$0F */
+    0x8D, 0x00, 0x21,  /* STA $2100 */
+    0x80, 0xFE         /* loop: BRA loop */
+};
+
+void test_emulator_shared_rom(void) {
+    TEST("Emulator instances sharing a ROM image");
+    
+    const char *filename = "test_shared_rom.sfc";
+    RomImage *rom;
+    
+    ASSERT_EQ(test_write_program_rom(filename, test_counter_program,
+                                     sizeof(test_counter_program)), SUCCESS);
+    rom = rom_image_load(filename);
+    ASSERT(rom != NULL);
+    ASSERT_EQ(rom->refcount, 1);
+    
+    ASSERT_EQ(emulator_init(&g_emu_a, rom), SUCCESS);
+    ASSERT_EQ(emulator_init(&g_emu_b, rom), SUCCESS);
+    ASSERT_EQ(rom->refcount, 3);
+    rom_image_release(rom);
+    ASSERT_EQ(rom->refcount, 2);
+    
+    /* ROM bytes are shared, SRAM and WRAM are not */
+    ASSERT(g_emu_a.cart.rom_data == rom->cart.rom_data);
+    ASSERT(g_emu_b.cart.rom_data == rom->cart.rom_data);
+    ASSERT(g_emu_a.cart.sram_data != NULL);
+    ASSERT(g_emu_a.cart.sram_data != g_emu_b.cart.sram_data);
+    ASSERT(g_emu_a.cart.sram_data != rom->cart.sram_data);
+    ASSERT_EQ(g_emu_a.cpu.pc, 0x8000);
+    ASSERT_EQ(g_emu_b.cpu.pc, 0x8000);
+    
+    /* Both run the same program independently */
+    emulator_run_frame(&g_emu_a);
+    ASSERT_EQ(g_emu_a.frames, 1);
+    ASSERT(g_emu_a.cpu.cycles >= CYCLES_PER_FRAME);
+    ASSERT_EQ(g_emu_a.memory.wram[0x10], 0x42);
+    ASSERT_EQ(g_emu_b.memory.wram[0x10], 0x00);
+    
+    emulator_run_frame(&g_emu_b);
+    ASSERT_EQ(g_emu_b.cpu.cycles, g_emu_a.cpu.cycles);
+    ASSERT_EQ(g_emu_b.memory.wram[0x11], g_emu_a.memory.wram[0x11]);
+    
+    memory_write(&g_emu_a.memory, 0x700000, 0x5A);
+    ASSERT_EQ(g_emu_a.cart.sram_data[0], 0x5A);
+    ASSERT_EQ(g_emu_b.cart.sram_data[0], 0x00);
+    
+    /* The image lives until the last instance lets go */
+    emulator_cleanup(&g_emu_a);
+    ASSERT_EQ(rom->refcount, 1);
+    ASSERT_EQ(rom->cart.rom_data[0x7FFD], 0x80);
+    emulator_cleanup(&g_emu_b);
+    
+    remove(filename);
+    TEST_PASS();
+}
+
+void test_emulator_batch(void) {
+    TEST("Batch runs on a thread pool");
+    
+    const char *filename = "test_batch_rom.sfc";
+    const char *report = "test_batch_report.csv";
+    Batch batch;
+    FILE *file;
+    char line[256];
+    u32 lines = 0;
+    u32 i;
+    
+    ASSERT_EQ(test_write_program_rom(filename, test_counter_program,
+                                     sizeof(test_counter_program)), SUCCESS);
+    batch_init(&batch);
+    ASSERT_EQ(batch_add(&batch, filename, 3, 5), SUCCESS);
+    ASSERT_EQ(batch_add(&batch, "missing_rom.sfc", 3, 1), SUCCESS);
+    ASSERT_EQ(batch.job_count, 6);
+    
+    /* The missing ROM fails; the others run */
+    ASSERT_EQ(batch_run(&batch, 2), ERROR);
+    ASSERT_EQ(batch.thread_count, 2);
+    ASSERT_EQ(batch.jobs[5].status, ERROR);
+    
+    /* Identical runs give identical results whichever worker ran them */
+    for (i = 0; i < 5; i++) {
+        ASSERT_EQ(batch.jobs[i].status, SUCCESS);
+        ASSERT(batch.jobs[i].worker < 2);
+        ASSERT(batch.jobs[i].cpu_cycles >= 3 * CYCLES_PER_FRAME);
+        ASSERT(batch.jobs[i].cpu_cycles == batch.jobs[0].cpu_cycles);
+        ASSERT(batch.jobs[i].framebuffer_hash == batch.jobs[0].framebuffer_hash);
+        ASSERT(batch.jobs[i].wram_hash == batch.jobs[0].wram_hash);
+    }
+    
+    /* CSV report: header plus one line per run */
+    ASSERT_EQ(batch_write_report(&batch, report), SUCCESS);
+    file = fopen(report, "r");
+    ASSERT(file != NULL);
+    while (fgets(line, sizeof(line), file)) {
+        lines++;
+    }
+    fclose(file);
+    ASSERT_EQ(lines, 7);
+    
+    batch_cleanup(&batch);
+    remove(report);
+    remove(filename);
+    TEST_PASS();
+}
+
+void test_emulator_movie(void) {
+    TEST("Input movie record and replay");
+    
+    const char *filename = "test_movie_rom.sfc";
+    const char *movie_file = "test_movie.smv";
+    RomImage *rom;
+    Movie movie;
+    Movie loaded;
+    u8 seen[12];
+    u32 frame;
+    
+    ASSERT_EQ(test_write_program_rom(filename, joypad_program, sizeof(joypad_program)), SUCCESS);
+    rom = rom_image_load(filename);
+    ASSERT(rom != NULL);
+    ASSERT_EQ(emulator_init(&g_emu_a, rom), SUCCESS);
+    ASSERT_EQ(emulator_init(&g_emu_b, rom), SUCCESS);
+    rom_image_release(rom);
+    movie_init(&movie);
+    movie_init(&loaded);
+    
+    /* Record live input; the game sees it through JOY1L */
+    movie_record(&movie, &g_emu_a.cart);
+    input_set_movie(&g_emu_a.input, &movie);
+    for (frame = 0; frame < 12; frame++) {
+        input_set_buttons(&g_emu_a.input, 0, (frame % 3 == 1) ? BUTTON_A : BUTTON_R);
+        emulator_run_frame(&g_emu_a);
+        seen[frame] = g_emu_a.memory.wram[0x10];
+    }
+    ASSERT_EQ(movie.frame_count, 12);
+    ASSERT_EQ(seen[4], BUTTON_A);
+    ASSERT_EQ(seen[5], BUTTON_R);
+    
+    /* Fast-forward replay from a file reaches the same state */
+    ASSERT_EQ(movie_write_file(&movie, movie_file), SUCCESS);
+    ASSERT_EQ(movie_read_file(&loaded, movie_file), SUCCESS);
+    ASSERT_EQ(loaded.frame_count, 12);
+    ASSERT_EQ(movie_play(&loaded, &g_emu_b.cart), SUCCESS);
+    input_set_movie(&g_emu_b.input, &loaded);
+    ASSERT_EQ(movie_fast_forward(&loaded, &g_emu_b, 11), 11);
+    emulator_run_frame(&g_emu_b);
+    ASSERT(movie_finished(&loaded));
+    ASSERT(g_emu_b.cpu.cycles == g_emu_a.cpu.cycles);
+    ASSERT(memcmp(g_emu_b.memory.wram, g_emu_a.memory.wram, WRAM_SIZE) == 0);
+    ASSERT_EQ(g_emu_b.ppu.render_policy, PPU_RENDER_ALWAYS);
+    
+    /* Playback ends after the last frame; other ROMs are refused */
+    emulator_run_frame(&g_emu_b);
+    ASSERT_EQ(loaded.mode, MOVIE_IDLE);
+    loaded.rom_checksum ^= 1;
+    ASSERT_EQ(movie_play(&loaded, &g_emu_b.cart), ERROR);
+    
+    movie_free(&movie);
+    movie_free(&loaded);
+    emulator_cleanup(&g_emu_a);
+    emulator_cleanup(&g_emu_b);
+    remove(movie_file);
+    remove(filename);
+    TEST_PASS();
+}
+
+void test_emulator_runahead(void) {
+    TEST("Run-ahead rolls back to the committed frame");
+    
+    const char *filename = "test_runahead_rom.sfc";
+    RomImage *rom;
+    RunAhead ra;
+    u32 frame;
+    
+    ASSERT_EQ(test_write_program_rom(filename, joypad_program, sizeof(joypad_program)), SUCCESS);
+    rom = rom_image_load(filename);
+    ASSERT(rom != NULL);
+    ASSERT_EQ(emulator_init(&g_emu_a, rom), SUCCESS);
+    ASSERT_EQ(emulator_init(&g_emu_b, rom), SUCCESS);
+    rom_image_release(rom);
+    runahead_init(&ra, 2);
+    
+    /* Same input: the run-ahead instance ends each frame where the plain one does */
+    for (frame = 0; frame < 6; frame++) {
+        u16 buttons = frame >= 3 ? BUTTON_A : 0;
+        
+        input_set_buttons(&g_emu_a.input, 0, buttons);
+        input_set_buttons(&g_emu_b.input, 0, buttons);
+        ASSERT_EQ(runahead_run_frame(&ra, &g_emu_a), SUCCESS);
+        emulator_run_frame(&g_emu_b);
+        
+        ASSERT_EQ(g_emu_a.frames, g_emu_b.frames);
+        ASSERT(g_emu_a.cpu.cycles == g_emu_b.cpu.cycles);
+        ASSERT_EQ(g_emu_a.apu.buffer_pos, g_emu_b.apu.buffer_pos);
+        ASSERT(memcmp(g_emu_a.memory.wram, g_emu_b.memory.wram, WRAM_SIZE) == 0);
+    }
+    ASSERT_EQ(g_emu_a.memory.wram[0x10], BUTTON_A);
+    
+    /* The snapshot leaves out the framebuffer; the render policy is kept */
+    ASSERT(ra.state.size < SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(u32) + WRAM_SIZE);
+    ASSERT_EQ(g_emu_a.ppu.render_policy, PPU_RENDER_ALWAYS);
+    
+    runahead_free(&ra);
+    emulator_cleanup(&g_emu_a);
+    emulator_cleanup(&g_emu_b);
+    remove(filename);
+    TEST_PASS();
+}
+
+void test_emulator_present(void) {
+    TEST("Threaded frames are published at present");
+    
+    const char *filename = "test_present_rom.sfc";
+    const size_t frame_size = SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(u32);
+    RomImage *rom;
+    
+    ASSERT_EQ(test_write_program_rom(filename, backdrop_program, sizeof(backdrop_program)), SUCCESS);
+    rom = rom_image_load(filename);
+    ASSERT(rom != NULL);
+    ASSERT_EQ(emulator_init(&g_emu_a, rom), SUCCESS);
+    ASSERT_EQ(emulator_init(&g_emu_b, rom), SUCCESS);
+    rom_image_release(rom);
+    ASSERT_EQ(ppu_start_render_threads(&g_emu_b.ppu, 1), SUCCESS);
+    
+    /* The inline instance has its frame; the threaded one is still drawing it */
+    emulator_run_frame(&g_emu_a);
+    emulator_run_frame(&g_emu_b);
+    ASSERT(g_emu_a.ppu.framebuffer[100 * SCREEN_WIDTH] != 0);
+    ASSERT(g_emu_b.ppu.framebuffer[100 * SCREEN_WIDTH] == 0);
+    
+    ASSERT(emulator_present(&g_emu_a) == g_emu_a.ppu.framebuffer);
+    ASSERT(memcmp(emulator_present(&g_emu_b), g_emu_a.ppu.framebuffer, frame_size) == 0);
+    
+    /* Later frames are published at the following VBlank */
+    emulator_run_frame(&g_emu_a);
+    emulator_run_frame(&g_emu_b);
+    emulator_run_frame(&g_emu_b);
+    ASSERT(memcmp(g_emu_b.ppu.framebuffer, g_emu_a.ppu.framebuffer, frame_size) == 0);
+    
+    emulator_cleanup(&g_emu_a);
+    emulator_cleanup(&g_emu_b);
+    remove(filename);
+    TEST_PASS();
+}
+
+/* Test suite runner */
+void test_emulator_suite(void) {
+    TEST_SUITE("Emulator Module");
+    
+    test_emulator_shared_rom();
+    test_emulator_batch();
+    test_emulator_movie();
+    test_emulator_runahead();
+    test_emulator_present();
+}
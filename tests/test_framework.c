@@ -8,6 +8,14 @@
 /* Global test statistics */
 TestStats g_test_stats = {0};
 
+const u8 test_counter_program[11] = {
+    0xA9, 0x42,        /* LDA #$42 */
+    0x8D, 0x10, 0x00,  /* STA $0010 */
+    0xE8,              /* loop: INX */
+    0x8E, 0x11, 0x00,  /* STX $0011 */
+    0x80, 0xFA         /* BRA loop */
+};
+
 void test_init(void) {
     memset(&g_test_stats, 0, sizeof(g_test_stats));
     printf("\n╔═══════════════════════════════════════════════════════╗\n");
@@ -33,3 +41,27 @@ void test_summary(void) {
     }
     printf("\n");
 }
+
+int test_write_program_rom(const char *filename, const u8 *program, size_t size) {
+    static u8 rom[0x8000];
+    FILE *file;
+    size_t written;
+    
+    memset(rom, 0, sizeof(rom));
+    memcpy(rom, program, size);
+    memcpy(&rom[0x7FC0], "PROGRAM TEST ROM     ", 21);
+    rom[0x7FD6] = 0x02;  /* ROM + SRAM + battery */
+    rom[0x7FD8] = 0x01;  /* 2KB SRAM */
+    rom[0x7FDC] = 0xFF;
+    rom[0x7FDD] = 0xFF;
+    rom[0x7FFC] = 0x00;  /* Reset vector: $8000 */
+    rom[0x7FFD] = 0x80;
+    
+    file = fopen(filename, "wb");
+    if (!file) {
+        return ERROR;
+    }
+    written = fwrite(rom, 1, sizeof(rom), file);
+    fclose(file);
+    return written == sizeof(rom) ? SUCCESS : ERROR;
+}
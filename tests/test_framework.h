@@ -9,6 +9,8 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "../include/types.h"
 
 /* Test statistics */
 typedef struct {
@@ -80,4 +82,10 @@ void test_init(void);
 /* Print test summary */
 void test_summary(void);
 
+/* Loops counting into $0011 (after storing $42 to $0010) */
+extern const u8 test_counter_program[11];
+
+/* Write a 32KB LoROM image with 2KB SRAM running a program from reset */
+int test_write_program_rom(const char *filename, const u8 *program, size_t size);
+
 #endif /* TEST_FRAMEWORK_H */
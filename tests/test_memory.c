@@ -7,6 +7,7 @@
 #include "test_framework.h"
 #include "../include/memory.h"
 #include "../include/cartridge.h"
+#include "../include/ppu.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -280,6 +281,47 @@ void test_memory_cartridge_attach(void) {
     TEST_PASS();
 }
 
+/* Test page table mapping */
+void test_memory_page_table(void) {
+    TEST("Page table mapping");
+    
+    Memory mem;
+    Cartridge cart;
+    static u8 rom[0x9000];
+    
+    memory_init(&mem);
+    memset(&cart, 0, sizeof(Cartridge));
+    memset(rom, 0xEA, sizeof(rom));
+    rom[0x0000] = 0x12;
+    rom[0x8FFF] = 0x34;
+    cart.rom_data = rom;
+    cart.rom_size = sizeof(rom);
+    
+    /* WRAM and its low mirror are direct pages */
+    ASSERT(mem.read_map[0x7E0000 >> MEMORY_PAGE_SHIFT] != NULL);
+    ASSERT(mem.write_map[0x001000 >> MEMORY_PAGE_SHIFT] != NULL);
+    memory_write(&mem, 0x801000, 0x5A);
+    ASSERT_EQ(memory_read(&mem, 0x7E1000), 0x5A);
+    
+    /* I/O stays on the slow path */
+    ASSERT(mem.read_map[0x002100 >> MEMORY_PAGE_SHIFT] == NULL);
+    
+    /* ROM pages appear once the cartridge is attached */
+    ASSERT(mem.read_map[0x008000 >> MEMORY_PAGE_SHIFT] == NULL);
+    memory_set_cartridge(&mem, &cart);
+    ASSERT(mem.read_map[0x008000 >> MEMORY_PAGE_SHIFT] != NULL);
+    ASSERT(mem.write_map[0x008000 >> MEMORY_PAGE_SHIFT] == NULL);
+    ASSERT_EQ(memory_read(&mem, 0x008000), 0x12);
+    ASSERT_EQ(memory_read16(&mem, 0x00FFFE), 0xEAEA);
+    
+    /* Partially backed page falls back to the slow handler */
+    ASSERT(mem.read_map[0x018000 >> MEMORY_PAGE_SHIFT] == NULL);
+    ASSERT_EQ(memory_read(&mem, 0x018FFF), 0x34);
+    ASSERT_EQ(memory_read(&mem, 0x019000), 0xFF);
+    
+    TEST_PASS();
+}
+
 /* Test I/O register space */
 void test_memory_io_registers(void) {
     TEST("I/O register space");
@@ -287,13 +329,251 @@ void test_memory_io_registers(void) {
     Memory mem;
     memory_init(&mem);
     
-    /* I/O registers are at $2000-$7FFF */
-    mem.io_registers[0x2100] = 0x0F;  /* INIDISP */
-    ASSERT_EQ(mem.io_registers[0x2100], 0x0F);
+    /* B-bus registers ($2100-$21FF) are mirrored for inspection */
+    memory_write(&mem, 0x002100, 0x0F);  /* INIDISP */
+    ASSERT_EQ(*memory_io_register(&mem, 0x2100), 0x0F);
+    
+    memory_write(&mem, 0x802105, 0x01);  /* BGMODE (bank $80 mirror) */
+    ASSERT_EQ(*memory_io_register(&mem, 0x2105), 0x01);
+    
+    /* CPU registers ($4000-$43FF) read back */
+    memory_write(&mem, 0x004200, 0x81);  /* NMITIMEN */
+    ASSERT_EQ(*memory_io_register(&mem, 0x4200), 0x81);
+    ASSERT_EQ(memory_read(&mem, 0x004200), 0x81);
+    
+    /* Unmapped pages are open bus */
+    memory_write(&mem, 0x003000, 0x12);
+    ASSERT_EQ(memory_read(&mem, 0x003000), 0xFF);
+    ASSERT(memory_io_register(&mem, 0x3000) == NULL);
+    
+    TEST_PASS();
+}
+
+/* Program a DMA channel through $43x0-$43x6 */
+static void dma_write_channel(Memory *mem, u8 channel, u8 control, u8 dest_reg,
+                              u32 src_addr, u16 size) {
+    u16 base = 0x4300 + channel * 16;
+    
+    memory_write(mem, base + 0, control);
+    memory_write(mem, base + 1, dest_reg);
+    memory_write(mem, base + 2, src_addr & 0xFF);
+    memory_write(mem, base + 3, (src_addr >> 8) & 0xFF);
+    memory_write(mem, base + 4, (src_addr >> 16) & 0xFF);
+    memory_write(mem, base + 5, size & 0xFF);
+    memory_write(mem, base + 6, size >> 8);
+}
+
+/* Test DMA block transfers into VRAM, CGRAM and OAM */
+void test_memory_dma_block(void) {
+    TEST("DMA block transfers");
+    
+    static Memory mem;
+    static PPU ppu;
+    u64 clock = 0;
+    u32 generation;
+    bool match = true;
+    int i;
+    
+    memory_init(&mem);
+    ppu_init(&ppu);
+    ppu_set_memory(&ppu, mem.vram, mem.cgram, mem.oam);
+    memory_set_ppu(&mem, &ppu);
+    memory_set_cpu_clock(&mem, &clock);
+    
+    /* Source crosses a host page ($7E:2000), destination wraps VRAM */
+    for (i = 0; i < 0x400; i++) {
+        mem.wram[0x1F00 + i] = (u8)(i * 7 + 3);
+    }
+    memory_write(&mem, 0x2115, 0x80);  /* VMAIN: +1 word after high byte */
+    memory_write(&mem, 0x2116, 0x00);
+    memory_write(&mem, 0x2117, 0x7F);
+    dma_write_channel(&mem, 0, 0x01, 0x18, 0x7E1F00, 0x400);
+    memory_write(&mem, 0x420B, 0x01);
+    
+    for (i = 0; i < 0x400 && match; i++) {
+        match = mem.vram[(0xFE00 + i) & 0xFFFF] == (u8)(i * 7 + 3);
+    }
+    ASSERT(match);
+    ASSERT_EQ(ppu.vram_addr & 0x7FFF, 0x0100);
+    ASSERT_EQ(clock, DMA_CYCLES_PER_CHANNEL + 0x400 * DMA_CYCLES_PER_BYTE);
+    ASSERT(!mem.dma[0].enabled);
+    ASSERT_EQ(memory_read(&mem, 0x4305), 0x00);
+    ASSERT_EQ(mem.dma[0].src_addr, 0x2300);
+    
+    /* Uploading identical data leaves the frame unchanged */
+    generation = ppu.mem_generation;
+    memory_write(&mem, 0x2116, 0x00);
+    memory_write(&mem, 0x2117, 0x7F);
+    dma_write_channel(&mem, 0, 0x01, 0x18, 0x7E1F00, 0x400);
+    memory_write(&mem, 0x420B, 0x01);
+    ASSERT_EQ(ppu.mem_generation, generation);
+    
+    /* Column upload (+32 words) */
+    memory_write(&mem, 0x2115, 0x81);
+    memory_write(&mem, 0x2116, 0x00);
+    memory_write(&mem, 0x2117, 0x10);
+    dma_write_channel(&mem, 1, 0x01, 0x18, 0x7E1F00, 0x40);
+    memory_write(&mem, 0x420B, 0x02);
+    for (i = 0; i < 0x20 && match; i++) {
+        match = mem.vram[0x2000 + i * 64] == mem.wram[0x1F00 + i * 2] &&
+                mem.vram[0x2001 + i * 64] == mem.wram[0x1F01 + i * 2];
+    }
+    ASSERT(match);
+    ASSERT_EQ(ppu.vram_addr, 0x1000 + 0x20 * 32);
+    
+    /* Fixed source fill */
+    mem.wram[0x0100] = 0xAA;
+    memory_write(&mem, 0x2115, 0x80);
+    memory_write(&mem, 0x2116, 0x00);
+    memory_write(&mem, 0x2117, 0x30);
+    dma_write_channel(&mem, 2, 0x09, 0x18, 0x7E0100, 0x100);
+    memory_write(&mem, 0x420B, 0x04);
+    for (i = 0; i < 0x100 && match; i++) {
+        match = mem.vram[0x6000 + i] == 0xAA;
+    }
+    ASSERT(match);
+    
+    /* Palette upload through CGDATA updates the converted colors */
+    memory_write(&mem, 0x2121, 0x00);
+    dma_write_channel(&mem, 3, 0x00, 0x22, 0x7E1F00, 0x20);
+    memory_write(&mem, 0x420B, 0x08);
+    for (i = 0; i < 0x20 && match; i++) {
+        match = mem.cgram[i] == (mem.wram[0x1F00 + i] & ((i & 1) ? 0x7F : 0xFF));
+    }
+    ASSERT(match);
+    ASSERT_EQ(ppu.cgram_addr, 0x10);
+    
+    /* Full OAM upload */
+    memory_write(&mem, 0x2102, 0x00);
+    memory_write(&mem, 0x2103, 0x00);
+    dma_write_channel(&mem, 4, 0x00, 0x04, 0x7E2000, OAM_SIZE);
+    memory_write(&mem, 0x420B, 0x10);
+    ASSERT(memcmp(mem.oam, &mem.wram[0x2000], OAM_SIZE) == 0);
+    ASSERT(ppu.obj_dirty);
+    
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Start an HDMA frame and replay lines, recording WH0 after each one */
+static void hdma_frame(Memory *mem, const PPU *ppu, u8 *wh0, int lines) {
+    int i;
+    
+    for (i = 0; i < 8; i++) {
+        memory_hdma_init(mem, i);
+    }
+    for (i = 0; i < lines; i++) {
+        memory_hdma_run(mem);
+        wh0[i] = ppu->window_pos[0];
+    }
+}
+
+/* Test compiled HDMA tables */
+void test_memory_hdma_tables(void) {
+    TEST("HDMA table replay");
+    
+    static Memory mem;
+    static PPU ppu;
+    static const u8 table[] = {0x03, 0x10, 0x82, 0x20, 0x21, 0x01, 0x30, 0x00};
+    static const u8 indirect[] = {0x02, 0x00, 0x03, 0x00};
+    static const u8 expected[8] = {0x10, 0x10, 0x10, 0x20, 0x21, 0x30, 0x30, 0x30};
+    u8 wh0[8];
+    int i;
+    
+    memory_init(&mem);
+    ppu_init(&ppu);
+    ppu_set_memory(&ppu, mem.vram, mem.cgram, mem.oam);
+    memory_set_ppu(&mem, &ppu);
+    
+    /* Channel 0: direct, mode 0 -> WH0; channel 1: indirect, mode 1 -> WH2/WH3 */
+    memcpy(&mem.wram[0x0100], table, sizeof(table));
+    memcpy(&mem.wram[0x0200], indirect, sizeof(indirect));
+    mem.wram[0x0300] = 0x55;
+    mem.wram[0x0301] = 0x66;
+    dma_write_channel(&mem, 0, 0x00, 0x26, 0x7E0100, 0);
+    dma_write_channel(&mem, 1, 0x41, 0x28, 0x7E0200, 0);
+    memory_write(&mem, 0x4317, 0x7E);
+    memory_write(&mem, 0x420C, 0x03);
+    
+    hdma_frame(&mem, &ppu, wh0, 8);
+    ASSERT(memcmp(wh0, expected, sizeof(expected)) == 0);
+    ASSERT_EQ(ppu.window_pos[2], 0x55);
+    ASSERT_EQ(ppu.window_pos[3], 0x66);
+    
+    /* The compiled program is replayed again next frame */
+    memset(wh0, 0, sizeof(wh0));
+    ppu.window_pos[2] = 0;
+    hdma_frame(&mem, &ppu, wh0, 8);
+    ASSERT(memcmp(wh0, expected, sizeof(expected)) == 0);
+    ASSERT_EQ(ppu.window_pos[2], 0x55);
+    
+    /* Writing a table entry mid-frame affects the lines still to come */
+    hdma_frame(&mem, &ppu, wh0, 3);
+    memory_write(&mem, 0x7E0104, 0x44);
+    for (i = 3; i < 8; i++) {
+        memory_hdma_run(&mem);
+        wh0[i] = ppu.window_pos[0];
+    }
+    ASSERT_EQ(wh0[3], 0x20);
+    ASSERT_EQ(wh0[4], 0x44);
+    ASSERT_EQ(wh0[5], 0x30);
     
-    mem.io_registers[0x2105] = 0x01;  /* BGMODE */
-    ASSERT_EQ(mem.io_registers[0x2105], 0x01);
+    /* Disabling the channels stops the writes from the next frame */
+    memory_write(&mem, 0x420C, 0x00);
+    ppu.window_pos[0] = 0;
+    hdma_frame(&mem, &ppu, wh0, 8);
+    ASSERT_EQ(wh0[7], 0x00);
     
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test only the bytes HDMA was compiled from invalidate it */
+void test_memory_hdma_watch(void) {
+    TEST("HDMA table write watch");
+    
+    static Memory mem;
+    static PPU ppu;
+    static const u8 table[] = {0x03, 0x10, 0x82, 0x20, 0x21, 0x01, 0x30, 0x00};
+    u8 wh0[8];
+    u32 generation;
+    
+    memory_init(&mem);
+    ppu_init(&ppu);
+    ppu_set_memory(&ppu, mem.vram, mem.cgram, mem.oam);
+    memory_set_ppu(&mem, &ppu);
+    
+    memcpy(&mem.wram[0x0100], table, sizeof(table));
+    dma_write_channel(&mem, 0, 0x00, 0x26, 0x7E0100, 0);
+    memory_write(&mem, 0x420C, 0x01);
+    hdma_frame(&mem, &ppu, wh0, 8);
+    generation = mem.hdma_generation;
+    
+    /* Variables next to the table, in the same span or page, are ignored */
+    memory_write(&mem, 0x7E0108, 0x11);
+    memory_write(&mem, 0x7E0120, 0x22);
+    memory_write(&mem, 0x0000F0, 0x33);
+    ASSERT(mem.hdma_generation == generation);
+    ASSERT(mem.watch_spans[0x0100 >> MEMORY_WATCH_SPAN_SHIFT] & MEMORY_WATCH_HDMA);
+    
+    /* A table byte for an earlier line changes the next frame in full */
+    hdma_frame(&mem, &ppu, wh0, 3);
+    memory_write(&mem, 0x7E0101, 0x77);
+    ASSERT(mem.hdma_generation != generation);
+    memory_hdma_run(&mem);
+    ASSERT_EQ(ppu.window_pos[0], 0x20);
+    hdma_frame(&mem, &ppu, wh0, 8);
+    ASSERT_EQ(wh0[0], 0x77);
+    ASSERT_EQ(wh0[3], 0x20);
+    
+    /* The recompiled program watches the table again */
+    generation = mem.hdma_generation;
+    memory_write(&mem, 0x7E0120, 0x44);
+    ASSERT(mem.hdma_generation == generation);
+    memory_write(&mem, 0x7E0106, 0x31);
+    ASSERT(mem.hdma_generation != generation);
+    
+    ppu_cleanup(&ppu);
     TEST_PASS();
 }
 
@@ -327,6 +607,10 @@ void test_memory_suite(void) {
     test_memory_dma_channels();
     test_memory_hdma_setup();
     test_memory_cartridge_attach();
+    test_memory_page_table();
     test_memory_io_registers();
+    test_memory_dma_block();
+    test_memory_hdma_tables();
+    test_memory_hdma_watch();
     test_memory_size_constants();
 }
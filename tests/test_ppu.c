@@ -0,0 +1,825 @@
+/*
+ * test_ppu.c - PPU tests
+ *
+ * Tests for VRAM access, the decoded tile cache, background and sprite rendering
+ */
+
+#include "test_framework.h"
+#include "../include/ppu.h"
+#include "../include/memory.h"
+#include <string.h>
+
+/* Write a VRAM word through $2116-$2119 */
+static void vram_write_word(Memory *mem, u16 word_addr, u16 value) {
+    memory_write(mem, PPU_VMADDL, word_addr & 0xFF);
+    memory_write(mem, PPU_VMADDH, word_addr >> 8);
+    memory_write(mem, PPU_VMDATAL, value & 0xFF);
+    memory_write(mem, PPU_VMDATAH, value >> 8);
+}
+
+/* Test VRAM port addressing and increment modes */
+void test_ppu_vram_port(void) {
+    TEST("PPU VRAM data port");
+
+    static Memory mem;
+    static PPU ppu;
+    memory_init(&mem);
+    ppu_init(&ppu);
+    ppu_set_memory(&ppu, mem.vram, mem.cgram, mem.oam);
+    memory_set_ppu(&mem, &ppu);
+
+    /* Increment by 1 word after the high byte */
+    memory_write(&mem, PPU_VMAIN, 0x80);
+    vram_write_word(&mem, 0x1000, 0xBEEF);
+    ASSERT_EQ(mem.vram[0x2000], 0xEF);
+    ASSERT_EQ(mem.vram[0x2001], 0xBE);
+    ASSERT_EQ(ppu.vram_addr, 0x1001);
+
+    /* Increment by 32 after the low byte */
+    memory_write(&mem, PPU_VMAIN, 0x01);
+    memory_write(&mem, PPU_VMADDL, 0x00);
+    memory_write(&mem, PPU_VMADDH, 0x10);
+    memory_write(&mem, PPU_VMDATAL, 0x42);
+    ASSERT_EQ(ppu.vram_addr, 0x1020);
+
+    /* Reads come back through $2139/$213A */
+    memory_write(&mem, PPU_VMAIN, 0x80);
+    memory_write(&mem, PPU_VMADDL, 0x00);
+    memory_write(&mem, PPU_VMADDH, 0x10);
+    ASSERT_EQ(memory_read(&mem, 0x2139), 0x42);
+    ASSERT_EQ(memory_read(&mem, 0x213A), 0xBE);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test planar tiles decode to one color index per pixel */
+void test_ppu_tile_decode(void) {
+    TEST("PPU tile decode");
+
+    static Memory mem;
+    static PPU ppu;
+    const u8 *tile;
+    memory_init(&mem);
+    ppu_init(&ppu);
+    ppu_set_memory(&ppu, mem.vram, mem.cgram, mem.oam);
+
+    /* 2bpp tile 1, row 0: plane 0 = 10000001, plane 1 = 11000000 */
+    mem.vram[16] = 0x81;
+    mem.vram[17] = 0xC0;
+    tile = ppu_get_tile(&ppu, 2, 1);
+    ASSERT_EQ(tile[0], 3);
+    ASSERT_EQ(tile[1], 2);
+    ASSERT_EQ(tile[2], 0);
+    ASSERT_EQ(tile[7], 1);
+
+    /* 4bpp tile 2, row 1: planes 2/3 live 16 bytes after planes 0/1 */
+    mem.vram[64 + 2] = 0x80;
+    mem.vram[64 + 16 + 3] = 0x80;
+    ppu_invalidate_vram(&ppu, 0, 128);
+    tile = ppu_get_tile(&ppu, 4, 2);
+    ASSERT_EQ(tile[8], 0x09);
+    ASSERT_EQ(tile[9], 0);
+
+    /* 8bpp tile 0 adds planes 4-7 at offsets 32 and 48 (row 0 has planes 2/3 set above) */
+    mem.vram[32] = 0x01;
+    mem.vram[49] = 0x01;
+    ppu_invalidate_vram(&ppu, 32, 18);
+    tile = ppu_get_tile(&ppu, 8, 0);
+    ASSERT_EQ(tile[7], 0x80 | 0x10 | 0x04);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test that VRAM writes refresh cached tiles */
+void test_ppu_tile_cache_invalidation(void) {
+    TEST("PPU tile cache invalidation");
+
+    static Memory mem;
+    static PPU ppu;
+    memory_init(&mem);
+    ppu_init(&ppu);
+    ppu_set_memory(&ppu, mem.vram, mem.cgram, mem.oam);
+    memory_set_ppu(&mem, &ppu);
+    memory_write(&mem, PPU_VMAIN, 0x80);
+
+    /* Warm the cache with an empty tile */
+    ASSERT_EQ(ppu_get_tile(&ppu, 2, 0)[0], 0);
+    ASSERT_EQ(ppu_get_tile(&ppu, 4, 0)[0], 0);
+
+    /* Register write: row 0 plane 0 of tile 0 */
+    vram_write_word(&mem, 0x0000, 0x0080);
+    ASSERT_EQ(ppu_get_tile(&ppu, 2, 0)[0], 1);
+    ASSERT_EQ(ppu_get_tile(&ppu, 4, 0)[0], 1);
+
+    /* DMA (mode 1 to $2118/$2119): row 1 of tile 0 */
+    mem.wram[0x0100] = 0x00;
+    mem.wram[0x0101] = 0x80;
+    memory_write(&mem, PPU_VMADDL, 0x01);
+    memory_write(&mem, PPU_VMADDH, 0x00);
+    memory_dma_setup(&mem, 0, 0x01, 0x18, 0x7E0100, 2);
+    memory_dma_trigger(&mem, 0x01);
+    ASSERT_EQ(ppu_get_tile(&ppu, 2, 0)[8], 2);
+
+    /* Direct edit reported through the memory system */
+    mem.vram[4] = 0x80;
+    memory_vram_written(&mem, 4, 1);
+    ASSERT_EQ(ppu_get_tile(&ppu, 2, 0)[16], 1);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test palette cache follows CGRAM writes and brightness */
+void test_ppu_palette_cache(void) {
+    TEST("PPU palette cache");
+
+    static Memory mem;
+    static PPU ppu;
+    memory_init(&mem);
+    ppu_init(&ppu);
+    ppu_set_memory(&ppu, mem.vram, mem.cgram, mem.oam);
+    memory_set_ppu(&mem, &ppu);
+
+    /* $2122 write: color 1 = white (0x7FFF) */
+    memory_write(&mem, PPU_CGADD, 1);
+    memory_write(&mem, PPU_CGDATA, 0xFF);
+    memory_write(&mem, PPU_CGDATA, 0x7F);
+    ASSERT(ppu.palette[1] == 0xFFF8F8F8);
+    ASSERT(ppu_get_color(&ppu, 1) == 0xFFF8F8F8);
+
+    /* Brightness 5/15 scales the displayed color only */
+    memory_write(&mem, PPU_INIDISP, 0x05);
+    ASSERT(ppu.palette[1] == 0xFFF8F8F8);
+    ASSERT(ppu_get_color(&ppu, 1) == 0xFF525252);
+
+    /* DMA to $2122: color 2 = pure green (0x03E0) */
+    mem.wram[0x0100] = 0xE0;
+    mem.wram[0x0101] = 0x03;
+    memory_write(&mem, PPU_CGADD, 2);
+    memory_dma_setup(&mem, 0, 0x00, 0x22, 0x7E0100, 2);
+    memory_dma_trigger(&mem, 0x01);
+    ASSERT(ppu.palette[2] == 0xFF00F800);
+
+    /* Direct edit reported through the memory system: color 3 = red */
+    mem.cgram[6] = 0x1F;
+    memory_cgram_written(&mem, 6, 2);
+    memory_write(&mem, PPU_INIDISP, 0x0F);
+    ASSERT(ppu_get_color(&ppu, 3) == 0xFF0000F8);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test a scrolled background line drawn from cached tiles */
+void test_ppu_render_background(void) {
+    TEST("PPU background rendering");
+
+    static Memory mem;
+    static PPU ppu;
+    u32 expected;
+    memory_init(&mem);
+    ppu_init(&ppu);
+    ppu_set_memory(&ppu, mem.vram, mem.cgram, mem.oam);
+    memory_set_ppu(&mem, &ppu);
+
+    /* Mode 1, BG1 map at word $0400, characters at word $1000 */
+    memory_write(&mem, PPU_BGMODE, 0x01);
+    memory_write(&mem, PPU_TM, 0x01);
+    memory_write(&mem, PPU_BG1SC, 0x04);
+    memory_write(&mem, PPU_BG12NBA, 0x01);
+    ASSERT_EQ(ppu.bg[0].tilemap_addr, 0x0800);
+    ASSERT_EQ(ppu.bg[0].chr_addr, 0x2000);
+
+    /* Map entry (1,0) -> tile 1, palette 2, horizontally flipped */
+    memory_write(&mem, PPU_VMAIN, 0x80);
+    vram_write_word(&mem, 0x0401, 0x4801);
+
+    /* 4bpp tile 1 (word $1010), row 0: leftmost pixel color 1 */
+    vram_write_word(&mem, 0x1010, 0x0080);
+
+    /* CGRAM color 33 (palette 2, color 1) = pure red */
+    memory_write(&mem, PPU_CGADD, 33);
+    memory_write(&mem, PPU_CGDATA, 0x1F);
+    memory_write(&mem, PPU_CGDATA, 0x00);
+    expected = ppu_get_color(&ppu, 33);
+
+    /* Scroll 4 pixels right: the flipped pixel lands at x = 15 - 4 */
+    memory_write(&mem, PPU_BG1HOFS, 4);
+    memory_write(&mem, PPU_BG1HOFS, 0);
+    ppu.vcount = 0;
+    ppu_render_scanline(&ppu);
+    ASSERT(ppu.framebuffer[11] == expected);
+    ASSERT(ppu.framebuffer[12] != expected);
+    ASSERT(ppu.framebuffer[4] != expected);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Set up a PPU whose layer line buffers are filled by hand */
+static void compose_setup(Memory *mem, PPU *ppu) {
+    int i;
+
+    memory_init(mem);
+    ppu_init(ppu);
+    ppu_set_memory(ppu, mem->vram, mem->cgram, mem->oam);
+    memory_set_ppu(mem, ppu);
+    memory_write(mem, PPU_BGMODE, 0x01);
+    memory_write(mem, PPU_TM, 0x13);
+
+    /* CGRAM entry i = 15-bit color i */
+    for (i = 0; i < 256; i++) {
+        mem->cgram[i * 2] = i & 0xFF;
+        mem->cgram[i * 2 + 1] = 0;
+    }
+    memory_cgram_written(mem, 0, CGRAM_SIZE);
+
+    for (i = 0; i < PPU_LAYER_COUNT; i++) {
+        memset(ppu->layer_buffer[i], 0, SCREEN_WIDTH * sizeof(u16));
+    }
+    ppu->vcount = 0;
+}
+
+/* Line buffer entry as produced by the renderers */
+static u16 layer_entry(u8 rank, u8 layer, u8 index) {
+    return (u16)((((rank << 3) | layer) << 8) | index);
+}
+
+/* Test mode 1 priority ordering in the compositor */
+void test_ppu_compose_priority(void) {
+    TEST("PPU compositor priority");
+
+    static Memory mem;
+    static PPU ppu;
+    compose_setup(&mem, &ppu);
+
+    /* x=0: BG1 low (6) vs BG2 high (8) -> BG2 */
+    ppu.layer_buffer[0][0] = layer_entry(6, 0, 10);
+    ppu.layer_buffer[1][0] = layer_entry(8, 1, 20);
+    /* x=1: BG1 high (9) vs OBJ priority 2 (7) -> BG1 */
+    ppu.layer_buffer[0][1] = layer_entry(9, 0, 11);
+    ppu.layer_buffer[4][1] = layer_entry(7, 4, 130);
+    /* x=2: BG3 is not on the main screen (TM bit 2 clear) -> backdrop */
+    ppu.layer_buffer[2][2] = layer_entry(3, 2, 12);
+
+    ppu_compose_scanline(&ppu);
+    ASSERT(ppu.framebuffer[0] == ppu_get_color(&ppu, 20));
+    ASSERT(ppu.framebuffer[1] == ppu_get_color(&ppu, 11));
+    ASSERT(ppu.framebuffer[2] == ppu_get_color(&ppu, 0));
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test the SIMD merge matches the scalar one */
+void test_ppu_compose_simd(void) {
+    TEST("PPU compositor SIMD matches scalar");
+
+    static Memory mem;
+    static PPU ppu;
+    static u32 expected[SCREEN_WIDTH];
+    u32 seed = 12345;
+    u8 fastest;
+    int i, x;
+    compose_setup(&mem, &ppu);
+    memory_write(&mem, PPU_TM, 0x1F);
+
+    /* Window 1 hides BG2 between x=40 and x=200 */
+    memory_write(&mem, PPU_W12SEL, 0x20);
+    memory_write(&mem, PPU_WH0, 40);
+    memory_write(&mem, PPU_WH0 + 1, 200);
+    memory_write(&mem, PPU_TMW, 0x02);
+
+    for (i = 0; i < PPU_LAYER_COUNT; i++) {
+        for (x = 0; x < SCREEN_WIDTH; x++) {
+            seed = seed * 1103515245 + 12345;
+            if ((seed >> 16) & 1) {
+                ppu.layer_buffer[i][x] = layer_entry((seed >> 20) & 0x0F, i, (seed >> 8) & 0xFF);
+            }
+        }
+    }
+
+    fastest = ppu.compose_path;
+    ppu.compose_path = PPU_COMPOSE_SCALAR;
+    ppu_compose_scanline(&ppu);
+    memcpy(expected, ppu.framebuffer, sizeof(expected));
+
+    for (i = PPU_COMPOSE_SSE2; i <= fastest; i++) {
+        ppu.compose_path = i;
+        memset(ppu.framebuffer, 0, SCREEN_WIDTH * sizeof(u32));
+        ppu_compose_scanline(&ppu);
+        ASSERT(memcmp(expected, ppu.framebuffer, sizeof(expected)) == 0);
+    }
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test windows and fixed-color math */
+void test_ppu_compose_color_math(void) {
+    TEST("PPU compositor windows and color math");
+
+    static Memory mem;
+    static PPU ppu;
+    compose_setup(&mem, &ppu);
+
+    /* BG1 pixel at x=0 and x=10, color 0x10 (red 16) */
+    ppu.layer_buffer[0][0] = layer_entry(6, 0, 0x10);
+    ppu.layer_buffer[0][10] = layer_entry(6, 0, 0x10);
+
+    /* Window 1 over x=5-15 masks BG1 on the main screen */
+    memory_write(&mem, PPU_W12SEL, 0x02);
+    memory_write(&mem, PPU_WH0, 5);
+    memory_write(&mem, PPU_WH0 + 1, 15);
+    memory_write(&mem, PPU_TMW, 0x01);
+
+    /* Add fixed red 8, halved, on BG1 */
+    memory_write(&mem, PPU_COLDATA, 0x20 | 0x08);
+    memory_write(&mem, PPU_CGADSUB, 0x41);
+
+    ppu_compose_scanline(&ppu);
+    /* (16 + 8) / 2 = 12 -> 12 << 3 */
+    ASSERT(ppu.framebuffer[0] == 0xFF000060);
+    /* Masked pixel shows the (unaffected) backdrop */
+    ASSERT(ppu.framebuffer[10] == ppu_get_color(&ppu, 0));
+
+    /* Subtract with clip-to-black everywhere leaves black */
+    memory_write(&mem, PPU_CGADSUB, 0x81);
+    memory_write(&mem, PPU_CGWSEL, 0xC0);
+    ppu_compose_scanline(&ppu);
+    ASSERT(ppu.framebuffer[0] == 0xFF000000);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test the Mode 7 start vector and screen over modes */
+void test_ppu_render_mode7(void) {
+    TEST("PPU Mode 7 rendering");
+
+    static Memory mem;
+    static PPU ppu;
+    u16 *buffer;
+    compose_setup(&mem, &ppu);
+    memory_write(&mem, PPU_BGMODE, 0x07);
+    buffer = ppu.layer_buffer[0];
+
+    /* Map (0,0) is tile 2, whose top-left pixel is color 5 */
+    mem.vram[0] = 2;
+    mem.vram[2 * 64] = 5;
+    memory_vram_written(&mem, 0, VRAM_SIZE);
+
+    /* Identity matrix: line 112, x=128 is world (0,0) */
+    ppu.vcount = 112;
+    ppu_render_mode7(&ppu);
+    ASSERT_EQ(buffer[128] & 0xFF, 5);
+    ASSERT_EQ(buffer[127], 0);
+
+    /* Screen over 3: outside the plane shows tile 0 (pixel 7,0 = color 9) */
+    mem.vram[7] = 9;
+    memory_write(&mem, PPU_M7SEL, 0xC0);
+    ASSERT_EQ(ppu.m7_repeat, 3);
+    memset(buffer, 0, SCREEN_WIDTH * sizeof(u16));
+    ppu_render_mode7(&ppu);
+    ASSERT_EQ(buffer[127] & 0xFF, 9);
+
+    /* Screen over 2: outside the plane is transparent */
+    memory_write(&mem, PPU_M7SEL, 0x80);
+    memset(buffer, 0, SCREEN_WIDTH * sizeof(u16));
+    ppu_render_mode7(&ppu);
+    ASSERT_EQ(buffer[127], 0);
+    ASSERT_EQ(buffer[128] & 0xFF, 5);
+
+    /* Horizontal flip mirrors the line */
+    memory_write(&mem, PPU_M7SEL, 0x81);
+    memset(buffer, 0, SCREEN_WIDTH * sizeof(u16));
+    ppu_render_mode7(&ppu);
+    ASSERT_EQ(buffer[127] & 0xFF, 5);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test the AVX2 Mode 7 rasterizer matches the scalar loops */
+void test_ppu_mode7_simd(void) {
+    TEST("PPU Mode 7 SIMD matches scalar");
+
+    static Memory mem;
+    static PPU ppu;
+    static u16 expected[SCREEN_WIDTH];
+    u32 seed = 777;
+    u8 fastest;
+    int i, sel, line;
+    compose_setup(&mem, &ppu);
+    memory_write(&mem, PPU_BGMODE, 0x07);
+
+    for (i = 0; i < VRAM_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        mem.vram[i] = (seed >> 16) & 0xFF;
+    }
+
+    /* Rotated, scaled plane partly outside the 1024x1024 area */
+    ppu.m7_matrix_a = 0x00B5;
+    ppu.m7_matrix_b = -0x0140;
+    ppu.m7_matrix_c = 0x00B5;
+    ppu.m7_matrix_d = 0x0090;
+    ppu.m7_center_x = 900;
+    ppu.m7_center_y = -40;
+
+    fastest = ppu.compose_path;
+    for (sel = 0; sel < 4; sel++) {
+        /* Each screen over mode, with both flips on the odd ones */
+        memory_write(&mem, PPU_M7SEL, (sel << 6) | ((sel & 1) ? 0x03 : 0x00));
+        for (line = 0; line < SCREEN_HEIGHT; line += 37) {
+            ppu.vcount = line;
+            ppu.compose_path = PPU_COMPOSE_SCALAR;
+            memset(ppu.layer_buffer[0], 0, SCREEN_WIDTH * sizeof(u16));
+            ppu_render_mode7(&ppu);
+            memcpy(expected, ppu.layer_buffer[0], sizeof(expected));
+
+            ppu.compose_path = fastest;
+            memset(ppu.layer_buffer[0], 0, SCREEN_WIDTH * sizeof(u16));
+            ppu_render_mode7(&ppu);
+            ASSERT(memcmp(expected, ppu.layer_buffer[0], sizeof(expected)) == 0);
+        }
+    }
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Write one sprite's low table entry through $2102-$2104 */
+static void oam_write_sprite(Memory *mem, u8 index, u8 x, u8 y, u8 tile, u8 attr) {
+    memory_write(mem, PPU_OAMADDL, index * 2);
+    memory_write(mem, PPU_OAMADDH, 0x00);
+    memory_write(mem, PPU_OAMDATA, x);
+    memory_write(mem, PPU_OAMDATA, y);
+    memory_write(mem, PPU_OAMDATA, tile);
+    memory_write(mem, PPU_OAMDATA, attr);
+}
+
+/* Park every sprite below the visible area */
+static void sprite_setup(Memory *mem, PPU *ppu) {
+    int i;
+
+    memory_init(mem);
+    ppu_init(ppu);
+    ppu_set_memory(ppu, mem->vram, mem->cgram, mem->oam);
+    memory_set_ppu(mem, ppu);
+    for (i = 0; i < 128; i++) {
+        oam_write_sprite(mem, i, 0, 240, 0, 0);
+    }
+}
+
+/* Test OAM is unpacked into per-scanline sprite lists */
+void test_ppu_sprite_evaluation(void) {
+    TEST("PPU sprite evaluation");
+
+    static Memory mem;
+    static PPU ppu;
+    sprite_setup(&mem, &ppu);
+
+    /* Sprite 0: 8x8 at (10, 20), tile $101, palette 3, priority 2 */
+    oam_write_sprite(&mem, 0, 10, 20, 0x01, 0x31 | 0x06);
+    /* Sprite 1: large (16x16 with OBSEL size 0) at x = -4 via the high table */
+    oam_write_sprite(&mem, 1, 0xFC, 30, 0x02, 0x00);
+    memory_write(&mem, PPU_OAMADDL, 0x00);
+    memory_write(&mem, PPU_OAMADDH, 0x01);
+    memory_write(&mem, PPU_OAMDATA, 0x0C);
+
+    ppu_evaluate_sprites(&ppu);
+    ASSERT_EQ(ppu.oam_sprites[0].x, 10);
+    ASSERT_EQ(ppu.oam_sprites[0].tile, 0x101);
+    ASSERT_EQ(ppu.oam_sprites[0].palette, 3);
+    ASSERT_EQ(ppu.oam_sprites[0].priority, 3);
+    ASSERT_EQ(ppu.oam_sprites[1].x, -4);
+    ASSERT_EQ(ppu.oam_sprites[1].width, 16);
+    ASSERT_EQ(ppu.obj_line_count[20], 1);
+    ASSERT_EQ(ppu.obj_line_count[28], 0);
+    ASSERT_EQ(ppu.obj_line_count[45], 1);
+    ASSERT_EQ(ppu.obj_lines[45][0], 1);
+    ASSERT(!ppu.obj_dirty);
+
+    /* OAM writes and OBSEL mark the lists stale; OBSEL 1 makes small 8x8, large 32x32 */
+    memory_write(&mem, PPU_OBSEL, 0x20);
+    ASSERT(ppu.obj_dirty);
+    ppu_evaluate_sprites(&ppu);
+    ASSERT_EQ(ppu.obj_line_count[61], 1);
+    ASSERT_EQ(ppu.obj_line_count[62], 0);
+    ASSERT_EQ(ppu.obj_status, 0);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test the 32 sprite and 34 tile per line limits */
+void test_ppu_sprite_limits(void) {
+    TEST("PPU sprite range and time limits");
+
+    static Memory mem;
+    static PPU ppu;
+    int i;
+    sprite_setup(&mem, &ppu);
+
+    /* 40 8x8 sprites on line 100: only sprites 0-31 are in range */
+    for (i = 0; i < 40; i++) {
+        oam_write_sprite(&mem, i, i * 4, 100, 0, 0);
+    }
+    ppu_evaluate_sprites(&ppu);
+    ASSERT_EQ(ppu.obj_line_count[100], PPU_OBJ_PER_LINE);
+    ASSERT_EQ(ppu.obj_lines[100][0], 0);
+    ASSERT_EQ(ppu.obj_lines[100][31], 31);
+    ASSERT_EQ(ppu.obj_status, PPU_OBJ_RANGE_OVER);
+    ASSERT_EQ(memory_read(&mem, 0x213E), PPU_OBJ_RANGE_OVER | 0x01);
+
+    /* Priority rotation starts the search at sprite 8 */
+    memory_write(&mem, PPU_OAMADDL, 8 * 2);
+    memory_write(&mem, PPU_OAMADDH, 0x80);
+    ppu_evaluate_sprites(&ppu);
+    ASSERT_EQ(ppu.obj_lines[100][0], 8);
+    ASSERT_EQ(ppu.obj_lines[100][31], 39);
+
+    /* 20 16x16 sprites need 40 tiles: the first three are dropped */
+    sprite_setup(&mem, &ppu);
+    memory_write(&mem, PPU_OBSEL, 0x60);
+    for (i = 0; i < 20; i++) {
+        oam_write_sprite(&mem, i, i * 8, 50, 0, 0);
+    }
+    ppu_evaluate_sprites(&ppu);
+    ASSERT_EQ(ppu.obj_line_count[50], 17);
+    ASSERT_EQ(ppu.obj_lines[50][0], 3);
+    ASSERT_EQ(ppu.obj_status, PPU_OBJ_TIME_OVER);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test a 16x16 sprite is drawn from 4bpp tiles into the OBJ line buffer */
+void test_ppu_render_sprites(void) {
+    TEST("PPU sprite rendering");
+
+    static Memory mem;
+    static PPU ppu;
+    int row;
+    sprite_setup(&mem, &ppu);
+    memory_write(&mem, PPU_OBSEL, 0x60);  /* 16x16 small, name base 0 */
+
+    /* Tile $11 (below-right of tile 0 in the 16x16 grid): rows of color 5 */
+    memory_write(&mem, PPU_VMAIN, 0x80);
+    for (row = 0; row < 8; row++) {
+        vram_write_word(&mem, 0x11 * 16 + row, 0x00FF);      /* planes 0-1 */
+        vram_write_word(&mem, 0x11 * 16 + 8 + row, 0x00FF);  /* planes 2-3 */
+    }
+    /* Sprite 0 at (40, 60), palette 2, priority 1, horizontally flipped */
+    oam_write_sprite(&mem, 0, 40, 60, 0x00, 0x40 | 0x10 | 0x04);
+
+    ppu.vcount = 70;
+    memset(ppu.layer_buffer[PPU_LAYER_OBJ], 0, SCREEN_WIDTH * sizeof(u16));
+    ppu_render_sprites(&ppu);
+
+    /* Flipped: tile $11 lands in the left half */
+    ASSERT_EQ(ppu.layer_buffer[PPU_LAYER_OBJ][40] & 0xFF, 128 + 2 * 16 + 5);
+    ASSERT_EQ(ppu.layer_buffer[PPU_LAYER_OBJ][47] & 0xFF, 128 + 2 * 16 + 5);
+    ASSERT_EQ(ppu.layer_buffer[PPU_LAYER_OBJ][48], 0);
+    ASSERT_EQ(ppu.layer_buffer[PPU_LAYER_OBJ][39], 0);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Fill every row of tile 1 (2bpp) with one plane 0 pattern */
+static void threaded_fill_tile(Memory *mem, u8 pattern) {
+    int row;
+
+    memory_write(mem, PPU_VMADDL, 0x08);
+    memory_write(mem, PPU_VMADDH, 0x00);
+    for (row = 0; row < 8; row++) {
+        memory_write(mem, PPU_VMDATAL, pattern);
+        memory_write(mem, PPU_VMDATAH, 0x00);
+    }
+}
+
+/* Drive one frame with mid-frame VRAM, CGRAM and scroll changes */
+static void threaded_frame_script(Memory *mem, PPU *ppu) {
+    int line;
+
+    for (line = 0; line < SCANLINES_PER_FRAME; line++) {
+        ppu_step_scanline(ppu);
+
+        if (ppu->vcount == 50) {
+            /* Palette 0 color 1 turns blue */
+            memory_write(mem, PPU_CGADD, 1);
+            memory_write(mem, PPU_CGDATA, 0x00);
+            memory_write(mem, PPU_CGDATA, 0x7C);
+        } else if (ppu->vcount == 100) {
+            memory_write(mem, PPU_BG1HOFS, 3);
+            memory_write(mem, PPU_BG1HOFS, 0);
+        } else if (ppu->vcount == 150) {
+            /* Tile 1 becomes solid color 1 */
+            threaded_fill_tile(mem, 0xFF);
+        } else if (ppu->vcount == 230) {
+            /* Restore the frame-start state during VBlank */
+            threaded_fill_tile(mem, 0xAA);
+            memory_write(mem, PPU_BG1HOFS, 0);
+            memory_write(mem, PPU_BG1HOFS, 0);
+            memory_write(mem, PPU_CGADD, 1);
+            memory_write(mem, PPU_CGDATA, 0x1F);
+            memory_write(mem, PPU_CGDATA, 0x00);
+        }
+    }
+}
+
+/* Set up mode 0 BG1 with a checkerboard of tile 1 */
+static void threaded_setup(Memory *mem, PPU *ppu) {
+    int i;
+
+    memory_init(mem);
+    ppu_init(ppu);
+    ppu_set_memory(ppu, mem->vram, mem->cgram, mem->oam);
+    memory_set_ppu(mem, ppu);
+
+    memory_write(mem, PPU_INIDISP, 0x0F);
+    memory_write(mem, PPU_BGMODE, 0x00);
+    memory_write(mem, PPU_TM, 0x01);
+    memory_write(mem, PPU_BG1SC, 0x04);      /* Map at word $0400 */
+    memory_write(mem, PPU_VMAIN, 0x80);
+
+    /* Tile 1 row pattern 10101010 */
+    threaded_fill_tile(mem, 0xAA);
+    for (i = 0; i < 32 * 32; i += 2) {
+        vram_write_word(mem, 0x0400 + i, 0x0001);
+    }
+
+    memory_write(mem, PPU_CGADD, 1);
+    memory_write(mem, PPU_CGDATA, 0x1F);
+    memory_write(mem, PPU_CGDATA, 0x00);
+}
+
+/* Test render threads produce the same frame as inline rendering */
+void test_ppu_render_threads(void) {
+    TEST("PPU threaded rendering matches inline");
+
+    static Memory mem_inline, mem_threaded;
+    static PPU ppu_inline, ppu_threaded;
+
+    threaded_setup(&mem_inline, &ppu_inline);
+    threaded_setup(&mem_threaded, &ppu_threaded);
+    ASSERT_EQ(ppu_start_render_threads(&ppu_threaded, 3), SUCCESS);
+
+    /* Two frames: the second one is drawn while the first is published */
+    threaded_frame_script(&mem_inline, &ppu_inline);
+    threaded_frame_script(&mem_inline, &ppu_inline);
+    threaded_frame_script(&mem_threaded, &ppu_threaded);
+    threaded_frame_script(&mem_threaded, &ppu_threaded);
+    ppu_render_flush(&ppu_threaded);
+
+    ASSERT(memcmp(ppu_inline.framebuffer, ppu_threaded.framebuffer,
+                  SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(u32)) == 0);
+
+    /* Changes really happened mid-frame */
+    ASSERT(ppu_inline.framebuffer[10 * SCREEN_WIDTH + 0] != ppu_inline.framebuffer[60 * SCREEN_WIDTH + 0]);
+    ASSERT(ppu_inline.framebuffer[60 * SCREEN_WIDTH + 0] != ppu_inline.framebuffer[110 * SCREEN_WIDTH + 0]);
+    ASSERT(ppu_inline.framebuffer[110 * SCREEN_WIDTH + 0] != ppu_inline.framebuffer[160 * SCREEN_WIDTH + 0]);
+
+    ppu_cleanup(&ppu_threaded);
+    ASSERT(ppu_threaded.render_pool == NULL);
+    ppu_cleanup(&ppu_inline);
+    TEST_PASS();
+}
+
+/* Step the PPU through one frame with no register or memory changes */
+static void idle_frame(PPU *ppu) {
+    int line;
+
+    for (line = 0; line < SCANLINES_PER_FRAME; line++) {
+        ppu_step_scanline(ppu);
+    }
+}
+
+/* Test unchanged lines are reused and unchanged frames are flagged */
+void test_ppu_unchanged_frames(void) {
+    TEST("PPU unchanged line and frame detection");
+
+    static Memory mem;
+    static PPU ppu;
+    threaded_setup(&mem, &ppu);
+
+    /* Lines 1-223 are drawn in the first call, line 0 after its VBlank */
+    idle_frame(&ppu);
+    ASSERT(!ppu.frame_unchanged);
+    idle_frame(&ppu);
+    ASSERT(!ppu.frame_unchanged);
+    idle_frame(&ppu);
+    ASSERT(ppu.frame_unchanged);
+
+    /* An unchanged line is not drawn again */
+    ppu.framebuffer[50 * SCREEN_WIDTH] = 0x12345678;
+    idle_frame(&ppu);
+    ASSERT(ppu.frame_unchanged);
+    ASSERT(ppu.framebuffer[50 * SCREEN_WIDTH] == 0x12345678);
+
+    /* Rewriting the same color is not a change; a new one redraws */
+    memory_write(&mem, PPU_CGADD, 1);
+    memory_write(&mem, PPU_CGDATA, 0x1F);
+    memory_write(&mem, PPU_CGDATA, 0x00);
+    idle_frame(&ppu);
+    ASSERT(ppu.frame_unchanged);
+    memory_write(&mem, PPU_CGADD, 0);
+    memory_write(&mem, PPU_CGDATA, 0x00);
+    memory_write(&mem, PPU_CGDATA, 0x7C);
+    idle_frame(&ppu);
+    ASSERT(!ppu.frame_unchanged);
+    ASSERT(ppu.framebuffer[50 * SCREEN_WIDTH] != 0x12345678);
+
+    /* Register changes redraw too */
+    memory_write(&mem, PPU_BG1HOFS, 1);
+    memory_write(&mem, PPU_BG1HOFS, 0);
+    idle_frame(&ppu);
+    ASSERT(!ppu.frame_unchanged);
+
+    /* Render threads skip drawing unchanged frames */
+    ASSERT_EQ(ppu_start_render_threads(&ppu, 2), SUCCESS);
+    idle_frame(&ppu);
+    idle_frame(&ppu);
+    ppu_render_flush(&ppu);
+    ASSERT(ppu.frame_unchanged);
+    memory_write(&mem, PPU_BG1HOFS, 2);
+    memory_write(&mem, PPU_BG1HOFS, 0);
+    idle_frame(&ppu);
+    ppu_render_flush(&ppu);
+    ASSERT(!ppu.frame_unchanged);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test render policies skip pixel generation but keep timing */
+void test_ppu_render_policy(void) {
+    TEST("PPU render policy");
+
+    static Memory mem;
+    static PPU ppu;
+    int frame, line;
+    bool saw_vblank = false;
+    threaded_setup(&mem, &ppu);
+
+    /* Never: nothing drawn, VBlank and the frame counter still advance */
+    ppu_set_render_policy(&ppu, PPU_RENDER_NEVER, 0);
+    for (line = 0; line < SCANLINES_PER_FRAME; line++) {
+        ppu_step_scanline(&ppu);
+        saw_vblank |= ppu.vblank;
+    }
+    ASSERT(saw_vblank);
+    ASSERT_EQ(ppu.frame_count, 1);
+    ASSERT(ppu.framebuffer[10 * SCREEN_WIDTH] == 0);
+    ASSERT(ppu.frame_unchanged);
+
+    /* Every 3rd frame */
+    ppu_set_render_policy(&ppu, PPU_RENDER_EVERY_NTH, 3);
+    for (frame = 0; frame < 6; frame++) {
+        idle_frame(&ppu);
+        ASSERT_EQ(ppu.render_enabled, (ppu.frame_count % 3) == 0);
+    }
+    ASSERT(ppu.framebuffer[10 * SCREEN_WIDTH] != 0);
+
+    /* On request: only the requested frame is drawn */
+    ppu_set_render_policy(&ppu, PPU_RENDER_ON_REQUEST, 0);
+    ppu.framebuffer[10 * SCREEN_WIDTH] = 0;
+    memory_write(&mem, PPU_CGADD, 0);
+    memory_write(&mem, PPU_CGDATA, 0x1F);
+    memory_write(&mem, PPU_CGDATA, 0x00);
+    idle_frame(&ppu);
+    ASSERT(ppu.framebuffer[10 * SCREEN_WIDTH] == 0);
+    ppu_request_frame(&ppu);
+    ASSERT(ppu.render_enabled);
+    idle_frame(&ppu);
+    ASSERT(ppu.framebuffer[10 * SCREEN_WIDTH] != 0);
+    ASSERT(!ppu.render_enabled);
+
+    ppu_cleanup(&ppu);
+    TEST_PASS();
+}
+
+/* Test suite runner */
+void test_ppu_suite(void) {
+    TEST_SUITE("PPU Module");
+
+    test_ppu_vram_port();
+    test_ppu_tile_decode();
+    test_ppu_tile_cache_invalidation();
+    test_ppu_palette_cache();
+    test_ppu_render_background();
+    test_ppu_compose_priority();
+    test_ppu_compose_simd();
+    test_ppu_compose_color_math();
+    test_ppu_render_mode7();
+    test_ppu_mode7_simd();
+    test_ppu_sprite_evaluation();
+    test_ppu_sprite_limits();
+    test_ppu_render_sprites();
+    test_ppu_render_threads();
+    test_ppu_unchanged_frames();
+    test_ppu_render_policy();
+}
@@ -11,6 +11,12 @@
 void test_cartridge_suite(void);
 void test_script_suite(void);
 void test_memory_suite(void);
+void test_cpu_suite(void);
+void test_scheduler_suite(void);
+void test_apu_suite(void);
+void test_ppu_suite(void);
+void test_emulator_suite(void);
+void test_savestate_suite(void);
 
 int main(void) {
     test_init();
@@ -19,6 +25,12 @@ int main(void) {
     test_cartridge_suite();
     test_script_suite();
     test_memory_suite();
+    test_cpu_suite();
+    test_scheduler_suite();
+    test_apu_suite();
+    test_ppu_suite();
+    test_emulator_suite();
+    test_savestate_suite();
     
     /* Print summary */
     test_summary();
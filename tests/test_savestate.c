@@ -0,0 +1,210 @@
+/*
+ * test_savestate.c - Unit tests for save states, LZ compression and rewind
+ */
+
+#include "test_framework.h"
+#include "../include/savestate.h"
+#include "../include/lz.h"
+#include "../include/rewind.h"
+#include "../include/types.h"
+#include <stdio.h>
+#include <string.h>
+
+static Emulator g_emu_a;
+static Emulator g_emu_b;
+static u8 g_wram[WRAM_SIZE];
+
+void test_lz_roundtrip(void) {
+    TEST("LZ compression round trip");
+    
+    static u8 input[70000];
+    static u8 packed[70000 + 70000 / 255 + 16];
+    static u8 output[70000];
+    u32 seed = 12345;
+    u32 packed_size;
+    u32 i;
+    
+    /* Runs (overlapping matches), noise, and a long repeat of both */
+    for (i = 0; i < sizeof(input); i++) {
+        seed = seed * 1103515245 + 12345;
+        if (i < 20000) {
+            input[i] = (u8)(i / 1000);
+        } else if (i < 40000) {
+            input[i] = (u8)(seed >> 16);
+        } else {
+            input[i] = input[i - 20000];
+        }
+    }
+    
+    packed_size = lz_compress(input, sizeof(input), packed, lz_compress_bound(sizeof(input)));
+    ASSERT(packed_size > 0);
+    ASSERT(packed_size < sizeof(input) / 2);
+    ASSERT_EQ(lz_decompress(packed, packed_size, output, sizeof(output)), sizeof(input));
+    ASSERT(memcmp(input, output, sizeof(input)) == 0);
+    
+    /* Incompressible data stays within the bound */
+    packed_size = lz_compress(&input[20000], 20000, packed, lz_compress_bound(20000));
+    ASSERT(packed_size > 0 && packed_size <= lz_compress_bound(20000));
+    ASSERT_EQ(lz_decompress(packed, packed_size, output, sizeof(output)), 20000);
+    ASSERT(memcmp(&input[20000], output, 20000) == 0);
+    
+    /* Short input, too small an output and a truncated block */
+    ASSERT_EQ(lz_decompress(packed, lz_compress(input, 5, packed, 64), output, 5), 5);
+    ASSERT_EQ(lz_decompress(packed, packed_size, output, 100), 0);
+    packed_size = lz_compress(input, sizeof(input), packed, lz_compress_bound(sizeof(input)));
+    ASSERT(lz_decompress(packed, packed_size - 3, output, sizeof(output)) != sizeof(input));
+    
+    TEST_PASS();
+}
+
+void test_savestate_roundtrip(void) {
+    TEST("Save state round trip");
+    
+    const char *filename = "test_savestate_rom.sfc";
+    const char *state_file = "test_savestate.sst";
+    RomImage *rom;
+    SaveState state;
+    SaveState raw;
+    SaveState loaded;
+    u64 saved_cycles;
+    u64 end_cycles;
+    u16 end_x;
+    
+    ASSERT_EQ(test_write_program_rom(filename, test_counter_program,
+                                     sizeof(test_counter_program)), SUCCESS);
+    rom = rom_image_load(filename);
+    ASSERT(rom != NULL);
+    ASSERT_EQ(emulator_init(&g_emu_a, rom), SUCCESS);
+    ASSERT_EQ(emulator_init(&g_emu_b, rom), SUCCESS);
+    rom_image_release(rom);
+    savestate_init(&state);
+    savestate_init(&raw);
+    savestate_init(&loaded);
+    
+    emulator_run_frame(&g_emu_a);
+    emulator_run_frame(&g_emu_a);
+    g_emu_a.cart.sram_data[5] = 0x77;
+    saved_cycles = g_emu_a.cpu.cycles;
+    ASSERT_EQ(savestate_save(&g_emu_a, &state, SAVESTATE_COMPRESS), SUCCESS);
+    ASSERT_EQ(savestate_save(&g_emu_a, &raw, 0), SUCCESS);
+    ASSERT(state.size < raw.size / 4);
+    
+    emulator_run_frame(&g_emu_a);
+    emulator_run_frame(&g_emu_a);
+    end_cycles = g_emu_a.cpu.cycles;
+    end_x = g_emu_a.cpu.x;
+    memcpy(g_wram, g_emu_a.memory.wram, WRAM_SIZE);
+    
+    /* Another instance continues exactly where the first one was saved */
+    ASSERT_EQ(savestate_load(&g_emu_b, &state), SUCCESS);
+    ASSERT(g_emu_b.cpu.cycles == saved_cycles);
+    ASSERT(g_emu_b.cpu.mem == &g_emu_b.memory);
+    ASSERT(g_emu_b.memory.ppu == &g_emu_b.ppu);
+    ASSERT_EQ(g_emu_b.cart.sram_data[5], 0x77);
+    emulator_run_frame(&g_emu_b);
+    emulator_run_frame(&g_emu_b);
+    ASSERT(g_emu_b.cpu.cycles == end_cycles);
+    ASSERT_EQ(g_emu_b.cpu.x, end_x);
+    ASSERT(memcmp(g_emu_b.memory.wram, g_wram, WRAM_SIZE) == 0);
+    
+    /* The uncompressed state restores the same, also via a file */
+    ASSERT_EQ(savestate_write_file(&raw, state_file), SUCCESS);
+    ASSERT_EQ(savestate_read_file(&loaded, state_file), SUCCESS);
+    ASSERT_EQ(loaded.size, raw.size);
+    ASSERT_EQ(savestate_load(&g_emu_a, &loaded), SUCCESS);
+    ASSERT(g_emu_a.cpu.cycles == saved_cycles);
+    emulator_run_frame(&g_emu_a);
+    emulator_run_frame(&g_emu_a);
+    ASSERT(memcmp(g_emu_a.memory.wram, g_wram, WRAM_SIZE) == 0);
+    
+    /* A state for another ROM or a damaged one is rejected untouched */
+    loaded.data[20] ^= 0xFF;
+    ASSERT_EQ(savestate_load(&g_emu_a, &loaded), ERROR);
+    loaded.data[20] ^= 0xFF;
+    state.size -= 100;
+    ASSERT_EQ(savestate_load(&g_emu_a, &state), ERROR);
+    ASSERT(g_emu_a.cpu.cycles == end_cycles);
+    
+    savestate_free(&state);
+    savestate_free(&raw);
+    savestate_free(&loaded);
+    emulator_cleanup(&g_emu_a);
+    emulator_cleanup(&g_emu_b);
+    remove(state_file);
+    remove(filename);
+    TEST_PASS();
+}
+
+void test_rewind_seek(void) {
+    TEST("Rewind seek and budget");
+    
+    const char *filename = "test_rewind_rom.sfc";
+    RomImage *rom;
+    RewindBuffer rw;
+    u64 cycles[20];
+    u32 budget;
+    u32 frame;
+    
+    ASSERT_EQ(test_write_program_rom(filename, test_counter_program,
+                                     sizeof(test_counter_program)), SUCCESS);
+    rom = rom_image_load(filename);
+    ASSERT(rom != NULL);
+    ASSERT_EQ(emulator_init(&g_emu_a, rom), SUCCESS);
+    rom_image_release(rom);
+    
+    /* Snapshot before each frame; deltas are a fraction of the keyframes */
+    rewind_init(&rw, 16 * 1024 * 1024, 4);
+    for (frame = 0; frame < 20; frame++) {
+        cycles[frame] = g_emu_a.cpu.cycles;
+        ASSERT_EQ(rewind_push(&rw, &g_emu_a), SUCCESS);
+        emulator_run_frame(&g_emu_a);
+    }
+    ASSERT_EQ(rewind_count(&rw), 20);
+    ASSERT_EQ(rw.keyframes, 5);
+    ASSERT(rw.used < rw.raw_size / 8);
+    budget = rw.used;
+    memcpy(g_wram, g_emu_a.memory.wram, WRAM_SIZE);
+    
+    /* Back to a delta and replay to the same end state */
+    ASSERT_EQ(rewind_seek(&rw, &g_emu_a, 5), SUCCESS);
+    ASSERT(g_emu_a.cpu.cycles == cycles[14]);
+    ASSERT_EQ(rewind_count(&rw), 15);
+    for (frame = 14; frame < 20; frame++) {
+        emulator_run_frame(&g_emu_a);
+    }
+    ASSERT(memcmp(g_emu_a.memory.wram, g_wram, WRAM_SIZE) == 0);
+    
+    /* Pushing continues the timeline; keyframes and the oldest still decode */
+    ASSERT_EQ(rewind_push(&rw, &g_emu_a), SUCCESS);
+    ASSERT_EQ(rewind_seek(&rw, &g_emu_a, 3), SUCCESS);
+    ASSERT(g_emu_a.cpu.cycles == cycles[12]);
+    ASSERT_EQ(rewind_seek(&rw, &g_emu_a, 12), SUCCESS);
+    ASSERT(g_emu_a.cpu.cycles == cycles[0]);
+    ASSERT_EQ(rewind_seek(&rw, &g_emu_a, 1), ERROR);
+    rewind_free(&rw);
+    
+    /* Half the budget keeps only the newest keyframe groups */
+    rewind_init(&rw, budget / 2, 4);
+    for (frame = 0; frame < 20; frame++) {
+        ASSERT_EQ(rewind_push(&rw, &g_emu_a), SUCCESS);
+        emulator_run_frame(&g_emu_a);
+    }
+    ASSERT(rw.used <= rw.budget);
+    ASSERT(rewind_count(&rw) >= 4 && rewind_count(&rw) < 20);
+    ASSERT_EQ(rewind_count(&rw) % 4, 0);
+    ASSERT_EQ(rewind_seek(&rw, &g_emu_a, rewind_count(&rw) - 1), SUCCESS);
+    rewind_free(&rw);
+    
+    emulator_cleanup(&g_emu_a);
+    remove(filename);
+    TEST_PASS();
+}
+
+/* Test suite runner */
+void test_savestate_suite(void) {
+    TEST_SUITE("Save State Module");
+    
+    test_lz_roundtrip();
+    test_savestate_roundtrip();
+    test_rewind_seek();
+}
@@ -0,0 +1,127 @@
+/*
+ * test_scheduler.c - Event scheduler tests
+ * 
+ * Tests for timestamped event ordering and rescheduling
+ */
+
+#include "test_framework.h"
+#include "../include/scheduler.h"
+
+/* Test empty scheduler */
+void test_scheduler_empty(void) {
+    TEST("Scheduler empty state");
+    
+    Scheduler sched;
+    EventType type;
+    u64 time;
+    
+    scheduler_init(&sched);
+    
+    ASSERT(scheduler_next_time(&sched) == SCHEDULER_NEVER);
+    ASSERT(!scheduler_pop(&sched, 1000000, &type, &time));
+    ASSERT(!scheduler_is_pending(&sched, EVENT_SCANLINE));
+    
+    TEST_PASS();
+}
+
+/* Test events are delivered in timestamp order */
+void test_scheduler_ordering(void) {
+    TEST("Scheduler event ordering");
+    
+    Scheduler sched;
+    EventType type;
+    u64 time;
+    
+    scheduler_init(&sched);
+    scheduler_schedule(&sched, EVENT_APU_SYNC, 500);
+    scheduler_schedule(&sched, EVENT_HBLANK, 274);
+    scheduler_schedule(&sched, EVENT_SCANLINE, 341);
+    
+    ASSERT(scheduler_next_time(&sched) == 274);
+    
+    /* Nothing is due before its timestamp */
+    ASSERT(!scheduler_pop(&sched, 273, &type, &time));
+    
+    ASSERT(scheduler_pop(&sched, 1000, &type, &time));
+    ASSERT_EQ(type, EVENT_HBLANK);
+    ASSERT_EQ((int)time, 274);
+    ASSERT(scheduler_pop(&sched, 1000, &type, &time));
+    ASSERT_EQ(type, EVENT_SCANLINE);
+    ASSERT(scheduler_pop(&sched, 1000, &type, &time));
+    ASSERT_EQ(type, EVENT_APU_SYNC);
+    ASSERT(!scheduler_pop(&sched, 1000, &type, &time));
+    
+    TEST_PASS();
+}
+
+/* Test same-time events follow event type order */
+void test_scheduler_ties(void) {
+    TEST("Scheduler same-time priority");
+    
+    Scheduler sched;
+    EventType type;
+    u64 time;
+    
+    scheduler_init(&sched);
+    scheduler_schedule(&sched, EVENT_HDMA, 100);
+    scheduler_schedule(&sched, EVENT_VBLANK, 100);
+    scheduler_schedule(&sched, EVENT_SCANLINE, 100);
+    
+    ASSERT(scheduler_pop(&sched, 100, &type, &time));
+    ASSERT_EQ(type, EVENT_SCANLINE);
+    ASSERT(scheduler_pop(&sched, 100, &type, &time));
+    ASSERT_EQ(type, EVENT_VBLANK);
+    ASSERT(scheduler_pop(&sched, 100, &type, &time));
+    ASSERT_EQ(type, EVENT_HDMA);
+    
+    TEST_PASS();
+}
+
+/* Test rescheduling and cancelling */
+void test_scheduler_reschedule(void) {
+    TEST("Scheduler reschedule and cancel");
+    
+    Scheduler sched;
+    EventType type;
+    u64 time;
+    
+    scheduler_init(&sched);
+    scheduler_schedule(&sched, EVENT_SCANLINE, 341);
+    scheduler_schedule(&sched, EVENT_IRQ_TIMER, 200);
+    
+    /* Moving an event keeps a single entry */
+    scheduler_schedule(&sched, EVENT_IRQ_TIMER, 400);
+    ASSERT_EQ(sched.count, 2);
+    ASSERT(scheduler_next_time(&sched) == 341);
+    
+    scheduler_cancel(&sched, EVENT_SCANLINE);
+    ASSERT(!scheduler_is_pending(&sched, EVENT_SCANLINE));
+    ASSERT(scheduler_next_time(&sched) == 400);
+    
+    ASSERT(scheduler_pop(&sched, 400, &type, &time));
+    ASSERT_EQ(type, EVENT_IRQ_TIMER);
+    ASSERT_EQ(sched.count, 0);
+    
+    TEST_PASS();
+}
+
+/* Test NTSC frame timing constants */
+void test_scheduler_frame_timing(void) {
+    TEST("Scheduler NTSC frame timing");
+    
+    ASSERT_EQ(CYCLES_PER_SCANLINE * 262, CYCLES_PER_FRAME);
+    ASSERT(HBLANK_START_CYCLE < CYCLES_PER_SCANLINE);
+    
+    TEST_PASS();
+}
+
+/* Test suite runner */
+void test_scheduler_suite(void) {
+    TEST_SUITE("Scheduler Module");
+    
+    test_scheduler_empty();
+    test_scheduler_ordering();
+    test_scheduler_ties();
+    test_scheduler_reschedule();
+    test_scheduler_frame_timing();
+}